@@ -0,0 +1,20 @@
+# Shared by the mock backends. Scale and latency come from the environment so
+# runs are reproducible:
+#   BENCH_APS       access points listed by nmcli (default 300)
+#   BENCH_DEVICES   devices known to bluetoothctl (default 50)
+#   BENCH_SINKS     sinks and sources listed by pactl (default 3)
+#   BENCH_LATENCY   seconds each invocation sleeps, e.g. 0.02 (default 0)
+BENCH_APS=${BENCH_APS:-300}
+BENCH_DEVICES=${BENCH_DEVICES:-50}
+BENCH_SINKS=${BENCH_SINKS:-3}
+
+mock_latency() {
+  if [ -n "$BENCH_LATENCY" ] && [ "$BENCH_LATENCY" != 0 ]; then
+    sleep "$BENCH_LATENCY"
+  fi
+}
+
+# Event streams (pactl subscribe, nmcli monitor) stay quiet until killed
+mock_idle() {
+  while :; do sleep 3600; done
+}
@@ -0,0 +1,645 @@
+// Stands in for NetworkManager on the system bus, for `BENCH_NM=1
+// bench/run.sh`, which points the system bus at a private dbus-daemon first.
+// It serves one Wi-Fi device with BENCH_APS access points named like the
+// nmcli mock's; every third one repeats the network before it on 5 GHz.
+//
+// RequestScan moves every signal a little and replaces one access point.
+// AddAndActivateConnection walks the device through NetworkManager's states
+// and fails at need-auth when the password is "wrong"; it saves a profile
+// either way, as NetworkManager does. BENCH_PROFILES networks (20 by default)
+// start out saved, and ActivateConnection brings one up without a password,
+// unless the profile holds the wrong one. Update takes a new psk and Delete
+// drops the profile.
+// DeactivateConnection takes down whatever is active or activating.
+#include <gio/gio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NM_SERVICE "org.freedesktop.NetworkManager"
+#define NM_PATH "/org/freedesktop/NetworkManager"
+#define NM_DEVICE NM_SERVICE ".Device"
+#define NM_WIRELESS NM_SERVICE ".Device.Wireless"
+#define NM_ACCESS_POINT NM_SERVICE ".AccessPoint"
+#define NM_SETTINGS NM_SERVICE ".Settings"
+#define NM_CONNECTION NM_SETTINGS ".Connection"
+#define SETTINGS_PATH NM_PATH "/Settings"
+#define DEVICE_PATH NM_PATH "/Devices/1"
+#define SCAN_MS 500
+#define STEP_MS 150
+
+static const gchar introspection[] =
+    "<node>"
+    " <interface name='org.freedesktop.NetworkManager'>"
+    "  <method name='GetDevices'><arg type='ao' direction='out'/></method>"
+    "  <method name='AddAndActivateConnection'>"
+    "   <arg type='a{sa{sv}}' direction='in'/>"
+    "   <arg type='o' direction='in'/><arg type='o' direction='in'/>"
+    "   <arg type='o' direction='out'/><arg type='o' direction='out'/>"
+    "  </method>"
+    "  <method name='ActivateConnection'>"
+    "   <arg type='o' direction='in'/><arg type='o' direction='in'/>"
+    "   <arg type='o' direction='in'/><arg type='o' direction='out'/>"
+    "  </method>"
+    "  <method name='DeactivateConnection'>"
+    "   <arg type='o' direction='in'/>"
+    "  </method>"
+    "  <property name='WirelessEnabled' type='b' access='readwrite'/>"
+    " </interface>"
+    " <interface name='org.freedesktop.NetworkManager.Settings'>"
+    "  <method name='ListConnections'><arg type='ao' direction='out'/></method>"
+    "  <signal name='NewConnection'><arg type='o'/></signal>"
+    "  <signal name='ConnectionRemoved'><arg type='o'/></signal>"
+    " </interface>"
+    " <interface name='org.freedesktop.NetworkManager.Settings.Connection'>"
+    "  <method name='GetSettings'>"
+    "   <arg type='a{sa{sv}}' direction='out'/>"
+    "  </method>"
+    "  <method name='Update'><arg type='a{sa{sv}}' direction='in'/></method>"
+    "  <method name='Delete'/>"
+    "  <signal name='Updated'/>"
+    " </interface>"
+    " <interface name='org.freedesktop.NetworkManager.Device'>"
+    "  <property name='DeviceType' type='u' access='read'/>"
+    "  <property name='State' type='u' access='read'/>"
+    "  <property name='StateReason' type='(uu)' access='read'/>"
+    "  <signal name='StateChanged'>"
+    "   <arg type='u'/><arg type='u'/><arg type='u'/>"
+    "  </signal>"
+    " </interface>"
+    " <interface name='org.freedesktop.NetworkManager.Device.Wireless'>"
+    "  <method name='GetAllAccessPoints'>"
+    "   <arg type='ao' direction='out'/>"
+    "  </method>"
+    "  <method name='RequestScan'><arg type='a{sv}' direction='in'/></method>"
+    "  <property name='ActiveAccessPoint' type='o' access='read'/>"
+    "  <property name='Bitrate' type='u' access='read'/>"
+    "  <property name='LastScan' type='x' access='read'/>"
+    "  <signal name='AccessPointAdded'><arg type='o'/></signal>"
+    "  <signal name='AccessPointRemoved'><arg type='o'/></signal>"
+    " </interface>"
+    " <interface name='org.freedesktop.NetworkManager.AccessPoint'>"
+    "  <property name='Ssid' type='ay' access='read'/>"
+    "  <property name='HwAddress' type='s' access='read'/>"
+    "  <property name='Strength' type='y' access='read'/>"
+    "  <property name='Frequency' type='u' access='read'/>"
+    "  <property name='MaxBitrate' type='u' access='read'/>"
+    "  <property name='Flags' type='u' access='read'/>"
+    "  <property name='WpaFlags' type='u' access='read'/>"
+    "  <property name='RsnFlags' type='u' access='read'/>"
+    " </interface>"
+    "</node>";
+
+typedef struct {
+  guint id;
+  gchar *path;
+  gchar *ssid;
+  gboolean secured;
+  gboolean five_ghz;
+  guint8 strength;
+  guint registration;
+} AccessPoint;
+
+// A saved connection profile
+typedef struct {
+  gchar *path;
+  gchar *uuid;
+  gchar *ssid;
+  gboolean secured;
+  gboolean wrong; // saved with the wrong password
+  guint64 timestamp;
+  guint registration;
+} Profile;
+
+// Device states an activation goes through, ending in activated or failed
+static const guint32 connect_steps[] = {40, 50, 60, 70, 80, 100};
+static const guint32 wrong_password_steps[] = {40, 50, 60, 120, 30};
+
+static GDBusConnection *bus;
+static GDBusNodeInfo *node;
+static GHashTable *access_points; // path -> AccessPoint
+static GPtrArray *profiles;       // Profile, oldest first
+static GRand *rand_source;
+static guint next_ap_id = 1;
+static guint next_connection_id = 1;
+static guint next_active_id = 1;
+static gboolean wireless_enabled = TRUE;
+static guint32 device_state = 100;
+static guint32 state_reason;
+static guint32 bitrate;
+static gchar *active_ap;
+static gint64 last_scan;
+static guint scan_id;
+static guint step_id;
+static const guint32 *steps;
+static guint n_steps;
+static guint step;
+
+static void emit_changed(const gchar *path, const gchar *interface,
+                         const gchar *name, GVariant *value) {
+  GVariantBuilder changed;
+
+  g_variant_builder_init(&changed, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add(&changed, "{sv}", name, value);
+  g_dbus_connection_emit_signal(
+      bus, NULL, path, "org.freedesktop.DBus.Properties", "PropertiesChanged",
+      g_variant_new("(sa{sv}as)", interface, &changed, NULL), NULL);
+}
+
+// The rate follows the signal of the access point in use
+static void update_bitrate(void) {
+  AccessPoint *ap =
+      active_ap != NULL ? g_hash_table_lookup(access_points, active_ap) : NULL;
+  guint32 rate = 0;
+
+  if (ap != NULL && device_state == 100)
+    rate = (ap->five_ghz ? 866700 : 144400) / 100 * ap->strength;
+  if (rate == bitrate)
+    return;
+  bitrate = rate;
+  emit_changed(DEVICE_PATH, NM_WIRELESS, "Bitrate",
+               g_variant_new_uint32(bitrate));
+}
+
+// State and StateReason change together, in one PropertiesChanged
+static void set_device_state(guint32 state, guint32 reason) {
+  guint32 old_state = device_state;
+  GVariantBuilder changed;
+
+  device_state = state;
+  state_reason = reason;
+  g_variant_builder_init(&changed, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add(&changed, "{sv}", "State",
+                        g_variant_new_uint32(state));
+  g_variant_builder_add(&changed, "{sv}", "StateReason",
+                        g_variant_new("(uu)", state, reason));
+  g_dbus_connection_emit_signal(
+      bus, NULL, DEVICE_PATH, "org.freedesktop.DBus.Properties",
+      "PropertiesChanged",
+      g_variant_new("(sa{sv}as)", NM_DEVICE, &changed, NULL), NULL);
+  update_bitrate();
+  g_dbus_connection_emit_signal(bus, NULL, DEVICE_PATH, NM_DEVICE,
+                                "StateChanged",
+                                g_variant_new("(uuu)", state, old_state,
+                                              reason),
+                                NULL);
+}
+
+static void set_active_ap(const gchar *path) {
+  g_free(active_ap);
+  active_ap = g_strdup(path);
+  emit_changed(DEVICE_PATH, NM_WIRELESS, "ActiveAccessPoint",
+               g_variant_new_object_path(path ? path : "/"));
+}
+
+static GVariant *get_ap_property(AccessPoint *ap, const gchar *name) {
+  if (g_strcmp0(name, "Ssid") == 0)
+    return g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE, ap->ssid,
+                                     strlen(ap->ssid), 1);
+  if (g_strcmp0(name, "HwAddress") == 0)
+    return g_variant_new_take_string(g_strdup_printf(
+        "02:00:00:%02X:%02X:%02X", (ap->id >> 16) & 0xff, (ap->id >> 8) & 0xff,
+        ap->id & 0xff));
+  if (g_strcmp0(name, "Strength") == 0)
+    return g_variant_new_byte(ap->strength);
+  if (g_strcmp0(name, "Frequency") == 0)
+    return g_variant_new_uint32(ap->five_ghz ? 5180 : 2437);
+  if (g_strcmp0(name, "MaxBitrate") == 0)
+    return g_variant_new_uint32(ap->five_ghz ? 866700 : 144400);
+  if (g_strcmp0(name, "Flags") == 0)
+    return g_variant_new_uint32(ap->secured ? 0x1 : 0);
+  if (g_strcmp0(name, "WpaFlags") == 0)
+    return g_variant_new_uint32(0);
+  // Pairwise and group CCMP, PSK key management
+  if (g_strcmp0(name, "RsnFlags") == 0)
+    return g_variant_new_uint32(ap->secured ? 0x188 : 0);
+  return NULL;
+}
+
+static GVariant *get_property(GDBusConnection *connection, const gchar *sender,
+                              const gchar *path, const gchar *interface,
+                              const gchar *name, GError **error,
+                              gpointer user_data) {
+  if (user_data != NULL)
+    return get_ap_property(user_data, name);
+  if (g_strcmp0(name, "WirelessEnabled") == 0)
+    return g_variant_new_boolean(wireless_enabled);
+  if (g_strcmp0(name, "DeviceType") == 0)
+    return g_variant_new_uint32(2);
+  if (g_strcmp0(name, "State") == 0)
+    return g_variant_new_uint32(device_state);
+  if (g_strcmp0(name, "StateReason") == 0)
+    return g_variant_new("(uu)", device_state, state_reason);
+  if (g_strcmp0(name, "ActiveAccessPoint") == 0)
+    return g_variant_new_object_path(active_ap ? active_ap : "/");
+  if (g_strcmp0(name, "Bitrate") == 0)
+    return g_variant_new_uint32(bitrate);
+  if (g_strcmp0(name, "LastScan") == 0)
+    return g_variant_new_int64(last_scan);
+  return NULL;
+}
+
+static gboolean set_property(GDBusConnection *connection, const gchar *sender,
+                             const gchar *path, const gchar *interface,
+                             const gchar *name, GVariant *value,
+                             GError **error, gpointer user_data) {
+  if (g_strcmp0(name, "WirelessEnabled") != 0) {
+    g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_PROPERTY_READ_ONLY,
+                "%s is read-only", name);
+    return FALSE;
+  }
+
+  wireless_enabled = g_variant_get_boolean(value);
+  emit_changed(NM_PATH, NM_SERVICE, "WirelessEnabled",
+               g_variant_new_boolean(wireless_enabled));
+  if (!wireless_enabled)
+    set_active_ap(NULL);
+  set_device_state(wireless_enabled ? 30 : 20, 0);
+  return TRUE;
+}
+
+static AccessPoint *add_access_point(void) {
+  AccessPoint *ap = g_new0(AccessPoint, 1);
+  GDBusInterfaceInfo *interface =
+      g_dbus_node_info_lookup_interface(node, NM_ACCESS_POINT);
+  static const GDBusInterfaceVTable vtable = {NULL, get_property, NULL};
+  // Every third one is the network before it on another band
+  guint network;
+
+  ap->id = next_ap_id++;
+  network = ap->id % 3 == 0 ? ap->id - 1 : ap->id;
+  ap->path = g_strdup_printf(NM_PATH "/AccessPoint/%u", ap->id);
+  ap->ssid = network % 7 == 0 ? g_strdup_printf("Lab:%u", network)
+                              : g_strdup_printf("Network %u", network);
+  ap->secured = network % 5 != 0;
+  ap->five_ghz = ap->id % 3 == 0;
+  ap->strength = 100 - ap->id % 100;
+  ap->registration = g_dbus_connection_register_object(
+      bus, ap->path, interface, &vtable, ap, NULL, NULL);
+  g_hash_table_insert(access_points, ap->path, ap);
+  return ap;
+}
+
+static void access_point_free(AccessPoint *ap) {
+  g_dbus_connection_unregister_object(bus, ap->registration);
+  g_free(ap->path);
+  g_free(ap->ssid);
+  g_free(ap);
+}
+
+static GVariant *access_point_paths(void) {
+  GVariantBuilder paths;
+  GHashTableIter iter;
+  gpointer path;
+
+  g_variant_builder_init(&paths, G_VARIANT_TYPE("ao"));
+  g_hash_table_iter_init(&iter, access_points);
+  while (g_hash_table_iter_next(&iter, &path, NULL))
+    g_variant_builder_add(&paths, "o", path);
+  return g_variant_new("(ao)", &paths);
+}
+
+static GVariant *profile_settings(Profile *profile) {
+  GVariantBuilder settings, section;
+
+  g_variant_builder_init(&settings, G_VARIANT_TYPE("a{sa{sv}}"));
+  g_variant_builder_init(&section, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add(&section, "{sv}", "type",
+                        g_variant_new_string("802-11-wireless"));
+  g_variant_builder_add(&section, "{sv}", "uuid",
+                        g_variant_new_string(profile->uuid));
+  g_variant_builder_add(&section, "{sv}", "id",
+                        g_variant_new_string(profile->ssid));
+  g_variant_builder_add(&section, "{sv}", "timestamp",
+                        g_variant_new_uint64(profile->timestamp));
+  g_variant_builder_add(&settings, "{sa{sv}}", "connection", &section);
+
+  g_variant_builder_init(&section, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add(
+      &section, "{sv}", "ssid",
+      g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE, profile->ssid,
+                                strlen(profile->ssid), 1));
+  g_variant_builder_add(&section, "{sv}", "mode",
+                        g_variant_new_string("infrastructure"));
+  g_variant_builder_add(&settings, "{sa{sv}}", "802-11-wireless", &section);
+
+  // Secrets stay out of GetSettings, as with NetworkManager
+  if (profile->secured) {
+    g_variant_builder_init(&section, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add(&section, "{sv}", "key-mgmt",
+                          g_variant_new_string("wpa-psk"));
+    g_variant_builder_add(&settings, "{sa{sv}}", "802-11-wireless-security",
+                          &section);
+  }
+  return g_variant_new("(@a{sa{sv}})", g_variant_builder_end(&settings));
+}
+
+static gboolean wrong_password(GVariant *settings) {
+  g_autoptr(GVariant) security = NULL;
+  const gchar *psk = NULL;
+
+  if (g_variant_lookup(settings, "802-11-wireless-security", "@a{sv}",
+                       &security))
+    g_variant_lookup(security, "psk", "&s", &psk);
+  return g_strcmp0(psk, "wrong") == 0;
+}
+
+static void remove_profile(Profile *profile);
+
+static void call_connection_method(GDBusConnection *connection,
+                                   const gchar *sender, const gchar *path,
+                                   const gchar *interface, const gchar *method,
+                                   GVariant *parameters,
+                                   GDBusMethodInvocation *invocation,
+                                   gpointer user_data) {
+  if (g_strcmp0(method, "GetSettings") == 0) {
+    g_dbus_method_invocation_return_value(invocation,
+                                          profile_settings(user_data));
+  } else if (g_strcmp0(method, "Update") == 0) {
+    g_autoptr(GVariant) settings = g_variant_get_child_value(parameters, 0);
+    Profile *profile = user_data;
+
+    profile->wrong = wrong_password(settings);
+    g_dbus_connection_emit_signal(bus, NULL, profile->path, NM_CONNECTION,
+                                  "Updated", NULL, NULL);
+    g_dbus_method_invocation_return_value(invocation, NULL);
+  } else if (g_strcmp0(method, "Delete") == 0) {
+    remove_profile(user_data);
+    g_dbus_method_invocation_return_value(invocation, NULL);
+  } else {
+    g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR,
+                                          G_DBUS_ERROR_UNKNOWN_METHOD,
+                                          "No method %s", method);
+  }
+}
+
+static Profile *add_profile(const gchar *ssid, gboolean secured,
+                            guint64 timestamp) {
+  static const GDBusInterfaceVTable vtable = {call_connection_method, NULL,
+                                              NULL};
+  Profile *profile = g_new0(Profile, 1);
+
+  profile->path = g_strdup_printf(SETTINGS_PATH "/%u", next_connection_id++);
+  profile->uuid = g_uuid_string_random();
+  profile->ssid = g_strdup(ssid);
+  profile->secured = secured;
+  profile->timestamp = timestamp;
+  profile->registration = g_dbus_connection_register_object(
+      bus, profile->path,
+      g_dbus_node_info_lookup_interface(node, NM_CONNECTION), &vtable, profile,
+      NULL, NULL);
+  g_ptr_array_add(profiles, profile);
+  return profile;
+}
+
+static void remove_profile(Profile *profile) {
+  g_autofree gchar *path = g_strdup(profile->path);
+
+  g_dbus_connection_unregister_object(bus, profile->registration);
+  g_ptr_array_remove(profiles, profile);
+  g_free(profile->path);
+  g_free(profile->uuid);
+  g_free(profile->ssid);
+  g_free(profile);
+  g_dbus_connection_emit_signal(bus, NULL, SETTINGS_PATH, NM_SETTINGS,
+                                "ConnectionRemoved", g_variant_new("(o)", path),
+                                NULL);
+}
+
+static Profile *find_profile(const gchar *path) {
+  for (guint i = 0; i < profiles->len; i++) {
+    Profile *profile = profiles->pdata[i];
+
+    if (g_strcmp0(profile->path, path) == 0)
+      return profile;
+  }
+  return NULL;
+}
+
+static GVariant *profile_paths(void) {
+  GVariantBuilder paths;
+
+  g_variant_builder_init(&paths, G_VARIANT_TYPE("ao"));
+  for (guint i = 0; i < profiles->len; i++)
+    g_variant_builder_add(&paths, "o", ((Profile *)profiles->pdata[i])->path);
+  return g_variant_new("(ao)", &paths);
+}
+
+static gboolean on_scan_done(gpointer user_data) {
+  GHashTableIter iter;
+  gpointer value;
+  AccessPoint *gone = NULL;
+  AccessPoint *added;
+
+  scan_id = 0;
+  g_hash_table_iter_init(&iter, access_points);
+  while (g_hash_table_iter_next(&iter, NULL, &value)) {
+    AccessPoint *ap = value;
+    gint strength = ap->strength + g_rand_int_range(rand_source, -5, 6);
+
+    strength = CLAMP(strength, 1, 100);
+    if (strength != ap->strength) {
+      ap->strength = strength;
+      emit_changed(ap->path, NM_ACCESS_POINT, "Strength",
+                   g_variant_new_byte(ap->strength));
+    }
+    if (gone == NULL && g_strcmp0(ap->path, active_ap) != 0)
+      gone = ap;
+  }
+
+  if (gone != NULL) {
+    g_autofree gchar *path = g_strdup(gone->path);
+    g_hash_table_remove(access_points, path);
+    g_dbus_connection_emit_signal(bus, NULL, DEVICE_PATH, NM_WIRELESS,
+                                  "AccessPointRemoved",
+                                  g_variant_new("(o)", path), NULL);
+  }
+  added = add_access_point();
+  g_dbus_connection_emit_signal(bus, NULL, DEVICE_PATH, NM_WIRELESS,
+                                "AccessPointAdded",
+                                g_variant_new("(o)", added->path), NULL);
+
+  update_bitrate();
+  last_scan = g_get_monotonic_time() / 1000;
+  emit_changed(DEVICE_PATH, NM_WIRELESS, "LastScan",
+               g_variant_new_int64(last_scan));
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean on_step(gpointer user_data) {
+  // A failed activation says why: 7 is "secrets were required, but not
+  // provided"
+  set_device_state(steps[step], steps[step] == 120 ? 7 : 0);
+  if (steps[step] == 30)
+    set_active_ap(NULL);
+  if (++step < n_steps)
+    return G_SOURCE_CONTINUE;
+  step_id = 0;
+  return G_SOURCE_REMOVE;
+}
+
+static gchar *start_activation(const gchar *ap_path, gboolean wrong) {
+  if (step_id != 0)
+    g_source_remove(step_id);
+  steps = wrong ? wrong_password_steps : connect_steps;
+  n_steps = wrong ? G_N_ELEMENTS(wrong_password_steps)
+                  : G_N_ELEMENTS(connect_steps);
+  step = 0;
+  set_active_ap(ap_path);
+  step_id = g_timeout_add(STEP_MS, on_step, NULL);
+  return g_strdup_printf(NM_PATH "/ActiveConnection/%u", next_active_id++);
+}
+
+static void activate(GDBusMethodInvocation *invocation, GVariant *parameters) {
+  g_autoptr(GVariant) settings = NULL;
+  g_autofree gchar *active_connection = NULL;
+  const gchar *ap_path;
+  AccessPoint *ap;
+  Profile *profile;
+
+  g_variant_get(parameters, "(@a{sa{sv}}&o&o)", &settings, NULL, &ap_path);
+  ap = g_hash_table_lookup(access_points, ap_path);
+  if (ap == NULL) {
+    g_dbus_method_invocation_return_dbus_error(
+        invocation, NM_SERVICE ".Error.UnknownConnection",
+        "The access point is gone");
+    return;
+  }
+
+  profile = add_profile(ap->ssid, ap->secured, 0);
+  profile->wrong = wrong_password(settings);
+  g_dbus_connection_emit_signal(bus, NULL, SETTINGS_PATH, NM_SETTINGS,
+                                "NewConnection",
+                                g_variant_new("(o)", profile->path), NULL);
+  active_connection = start_activation(ap_path, profile->wrong);
+  g_dbus_method_invocation_return_value(
+      invocation, g_variant_new("(oo)", profile->path, active_connection));
+}
+
+// A specific object of "/" lets NetworkManager pick any access point of the
+// profile's network
+static void activate_profile(GDBusMethodInvocation *invocation,
+                             GVariant *parameters) {
+  g_autofree gchar *active_connection = NULL;
+  const gchar *profile_path, *ap_path;
+  Profile *profile;
+  AccessPoint *ap;
+
+  g_variant_get(parameters, "(&o&o&o)", &profile_path, NULL, &ap_path);
+  profile = find_profile(profile_path);
+  ap = g_hash_table_lookup(access_points, ap_path);
+  if (ap == NULL && profile != NULL) {
+    GHashTableIter iter;
+    gpointer value;
+
+    g_hash_table_iter_init(&iter, access_points);
+    while (ap == NULL && g_hash_table_iter_next(&iter, NULL, &value)) {
+      if (g_strcmp0(((AccessPoint *)value)->ssid, profile->ssid) == 0)
+        ap = value;
+    }
+  }
+  if (profile == NULL || ap == NULL) {
+    g_dbus_method_invocation_return_dbus_error(
+        invocation, NM_SERVICE ".Error.UnknownConnection",
+        profile == NULL ? "No such connection" : "The network is out of range");
+    return;
+  }
+
+  profile->timestamp = g_get_real_time() / G_USEC_PER_SEC;
+  g_dbus_connection_emit_signal(bus, NULL, profile->path, NM_CONNECTION,
+                                "Updated", NULL, NULL);
+  active_connection = start_activation(ap->path, profile->wrong);
+  g_dbus_method_invocation_return_value(
+      invocation, g_variant_new("(o)", active_connection));
+}
+
+static void call_method(GDBusConnection *connection, const gchar *sender,
+                        const gchar *path, const gchar *interface,
+                        const gchar *method, GVariant *parameters,
+                        GDBusMethodInvocation *invocation,
+                        gpointer user_data) {
+  if (g_strcmp0(method, "GetDevices") == 0) {
+    const gchar *devices[] = {DEVICE_PATH};
+    g_dbus_method_invocation_return_value(
+        invocation,
+        g_variant_new("(@ao)", g_variant_new_objv(devices, 1)));
+  } else if (g_strcmp0(method, "GetAllAccessPoints") == 0) {
+    g_dbus_method_invocation_return_value(invocation, access_point_paths());
+  } else if (g_strcmp0(method, "RequestScan") == 0) {
+    if (scan_id == 0)
+      scan_id = g_timeout_add(SCAN_MS, on_scan_done, NULL);
+    g_dbus_method_invocation_return_value(invocation, NULL);
+  } else if (g_strcmp0(method, "AddAndActivateConnection") == 0) {
+    activate(invocation, parameters);
+  } else if (g_strcmp0(method, "ActivateConnection") == 0) {
+    activate_profile(invocation, parameters);
+  } else if (g_strcmp0(method, "DeactivateConnection") == 0) {
+    // Whatever is active or activating; there is only ever one. 39 is
+    // "deactivated by the user".
+    g_clear_handle_id(&step_id, g_source_remove);
+    set_device_state(110, 39);
+    set_active_ap(NULL);
+    set_device_state(30, 39);
+    g_dbus_method_invocation_return_value(invocation, NULL);
+  } else if (g_strcmp0(method, "ListConnections") == 0) {
+    g_dbus_method_invocation_return_value(invocation, profile_paths());
+  } else {
+    g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR,
+                                          G_DBUS_ERROR_UNKNOWN_METHOD,
+                                          "No method %s", method);
+  }
+}
+
+static void register_interface(const gchar *path, const gchar *interface) {
+  static const GDBusInterfaceVTable vtable = {call_method, get_property,
+                                              set_property};
+
+  g_dbus_connection_register_object(
+      bus, path, g_dbus_node_info_lookup_interface(node, interface), &vtable,
+      NULL, NULL, NULL);
+}
+
+// Objects go up before the name, so clients that see it find them
+static void on_bus_acquired(GDBusConnection *connection, const gchar *name,
+                            gpointer user_data) {
+  const gchar *count = g_getenv("BENCH_APS");
+  guint n_access_points = count ? (guint)g_ascii_strtoull(count, NULL, 10)
+                                : 300;
+  const gchar *saved = g_getenv("BENCH_PROFILES");
+  guint n_profiles = saved ? (guint)g_ascii_strtoull(saved, NULL, 10) : 20;
+  gint64 now = g_get_real_time() / G_USEC_PER_SEC;
+
+  bus = connection;
+  register_interface(NM_PATH, NM_SERVICE);
+  register_interface(DEVICE_PATH, NM_DEVICE);
+  register_interface(DEVICE_PATH, NM_WIRELESS);
+  register_interface(SETTINGS_PATH, NM_SETTINGS);
+  for (guint i = 0; i < n_access_points; i++) {
+    AccessPoint *ap = add_access_point();
+
+    // The first networks were used an hour apart, the first most recently
+    if (ap->id % 3 != 0 && profiles->len < n_profiles)
+      add_profile(ap->ssid, ap->secured, now - (gint64)ap->id * 3600);
+  }
+  active_ap = g_strdup(NM_PATH "/AccessPoint/1");
+  update_bitrate();
+}
+
+static void on_name_lost(GDBusConnection *connection, const gchar *name,
+                         gpointer user_data) {
+  g_printerr("nm-mock: could not own %s\n", name);
+  exit(1);
+}
+
+int main(void) {
+  GMainLoop *loop = g_main_loop_new(NULL, FALSE);
+
+  node = g_dbus_node_info_new_for_xml(introspection, NULL);
+  access_points = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                        (GDestroyNotify)access_point_free);
+  profiles = g_ptr_array_new();
+  rand_source = g_rand_new_with_seed(1);
+  g_bus_own_name(G_BUS_TYPE_SYSTEM, NM_SERVICE, G_BUS_NAME_OWNER_FLAGS_NONE,
+                 on_bus_acquired, NULL, on_name_lost, NULL, NULL);
+  g_main_loop_run(loop);
+  return 0;
+}
@@ -0,0 +1,235 @@
+// Headless page benchmarks. `make bench` links this against every source
+// file except main.c and runs it on a broadway display with the mock backends
+// from bench/mock first on PATH.
+//
+// For each page it reports the time spent in the synchronous open call, the
+// time to the first painted frame, the time until every backend command it
+// started has finished, and how many processes that took. It then drags the
+// continuous sliders and measures the idle CPU cost of the refresh timers.
+#include "command/command.h"
+#include "command/stats.h"
+#include "option/audio.h"
+#include "option/autostart.h"
+#include "option/bluetooth.h"
+#include "option/config.h"
+#include "option/default_app.h"
+#include "option/display.h"
+#include "option/keyboard_shortcuts.h"
+#include "option/security.h"
+#include "option/user_permissions.h"
+#include "option/wifi.h"
+#include <adwaita.h>
+#include <gtk/gtk.h>
+#include <sys/resource.h>
+
+// Backends count as settled once nothing has run for this long
+#define BENCH_QUIET_US (50 * G_TIME_SPAN_MILLISECOND)
+#define BENCH_TIMEOUT_US (30 * G_TIME_SPAN_SECOND)
+// Slider positions per drag
+#define BENCH_DRAG_STEPS 200
+
+typedef struct {
+  const char *name;
+  void (*open)(gpointer stack);
+} PageCase;
+
+static const PageCase pages[] = {
+    {"display", change_panel_to_display},
+    {"audio", change_panel_to_audio},
+    {"wifi", change_panel_to_wifi},
+    {"bluetooth", change_panel_to_bluetooth},
+    {"autostart", change_panel_to_autostart},
+    {"security", change_panel_to_security},
+    {"default_apps", change_panel_to_default_apps},
+    {"user_permissions", change_panel_to_user_permissions},
+    {"keyboard_shortcuts", change_panel_to_keyboard_shortcuts},
+    {"config", change_panel_to_config},
+};
+
+static gboolean on_wakeup(gpointer user_data) { return G_SOURCE_CONTINUE; }
+
+static void on_after_paint(GdkFrameClock *clock, gpointer user_data) {
+  *(gboolean *)user_data = TRUE;
+}
+
+// Iterate the main loop until the window has painted a frame
+static void wait_for_frame(GtkWidget *window) {
+  GdkFrameClock *clock = gtk_widget_get_frame_clock(window);
+  gboolean painted = FALSE;
+  gint64 deadline = g_get_monotonic_time() + BENCH_TIMEOUT_US;
+
+  if (clock == NULL)
+    return;
+
+  gulong handler = g_signal_connect(clock, "after-paint",
+                                    G_CALLBACK(on_after_paint), &painted);
+  guint wakeup = g_timeout_add(10, on_wakeup, NULL);
+  gtk_widget_queue_draw(window);
+
+  while (!painted && g_get_monotonic_time() < deadline)
+    g_main_context_iteration(NULL, TRUE);
+
+  g_source_remove(wakeup);
+  g_signal_handler_disconnect(clock, handler);
+}
+
+// Iterate the main loop until no backend process has run for BENCH_QUIET_US
+static void wait_until_settled(void) {
+  gint64 deadline = g_get_monotonic_time() + BENCH_TIMEOUT_US;
+  gint64 quiet_since = g_get_monotonic_time();
+  guint wakeup = g_timeout_add(5, on_wakeup, NULL);
+
+  while (g_get_monotonic_time() < deadline) {
+    g_main_context_iteration(NULL, TRUE);
+
+    gint64 now = g_get_monotonic_time();
+    if (command_running_count() > 0)
+      quiet_since = now;
+    else if (now - quiet_since >= BENCH_QUIET_US)
+      break;
+  }
+  g_source_remove(wakeup);
+}
+
+static double ms_since(gint64 start) {
+  return (g_get_monotonic_time() - start) / 1000.0;
+}
+
+static void bench_page(GtkWidget *window, GtkStack *stack,
+                       const PageCase *page) {
+  guint forks = command_stats_total_forks();
+  gint64 start = g_get_monotonic_time();
+
+  page->open(stack);
+  double open_ms = ms_since(start);
+
+  wait_for_frame(window);
+  double frame_ms = ms_since(start);
+
+  // The quiet period is not part of the page's cost
+  wait_until_settled();
+  double settled_ms = ms_since(start) - BENCH_QUIET_US / 1000.0;
+
+  g_print("%-20s %9.2f %9.2f %10.2f %6u\n", page->name, open_ms, frame_ms,
+          settled_ms, command_stats_total_forks() - forks);
+}
+
+static GtkRange *find_range(GtkWidget *widget) {
+  if (GTK_IS_RANGE(widget))
+    return GTK_RANGE(widget);
+
+  for (GtkWidget *child = gtk_widget_get_first_child(widget); child != NULL;
+       child = gtk_widget_get_next_sibling(child)) {
+    GtkRange *range = find_range(child);
+    if (range != NULL)
+      return range;
+  }
+  return NULL;
+}
+
+// Move a slider through BENCH_DRAG_STEPS positions, one per main loop
+// iteration, the way a pointer drag delivers them
+static void bench_drag(const char *name, GtkWidget *page) {
+  GtkRange *range = page ? find_range(page) : NULL;
+
+  if (range == NULL) {
+    g_print("%-20s (no slider)\n", name);
+    return;
+  }
+
+  guint forks = command_stats_total_forks();
+  gint64 start = g_get_monotonic_time();
+
+  for (int i = 0; i < BENCH_DRAG_STEPS; i++) {
+    gtk_range_set_value(range, 20 + i % 60);
+    while (g_main_context_iteration(NULL, FALSE))
+      ;
+  }
+  double drag_ms = ms_since(start);
+
+  wait_until_settled();
+  double settled_ms = ms_since(start) - BENCH_QUIET_US / 1000.0;
+
+  g_print("%-20s %9.0f %9.2f %10.2f %6u\n", name,
+          BENCH_DRAG_STEPS / (drag_ms / 1000.0), drag_ms, settled_ms,
+          command_stats_total_forks() - forks);
+}
+
+static double cpu_ms(void) {
+  struct rusage self, children;
+
+  getrusage(RUSAGE_SELF, &self);
+  getrusage(RUSAGE_CHILDREN, &children);
+  return (self.ru_utime.tv_sec + self.ru_stime.tv_sec +
+          children.ru_utime.tv_sec + children.ru_stime.tv_sec) * 1000.0 +
+         (self.ru_utime.tv_usec + self.ru_stime.tv_usec +
+          children.ru_utime.tv_usec + children.ru_stime.tv_usec) / 1000.0;
+}
+
+static gboolean on_idle_done(gpointer user_data) {
+  *(gboolean *)user_data = TRUE;
+  return G_SOURCE_REMOVE;
+}
+
+// Leave every page open and let the refresh timers run
+static void bench_idle(guint seconds) {
+  gboolean done = FALSE;
+  guint forks = command_stats_total_forks();
+  double cpu = cpu_ms();
+
+  g_timeout_add_seconds(seconds, on_idle_done, &done);
+  while (!done)
+    g_main_context_iteration(NULL, TRUE);
+  wait_until_settled();
+
+  g_print("idle %us: %.1f ms CPU per second, %u processes\n", seconds,
+          (cpu_ms() - cpu) / seconds, command_stats_total_forks() - forks);
+}
+
+static void activate(GtkApplication *app, gpointer user_data) {
+  const char *idle_env = g_getenv("BENCH_IDLE_SECONDS");
+  guint idle_seconds = idle_env ? (guint)g_ascii_strtoull(idle_env, NULL, 10) : 5;
+
+  GtkWidget *window = gtk_application_window_new(app);
+  GtkWidget *stack = gtk_stack_new();
+  gtk_window_set_default_size(GTK_WINDOW(window), 1000, 700);
+  gtk_window_set_child(GTK_WINDOW(window), stack);
+  gtk_window_present(GTK_WINDOW(window));
+  wait_for_frame(window);
+
+  g_print("%-20s %9s %9s %10s %6s\n", "page", "open ms", "frame ms",
+          "settled ms", "forks");
+  for (gsize i = 0; i < G_N_ELEMENTS(pages); i++)
+    bench_page(window, GTK_STACK(stack), &pages[i]);
+
+  g_print("\n%-20s %9s %9s %10s %6s\n", "slider", "steps/s", "drag ms",
+          "settled ms", "forks");
+  gtk_stack_set_visible_child_name(GTK_STACK(stack), "audio_page");
+  bench_drag("audio volume", AudioPage);
+  gtk_stack_set_visible_child_name(GTK_STACK(stack), "display_page");
+  bench_drag("display brightness", DisplayPage);
+
+  g_print("\n");
+  if (idle_seconds > 0)
+    bench_idle(idle_seconds);
+
+  gchar *report = command_stats_report();
+  g_print("\n%s", report);
+  g_free(report);
+
+  cleanup_bluetooth();
+  cleanup_wifi();
+  gtk_window_destroy(GTK_WINDOW(window));
+}
+
+int main(int argc, char *argv[]) {
+  adw_init();
+
+  GtkApplication *app = gtk_application_new("org.systune.bench",
+                                            G_APPLICATION_NON_UNIQUE);
+  g_signal_connect(app, "activate", G_CALLBACK(activate), NULL);
+
+  int status = g_application_run(G_APPLICATION(app), argc, argv);
+  g_object_unref(app);
+  return status;
+}
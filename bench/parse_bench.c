@@ -0,0 +1,206 @@
+// Microbenchmarks for src/parse.c against the strtok/sscanf parsing it
+// replaced. Each case parses a captured backend output many times over and
+// reports nanoseconds per pass; `make parse-bench` builds and runs it.
+#define _POSIX_C_SOURCE 200809L
+#include "parse/parse.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_MIN_NS 200000000L // run each case for at least 0.2 s
+
+static volatile long sink; // keeps results alive past the optimizer
+
+static const char xrandr_sample[] =
+    "Screen 0: minimum 320 x 200, current 1920 x 1080, maximum 16384 x 16384\n"
+    "eDP-1 connected primary 1920x1080+0+0 (normal left inverted right x axis "
+    "y axis) 344mm x 194mm\n"
+    "   1920x1080     60.02*+  59.94    48.00\n"
+    "   1680x1050     59.95    59.88\n"
+    "   1400x1050     59.98\n"
+    "   1280x1024     60.02\n"
+    "   1280x960      60.00\n"
+    "   1024x768      60.04    60.00\n"
+    "   800x600       60.32    56.25\n"
+    "   640x480       59.94\n"
+    "HDMI-1 disconnected (normal left inverted right x axis y axis)\n";
+
+static const char nmcli_sample[] = "Home\\:5G:87:WPA2\n"
+                                   "Cafe Guest:54:\n"
+                                   "Office:100:WPA2 802.1X\n"
+                                   "Neighbour:32:WPA1 WPA2\n"
+                                   "Printer-Direct:20:WPA2\n"
+                                   "Library:66:\n";
+
+static const char pactl_sample[] =
+    "Sink #52\n"
+    "\tState: RUNNING\n"
+    "\tName: alsa_output.pci-0000_00_1f.3.analog-stereo\n"
+    "\tDescription: Built-in Audio Analog Stereo\n"
+    "\tDriver: PipeWire\n"
+    "\tMute: no\n"
+    "\tVolume: front-left: 42598 /  65% / -11.23 dB\n"
+    "Sink #71\n"
+    "\tState: SUSPENDED\n"
+    "\tName: bluez_output.00_1B_66_A1_B2_C3.1\n"
+    "\tDescription: WH-1000XM4\n"
+    "\tDriver: PipeWire\n"
+    "\tMute: no\n";
+
+typedef long (*BenchFunc)(const char *sample, size_t len);
+
+static long now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// strtok writes into its input, so the old parsers get a fresh copy per pass
+// the way they got a fresh g_strdup'd command output
+static long xrandr_sscanf(const char *sample, size_t len) {
+  char *copy = malloc(len + 1);
+  long total = 0;
+
+  memcpy(copy, sample, len + 1);
+  for (char *line = strtok(copy, "\n"); line; line = strtok(NULL, "\n")) {
+    char resolution[32];
+    float rate;
+    if (strstr(line, "x") && strstr(line, ".") &&
+        sscanf(line, " %31s %f", resolution, &rate) == 2)
+      total += (long)(rate * 1000);
+  }
+  free(copy);
+  return total;
+}
+
+static long xrandr_views(const char *sample, size_t len) {
+  LineReader reader;
+  StrView line;
+  ModeLine mode;
+  long total = 0;
+
+  line_reader_init(&reader, sample, len);
+  while (line_reader_next(&reader, &line))
+    if (parse_xrandr_mode(line, &mode))
+      total += mode.refresh_mhz;
+  return total;
+}
+
+static long nmcli_strtok(const char *sample, size_t len) {
+  char *copy = malloc(len + 1);
+  long total = 0;
+
+  memcpy(copy, sample, len + 1);
+  for (char *line = strtok(copy, "\n"); line; line = strtok(NULL, "\n")) {
+    // The per-field allocations g_strsplit made
+    char *fields[8];
+    int count = 0;
+    for (char *field = line; field && count < 8; count++) {
+      char *colon = strchr(field, ':');
+      if (colon)
+        *colon = '\0';
+      fields[count] = strdup(field);
+      field = colon ? colon + 1 : NULL;
+    }
+    if (count >= 3)
+      total += atoi(fields[1]) + (long)strlen(fields[0]);
+    for (int i = 0; i < count; i++)
+      free(fields[i]);
+  }
+  free(copy);
+  return total;
+}
+
+static long nmcli_views(const char *sample, size_t len) {
+  LineReader reader;
+  StrView line, fields[3];
+  char ssid[128];
+  long total = 0, signal;
+
+  line_reader_init(&reader, sample, len);
+  while (line_reader_next(&reader, &line)) {
+    if (nmcli_split(line, fields, 3) >= 3 &&
+        str_view_take_int(&fields[1], &signal))
+      total += signal + (long)nmcli_unescape(fields[0], ssid, sizeof(ssid));
+  }
+  return total;
+}
+
+static long pactl_strtok(const char *sample, size_t len) {
+  char *copy = malloc(len + 1);
+  long total = 0;
+  unsigned index;
+
+  memcpy(copy, sample, len + 1);
+  for (char *line = strtok(copy, "\n"); line; line = strtok(NULL, "\n")) {
+    char *desc;
+    if (strncmp(line, "Sink ", 5) == 0 && sscanf(line + 4, " #%u", &index) == 1)
+      total += index;
+    else if ((desc = strstr(line, "Description: ")) != NULL)
+      total += (long)strlen(desc);
+  }
+  free(copy);
+  return total;
+}
+
+static long pactl_views(const char *sample, size_t len) {
+  LineReader reader;
+  StrView line, key, value;
+  long total = 0, index;
+
+  line_reader_init(&reader, sample, len);
+  while (line_reader_next(&reader, &line)) {
+    if (str_view_has_prefix(line, "Sink #")) {
+      StrView rest = str_view_skip(line, 6);
+      if (str_view_take_int(&rest, &index))
+        total += index;
+    } else if (parse_key_value(line, &key, &value) &&
+               str_view_equal(key, "Description")) {
+      total += (long)value.len;
+    }
+  }
+  return total;
+}
+
+static void on_line(StrView line, void *user_data) { *(long *)user_data += line.len; }
+
+// The coprocess path: the same text arriving as small pipe reads
+static long feeder_chunks(const char *sample, size_t len) {
+  LineFeeder feeder;
+  long total = 0;
+
+  line_feeder_init(&feeder);
+  for (size_t pos = 0; pos < len; pos += 48)
+    line_feeder_feed(&feeder, sample + pos, len - pos < 48 ? len - pos : 48,
+                     on_line, &total);
+  line_feeder_flush(&feeder, on_line, &total);
+  line_feeder_clear(&feeder);
+  return total;
+}
+
+static void bench(const char *name, BenchFunc func, const char *sample) {
+  size_t len = strlen(sample);
+  long passes = 0, start = now_ns(), elapsed;
+
+  do {
+    for (int i = 0; i < 1000; i++)
+      sink += func(sample, len);
+    passes += 1000;
+    elapsed = now_ns() - start;
+  } while (elapsed < BENCH_MIN_NS);
+
+  printf("%-24s %10.1f ns/pass %8.1f MB/s\n", name, (double)elapsed / passes,
+         (double)len * passes / elapsed * 1000.0);
+}
+
+int main(void) {
+  bench("xrandr sscanf", xrandr_sscanf, xrandr_sample);
+  bench("xrandr views", xrandr_views, xrandr_sample);
+  bench("nmcli strtok+split", nmcli_strtok, nmcli_sample);
+  bench("nmcli views", nmcli_views, nmcli_sample);
+  bench("pactl strtok", pactl_strtok, pactl_sample);
+  bench("pactl views", pactl_views, pactl_sample);
+  bench("feeder 48-byte reads", feeder_chunks, pactl_sample);
+  return 0;
+}
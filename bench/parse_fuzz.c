@@ -0,0 +1,187 @@
+// Fuzz harness for src/parse.c.
+//
+// With libFuzzer:  clang -fsanitize=fuzzer,address -DPARSE_FUZZ_LIBFUZZER ...
+// Standalone:      make parse-fuzz, which mutates bench/corpus under ASan/UBSan
+#include "parse/parse.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FUZZ_MUTATIONS 20000
+
+typedef struct {
+  const char *expected;
+  size_t expected_len;
+  size_t offset;
+  size_t lines;
+} FeedCheck;
+
+static void check_view(StrView view, const char *data, size_t len) {
+  assert(view.len == 0 ||
+         (view.data >= data && view.data + view.len <= data + len));
+}
+
+static void exercise_line(StrView line, const char *data, size_t len) {
+  StrView fields[8], key, value;
+  char buffer[64];
+  ModeLine mode;
+  PwTopNode node;
+  long number;
+
+  check_view(line, data, len);
+
+  size_t count = nmcli_split(line, fields, 8);
+  for (size_t i = 0; i < count && i < 8; i++) {
+    check_view(fields[i], data, len);
+    assert(nmcli_unescape(fields[i], buffer, sizeof(buffer)) < sizeof(buffer));
+  }
+
+  if (parse_key_value(line, &key, &value)) {
+    check_view(key, data, len);
+    check_view(value, data, len);
+  }
+
+  if (parse_xrandr_mode(line, &mode))
+    assert(mode.width > 0 && mode.height > 0);
+  if (parse_wlr_randr_mode(line, &mode))
+    assert(mode.width > 0 && mode.height > 0);
+
+  if (parse_pw_metadata(line, &key, &value)) {
+    check_view(key, data, len);
+    check_view(value, data, len);
+  }
+  if (parse_pw_top_node(line, &node)) {
+    assert(node.name.len > 0);
+    check_view(node.name, data, len);
+  }
+
+  StrView cursor = line;
+  while (cursor.len > 0) {
+    if (!str_view_take_milli(&cursor, &number))
+      cursor = str_view_skip(cursor, 1);
+    check_view(cursor, data, len);
+  }
+
+  str_view_copy(str_view_strip(line), buffer, sizeof(buffer));
+  str_view_find(line, "Description:");
+}
+
+// Lines from the feeder must match what the reader finds in the whole buffer
+static void on_fed_line(StrView line, void *user_data) {
+  FeedCheck *check = user_data;
+  LineReader reader;
+  StrView expected;
+
+  line_reader_init(&reader, check->expected + check->offset,
+                   check->expected_len - check->offset);
+  assert(line_reader_next(&reader, &expected));
+  assert(line.len == expected.len &&
+         memcmp(line.data, expected.data, line.len) == 0);
+  check->offset = reader.pos - check->expected;
+  check->lines++;
+}
+
+static void fuzz_one(const char *data, size_t len) {
+  LineReader reader;
+  StrView line;
+  size_t lines = 0;
+
+  line_reader_init(&reader, data, len);
+  while (line_reader_next(&reader, &line)) {
+    exercise_line(line, data, len);
+    lines++;
+  }
+
+  // Replay the same bytes through the feeder in uneven chunks
+  size_t chunk = len % 7 + 1;
+  FeedCheck check = {data, len, 0, 0};
+  LineFeeder feeder;
+
+  line_feeder_init(&feeder);
+  for (size_t pos = 0; pos < len;) {
+    size_t n = len - pos < chunk ? len - pos : chunk;
+    line_feeder_feed(&feeder, data + pos, n, on_fed_line, &check);
+    pos += n;
+    chunk = chunk * 3 % 61 + 1;
+  }
+  line_feeder_flush(&feeder, on_fed_line, &check);
+  line_feeder_clear(&feeder);
+  assert(check.lines == lines);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  // Exact-size copy so ASan catches reads past the end
+  char *copy = malloc(size ? size : 1);
+  memcpy(copy, data, size);
+  fuzz_one(copy, size);
+  free(copy);
+  return 0;
+}
+
+#ifndef PARSE_FUZZ_LIBFUZZER
+static uint32_t next_random(uint32_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+static char *read_file(const char *path, size_t *len) {
+  FILE *file = fopen(path, "rb");
+  char *data = NULL;
+
+  if (file == NULL)
+    return NULL;
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  if (size >= 0 && (data = malloc(size + 1)) != NULL)
+    *len = fread(data, 1, size, file);
+  fclose(file);
+  return data;
+}
+
+int main(int argc, char **argv) {
+  static const char interesting[] = "\\:\n\r x.*+(0123456789";
+  uint32_t seed = 0x5eed1234;
+
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s CORPUS_FILE...\n", argv[0]);
+    return 2;
+  }
+
+  for (int i = 1; i < argc; i++) {
+    size_t len = 0;
+    char *data = read_file(argv[i], &len);
+    if (data == NULL) {
+      perror(argv[i]);
+      return 1;
+    }
+
+    LLVMFuzzerTestOneInput((const uint8_t *)data, len);
+
+    // Byte flips, separator insertions and truncations of each sample
+    char *mutant = malloc(len + 1);
+    for (int round = 0; round < FUZZ_MUTATIONS / argc; round++) {
+      size_t mutant_len = len;
+      memcpy(mutant, data, len);
+      for (int flips = next_random(&seed) % 4 + 1; flips > 0 && len; flips--) {
+        size_t at = next_random(&seed) % len;
+        mutant[at] = next_random(&seed) % 2
+                         ? (char)next_random(&seed)
+                         : interesting[next_random(&seed) %
+                                       (sizeof(interesting) - 1)];
+      }
+      if (len && next_random(&seed) % 3 == 0)
+        mutant_len = next_random(&seed) % len;
+      LLVMFuzzerTestOneInput((const uint8_t *)mutant, mutant_len);
+    }
+    free(mutant);
+    free(data);
+    printf("%s: ok\n", argv[i]);
+  }
+  return 0;
+}
+#endif
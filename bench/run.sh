@@ -0,0 +1,64 @@
+#!/bin/sh
+# Run a benchmark binary headless against the mock backends.
+#
+# Uses the broadway backend on a private display unless GDK_BACKEND is already
+# set, so `GDK_BACKEND=wayland bench/run.sh ...` inside a headless compositor
+# works too.
+set -e
+
+here=$(cd "$(dirname "$0")" && pwd)
+PATH="$here/mock:$PATH"
+export PATH
+
+# Keep the run independent of the desktop it is started from
+export GSETTINGS_BACKEND=memory
+export NO_AT_BRIDGE=1
+export XDG_SESSION_TYPE=${XDG_SESSION_TYPE:-wayland}
+export DESKTOP_SESSION=${DESKTOP_SESSION:-mock}
+# Point libpulse at nothing so the audio page uses the mock pactl
+export PULSE_SERVER=unix:/nonexistent
+
+# BENCH_HYPRLAND=1 runs the pages against a fake Hyprland IPC server
+hyprland_pid=
+if [ -n "$BENCH_HYPRLAND" ]; then
+  XDG_RUNTIME_DIR=$(mktemp -d)
+  export XDG_RUNTIME_DIR
+  export HYPRLAND_INSTANCE_SIGNATURE=bench
+  "$here/mock/Hyprland" &
+  hyprland_pid=$!
+  trap 'kill $hyprland_pid 2>/dev/null' EXIT
+  while [ ! -S "$XDG_RUNTIME_DIR/hypr/bench/.socket2.sock" ]; do sleep 0.1; done
+fi
+
+# BENCH_NM=1 serves a fake NetworkManager on a private system bus
+bus_pid=
+nm_pid=
+if [ -n "$BENCH_NM" ]; then
+  bus=$(dbus-daemon --session --fork --print-address=1 --print-pid=1)
+  DBUS_SYSTEM_BUS_ADDRESS=$(echo "$bus" | sed -n 1p)
+  export DBUS_SYSTEM_BUS_ADDRESS
+  bus_pid=$(echo "$bus" | sed -n 2p)
+  "$here/../bin/nm-mock" &
+  nm_pid=$!
+  trap 'kill $hyprland_pid $nm_pid $bus_pid 2>/dev/null' EXIT
+  gdbus wait --system --timeout 10 org.freedesktop.NetworkManager
+fi
+
+broadwayd_pid=
+if [ -z "$GDK_BACKEND" ]; then
+  display=${BENCH_BROADWAY_DISPLAY:-:94}
+  broadwayd=$(command -v gtk4-broadwayd || true)
+  if [ -z "$broadwayd" ]; then
+    echo "gtk4-broadwayd not found; set GDK_BACKEND to run on another display" >&2
+    exit 1
+  fi
+  "$broadwayd" "$display" >/dev/null 2>&1 &
+  broadwayd_pid=$!
+  trap 'kill $broadwayd_pid $hyprland_pid $nm_pid $bus_pid 2>/dev/null' EXIT
+  sleep 0.5
+
+  export GDK_BACKEND=broadway
+  export BROADWAY_DISPLAY="$display"
+fi
+
+"$@"
@@ -0,0 +1,14 @@
+#ifndef AUDIO_LATENCY_H
+#define AUDIO_LATENCY_H
+
+#include <gtk/gtk.h>
+
+// PipeWire clock section of the audio page: graph sample rate and quantum,
+// read and set live through the "settings" metadata with pw-metadata, the
+// resulting buffer latency of every running device with the xruns pw-top's
+// profiler counted, and an optional drop-in that makes the settings stick.
+// Hidden while the sound server is not PipeWire; looked at again whenever
+// the page is shown.
+void audio_latency_attach(GtkBuilder *builder);
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef AUDIO_MIXER_H
+#define AUDIO_MIXER_H
+
+#include <gtk/gtk.h>
+
+// Per-application section of the audio page: one row per playback or
+// recording stream with its own volume, mute and level meter, kept in step
+// with the libpulse client. Meters run only while the list is mapped.
+void audio_mixer_attach(GtkListBox *list);
+
+#endif
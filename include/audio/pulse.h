@@ -0,0 +1,112 @@
+#ifndef AUDIO_PULSE_H
+#define AUDIO_PULSE_H
+
+#include <glib.h>
+
+// In-process client for the sound server (PulseAudio or pipewire-pulse) over
+// libpulse's async API on the GLib main loop. It keeps the sinks, sources,
+// application streams and defaults in memory, follows the server's change
+// events and tells listeners about every change. Main thread only.
+
+typedef enum {
+  AUDIO_SINK,
+  AUDIO_SOURCE,
+} AudioDirection;
+
+typedef struct {
+  AudioDirection direction;
+  guint32 index;
+  gchar *name;
+  gchar *description;
+  gint volume; // loudest channel in percent, 100 is nominal
+  gboolean muted;
+} AudioDevice;
+
+// An application's playback stream (AUDIO_SINK, a sink input) or recording
+// stream (AUDIO_SOURCE, a source output)
+typedef struct {
+  AudioDirection direction;
+  guint32 index;
+  guint32 device; // sink or source the stream is attached to
+  gchar *application;
+  gchar *title; // what is playing or recording, may be NULL
+  gchar *icon_name; // may be NULL
+  gint volume;
+  gboolean muted;
+  gfloat peak; // 0..1, refreshed AUDIO_METER_RATE times a second while
+               // meters are on
+} AudioStream;
+
+typedef enum {
+  AUDIO_PULSE_CONNECTING,
+  AUDIO_PULSE_READY,  // connected and the initial state is loaded
+  AUDIO_PULSE_FAILED, // not connected: no server, or the connection was lost
+} AudioPulseState;
+
+typedef enum {
+  AUDIO_CHANGE_STATE,   // see audio_pulse_get_state(); devices are dropped
+                        // when the connection is lost
+  AUDIO_CHANGE_DEVICE,  // device was added or changed
+  AUDIO_CHANGE_REMOVED, // device is about to be freed
+  AUDIO_CHANGE_DEFAULT, // the default sink or source changed
+  AUDIO_CHANGE_STREAM,  // stream was added or changed
+  AUDIO_CHANGE_STREAM_REMOVED, // stream is about to be freed
+} AudioChange;
+
+// device is set for AUDIO_CHANGE_DEVICE and AUDIO_CHANGE_REMOVED only
+typedef void (*AudioPulseFunc)(AudioChange change, const AudioDevice *device,
+                               gpointer user_data);
+// Gets AUDIO_CHANGE_STREAM and AUDIO_CHANGE_STREAM_REMOVED. Meter readings
+// are not changes; read AudioStream.peak instead.
+typedef void (*AudioPulseStreamFunc)(AudioChange change,
+                                     const AudioStream *stream,
+                                     gpointer user_data);
+
+// Start connecting; does nothing if already connected or connecting. Until
+// audio_pulse_disconnect(), a lost connection is retried every
+// AUDIO_PULSE_RECONNECT seconds.
+#define AUDIO_PULSE_RECONNECT 5
+void audio_pulse_connect(void);
+void audio_pulse_disconnect(void);
+AudioPulseState audio_pulse_get_state(void);
+
+guint audio_pulse_listen(AudioPulseFunc func, gpointer user_data);
+guint audio_pulse_listen_streams(AudioPulseStreamFunc func, gpointer user_data);
+void audio_pulse_unlisten(guint id);
+
+// Devices ordered by index. Free the array with g_ptr_array_unref(); the
+// devices belong to the client and stay valid until their REMOVED change.
+GPtrArray *audio_pulse_devices(AudioDirection direction);
+const AudioDevice *audio_pulse_lookup(AudioDirection direction, guint32 index);
+const AudioDevice *audio_pulse_default(AudioDirection direction);
+
+// Return FALSE when not connected or the device is gone. The result arrives
+// as a change event.
+gboolean audio_pulse_set_default(AudioDirection direction, guint32 index);
+
+// Volume writes also report when the server answered, so callers can keep
+// one write per device in flight. done may be NULL and is not called when
+// the write could not be sent.
+typedef void (*AudioPulseDoneFunc)(gboolean success, gpointer user_data);
+gboolean audio_pulse_set_volume(AudioDirection direction, guint32 index,
+                                gint percent, AudioPulseDoneFunc done,
+                                gpointer user_data);
+
+// Streams ordered by index, same ownership as audio_pulse_devices()
+GPtrArray *audio_pulse_streams(AudioDirection direction);
+const AudioStream *audio_pulse_lookup_stream(AudioDirection direction,
+                                             guint32 index);
+gboolean audio_pulse_set_stream_volume(AudioDirection direction, guint32 index,
+                                       gint percent, AudioPulseDoneFunc done,
+                                       gpointer user_data);
+gboolean audio_pulse_set_stream_mute(AudioDirection direction, guint32 index,
+                                     gboolean muted);
+
+// Level meters: one mono peak-detecting record stream per application
+// stream, computed by the server and delivered AUDIO_METER_RATE times a
+// second. They don't keep idle devices awake. Turn them off while nobody
+// looks.
+#define AUDIO_METER_RATE 20
+void audio_pulse_set_meters(gboolean enabled);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef AUDIO_REGISTRY_H
+#define AUDIO_REGISTRY_H
+
+#include "audio/pulse.h"
+#include <gio/gio.h>
+
+// The sinks and sources currently known, as list models ordered by the
+// server's object index. Backends feed it one device at a time, so a hotplug
+// or rename changes only the affected item and bound widgets keep their
+// other rows. Main thread only.
+
+#define AUDIO_TYPE_DEVICE_ITEM (audio_device_item_get_type())
+G_DECLARE_FINAL_TYPE(AudioDeviceItem, audio_device_item, AUDIO, DEVICE_ITEM,
+                     GObject)
+
+// Properties: "index", "name", "description", "volume", "muted", "is-default"
+guint32 audio_device_item_get_index(AudioDeviceItem *item);
+const gchar *audio_device_item_get_name(AudioDeviceItem *item);
+const gchar *audio_device_item_get_description(AudioDeviceItem *item);
+gint audio_device_item_get_volume(AudioDeviceItem *item);
+gboolean audio_device_item_get_is_default(AudioDeviceItem *item);
+
+// Models of AudioDeviceItem, owned by the registry
+GListModel *audio_sink_list(void);
+GListModel *audio_source_list(void);
+
+AudioDeviceItem *audio_registry_lookup(AudioDirection direction,
+                                       guint32 index);
+AudioDeviceItem *audio_registry_get_default(AudioDirection direction);
+
+// Add a device or update it in place. A new description replaces the item's
+// row in the model; volume and mute changes only notify the item's
+// properties.
+void audio_registry_update(const AudioDevice *device);
+void audio_registry_remove(AudioDirection direction, guint32 index);
+void audio_registry_set_default(AudioDirection direction, const gchar *name);
+
+// For backends that only get full listings: update every device between the
+// two calls, and end() removes the ones not seen since begin()
+void audio_registry_begin(AudioDirection direction);
+void audio_registry_end(AudioDirection direction);
+
+void audio_registry_clear(void);
+
+#endif
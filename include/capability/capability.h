@@ -0,0 +1,51 @@
+#ifndef CAPABILITY_H
+#define CAPABILITY_H
+
+#include <glib.h>
+
+// What this machine and session offer, found once at startup so that pages
+// pick a backend and hide controls that cannot work without probing on their
+// own. Programs, D-Bus services and sysfs nodes are probed in parallel.
+// Which programs exist is kept in $XDG_CACHE_HOME/systune/capabilities until
+// the systune binary, PATH or a PATH directory changes; services, devices
+// and the session are looked at every time.
+
+typedef enum {
+  CAPABILITY_SESSION_OTHER,
+  CAPABILITY_SESSION_WAYLAND,
+  CAPABILITY_SESSION_X11,
+} CapabilitySession;
+
+typedef struct {
+  CapabilitySession session;
+  gchar *desktop;    // XDG_CURRENT_DESKTOP, may be NULL
+  gchar *compositor; // "Hyprland" or "sway" when recognised, else NULL
+
+  // Programs on PATH
+  gboolean nmcli;
+  gboolean pactl;
+  gboolean bluetoothctl;
+  gboolean ufw;
+  gboolean pkexec;
+  gboolean brightnessctl;
+  gboolean swww;
+  gboolean feh;
+  gboolean hyprctl;
+
+  // System bus services, running or activatable
+  gboolean network_manager;
+  gboolean bluez;
+  gboolean logind;
+
+  // sysfs
+  gboolean backlight;         // a device under /sys/class/backlight
+  gboolean wireless;          // a network interface with a wireless directory
+  gboolean bluetooth_adapter; // a device under /sys/class/bluetooth
+} Capabilities;
+
+// Called once before the window is built. capabilities() runs it on first
+// use otherwise.
+void capabilities_init(void);
+const Capabilities *capabilities(void);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef COMMAND_CACHE_H
+#define COMMAND_CACHE_H
+
+#include "command/command.h"
+
+// Read-through cache for backend queries. Results of the same argv are served
+// from memory for ttl_ms, and identical queries issued while one is already
+// running share that single process. Failed runs are never cached, and
+// stale results are dropped from time to time.
+void command_query_async(const gchar *const *argv, guint ttl_ms,
+                         GCancellable *cancellable,
+                         GAsyncReadyCallback callback, gpointer user_data);
+CommandResult *command_query_finish(GAsyncResult *result, GError **error);
+
+// Blocking variant for worker threads only; shares entries with the async
+// one
+CommandResult *command_query_sync(const gchar *const *argv, guint ttl_ms,
+                                  GCancellable *cancellable, GError **error);
+
+// Drop every cached result whose argv[0] is tool (all results if NULL).
+// Queries still running are not stored once they finish.
+void command_cache_invalidate(const gchar *tool);
+
+// command_spawn() for state changes: invalidates argv[0]'s cached reads when
+// issued and again when the write completes
+void command_write(const gchar *const *argv);
+
+#endif
@@ -1,6 +1,50 @@
 #ifndef COMMAND_H
 #define COMMAND_H
 
-char* execute_command(const char*);
+#include <gio/gio.h>
+
+// Default timeout for backend queries, in milliseconds
+#define COMMAND_DEFAULT_TIMEOUT 10000
+
+// Outcome of a finished process. Output is captured in full, there is no size
+// limit. exit_status is the exit code, or -1 if the process was killed by a
+// signal (term_signal is then set).
+typedef struct {
+  gchar *out;
+  gsize out_len;
+  gchar *err;
+  gint exit_status;
+  gint term_signal;
+} CommandResult;
+
+// Called on the main loop for every chunk read from the child's stdout
+typedef void (*CommandOutputFunc)(const gchar *data, gsize len,
+                                  gpointer user_data);
+
+// Spawn argv[0] (looked up in PATH) without a shell and collect its output
+// asynchronously. A timeout_ms of 0 disables the timeout. Cancelling or timing
+// out kills the child and finishes with G_IO_ERROR_CANCELLED or
+// G_IO_ERROR_TIMED_OUT.
+void command_run_async(const gchar *const *argv, guint timeout_ms,
+                       CommandOutputFunc on_output, gpointer output_data,
+                       GCancellable *cancellable, GAsyncReadyCallback callback,
+                       gpointer user_data);
+CommandResult *command_run_finish(GAsyncResult *result, GError **error);
+
+// Blocking variant for worker threads (GTask thread functions)
+CommandResult *command_run_sync(const gchar *const *argv, guint timeout_ms,
+                                GCancellable *cancellable, GError **error);
+
+// Fire-and-forget for writes; failures are logged
+void command_spawn(const gchar *const *argv);
+
+gboolean command_result_success(const CommandResult *result);
+
+// Processes started by command_run_async() that have not finished yet, on any
+// thread
+guint command_running_count(void);
+void command_result_free(CommandResult *result);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(CommandResult, command_result_free)
 
 #endif
@@ -0,0 +1,38 @@
+#ifndef COPROCESS_H
+#define COPROCESS_H
+
+#include <gio/gio.h>
+
+// A long-lived interactive backend (bluetoothctl, pactl subscribe, nmcli
+// monitor) shared by the whole app. Requests are written to its stdin one at a
+// time; output lines are collected as the response of the request at the head
+// of the queue and are also handed to subscribers as events. Main thread only.
+typedef struct _Coprocess Coprocess;
+
+typedef void (*CoprocessEventFunc)(const gchar *line, gpointer user_data);
+
+// Return the shared instance for argv, creating it on first use. The process
+// is started lazily and respawned if it exits while someone is subscribed.
+Coprocess *coprocess_get(const gchar *const *argv);
+
+// Send one command line. The response is complete when a line containing one
+// of markers arrives, or, with no markers, once output has been quiet for a
+// short settle period. A marker starting with '^' must start the line, which
+// tells a reply apart from events that mention the same words. A timeout_ms
+// of 0 means no timeout.
+void coprocess_request_async(Coprocess *coprocess, const gchar *line,
+                             const gchar *const *markers, guint timeout_ms,
+                             GCancellable *cancellable,
+                             GAsyncReadyCallback callback, gpointer user_data);
+gchar *coprocess_request_finish(GAsyncResult *result, GError **error);
+
+// Fire-and-forget request with the settle framing
+void coprocess_send(Coprocess *coprocess, const gchar *line);
+
+// Receive every line starting with prefix (all lines if NULL). Lines are
+// stripped of colour codes, carriage returns and bluetoothctl-style prompts.
+guint coprocess_subscribe(Coprocess *coprocess, const gchar *prefix,
+                          CoprocessEventFunc callback, gpointer user_data);
+void coprocess_unsubscribe(Coprocess *coprocess, guint id);
+
+#endif
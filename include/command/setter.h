@@ -0,0 +1,40 @@
+#ifndef COMMAND_SETTER_H
+#define COMMAND_SETTER_H
+
+#include "command/command.h"
+
+// Minimum spacing between two writes to the same target: one frame at 60 Hz
+#define COMMAND_SET_INTERVAL 16
+
+// Latest-value-wins writes for continuous controls (sliders, switches).
+// Each target, such as "sink-volume", has at most one write running. A new
+// value that arrives while one runs replaces any value still waiting, so a
+// drag of any length costs a handful of writes and always ends with the last
+// value. Writes never block the main loop. Main thread only.
+void command_set(const gchar *target, const gchar *const *argv);
+
+// Same, for backends that are not processes, such as a libpulse context.
+// func starts the write on the main thread and reports its outcome with
+// command_set_done() once the backend answered, or right away when it could
+// not start it. destroy frees data after that, or once it was superseded.
+typedef void (*CommandSetFunc)(const gchar *target, gpointer data);
+void command_set_func(const gchar *target, CommandSetFunc func, gpointer data,
+                      GDestroyNotify destroy);
+void command_set_done(const gchar *target, gboolean success);
+
+// Change a target's minimum spacing between writes (0: only one at a time)
+void command_set_interval(const gchar *target, guint interval_ms);
+
+// Called on the main thread whenever a target has written its last pending
+// value, with the outcome of that final write
+typedef void (*CommandSetSettledFunc)(const gchar *target, gboolean success,
+                                      gpointer user_data);
+void command_set_connect_settled(const gchar *target,
+                                 CommandSetSettledFunc callback,
+                                 gpointer user_data);
+
+// Write out everything still pending, ignoring the intervals, and wait for it.
+// Used on exit so the last slider position is not lost.
+void command_set_flush(void);
+
+#endif
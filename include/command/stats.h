@@ -0,0 +1,37 @@
+#ifndef COMMAND_STATS_H
+#define COMMAND_STATS_H
+
+#include <glib.h>
+
+// Per-command counters behind --stats and the debug page. Every process
+// run, cache hit, co-process request and timed worker task is recorded under
+// a short key such as "nmcli device wifi" with a log2 latency histogram.
+// Thread safe.
+#define COMMAND_STATS_BUCKETS 12 // <1 ms, <2 ms, ... <1024 ms, slower
+
+// Key for argv: the program and its first two non-option words
+gchar *command_stats_key(const gchar *const *argv);
+
+void command_stats_add(const gchar *key, gint64 duration_us, gsize bytes,
+                       gboolean forked);
+void command_stats_add_hit(const gchar *key);
+
+// Times a block of code, such as a worker thread or a page open. Declare it
+// with g_auto() and it is recorded when it goes out of scope.
+typedef struct {
+  const gchar *key;
+  gint64 start;
+} CommandStatsSpan;
+
+CommandStatsSpan command_stats_begin(const gchar *key);
+void command_stats_end(CommandStatsSpan *span);
+G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC(CommandStatsSpan, command_stats_end)
+
+// Processes started since startup or the last reset
+guint command_stats_total_forks(void);
+
+// Text table of everything recorded so far, slowest total first
+gchar *command_stats_report(void);
+void command_stats_reset(void);
+
+#endif
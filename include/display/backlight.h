@@ -0,0 +1,35 @@
+#ifndef DISPLAY_BACKLIGHT_H
+#define DISPLAY_BACKLIGHT_H
+
+#include <glib.h>
+
+// Panel backlight through /sys/class/backlight, without brightnessctl. The
+// brightness attribute stays open for pread/pwrite; when it is not writable
+// or a write fails, levels go to logind's Session.SetBrightness instead.
+// Changes made elsewhere, such as brightness hotkeys, arrive as udev events.
+// Main thread only.
+//
+// Levels are perceptual percentages: the hardware level grows with the
+// square of the percentage, so equal slider steps look like equal steps.
+
+// Duration of a ramp to a new level, and the time between its writes
+#define BACKLIGHT_RAMP_MS 150
+#define BACKLIGHT_RAMP_STEP_MS 16
+
+typedef void (*BacklightFunc)(gdouble percent, gpointer user_data);
+
+// Pick the device: firmware interfaces first, then platform, then raw.
+// Returns FALSE when the machine has no backlight.
+gboolean backlight_init(void);
+const gchar *backlight_device(void);
+
+gdouble backlight_get(void);
+// Ramp from the current level to percent over BACKLIGHT_RAMP_MS. Setting a
+// new target mid-ramp continues from wherever the ramp is.
+void backlight_set(gdouble percent);
+
+// Called for changes made outside this process
+guint backlight_listen(BacklightFunc func, gpointer user_data);
+void backlight_unlisten(guint id);
+
+#endif
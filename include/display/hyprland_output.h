@@ -0,0 +1,12 @@
+#ifndef DISPLAY_HYPRLAND_OUTPUT_H
+#define DISPLAY_HYPRLAND_OUTPUT_H
+
+#include "display/output.h"
+
+// Backend for Hyprland over its IPC socket. The model comes from
+// `j/monitors all`, a layout goes out as one batch of `keyword monitor`
+// rules (what hyprctl would send), and monitoradded, monitorremoved and
+// configreloaded events reload it. Returns NULL outside Hyprland.
+const DisplayBackend *display_hyprland_connect(void);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef DISPLAY_LAYOUT_H
+#define DISPLAY_LAYOUT_H
+
+#include <gtk/gtk.h>
+
+// Arrangement section of the display page: every connected output drawn to
+// scale where it sits, dragged into place and snapped flush against its
+// neighbours, turned on or off, then applied together as one layout. Edits
+// are drafts until applied and are dropped whenever the outputs change.
+// Hides itself unless a display backend is up and reports several outputs.
+void display_layout_attach(GtkBuilder *builder);
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef DISPLAY_OUTPUT_H
+#define DISPLAY_OUTPUT_H
+
+#include <gio/gio.h>
+
+// In-process model of the connected monitors, kept in step with the display
+// server by a native backend instead of by scraping randr tools. Listeners
+// hear about changes once the server has finished describing them, so they
+// never see half of an update. Main thread only.
+
+typedef struct _DisplayOutput DisplayOutput;
+
+typedef struct {
+  DisplayOutput *output;
+  gint width;
+  gint height;
+  gint refresh_mhz; // exact: 59.94 Hz is 59940, not 60
+  gboolean preferred;
+  gpointer handle; // backend's mode object
+} DisplayMode;
+
+struct _DisplayOutput {
+  gchar *name;        // connector, e.g. "eDP-1"
+  gchar *description; // make and model, may be NULL
+  gboolean enabled;
+  gint x, y;
+  gdouble scale;
+  gint transform; // wl_output_transform
+  GPtrArray *modes;     // DisplayMode, in the order the server lists them
+  GPtrArray *mode_table; // the same modes for people: largest first, fastest
+                         // first within a size, one per size and rate
+  DisplayMode *current;  // NULL while disabled
+  gpointer handle;      // backend's output object
+};
+
+// What one output should look like after display_outputs_apply_async()
+typedef struct {
+  DisplayOutput *output;
+  gboolean enabled;
+  DisplayMode *mode;
+  gint x, y;
+  gdouble scale;
+} DisplayOutputConfig;
+
+typedef void (*DisplayOutputsFunc)(gpointer user_data);
+
+typedef struct {
+  const gchar *name;
+  // Send the whole layout: outputs missing from configs keep their state.
+  // Complete the task with TRUE once it is live.
+  void (*apply)(GArray *configs, GTask *task);
+} DisplayBackend;
+
+// Connect to the first backend the display server supports: Hyprland's IPC,
+// wlr output management on Wayland, then RandR on X11. Returns FALSE when
+// there is none.
+gboolean display_outputs_init(void);
+const DisplayBackend *display_outputs_backend(void);
+
+guint display_outputs_listen(DisplayOutputsFunc func, gpointer user_data);
+void display_outputs_unlisten(guint id);
+
+// Outputs ordered by name. The array belongs to the model; outputs and modes
+// stay valid until the next change notification.
+GPtrArray *display_outputs(void);
+DisplayOutput *display_outputs_lookup(const gchar *name);
+void display_output_config_init(DisplayOutputConfig *config,
+                                DisplayOutput *output);
+gchar *display_mode_label(const DisplayMode *mode);
+// Size in layout coordinates: turned by the transform, divided by the scale
+void display_mode_extent(const DisplayMode *mode, gint transform,
+                         gdouble scale, gint *width, gint *height);
+
+// Configure every output in one step. The backend has the server test the
+// layout before applying it, so a rejected layout changes nothing.
+void display_outputs_apply_async(const DisplayOutputConfig *configs,
+                                 guint n_configs, GCancellable *cancellable,
+                                 GAsyncReadyCallback callback,
+                                 gpointer user_data);
+gboolean display_outputs_apply_finish(GAsyncResult *result, GError **error);
+
+// For backends
+DisplayOutput *display_output_new(const gchar *name, gpointer handle);
+DisplayMode *display_mode_new(DisplayOutput *output, gpointer handle);
+void display_outputs_add(DisplayOutput *output);
+void display_outputs_remove(DisplayOutput *output);
+void display_output_remove_mode(DisplayOutput *output, DisplayMode *mode);
+void display_outputs_changed(void);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef DISPLAY_THUMBNAIL_H
+#define DISPLAY_THUMBNAIL_H
+
+#include <gtk/gtk.h>
+
+// Image thumbnails through the freedesktop thumbnail cache
+// (~/.cache/thumbnails), shared with file managers. A cached thumbnail is
+// used when its URI and mtime match the file; otherwise a worker decodes the
+// image at reduced size, caches the result and records images that fail.
+// The most recent requests are decoded first, so the rows on screen win
+// over those scrolled past, and a bounded set of textures stays in memory.
+
+typedef enum {
+  THUMBNAIL_NORMAL = 128,
+  THUMBNAIL_LARGE = 256,
+} ThumbnailSize;
+
+// Decoder threads, at most
+#define THUMBNAIL_WORKERS 4
+// Textures kept in memory, least recently used dropped first
+#define THUMBNAIL_MEMORY_ITEMS 256
+
+// mtime is the file's time::modified in seconds
+void thumbnail_load_async(GFile *file, guint64 mtime, ThumbnailSize size,
+                          GCancellable *cancellable,
+                          GAsyncReadyCallback callback, gpointer user_data);
+GdkTexture *thumbnail_load_finish(GAsyncResult *result, GError **error);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef DISPLAY_WALLPAPER_H
+#define DISPLAY_WALLPAPER_H
+
+#include <gtk/gtk.h>
+
+// Background section of the display page: a gallery of the images in a
+// chosen folder (the Pictures folder at first), listed without blocking and
+// given thumbnails only as their cells scroll into view. Activating one
+// sets it as the wallpaper with swww on Wayland or feh on X11, handing them
+// an image already rendered at each output's native size.
+void display_wallpaper_attach(GtkBuilder *builder);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef DISPLAY_WALLPAPER_CACHE_H
+#define DISPLAY_WALLPAPER_CACHE_H
+
+#include <gio/gio.h>
+
+// Wallpapers rendered ahead of time at each output's native size, so swww
+// and feh load an image that needs no decoding work beyond a copy and no
+// scaling at all. Renders are cropped to fill, stored as uncompressed BMP
+// under $XDG_CACHE_HOME/systune/wallpapers and keyed by the source file's
+// identity (URI, size, mtime) and the target geometry, so choosing the same
+// image for the same monitors again costs a lookup.
+
+// Renders kept on disk, oldest used dropped first. A 4K render is about
+// 25 MB, so the size limit is usually the one that applies.
+#define WALLPAPER_CACHE_FILES 24
+#define WALLPAPER_CACHE_BYTES (192 * 1024 * 1024)
+
+typedef struct {
+  gchar *name; // output, e.g. "DP-1"
+  gint x, y;   // position, used for the canvas only
+  gint width, height; // native pixels, turned as the output is
+} WallpaperTarget;
+
+void wallpaper_target_clear(WallpaperTarget *target);
+
+// With canvas FALSE, finish returns one path per target, in order. With
+// canvas TRUE it returns a single image of the layout's bounding box with
+// each target's crop at its position, for setters that paint the whole X
+// screen at once.
+void wallpaper_cache_render_async(GFile *source, GArray *targets,
+                                  gboolean canvas, GCancellable *cancellable,
+                                  GAsyncReadyCallback callback,
+                                  gpointer user_data);
+GPtrArray *wallpaper_cache_render_finish(GAsyncResult *result, GError **error);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef DISPLAY_WLR_OUTPUT_H
+#define DISPLAY_WLR_OUTPUT_H
+
+#include "display/output.h"
+
+// Backend for wlroots-based compositors (Sway, Hyprland, river, labwc...)
+// over zwlr_output_manager_v1 on GTK's own Wayland connection. Layouts are
+// tested before they are applied, and the model is republished on each of
+// the manager's done events. Returns NULL when the session is not Wayland or
+// the compositor does not offer the protocol.
+const DisplayBackend *display_wlr_connect(void);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef DISPLAY_XRANDR_OUTPUT_H
+#define DISPLAY_XRANDR_OUTPUT_H
+
+#include "display/output.h"
+
+// Backend for Xorg sessions over libXrandr on GDK's own X connection. It
+// reads screen resources, CRTCs and outputs directly, sets each changed
+// output's CRTC with a single request, and reloads the model on
+// RRScreenChangeNotify. Returns NULL when the session is not X11 or the
+// server lacks RandR 1.2.
+const DisplayBackend *display_xrandr_connect(void);
+
+#endif
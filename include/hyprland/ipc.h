@@ -0,0 +1,43 @@
+#ifndef HYPRLAND_IPC_H
+#define HYPRLAND_IPC_H
+
+#include <gio/gio.h>
+#include <json-glib/json-glib.h>
+
+// Client for Hyprland's own sockets under
+// $XDG_RUNTIME_DIR/hypr/$HYPRLAND_INSTANCE_SIGNATURE, in place of spawning
+// hyprctl. .socket.sock answers one request per connection; .socket2.sock
+// streams events as "name>>data" lines. Both are found from the environment
+// alone, so a fake server there (bench/mock/Hyprland) stands in for the
+// compositor. Main thread only.
+
+// Whether a Hyprland instance is there to talk to
+gboolean hyprland_ipc_available(void);
+
+// Send one raw request, e.g. "dispatch exec foot", and return the reply
+void hyprland_request_async(const gchar *request, GCancellable *cancellable,
+                            GAsyncReadyCallback callback, gpointer user_data);
+gchar *hyprland_request_finish(GAsyncResult *result, GError **error);
+
+// Send several commands, e.g. "keyword monitor DP-1,preferred,auto,1", in
+// one round trip. Commands must not contain ';'. Fails with the first reply
+// that is not "ok".
+void hyprland_batch_async(const gchar *const *commands,
+                          GCancellable *cancellable,
+                          GAsyncReadyCallback callback, gpointer user_data);
+gboolean hyprland_batch_finish(GAsyncResult *result, GError **error);
+
+// The JSON form of a query such as "monitors all", "clients" or "binds"
+void hyprland_query_async(const gchar *query, GCancellable *cancellable,
+                          GAsyncReadyCallback callback, gpointer user_data);
+JsonNode *hyprland_query_finish(GAsyncResult *result, GError **error);
+
+// The event socket is open while anyone listens. event is e.g.
+// "monitoradded", data what followed the ">>".
+typedef void (*HyprlandEventFunc)(const gchar *event, const gchar *data,
+                                  gpointer user_data);
+
+guint hyprland_events_listen(HyprlandEventFunc func, gpointer user_data);
+void hyprland_events_unlisten(guint id);
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef LISTENER_LISTENER_H
+#define LISTENER_LISTENER_H
+
+#include <glib-object.h>
+
+// The callbacks a module hands its changes to, behind its own _listen() and
+// _unlisten(). Listeners may come and go from within a callback: one that
+// left is not called again, not even later in the same emission, and one
+// that joined hears the next emission. Ids are unique across all lists and
+// never 0. A zeroed ListenerList is empty. Main thread only.
+
+typedef struct {
+  GArray *entries; // ListenerEntry, in the order they joined
+  guint length;    // those that have not left
+  guint emitting;  // emissions in progress, which may nest
+} ListenerList;
+
+// Calls one listener: func is the module's callback type, args what the
+// module passed to listener_list_emit()
+typedef void (*ListenerCall)(GCallback func, gpointer user_data,
+                             gpointer args);
+
+guint listener_list_add(ListenerList *list, GCallback func,
+                        gpointer user_data);
+// FALSE when id is not in the list
+gboolean listener_list_remove(ListenerList *list, guint id);
+guint listener_list_length(const ListenerList *list);
+void listener_list_emit(ListenerList *list, ListenerCall call, gpointer args);
+
+#endif
@@ -7,5 +7,6 @@ extern GtkWidget* BluetoothPage;
 
 void change_panel_to_bluetooth(gpointer);
 static void bluetooth_to_stack(GtkStack*);
+void cleanup_bluetooth(void);
 
 #endif
@@ -0,0 +1,12 @@
+#ifndef DEBUG_H
+#define DEBUG_H
+
+#include <gtk/gtk.h>
+
+extern GtkWidget* DebugPage;
+
+// Hidden page with live backend statistics; opened with Ctrl+Shift+D
+void change_panel_to_debug(gpointer);
+static void debug_to_stack(GtkStack*);
+
+#endif
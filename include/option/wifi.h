@@ -7,5 +7,6 @@ extern GtkWidget* WifiPage;
 
 void change_panel_to_wifi(gpointer);
 static void wiifi_to_stack(GtkStack*);
+void cleanup_wifi(void);
 
 #endif
@@ -0,0 +1,114 @@
+#ifndef PARSE_H
+#define PARSE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Helpers for reading backend output in place. A StrView points into a
+// buffer owned by someone else and is not NUL-terminated; nothing here
+// allocates except the LineFeeder's carry-over of a partial line. Plain C so
+// the benchmarks and fuzzers build without GTK.
+typedef struct {
+  const char *data;
+  size_t len;
+} StrView;
+
+StrView str_view(const char *string);
+StrView str_view_strip(StrView view);
+bool str_view_equal(StrView view, const char *string);
+bool str_view_has_prefix(StrView view, const char *prefix);
+bool str_view_has_suffix(StrView view, const char *suffix);
+// Offset of the first occurrence, or -1
+long str_view_find(StrView view, const char *needle);
+long str_view_find_char(StrView view, char c);
+// Drop the first n bytes (all of them if n is past the end)
+StrView str_view_skip(StrView view, size_t n);
+// Split at the first c: *head gets what precedes it, the view what follows.
+// Returns false and leaves the view alone if c does not occur.
+bool str_view_split(StrView *view, char c, StrView *head);
+
+// Consume leading blanks and the run of non-blanks after them. Returns false
+// if only blanks are left.
+bool str_view_take_word(StrView *view, StrView *word);
+
+// Consume leading blanks and a decimal integer. Returns false without
+// consuming anything if there are no digits.
+bool str_view_take_int(StrView *view, long *value);
+// Consume a decimal such as "59.94" as thousandths (59940), rounding any
+// further digits
+bool str_view_take_milli(StrView *view, long *value);
+
+// Copy into a NUL-terminated buffer, truncating; returns the copied length
+size_t str_view_copy(StrView view, char *buffer, size_t size);
+
+// Iterate over the lines of a complete buffer. Lines exclude their "\n" and
+// any trailing "\r"; a final line without a newline is still returned.
+typedef struct {
+  const char *pos;
+  const char *end;
+} LineReader;
+
+void line_reader_init(LineReader *reader, const char *data, size_t len);
+bool line_reader_next(LineReader *reader, StrView *line);
+
+// Split a stream that arrives in arbitrary chunks into lines. Complete lines
+// are handed out as views into the chunk itself; only a line cut by a chunk
+// boundary is copied, into a buffer that is reused between feeds.
+typedef void (*LineFunc)(StrView line, void *user_data);
+
+typedef struct {
+  char *partial;
+  size_t partial_len;
+  size_t partial_size;
+} LineFeeder;
+
+void line_feeder_init(LineFeeder *feeder);
+void line_feeder_feed(LineFeeder *feeder, const char *data, size_t len,
+                      LineFunc callback, void *user_data);
+// Emit whatever is left once the stream ended without a final newline
+void line_feeder_flush(LineFeeder *feeder, LineFunc callback,
+                       void *user_data);
+void line_feeder_clear(LineFeeder *feeder);
+
+// Split one line of `nmcli -t` output on the ':' separators that are not
+// escaped. Fields still contain their "\:" and "\\" escapes. Returns the
+// number of fields found, of which at most max are stored.
+size_t nmcli_split(StrView line, StrView *fields, size_t max);
+// Resolve the escapes of one field into buffer; returns the written length
+size_t nmcli_unescape(StrView field, char *buffer, size_t size);
+
+// Split "  Key: value" (pactl list, bluetoothctl info, brightnessctl) at the
+// first ':' into stripped key and value. Returns false if there is no ':'.
+bool parse_key_value(StrView line, StrView *key, StrView *value);
+
+typedef struct {
+  int width;
+  int height;
+  long refresh_mhz; // 59.94 Hz is 59940
+  bool current;
+  bool preferred;
+} ModeLine;
+
+// "   1920x1080     60.00*+  59.94    50.00" from xrandr. The refresh is the
+// current rate if the line has one, otherwise the first listed.
+bool parse_xrandr_mode(StrView line, ModeLine *mode);
+// "    1920x1080 px, 60.000000 Hz (preferred, current)" from wlr-randr
+bool parse_wlr_randr_mode(StrView line, ModeLine *mode);
+
+// "update: id:0 key:'clock.rate' value:'48000' type:''" from pw-metadata
+bool parse_pw_metadata(StrView line, StrView *key, StrView *value);
+
+typedef struct {
+  long id;
+  long quantum;
+  long rate;
+  long errors;  // xruns the profiler counted for the node
+  bool driver;  // followers are listed under their driver as "+ name"
+  StrView name;
+} PwTopNode;
+
+// One node line of `pw-top -b`:
+// "R   30   1024  48000  35.2us  12.1us  0.03  0.01    0  S32LE 2 48000 alsa_output.pci"
+bool parse_pw_top_node(StrView line, PwTopNode *node);
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef WIFI_ATTEMPT_H
+#define WIFI_ATTEMPT_H
+
+#include "wifi/nm.h"
+#include <gio/gio.h>
+
+// The latest attempt to join a Wi-Fi network, from the click until it is
+// connected, failed, cancelled or timed out. Everything runs on the main
+// loop, so nothing waits for the radio or DHCP. With NetworkManager it
+// follows the device through its states; with nmcli only the start and
+// the outcome are known. A new attempt replaces the one before, as the
+// device can only join one network at a time. Main thread only.
+
+typedef enum {
+  WIFI_ATTEMPT_NONE,           // nothing tried yet
+  WIFI_ATTEMPT_STARTING,       // the request is on its way
+  WIFI_ATTEMPT_ASSOCIATING,
+  WIFI_ATTEMPT_AUTHENTICATING,
+  WIFI_ATTEMPT_OBTAINING_IP,
+  WIFI_ATTEMPT_CONNECTED,
+  WIFI_ATTEMPT_FAILED,
+  WIFI_ATTEMPT_CANCELLED,
+  WIFI_ATTEMPT_TIMED_OUT,
+} WifiAttemptState;
+
+// Called on every change of state
+typedef void (*WifiAttemptFunc)(gpointer user_data);
+void wifi_attempt_set_changed_func(WifiAttemptFunc func, gpointer user_data);
+
+// Called when NetworkManager failed the attempt for want of a password, a
+// new network's or one a saved profile no longer has right, so it can be
+// asked for and tried again. ap_path is the access point the attempt was
+// for, possibly NULL. The attempt is already FAILED by then.
+typedef void (*WifiAttemptSecretsFunc)(const gchar *ssid,
+                                       WifiSecurity security,
+                                       const gchar *ap_path,
+                                       gpointer user_data);
+void wifi_attempt_set_secrets_func(WifiAttemptSecretsFunc func,
+                                   gpointer user_data);
+
+// Join the network of the access point at ap_path through NetworkManager,
+// with a new connection. password is NULL for open networks.
+void wifi_attempt_start(const gchar *ssid, WifiSecurity security,
+                        const gchar *ap_path, const gchar *password);
+// The same with the saved profile of this UUID, which has the secrets, or
+// gets password as its new one when that is not NULL
+void wifi_attempt_start_profile(const gchar *ssid, WifiSecurity security,
+                                const gchar *uuid, const gchar *ap_path,
+                                const gchar *password);
+// The same through `nmcli device wifi connect`
+void wifi_attempt_start_nmcli(const gchar *ssid, WifiSecurity security,
+                              const gchar *password);
+
+// Gives up on the attempt in flight, taking down what was activated so far
+void wifi_attempt_cancel(void);
+
+WifiAttemptState wifi_attempt_get_state(void);
+// Whether the state is one before the outcome
+gboolean wifi_attempt_in_progress(void);
+// Whether the latest attempt was for this network
+gboolean wifi_attempt_is_for(const gchar *ssid, WifiSecurity security);
+// The state for people, with the reason once it failed; NULL for
+// WIFI_ATTEMPT_NONE
+const gchar *wifi_attempt_get_label(void);
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef WIFI_HISTORY_H
+#define WIFI_HISTORY_H
+
+#include <glib.h>
+
+// Link quality over time, per access point (BSSID): signal strength and
+// frequency of every access point in range, and the bit rate of the one
+// in use. Samples are taken when the backend reports a value, at most one
+// per WIFI_HISTORY_INTERVAL seconds per access point, so nothing wakes up
+// to poll. Each access point keeps its last WIFI_HISTORY_SAMPLES samples
+// in a ring of about 1.5 KB. Main thread only.
+
+#define WIFI_HISTORY_SAMPLES 128
+#define WIFI_HISTORY_INTERVAL 10
+
+typedef struct {
+  guint32 time;      // seconds on the monotonic clock
+  guint16 bitrate;   // Mbit/s, 0 when not in use
+  guint16 frequency; // MHz, 0 if unknown
+  guint8 strength;   // percent
+} WifiSample;
+
+typedef struct _WifiHistory WifiHistory;
+
+// bitrate is in kbit/s, as NetworkManager has it
+void wifi_history_record(const gchar *bssid, guint strength, guint32 bitrate,
+                         guint32 frequency);
+
+// NULL for an access point without samples
+const WifiHistory *wifi_history_lookup(const gchar *bssid);
+guint wifi_history_length(const WifiHistory *history);
+// Oldest first
+const WifiSample *wifi_history_nth(const WifiHistory *history, guint index);
+
+// Called after each sample, with the access point's BSSID
+typedef void (*WifiHistoryFunc)(const gchar *bssid, gpointer user_data);
+guint wifi_history_listen(WifiHistoryFunc func, gpointer user_data);
+void wifi_history_unlisten(guint id);
+
+#endif
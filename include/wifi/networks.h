@@ -0,0 +1,57 @@
+#ifndef WIFI_NETWORKS_H
+#define WIFI_NETWORKS_H
+
+#include "wifi/nm.h"
+#include <gio/gio.h>
+
+// The Wi-Fi networks in range, as a list model with one item per SSID and
+// security. Access points (BSSIDs) of the same network fold into its item,
+// which shows the strongest of them. Backends feed it one access point at a
+// time, so a scan changes only the items whose network changed and bound
+// rows keep their widgets. Main thread only.
+
+#define WIFI_TYPE_NETWORK_ITEM (wifi_network_item_get_type())
+G_DECLARE_FINAL_TYPE(WifiNetworkItem, wifi_network_item, WIFI, NETWORK_ITEM,
+                     GObject)
+
+// Properties: "ssid", "security", "strength", "access-point", "bssid",
+// "last-used"
+const gchar *wifi_network_item_get_ssid(WifiNetworkItem *item);
+WifiSecurity wifi_network_item_get_security(WifiNetworkItem *item);
+guint wifi_network_item_get_strength(WifiNetworkItem *item);
+// D-Bus path of the strongest access point, NULL for networks from nmcli
+const gchar *wifi_network_item_get_access_point(WifiNetworkItem *item);
+// Hardware address of the strongest access point, if known
+const gchar *wifi_network_item_get_bssid(WifiNetworkItem *item);
+// Unix time the saved profile for it was last used, 0 for none
+guint64 wifi_network_item_get_last_used(WifiNetworkItem *item);
+
+// Signal bars, 0 (weak) to 3 (excellent), for a strength in percent
+guint wifi_signal_bars(guint strength);
+
+// Model of WifiNetworkItem, owned by the list. Saved networks first, most
+// recently used first; then strongest bars, then by name, so signal jitter
+// within a bar moves no rows.
+GListModel *wifi_network_list(void);
+
+// Where last-used comes from; without one every network is unsaved. Call
+// wifi_networks_rerank() when its answers change.
+typedef guint64 (*WifiLastUsedFunc)(const gchar *ssid, WifiSecurity security);
+void wifi_networks_set_last_used_func(WifiLastUsedFunc func);
+void wifi_networks_rerank(void);
+
+// Add or update one access point, keyed by its path or, without one, its
+// BSSID. Hidden networks are left out.
+void wifi_networks_update(const WifiAccessPoint *ap);
+void wifi_networks_remove(const gchar *key);
+
+// For backends that only get full listings: update every access point
+// between the two calls, and end() removes the ones not seen since begin().
+// end() returns whether a network came, went or changed its bars, which
+// is what the list shows; strength within the same bars does not count.
+void wifi_networks_begin(void);
+gboolean wifi_networks_end(void);
+
+void wifi_networks_clear(void);
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef WIFI_NM_H
+#define WIFI_NM_H
+
+#include <gio/gio.h>
+
+// In-process client for NetworkManager over its D-Bus API on the system bus.
+// It uses the first Wi-Fi device, keeps that device's access points in
+// memory, follows AccessPointAdded/AccessPointRemoved and every access
+// point's property changes, and tells listeners about each. The saved Wi-Fi
+// connection profiles are cached the same way, so known networks can be
+// joined without asking for their password again. Main thread only.
+
+typedef enum {
+  WIFI_SECURITY_NONE,
+  WIFI_SECURITY_WEP,
+  WIFI_SECURITY_PSK,
+  WIFI_SECURITY_SAE,
+  WIFI_SECURITY_ENTERPRISE, // 802.1X, which needs more than a password
+} WifiSecurity;
+
+typedef struct {
+  gchar *path;  // D-Bus object path, stable while the access point is seen
+  gchar *ssid;  // valid UTF-8, empty for a hidden network
+  gchar *bssid;
+  WifiSecurity security;
+  guint8 strength;     // percent
+  guint32 frequency;   // MHz
+  guint32 max_bitrate; // kbit/s
+} WifiAccessPoint;
+
+// A saved Wi-Fi connection profile
+typedef struct {
+  gchar *path; // D-Bus object path of the settings connection
+  gchar *uuid;
+  gchar *id;   // the profile's name, often the SSID
+  gchar *ssid; // valid UTF-8
+  WifiSecurity security;
+  guint64 timestamp; // last successful activation, seconds since the epoch,
+                     // 0 if never
+} WifiProfile;
+
+typedef enum {
+  WIFI_NM_CONNECTING,
+  WIFI_NM_READY,  // a Wi-Fi device was found and its access points listed
+  WIFI_NM_FAILED, // no NetworkManager or no Wi-Fi device
+} WifiNmState;
+
+// What the device is doing, from NetworkManager's device states
+typedef enum {
+  WIFI_LINK_UNAVAILABLE, // radio off or device not managed
+  WIFI_LINK_DISCONNECTED,
+  WIFI_LINK_ASSOCIATING,    // prepare and config
+  WIFI_LINK_AUTHENTICATING, // need-auth
+  WIFI_LINK_CONFIGURING,    // ip-config, ip-check and secondaries
+  WIFI_LINK_CONNECTED,
+  WIFI_LINK_FAILED,
+} WifiLink;
+
+typedef enum {
+  WIFI_CHANGE_STATE,      // see wifi_nm_get_state(); access points are
+                          // dropped when NetworkManager goes away
+  WIFI_CHANGE_RADIO,      // see wifi_nm_get_radio()
+  WIFI_CHANGE_AP,         // access point was added or changed
+  WIFI_CHANGE_AP_REMOVED, // access point is about to be freed
+  WIFI_CHANGE_LINK,       // the link or the active access point changed
+  WIFI_CHANGE_PROFILES,   // saved profiles were loaded, added, changed or
+                          // removed
+} WifiChange;
+
+// ap is set for WIFI_CHANGE_AP and WIFI_CHANGE_AP_REMOVED only
+typedef void (*WifiNmFunc)(WifiChange change, const WifiAccessPoint *ap,
+                           gpointer user_data);
+
+// Start following NetworkManager; does nothing after the first call. It is
+// picked up again whenever it (re)appears on the bus.
+void wifi_nm_connect(void);
+WifiNmState wifi_nm_get_state(void);
+
+guint wifi_nm_listen(WifiNmFunc func, gpointer user_data);
+void wifi_nm_unlisten(guint id);
+
+// Access points in no particular order. Free the array with
+// g_ptr_array_unref(); the access points belong to the client and stay valid
+// until their REMOVED change.
+GPtrArray *wifi_nm_access_points(void);
+const WifiAccessPoint *wifi_nm_lookup(const gchar *path);
+// The access point the device is using or activating, or NULL
+const WifiAccessPoint *wifi_nm_active(void);
+WifiLink wifi_nm_get_link(void);
+// kbit/s the device sends at while connected, 0 otherwise. Changes arrive
+// as WIFI_CHANGE_LINK.
+guint32 wifi_nm_get_bitrate(void);
+// Why the link is WIFI_LINK_FAILED, for people; NULL while it is not
+const gchar *wifi_nm_get_failure(void);
+// Whether the link failed for want of a (right) password
+gboolean wifi_nm_failure_needs_secrets(void);
+
+// The result arrives as WIFI_CHANGE_RADIO; a refused change reports the
+// unchanged state so switches can flip back
+gboolean wifi_nm_get_radio(void);
+void wifi_nm_set_radio(gboolean enabled);
+
+// New results arrive as access point changes. NetworkManager refuses scans
+// that follow the last one too closely, which is not an error here.
+void wifi_nm_request_scan(void);
+
+// The most recently used saved profile for a network, or NULL. WPA2 and WPA3
+// personal profiles stand in for each other, as transition mode networks
+// offer both.
+const WifiProfile *wifi_nm_lookup_profile(const gchar *ssid,
+                                          WifiSecurity security);
+
+// Add a connection for the access point's network and activate it.
+// password is the PSK or WEP key, NULL for open networks. Completes once
+// NetworkManager took the request, with the active connection's object
+// path; progress follows as WIFI_CHANGE_LINK. The connection is deleted
+// again if this first activation fails, so a wrong password is not saved.
+void wifi_nm_activate_async(const gchar *ap_path, const gchar *password,
+                            GCancellable *cancellable,
+                            GAsyncReadyCallback callback, gpointer user_data);
+gchar *wifi_nm_activate_finish(GAsyncResult *result, GError **error);
+
+// Activate the saved profile with this UUID on the access point, with the
+// secrets NetworkManager already has, or with password saved into the
+// profile first when it is not NULL. ap_path may be NULL to let it pick an
+// access point. Finish with wifi_nm_activate_finish().
+void wifi_nm_activate_profile_async(const gchar *uuid, const gchar *ap_path,
+                                    const gchar *password,
+                                    GCancellable *cancellable,
+                                    GAsyncReadyCallback callback,
+                                    gpointer user_data);
+
+// Take down an active connection, such as one still being activated.
+// Failures are logged; the link changes tell the outcome.
+void wifi_nm_deactivate(const gchar *active_connection);
+
+#endif
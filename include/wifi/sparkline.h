@@ -0,0 +1,19 @@
+#ifndef WIFI_SPARKLINE_H
+#define WIFI_SPARKLINE_H
+
+#include <gtk/gtk.h>
+
+// Signal strength of one access point from its history, one bar per
+// sample with the newest on the right, and a tick where the frequency
+// changed. It redraws only when that access point gets a sample; the
+// tooltip has the numbers.
+
+#define WIFI_TYPE_SPARKLINE (wifi_sparkline_get_type())
+G_DECLARE_FINAL_TYPE(WifiSparkline, wifi_sparkline, WIFI, SPARKLINE,
+                     GtkWidget)
+
+GtkWidget *wifi_sparkline_new(void);
+// NULL shows nothing
+void wifi_sparkline_set_bssid(WifiSparkline *self, const gchar *bssid);
+
+#endif
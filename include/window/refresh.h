@@ -0,0 +1,34 @@
+#ifndef WINDOW_REFRESH_H
+#define WINDOW_REFRESH_H
+
+#include <gtk/gtk.h>
+
+// Periodic refreshes of what a page shows, run only while someone can see
+// it: the page is mapped (the visible child of its stack) and its window is
+// the active one. A run whose results match the last one doubles the wait
+// before the next, up to a limit; a change goes back to the base interval.
+// Going out of sight cancels the run in flight. Main thread only.
+
+typedef struct {
+  const gchar *name;  // runs are timed as "refresh <name>"; NULL for none
+  guint interval;     // seconds between runs while results change
+  guint max_interval; // seconds, the backoff limit when they do not
+  // Start a run and finish it with refresh_done(cancellable, ...), also
+  // when it fails; keep a reference to cancellable until then. Results that
+  // arrive after it was cancelled are stale and should be dropped.
+  void (*run)(GCancellable *cancellable, gpointer user_data);
+  // Optional: the page came into or went out of sight, for work that should
+  // only go on meanwhile, such as a device discovery
+  void (*visible)(gboolean visible, gpointer user_data);
+} RefreshJob;
+
+// job must outlive the registration. The first run starts as soon as page is
+// in sight.
+guint refresh_add(GtkWidget *page, const RefreshJob *job, gpointer user_data);
+void refresh_remove(guint id);
+
+// The run that was given cancellable is over; changed says whether it found
+// anything new. Finished or cancelled runs are ignored.
+void refresh_done(GCancellable *cancellable, gboolean changed);
+
+#endif
@@ -2,22 +2,36 @@
 #include <gtk/gtk.h>
 #include <stdio.h>
 #include "option/audio.h"
-#include "command/command.h"
-
-#define MAX_SINKS 16
-#define MAX_DESC_LENGTH 256
+#include "audio/latency.h"
+#include "capability/capability.h"
+#include "audio/mixer.h"
+#include "audio/pulse.h"
+#include "audio/registry.h"
+#include "command/cache.h"
+#include "command/coprocess.h"
+#include "command/setter.h"
+#include "parse/parse.h"
+
+// Volume and device reads are reused for this long unless we change them
+#define AUDIO_QUERY_TTL 2000
+// Bursts of server events collapse into one refresh after this quiet period
+#define AUDIO_EVENT_DEBOUNCE 100
+// Change events this soon after one of our own writes are its echo
+#define AUDIO_WRITE_ECHO_US (500 * G_TIME_SPAN_MILLISECOND)
 
 GtkWidget *AudioPage;
 
-typedef struct {
-  uint32_t index;
-  char description[256];
-} SinkInfo;
-
-SinkInfo *sinks;    // Array to store sink information
-SinkInfo *sources;    // Array to store source information
-int sink_count = 0; // Counter for the number of sinks
-int source_count = 0; // Counter for the number of source
+static GtkRange *SinkSlider = NULL;
+static GtkRange *SourceSlider = NULL;
+static AdwComboRow *SinkCombo = NULL;
+static AdwComboRow *SourceCombo = NULL;
+static GtkWidget *StreamsGroup = NULL;
+static guint refresh_source_id = 0;
+static gint64 last_write_time = 0;
+// Set when no sound server answered over libpulse; the page then runs pactl
+static gboolean use_pactl = FALSE;
+static gboolean pulse_was_ready = FALSE;
+static guint pulse_listener = 0;
 
 void change_panel_to_audio(gpointer user_data) {
   GtkStack *stack = GTK_STACK(user_data);
@@ -25,64 +39,205 @@ void change_panel_to_audio(gpointer user_data) {
   gtk_stack_set_visible_child_name(stack, "audio_page");
 }
 
-int current_sink_volume() {
-  char *result = execute_command("pactl get-sink-volume @DEFAULT_SINK@");
-  int volume;
+// Parse the first channel percentage out of `pactl get-*-volume`
+static int parse_volume(const char *output) {
+  StrView rest = str_view(output);
+  long slash = str_view_find_char(rest, '/');
+  long volume = 0;
+
+  if (slash >= 0) {
+    rest = str_view_skip(rest, slash + 1);
+    str_view_take_int(&rest, &volume);
+  }
+  return (int)volume;
+}
+
+// Feed the "<kind> #N" headers with their Name and Description lines from
+// `pactl list` into the registry
+static void parse_devices(const CommandResult *result, const char *kind,
+                          AudioDirection direction) {
+  gsize kind_len = strlen(kind);
+  AudioDevice device = {direction};
+  gboolean in_device = FALSE;
+  LineReader reader;
+  StrView line, key, value;
+
+  audio_registry_begin(direction);
+  line_reader_init(&reader, result->out, result->out_len);
+  while (line_reader_next(&reader, &line)) {
+    StrView header = str_view_skip(line, kind_len);
+    long index = 0;
+
+    if (str_view_has_prefix(line, kind) && str_view_has_prefix(header, " #")) {
+      header = str_view_skip(header, 2);
+      in_device = str_view_take_int(&header, &index);
+      device.index = (guint32)index;
+      g_clear_pointer(&device.name, g_free);
+    } else if (in_device && parse_key_value(line, &key, &value)) {
+      if (str_view_equal(key, "Name")) {
+        g_free(device.name);
+        device.name = g_strndup(value.data, value.len);
+      } else if (str_view_equal(key, "Description")) {
+        device.description = g_strndup(value.data, value.len);
+        audio_registry_update(&device);
+        g_clear_pointer(&device.description, g_free);
+        in_device = FALSE;
+      }
+    }
+  }
+  g_free(device.name);
+  audio_registry_end(direction);
+}
+
+static void on_volume_changed(GtkRange *range, gpointer user_data);
+static void on_mic_volume_changed(GtkRange *range, gpointer user_data);
+void on_output_device_changed(AdwComboRow *combo, gpointer user_data);
+void on_input_device_changed(AdwComboRow *combo, gpointer user_data);
 
-  char *line = strtok(result, "\n");
-  /* sscanf(line, "%*[^/]/%d%%%*[^/]/%d%%", &volume, &volume); */
-  sscanf(line, "%*[^/]/%d", &volume);
-  return volume;
+// Registry changes move the rows' selection; that is not a user choice
+static void block_device_rows(void) {
+  g_signal_handlers_block_by_func(SinkCombo, on_output_device_changed, NULL);
+  g_signal_handlers_block_by_func(SourceCombo, on_input_device_changed, NULL);
 }
 
-int current_source_volume() {
-  char *result = execute_command("pactl get-source-volume @DEFAULT_SOURCE@");
-  int volume;
+static void select_default(AdwComboRow *combo, AudioDirection direction) {
+  AudioDeviceItem *item = audio_registry_get_default(direction);
+  GListModel *model = adw_combo_row_get_model(combo);
+  guint position;
 
-  char *line = strtok(result, "\n");
-  /* sscanf(line, "%*[^/]/%d%%%*[^/]/%d%%", &volume, &volume); */
-  sscanf(line, "%*[^/]/%d", &volume);
-  return volume;
+  if (item != NULL &&
+      g_list_store_find(G_LIST_STORE(model), item, &position))
+    adw_combo_row_set_selected(combo, position);
 }
 
-void get_audio_sources(GtkStringList *sink_list) {
-  char *output =
-      execute_command("pactl list sinks | grep -E \"Sink #|Description:\" | "
-                      "awk '/Sink #/{idx=$2} /Description:/{print idx, $0}'");
+// Put the selection back on the default devices and unmute the rows
+static void unblock_device_rows(void) {
+  select_default(SinkCombo, AUDIO_SINK);
+  select_default(SourceCombo, AUDIO_SOURCE);
+  g_signal_handlers_unblock_by_func(SinkCombo, on_output_device_changed, NULL);
+  g_signal_handlers_unblock_by_func(SourceCombo, on_input_device_changed, NULL);
+}
+
+static void on_sink_volume_ready(GObject *source, GAsyncResult *res,
+                                 gpointer user_data) {
+  GtkRange *slider = GTK_RANGE(user_data);
+  g_autoptr(GError) error = NULL;
+  g_autoptr(CommandResult) result = command_query_finish(res, &error);
+
+  if (error) {
+    g_printerr("Failed to read sink volume: %s\n", error->message);
+    return;
+  }
+
+  // Don't echo the value we just read back to pactl
+  g_signal_handlers_block_by_func(slider, on_volume_changed, NULL);
+  gtk_range_set_value(slider, parse_volume(result->out));
+  g_signal_handlers_unblock_by_func(slider, on_volume_changed, NULL);
+}
+
+static void on_source_volume_ready(GObject *source, GAsyncResult *res,
+                                   gpointer user_data) {
+  GtkRange *slider = GTK_RANGE(user_data);
+  g_autoptr(GError) error = NULL;
+  g_autoptr(CommandResult) result = command_query_finish(res, &error);
+
+  if (error) {
+    g_printerr("Failed to read source volume: %s\n", error->message);
+    return;
+  }
+
+  g_signal_handlers_block_by_func(slider, on_mic_volume_changed, NULL);
+  gtk_range_set_value(slider, parse_volume(result->out));
+  g_signal_handlers_unblock_by_func(slider, on_mic_volume_changed, NULL);
+}
 
-  sinks = malloc(10 * sizeof(SinkInfo));
+static void on_sinks_ready(GObject *source, GAsyncResult *res,
+                           gpointer user_data) {
+  g_autoptr(GError) error = NULL;
+  g_autoptr(CommandResult) result = command_query_finish(res, &error);
 
-  char *line = strtok(output, "\n"); // Split output into lines
-  while (line) {
-    SinkInfo s;
-    sscanf(line, "#%d Description: %[^\n]", &s.index, &s.description);
-    gtk_string_list_append(sink_list, s.description);
-    line = strtok(NULL, "\n"); // Split output into lines
-    sinks[sink_count] = s;
-    sink_count++;
-    g_print("Found sink: %s\n", line);
-    
+  if (error) {
+    g_printerr("Failed to list sinks: %s\n", error->message);
+    return;
   }
-  g_print("\n");
+
+  block_device_rows();
+  parse_devices(result, "Sink", AUDIO_SINK);
+  unblock_device_rows();
 }
 
-void get_audio_sources_mic(GtkStringList *source_list) {
-  char *output =
-      execute_command("pactl list sources | grep -E \"Source #|Description:\" | "
-                      "awk '/Source #/{idx=$2} /Description:/{print idx, $0}'");
+static void on_sources_ready(GObject *source, GAsyncResult *res,
+                             gpointer user_data) {
+  g_autoptr(GError) error = NULL;
+  g_autoptr(CommandResult) result = command_query_finish(res, &error);
+
+  if (error) {
+    g_printerr("Failed to list sources: %s\n", error->message);
+    return;
+  }
+
+  block_device_rows();
+  parse_devices(result, "Source", AUDIO_SOURCE);
+  unblock_device_rows();
+}
 
-  sources = malloc(15 * sizeof(SinkInfo));
-  
-  char *line = strtok(output, "\n");
-  while (line) {
-    SinkInfo s;
-    // Parse the line containing index and description
-    sscanf(line, "#%d Description: %[^\n]", &s.index, &s.description);
-    gtk_string_list_append(source_list, s.description);
-    line = strtok(NULL, "\n");
-    sources[source_count] = s;
-    source_count++;
+// `pactl get-default-sink` and `get-default-source` print the bare name
+static void on_default_ready(GObject *source, GAsyncResult *res,
+                             gpointer user_data) {
+  AudioDirection direction = GPOINTER_TO_INT(user_data);
+  g_autoptr(GError) error = NULL;
+  g_autoptr(CommandResult) result = command_query_finish(res, &error);
+  g_autofree gchar *name = NULL;
+
+  if (error || !command_result_success(result)) {
+    g_printerr("Failed to read the default %s: %s\n",
+               direction == AUDIO_SINK ? "sink" : "source",
+               error ? error->message : "pactl failed");
+    return;
   }
+
+  name = g_strstrip(g_strdup(result->out != NULL ? result->out : ""));
+  block_device_rows();
+  audio_registry_set_default(direction, *name != '\0' ? name : NULL);
+  unblock_device_rows();
+}
+
+typedef struct {
+  AudioDirection direction;
+  guint32 index;
+  gint percent;
+} PulseVolumeWrite;
+
+static void on_pulse_volume_written(gboolean success, gpointer user_data) {
+  command_set_done(user_data, success);
+}
+
+static void write_pulse_volume(const gchar *target, gpointer data) {
+  PulseVolumeWrite *write = data;
+
+  if (!audio_pulse_set_volume(write->direction, write->index, write->percent,
+                              on_pulse_volume_written, (gpointer)target))
+    command_set_done(target, FALSE);
+}
+
+// One libpulse write per device in flight; a drag sends the latest position
+// once the server answered the previous one
+static void queue_pulse_volume(AudioDirection direction, gint percent) {
+  AudioDeviceItem *device = audio_registry_get_default(direction);
+  PulseVolumeWrite *write;
+  g_autofree gchar *target = NULL;
+
+  if (device == NULL)
+    return;
+
+  write = g_new(PulseVolumeWrite, 1);
+  write->direction = direction;
+  write->index = audio_device_item_get_index(device);
+  write->percent = percent;
+  target = g_strdup_printf("%s-volume-%u",
+                           direction == AUDIO_SINK ? "sink" : "source",
+                           write->index);
+  command_set_func(target, write_pulse_volume, write, g_free);
 }
 
 // Callback function for when the slider value changes
@@ -90,12 +245,17 @@ static void on_volume_changed(GtkRange *range, gpointer user_data) {
   // Get the current value of the slider
   int volume = (int)gtk_range_get_value(range);
 
-  // adjust the system volume using a command-line tool (e.g., `amixer` or
-  // `pactl`)
-  char command[256];
-  snprintf(command, sizeof(command),
-           "pactl set-sink-volume @DEFAULT_SINK@ %d%%", volume);
-  system(command);
+  last_write_time = g_get_monotonic_time();
+  if (!use_pactl) {
+    queue_pulse_volume(AUDIO_SINK, volume);
+    return;
+  }
+
+  gchar *level = g_strdup_printf("%d%%", volume);
+  const gchar *argv[] = {"pactl", "set-sink-volume", "@DEFAULT_SINK@", level,
+                         NULL};
+  command_set("sink-volume", argv);
+  g_free(level);
 }
 
 // Callback function for when the slider value changes
@@ -103,47 +263,205 @@ static void on_mic_volume_changed(GtkRange *range, gpointer user_data) {
   // Get the current value of the slider
   int volume = (int)gtk_range_get_value(range);
 
-  // adjust the system volume using a command-line tool (e.g., `amixer` or
-  // `pactl`)
-  char command[256];
-  snprintf(command, sizeof(command), "pactl set-source-volume @DEFAULT_SOURCE@ %d%%", volume);
-  system(command);
+  last_write_time = g_get_monotonic_time();
+  if (!use_pactl) {
+    queue_pulse_volume(AUDIO_SOURCE, volume);
+    return;
+  }
+
+  gchar *level = g_strdup_printf("%d%%", volume);
+  const gchar *argv[] = {"pactl", "set-source-volume", "@DEFAULT_SOURCE@",
+                         level, NULL};
+  command_set("source-volume", argv);
+  g_free(level);
 }
 
 // Callback function when output device selection changes
 void on_output_device_changed(AdwComboRow *combo, gpointer user_data) {
-  GtkStringList *sink_list = GTK_STRING_LIST(adw_combo_row_get_model(combo));
-  guint selected_index = adw_combo_row_get_selected(combo);
+  AudioDeviceItem *item = adw_combo_row_get_selected_item(combo);
 
-  if (selected_index == GTK_INVALID_LIST_POSITION) {
+  if (item == NULL) {
     g_print("No device selected.\n");
     return;
   }
 
-  int index = sinks[selected_index].index;
+  last_write_time = g_get_monotonic_time();
+  if (!use_pactl) {
+    audio_pulse_set_default(AUDIO_SINK, audio_device_item_get_index(item));
+    return;
+  }
 
-  char command[512];
-  sprintf(command, "pactl set-default-sink %d", index);
-  execute_command(command);
+  gchar *index = g_strdup_printf("%u", audio_device_item_get_index(item));
+  const gchar *argv[] = {"pactl", "set-default-sink", index, NULL};
+  command_set("default-sink", argv);
+  g_free(index);
 }
 
-// Callback function when output device selection changes
+// Callback function when input device selection changes
 void on_input_device_changed(AdwComboRow *combo, gpointer user_data) {
-  GtkStringList *sink_list = GTK_STRING_LIST(adw_combo_row_get_model(combo));
-  guint selected_index = adw_combo_row_get_selected(combo);
+  AudioDeviceItem *item = adw_combo_row_get_selected_item(combo);
 
-  if (selected_index == GTK_INVALID_LIST_POSITION) {
+  if (item == NULL) {
     g_print("No device selected.\n");
     return;
   }
 
-  int index = sources[selected_index].index;
-  g_print("index is %d", index);
-  g_print("source is %s", sources[selected_index].description);
+  last_write_time = g_get_monotonic_time();
+  if (!use_pactl) {
+    audio_pulse_set_default(AUDIO_SOURCE, audio_device_item_get_index(item));
+    return;
+  }
+
+  gchar *index = g_strdup_printf("%u", audio_device_item_get_index(item));
+  const gchar *argv[] = {"pactl", "set-default-source", index, NULL};
+  command_set("default-source", argv);
+  g_free(index);
+}
+
+// Read volumes and devices into the page; the change handlers are muted while
+// the results are applied
+static void refresh_audio(void) {
+  const gchar *sink_volume_argv[] = {"pactl", "get-sink-volume", "@DEFAULT_SINK@", NULL};
+  const gchar *source_volume_argv[] = {"pactl", "get-source-volume", "@DEFAULT_SOURCE@", NULL};
+  const gchar *sinks_argv[] = {"pactl", "list", "sinks", NULL};
+  const gchar *sources_argv[] = {"pactl", "list", "sources", NULL};
+  const gchar *default_sink_argv[] = {"pactl", "get-default-sink", NULL};
+  const gchar *default_source_argv[] = {"pactl", "get-default-source", NULL};
+
+  command_query_async(sink_volume_argv, AUDIO_QUERY_TTL, NULL, on_sink_volume_ready, SinkSlider);
+  command_query_async(source_volume_argv, AUDIO_QUERY_TTL, NULL, on_source_volume_ready, SourceSlider);
+  command_query_async(sinks_argv, AUDIO_QUERY_TTL, NULL, on_sinks_ready, SinkCombo);
+  command_query_async(sources_argv, AUDIO_QUERY_TTL, NULL, on_sources_ready, SourceCombo);
+  command_query_async(default_sink_argv, AUDIO_QUERY_TTL, NULL, on_default_ready,
+                      GINT_TO_POINTER(AUDIO_SINK));
+  command_query_async(default_source_argv, AUDIO_QUERY_TTL, NULL,
+                      on_default_ready, GINT_TO_POINTER(AUDIO_SOURCE));
+}
+
+static gboolean on_refresh_due(gpointer user_data) {
+  refresh_source_id = 0;
+  refresh_audio();
+  return G_SOURCE_REMOVE;
+}
+
+// One line of `pactl subscribe`, e.g. "Event 'change' on sink #52"
+static void on_pulse_event(const gchar *line, gpointer user_data) {
+  gboolean is_change = strstr(line, "'change'") != NULL;
+
+  if (!strstr(line, " on sink") && !strstr(line, " on source") &&
+      !strstr(line, " on server"))
+    return;
+
+  // Our own volume drags would otherwise bounce back into the slider
+  if (is_change &&
+      g_get_monotonic_time() - last_write_time < AUDIO_WRITE_ECHO_US)
+    return;
+
+  command_cache_invalidate("pactl");
+  if (refresh_source_id == 0)
+    refresh_source_id =
+        g_timeout_add(AUDIO_EVENT_DEBOUNCE, on_refresh_due, NULL);
+}
+
+// Show the default device's volume, unless it is the echo of our own drag
+static void apply_pulse_volume(AudioDirection direction) {
+  AudioDeviceItem *item = audio_registry_get_default(direction);
+  GtkRange *slider = direction == AUDIO_SINK ? SinkSlider : SourceSlider;
+  gpointer handler = direction == AUDIO_SINK ? (gpointer)on_volume_changed
+                                             : (gpointer)on_mic_volume_changed;
+
+  if (item == NULL ||
+      g_get_monotonic_time() - last_write_time < AUDIO_WRITE_ECHO_US)
+    return;
+
+  g_signal_handlers_block_by_func(slider, handler, NULL);
+  gtk_range_set_value(slider, audio_device_item_get_volume(item));
+  g_signal_handlers_unblock_by_func(slider, handler, NULL);
+}
+
+static void apply_pulse_default(AudioDirection direction) {
+  const AudioDevice *device = audio_pulse_default(direction);
+  audio_registry_set_default(direction, device ? device->name : NULL);
+}
+
+// Replace the registry's contents with the client's after (re)connecting
+static void sync_from_pulse(void) {
+  block_device_rows();
+  for (AudioDirection direction = AUDIO_SINK; direction <= AUDIO_SOURCE;
+       direction++) {
+    GPtrArray *devices = audio_pulse_devices(direction);
+
+    audio_registry_begin(direction);
+    for (guint i = 0; i < devices->len; i++)
+      audio_registry_update(devices->pdata[i]);
+    audio_registry_end(direction);
+    apply_pulse_default(direction);
+    g_ptr_array_unref(devices);
+  }
+  unblock_device_rows();
+
+  apply_pulse_volume(AUDIO_SINK);
+  apply_pulse_volume(AUDIO_SOURCE);
+}
+
+// Follow the server through the pactl co-process instead of libpulse
+static void start_pactl_fallback(void) {
+  static const gchar *subscribe_argv[] = {"pactl", "subscribe", NULL};
+
+  use_pactl = TRUE;
+  audio_pulse_unlisten(pulse_listener);
+  audio_pulse_disconnect();
+  // pactl has no per-application levels worth polling for
+  gtk_widget_set_visible(StreamsGroup, FALSE);
+
+  if (!capabilities()->pactl) {
+    g_print("No sound server and no pactl to reach one\n");
+    gtk_widget_set_sensitive(AudioPage, FALSE);
+    return;
+  }
+
+  refresh_audio();
+  coprocess_subscribe(coprocess_get(subscribe_argv), "Event ", on_pulse_event,
+                      NULL);
+}
 
-  char command[512];
-  sprintf(command, "pactl set-default-source %d", index);
-  execute_command(command);
+// Every change touches only the affected item of the device rows
+static void on_audio_change(AudioChange change, const AudioDevice *device,
+                            gpointer user_data) {
+  switch (change) {
+  case AUDIO_CHANGE_STATE:
+    if (audio_pulse_get_state() == AUDIO_PULSE_READY) {
+      pulse_was_ready = TRUE;
+      sync_from_pulse();
+    } else if (!pulse_was_ready) {
+      start_pactl_fallback();
+    } else {
+      block_device_rows();
+      audio_registry_clear();
+      unblock_device_rows();
+    }
+    break;
+  case AUDIO_CHANGE_DEVICE:
+    block_device_rows();
+    audio_registry_update(device);
+    unblock_device_rows();
+    if (device == audio_pulse_default(device->direction))
+      apply_pulse_volume(device->direction);
+    break;
+  case AUDIO_CHANGE_REMOVED:
+    block_device_rows();
+    audio_registry_remove(device->direction, device->index);
+    unblock_device_rows();
+    break;
+  case AUDIO_CHANGE_DEFAULT:
+    block_device_rows();
+    apply_pulse_default(AUDIO_SINK);
+    apply_pulse_default(AUDIO_SOURCE);
+    unblock_device_rows();
+    apply_pulse_volume(AUDIO_SINK);
+    apply_pulse_volume(AUDIO_SOURCE);
+    break;
+  }
 }
 
 static void audio_to_stack(GtkStack *stack) {
@@ -181,21 +499,19 @@ static void audio_to_stack(GtkStack *stack) {
     return;
   }
 
-  GtkStringList *sink_list = GTK_STRING_LIST(gtk_builder_get_object(audio_builder, "audio_sink_list"));
-  GtkStringList *sink_list_mic = GTK_STRING_LIST(gtk_builder_get_object(audio_builder, "audio_source_list"));
-
-  GtkAdjustment *adjustment = GTK_ADJUSTMENT(gtk_builder_get_object(audio_builder, "slider"));
-  gtk_adjustment_set_value(adjustment, current_sink_volume());
-
-  GtkAdjustment *adjustment_mic = GTK_ADJUSTMENT(gtk_builder_get_object(audio_builder, "slider_mic"));
-  gtk_adjustment_set_value(adjustment_mic, current_source_volume());
-
-  get_audio_sources(sink_list);
-  get_audio_sources_mic(sink_list_mic);
-
   AdwComboRow *combo = ADW_COMBO_ROW(gtk_builder_get_object(audio_builder, "output_device"));
   AdwComboRow *combo_input = ADW_COMBO_ROW(gtk_builder_get_object(audio_builder, "input_device"));
 
+  // The rows list the registry's devices by description
+  adw_combo_row_set_model(combo, audio_sink_list());
+  adw_combo_row_set_expression(
+      combo, gtk_property_expression_new(AUDIO_TYPE_DEVICE_ITEM, NULL,
+                                         "description"));
+  adw_combo_row_set_model(combo_input, audio_source_list());
+  adw_combo_row_set_expression(
+      combo_input, gtk_property_expression_new(AUDIO_TYPE_DEVICE_ITEM, NULL,
+                                               "description"));
+
   // Connect the selection change event
   g_signal_connect(combo, "notify::selected", G_CALLBACK(on_output_device_changed), NULL);
   g_signal_connect(combo_input, "notify::selected", G_CALLBACK(on_input_device_changed), NULL);
@@ -208,6 +524,21 @@ static void audio_to_stack(GtkStack *stack) {
   GtkWidget *mic_slider = GTK_WIDGET(gtk_builder_get_object(audio_builder, "adjustment_slider_mic"));
   g_signal_connect(mic_slider, "value-changed", G_CALLBACK(on_mic_volume_changed), NULL);
 
+  SinkSlider = GTK_RANGE(slider);
+  SourceSlider = GTK_RANGE(mic_slider);
+  SinkCombo = combo;
+  SourceCombo = combo_input;
+  StreamsGroup = GTK_WIDGET(gtk_builder_get_object(audio_builder, "app_streams"));
+  audio_mixer_attach(
+      GTK_LIST_BOX(gtk_builder_get_object(audio_builder, "app_streams_list")));
+  audio_latency_attach(audio_builder);
+
+  // Talk to the sound server directly and follow its change events; the page
+  // fills in as soon as the initial state arrives. Without a reachable server
+  // this falls back to pactl.
+  pulse_listener = audio_pulse_listen(on_audio_change, NULL);
+  audio_pulse_connect();
+
   gtk_stack_add_named(stack, AudioPage, "audio_page");
   g_object_unref(audio_builder);
 }
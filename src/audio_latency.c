@@ -0,0 +1,378 @@
+#include "audio/latency.h"
+#include "command/cache.h"
+#include "command/setter.h"
+#include "parse/parse.h"
+#include "window/refresh.h"
+#include <adwaita.h>
+#include <errno.h>
+#include <glib/gstdio.h>
+
+#define LATENCY_QUERY_TTL 2000
+// The settings metadata is read again while the page is shown, for a sound
+// server that came up later and for changes made with other tools
+#define LATENCY_PROBE_INTERVAL 30
+#define LATENCY_PROBE_MAX_INTERVAL 120
+// pw-top needs two samples a second apart per poll, so poll slowly, and
+// slower still while the graph stays the same
+#define LATENCY_POLL_INTERVAL 5
+#define LATENCY_POLL_MAX_INTERVAL 40
+#define LATENCY_POLL_TIMEOUT 5000
+// Relative to the user's config directory
+#define LATENCY_DROP_IN "pipewire/pipewire.conf.d/50-systune-latency.conf"
+
+static const guint rates[] = {0, 44100, 48000, 88200, 96000, 176400, 192000};
+static const guint quanta[] = {0,   16,   32,   64,   128, 256,
+                               512, 1024, 2048, 4096, 8192};
+
+// One combo row bound to a key of the "settings" metadata. A value of 0
+// means automatic: the graph picks it from what its clients ask for.
+typedef struct {
+  const gchar *id;       // combo row in audio.ui
+  const gchar *key;      // metadata key set live
+  const gchar *conf_key; // context property in the drop-in
+  const guint *values;
+  gsize n_values;
+  AdwComboRow *combo;
+  long value;
+} ClockControl;
+
+enum { CLOCK_RATE, CLOCK_QUANTUM, CLOCK_MIN_QUANTUM, CLOCK_MAX_QUANTUM };
+
+static ClockControl controls[] = {
+    {"latency_rate", "clock.force-rate", "default.clock.rate", rates,
+     G_N_ELEMENTS(rates)},
+    {"latency_quantum", "clock.force-quantum", "default.clock.quantum", quanta,
+     G_N_ELEMENTS(quanta)},
+    // Bounds are never automatic
+    {"latency_min_quantum", "clock.min-quantum", "default.clock.min-quantum",
+     quanta + 1, G_N_ELEMENTS(quanta) - 1},
+    {"latency_max_quantum", "clock.max-quantum", "default.clock.max-quantum",
+     quanta + 1, G_N_ELEMENTS(quanta) - 1},
+};
+
+static GtkWidget *LatencyGroup = NULL;
+static GtkSwitch *PersistSwitch = NULL;
+static GtkListBox *LatencyDevices = NULL;
+static long running_rate = 0;
+static long running_quantum = 0;
+static GHashTable *last_errors = NULL; // device name -> xruns at last poll
+static gchar *last_nodes = NULL;       // what the last poll showed
+
+static void on_clock_selected(AdwComboRow *combo, GParamSpec *pspec,
+                              gpointer user_data);
+
+static gchar *drop_in_path(void) {
+  return g_build_filename(g_get_user_config_dir(), LATENCY_DROP_IN, NULL);
+}
+
+// Rewrite the drop-in with the current settings; automatic ones are left out
+// so PipeWire's own defaults apply
+static void save_drop_in(void) {
+  g_autofree gchar *path = drop_in_path();
+  g_autofree gchar *dir = g_path_get_dirname(path);
+  g_autoptr(GError) error = NULL;
+  GString *conf = g_string_new("# Written by SysTune; delete to undo\n"
+                               "context.properties = {\n");
+
+  for (gsize i = 0; i < G_N_ELEMENTS(controls); i++) {
+    if (controls[i].value > 0)
+      g_string_append_printf(conf, "    %s = %ld\n", controls[i].conf_key,
+                             controls[i].value);
+  }
+  g_string_append(conf, "}\n");
+
+  if (g_mkdir_with_parents(dir, 0755) != 0 ||
+      !g_file_set_contents(path, conf->str, conf->len, &error))
+    g_printerr("Failed to write %s: %s\n", path,
+               error ? error->message : g_strerror(errno));
+  g_string_free(conf, TRUE);
+}
+
+static void on_persist_changed(GObject *object, GParamSpec *pspec,
+                               gpointer user_data) {
+  g_autofree gchar *path = drop_in_path();
+
+  if (gtk_switch_get_active(PersistSwitch))
+    save_drop_in();
+  else if (g_remove(path) != 0 && errno != ENOENT)
+    g_printerr("Failed to remove %s: %s\n", path, g_strerror(errno));
+}
+
+static void fill_combo(ClockControl *control) {
+  GtkStringList *list = gtk_string_list_new(NULL);
+  gboolean is_rate = control->values == rates;
+
+  for (gsize i = 0; i < control->n_values; i++) {
+    g_autofree gchar *label =
+        control->values[i] == 0
+            ? g_strdup("Automatic")
+            : g_strdup_printf(is_rate ? "%u Hz" : "%u samples",
+                              control->values[i]);
+    gtk_string_list_append(list, label);
+  }
+  adw_combo_row_set_model(control->combo, G_LIST_MODEL(list));
+  g_object_unref(list);
+}
+
+// Show what the graph runs at, which is the forced value if there is one
+static void update_subtitles(void) {
+  long rate = controls[CLOCK_RATE].value ? controls[CLOCK_RATE].value
+                                         : running_rate;
+  long quantum = controls[CLOCK_QUANTUM].value ? controls[CLOCK_QUANTUM].value
+                                               : running_quantum;
+  g_autofree gchar *rate_text = g_strdup_printf("Running at %ld Hz", rate);
+  g_autofree gchar *quantum_text =
+      rate > 0 ? g_strdup_printf("%ld samples, %.1f ms per cycle", quantum,
+                                 quantum * 1000.0 / rate)
+               : g_strdup("");
+
+  adw_action_row_set_subtitle(ADW_ACTION_ROW(controls[CLOCK_RATE].combo),
+                              rate_text);
+  adw_action_row_set_subtitle(ADW_ACTION_ROW(controls[CLOCK_QUANTUM].combo),
+                              quantum_text);
+}
+
+static void select_value(ClockControl *control) {
+  g_signal_handlers_block_by_func(control->combo, on_clock_selected, control);
+  for (gsize i = 0; i < control->n_values; i++) {
+    if (control->values[i] == control->value) {
+      adw_combo_row_set_selected(control->combo, i);
+      break;
+    }
+  }
+  g_signal_handlers_unblock_by_func(control->combo, on_clock_selected,
+                                    control);
+}
+
+static void on_metadata_ready(GObject *source, GAsyncResult *res,
+                              gpointer user_data) {
+  g_autoptr(GCancellable) cancellable = user_data;
+  g_autoptr(GError) error = NULL;
+  g_autoptr(CommandResult) result = command_query_finish(res, &error);
+  long rate = running_rate, quantum = running_quantum;
+  long values[G_N_ELEMENTS(controls)];
+  gboolean found = FALSE, changed;
+  LineReader reader;
+  StrView line, key, value;
+
+  if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+    refresh_done(cancellable, FALSE);
+    return;
+  }
+
+  for (gsize i = 0; i < G_N_ELEMENTS(controls); i++)
+    values[i] = controls[i].value;
+  if (!error && command_result_success(result)) {
+    line_reader_init(&reader, result->out, result->out_len);
+    while (line_reader_next(&reader, &line)) {
+      if (!parse_pw_metadata(line, &key, &value))
+        continue;
+      found = TRUE;
+
+      long number = 0;
+      str_view_take_int(&value, &number);
+      if (str_view_equal(key, "clock.rate"))
+        running_rate = number;
+      else if (str_view_equal(key, "clock.quantum"))
+        running_quantum = number;
+      for (gsize i = 0; i < G_N_ELEMENTS(controls); i++) {
+        if (str_view_equal(key, controls[i].key))
+          controls[i].value = number;
+      }
+    }
+  }
+
+  // No settings metadata: not PipeWire, or not yet, nothing to tune
+  changed = found != gtk_widget_get_visible(LatencyGroup) ||
+            rate != running_rate || quantum != running_quantum;
+  gtk_widget_set_visible(LatencyGroup, found);
+  if (!found) {
+    refresh_done(cancellable, changed);
+    return;
+  }
+
+  for (gsize i = 0; i < G_N_ELEMENTS(controls); i++) {
+    changed |= values[i] != controls[i].value;
+    select_value(&controls[i]);
+  }
+  update_subtitles();
+  refresh_done(cancellable, changed);
+}
+
+static void on_clock_selected(AdwComboRow *combo, GParamSpec *pspec,
+                              gpointer user_data) {
+  ClockControl *control = user_data;
+  guint selected = adw_combo_row_get_selected(combo);
+
+  if (selected >= control->n_values)
+    return;
+
+  control->value = control->values[selected];
+  g_autofree gchar *value = g_strdup_printf("%ld", control->value);
+  const gchar *argv[] = {"pw-metadata", "-n",       "settings", "0",
+                         control->key,  value, NULL};
+  command_set(control->key, argv);
+
+  update_subtitles();
+  if (gtk_switch_get_active(PersistSwitch))
+    save_drop_in();
+}
+
+static GtkWidget *device_row_new(const PwTopNode *node) {
+  g_autofree gchar *name = g_strndup(node->name.data, node->name.len);
+  g_autofree gchar *timing =
+      g_strdup_printf("%ld samples at %ld Hz, %.1f ms", node->quantum,
+                      node->rate, node->quantum * 1000.0 / node->rate);
+  GtkWidget *row = adw_action_row_new();
+  gpointer seen = NULL;
+
+  adw_preferences_row_set_use_markup(ADW_PREFERENCES_ROW(row), FALSE);
+  adw_preferences_row_set_title(ADW_PREFERENCES_ROW(row), name);
+  adw_action_row_set_subtitle(ADW_ACTION_ROW(row), timing);
+
+  if (node->errors > 0) {
+    g_autofree gchar *text = g_strdup_printf("%ld xruns", node->errors);
+    GtkWidget *label = gtk_label_new(text);
+    gboolean had = g_hash_table_lookup_extended(last_errors, name, NULL, &seen);
+
+    // New since the last poll: the current settings are too tight
+    gtk_widget_add_css_class(label, had && GPOINTER_TO_INT(seen) < node->errors
+                                        ? "error"
+                                        : "warning");
+    adw_action_row_add_suffix(ADW_ACTION_ROW(row), label);
+  }
+  g_hash_table_insert(last_errors, g_steal_pointer(&name),
+                      GINT_TO_POINTER((gint)node->errors));
+  return row;
+}
+
+// Show the driving devices of the last pw-top sample with their latency
+static void on_pw_top_ready(GObject *source, GAsyncResult *res,
+                            gpointer user_data) {
+  g_autoptr(GCancellable) cancellable = user_data;
+  g_autoptr(GError) error = NULL;
+  g_autoptr(CommandResult) result = command_run_finish(res, &error);
+  GArray *nodes = g_array_new(FALSE, FALSE, sizeof(PwTopNode));
+  GString *shown = g_string_new(NULL);
+  LineReader reader;
+  StrView line;
+  PwTopNode node;
+  gboolean changed;
+
+  if (error) {
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      g_printerr("Failed to run pw-top: %s\n", error->message);
+    g_array_free(nodes, TRUE);
+    g_string_free(shown, TRUE);
+    refresh_done(cancellable, FALSE);
+    return;
+  }
+
+  line_reader_init(&reader, result->out, result->out_len);
+  while (line_reader_next(&reader, &line)) {
+    // Each sample starts with the header; only the last one counts
+    if (str_view_has_prefix(str_view_strip(line), "S ") &&
+        str_view_find(line, "QUANT") >= 0)
+      g_array_set_size(nodes, 0);
+    else if (parse_pw_top_node(line, &node) && node.driver &&
+             node.quantum > 0 && node.rate > 0)
+      g_array_append_val(nodes, node);
+  }
+
+  // Timings such as the busy time move with every sample; only what the
+  // rows show counts as a change
+  for (guint i = 0; i < nodes->len; i++) {
+    PwTopNode *shown_node = &g_array_index(nodes, PwTopNode, i);
+    g_string_append_printf(shown, "%.*s %ld %ld %ld\n",
+                           (int)shown_node->name.len, shown_node->name.data,
+                           shown_node->quantum, shown_node->rate,
+                           shown_node->errors);
+  }
+  changed = g_strcmp0(shown->str, last_nodes) != 0;
+  g_free(last_nodes);
+  last_nodes = g_string_free(shown, FALSE);
+
+  GtkWidget *child;
+  while ((child = gtk_widget_get_first_child(GTK_WIDGET(LatencyDevices))))
+    gtk_list_box_remove(LatencyDevices, child);
+  for (guint i = 0; i < nodes->len; i++)
+    gtk_list_box_append(LatencyDevices,
+                        device_row_new(&g_array_index(nodes, PwTopNode, i)));
+  g_array_free(nodes, TRUE);
+  refresh_done(cancellable, changed);
+}
+
+static void poll_pw_top(GCancellable *cancellable, gpointer user_data) {
+  static const gchar *argv[] = {"pw-top", "-b", "-n", "2", NULL};
+
+  command_run_async(argv, LATENCY_POLL_TIMEOUT, NULL, NULL, cancellable,
+                    on_pw_top_ready, g_object_ref(cancellable));
+}
+
+static const RefreshJob pw_top_job = {
+    .name = "latency pw-top",
+    .interval = LATENCY_POLL_INTERVAL,
+    .max_interval = LATENCY_POLL_MAX_INTERVAL,
+    .run = poll_pw_top,
+};
+
+// Also outside the schedule with a NULL cancellable, which refresh_done
+// ignores; identical queries in flight share one run
+static void probe_metadata(GCancellable *cancellable, gpointer user_data) {
+  static const gchar *argv[] = {"pw-metadata", "-n", "settings", NULL};
+
+  command_query_async(argv, LATENCY_QUERY_TTL, cancellable, on_metadata_ready,
+                      cancellable != NULL ? g_object_ref(cancellable) : NULL);
+}
+
+// While hidden the probe backs off; showing the page asks at once
+static void on_page_visible(gboolean visible, gpointer user_data) {
+  if (visible && !gtk_widget_get_visible(LatencyGroup))
+    probe_metadata(NULL, user_data);
+}
+
+static const RefreshJob probe_job = {
+    .name = "latency settings",
+    .interval = LATENCY_PROBE_INTERVAL,
+    .max_interval = LATENCY_PROBE_MAX_INTERVAL,
+    .run = probe_metadata,
+    .visible = on_page_visible,
+};
+
+void audio_latency_attach(GtkBuilder *builder) {
+  g_autofree gchar *path = drop_in_path();
+  GtkWidget *placeholder =
+      gtk_label_new("No device is running through the graph");
+
+  LatencyGroup = GTK_WIDGET(gtk_builder_get_object(builder, "latency_group"));
+  PersistSwitch = GTK_SWITCH(gtk_builder_get_object(builder, "latency_persist"));
+  LatencyDevices =
+      GTK_LIST_BOX(gtk_builder_get_object(builder, "latency_devices"));
+  last_errors = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+  for (gsize i = 0; i < G_N_ELEMENTS(controls); i++) {
+    controls[i].combo =
+        ADW_COMBO_ROW(gtk_builder_get_object(builder, controls[i].id));
+    fill_combo(&controls[i]);
+    g_signal_connect(controls[i].combo, "notify::selected",
+                     G_CALLBACK(on_clock_selected), &controls[i]);
+  }
+
+  gtk_switch_set_active(PersistSwitch, g_file_test(path, G_FILE_TEST_EXISTS));
+  g_signal_connect(PersistSwitch, "notify::active",
+                   G_CALLBACK(on_persist_changed), NULL);
+
+  gtk_widget_add_css_class(placeholder, "dim-label");
+  gtk_widget_set_margin_top(placeholder, 12);
+  gtk_widget_set_margin_bottom(placeholder, 12);
+  gtk_list_box_set_placeholder(LatencyDevices, placeholder);
+
+  // The group stays hidden until a probe finds the settings metadata. The
+  // probe follows the page, since a hidden group is never mapped; pw-top
+  // polls only while the group is on screen. The page lives for the rest of
+  // the session.
+  gtk_widget_set_visible(LatencyGroup, FALSE);
+  refresh_add(GTK_WIDGET(gtk_builder_get_object(builder, "audio_page")),
+              &probe_job, NULL);
+  refresh_add(LatencyGroup, &pw_top_job, NULL);
+}
@@ -0,0 +1,240 @@
+#include "audio/mixer.h"
+#include "audio/pulse.h"
+#include "command/setter.h"
+#include <adwaita.h>
+
+// Stream change events this soon after one of our own writes are its echo
+#define MIXER_WRITE_ECHO_US (500 * G_TIME_SPAN_MILLISECOND)
+// Meter changes smaller than this are not worth a redraw
+#define MIXER_METER_EPSILON 0.01
+
+typedef struct {
+  AudioDirection direction;
+  guint32 index;
+  GtkWidget *row;
+  GtkWidget *icon;
+  GtkRange *slider;
+  GtkToggleButton *mute;
+  GtkLevelBar *meter;
+  gint64 last_write_time;
+} StreamRow;
+
+static GtkListBox *StreamList = NULL;
+static GHashTable *rows[2]; // stream index -> StreamRow, per direction
+static guint meter_source_id = 0;
+
+typedef struct {
+  AudioDirection direction;
+  guint32 index;
+  gint percent;
+} StreamVolumeWrite;
+
+static void on_stream_volume_written(gboolean success, gpointer user_data) {
+  command_set_done(user_data, success);
+}
+
+// A stream gone meanwhile fails the write, which ends it
+static void write_stream_volume(const gchar *target, gpointer data) {
+  StreamVolumeWrite *write = data;
+
+  if (!audio_pulse_set_stream_volume(write->direction, write->index,
+                                     write->percent, on_stream_volume_written,
+                                     (gpointer)target))
+    command_set_done(target, FALSE);
+}
+
+// One write per stream in flight, the latest slider position after it
+static void on_stream_volume_changed(GtkRange *range, gpointer user_data) {
+  StreamRow *row = user_data;
+  StreamVolumeWrite *write = g_new(StreamVolumeWrite, 1);
+  g_autofree gchar *target = g_strdup_printf(
+      "%s-volume-%u", row->direction == AUDIO_SINK ? "sink-input"
+                                                   : "source-output",
+      row->index);
+
+  row->last_write_time = g_get_monotonic_time();
+  write->direction = row->direction;
+  write->index = row->index;
+  write->percent = (gint)gtk_range_get_value(range);
+  command_set_func(target, write_stream_volume, write, g_free);
+}
+
+static void on_stream_mute_toggled(GtkToggleButton *button,
+                                   gpointer user_data) {
+  StreamRow *row = user_data;
+
+  row->last_write_time = g_get_monotonic_time();
+  audio_pulse_set_stream_mute(row->direction, row->index,
+                              gtk_toggle_button_get_active(button));
+}
+
+static void stream_row_free(StreamRow *row) {
+  gtk_list_box_remove(StreamList, row->row);
+  g_free(row);
+}
+
+static StreamRow *stream_row_new(const AudioStream *stream) {
+  StreamRow *row = g_new0(StreamRow, 1);
+  GtkWidget *controls = gtk_box_new(GTK_ORIENTATION_VERTICAL, 2);
+  GtkWidget *slider =
+      gtk_scale_new_with_range(GTK_ORIENTATION_HORIZONTAL, 0, 100, 1);
+  GtkWidget *meter = gtk_level_bar_new_for_interval(0, 1);
+  GtkWidget *mute = gtk_toggle_button_new();
+
+  row->direction = stream->direction;
+  row->index = stream->index;
+  row->row = adw_action_row_new();
+  row->icon = gtk_image_new();
+  row->slider = GTK_RANGE(slider);
+  row->mute = GTK_TOGGLE_BUTTON(mute);
+  row->meter = GTK_LEVEL_BAR(meter);
+
+  // Application names are plain text, not markup
+  adw_preferences_row_set_use_markup(ADW_PREFERENCES_ROW(row->row), FALSE);
+  adw_action_row_add_prefix(ADW_ACTION_ROW(row->row), row->icon);
+
+  gtk_widget_set_size_request(slider, 200, -1);
+  gtk_scale_set_draw_value(GTK_SCALE(slider), FALSE);
+  gtk_level_bar_set_mode(GTK_LEVEL_BAR(meter), GTK_LEVEL_BAR_MODE_CONTINUOUS);
+  gtk_widget_set_margin_start(meter, 12);
+  gtk_widget_set_margin_end(meter, 12);
+  gtk_widget_set_valign(controls, GTK_ALIGN_CENTER);
+  gtk_box_append(GTK_BOX(controls), slider);
+  gtk_box_append(GTK_BOX(controls), meter);
+  adw_action_row_add_suffix(ADW_ACTION_ROW(row->row), controls);
+
+  gtk_button_set_icon_name(GTK_BUTTON(mute), "audio-volume-muted-symbolic");
+  gtk_widget_set_tooltip_text(mute, "Mute");
+  gtk_widget_set_valign(mute, GTK_ALIGN_CENTER);
+  gtk_widget_add_css_class(mute, "flat");
+  adw_action_row_add_suffix(ADW_ACTION_ROW(row->row), mute);
+
+  g_signal_connect(slider, "value-changed",
+                   G_CALLBACK(on_stream_volume_changed), row);
+  g_signal_connect(mute, "toggled", G_CALLBACK(on_stream_mute_toggled), row);
+
+  gtk_list_box_append(StreamList, row->row);
+  return row;
+}
+
+static void stream_row_update(StreamRow *row, const AudioStream *stream) {
+  const gchar *fallback_icon = stream->direction == AUDIO_SINK
+                                   ? "audio-speakers-symbolic"
+                                   : "audio-input-microphone-symbolic";
+
+  adw_preferences_row_set_title(ADW_PREFERENCES_ROW(row->row),
+                                stream->application ? stream->application : "");
+  adw_action_row_set_subtitle(ADW_ACTION_ROW(row->row),
+                              stream->title ? stream->title : "");
+  gtk_image_set_from_icon_name(GTK_IMAGE(row->icon), stream->icon_name
+                                                         ? stream->icon_name
+                                                         : fallback_icon);
+
+  // Don't let the echo of a drag in progress pull the slider back
+  if (g_get_monotonic_time() - row->last_write_time < MIXER_WRITE_ECHO_US)
+    return;
+
+  g_signal_handlers_block_by_func(row->slider, on_stream_volume_changed, row);
+  gtk_range_set_value(row->slider, stream->volume);
+  g_signal_handlers_unblock_by_func(row->slider, on_stream_volume_changed, row);
+
+  g_signal_handlers_block_by_func(row->mute, on_stream_mute_toggled, row);
+  gtk_toggle_button_set_active(row->mute, stream->muted);
+  g_signal_handlers_unblock_by_func(row->mute, on_stream_mute_toggled, row);
+}
+
+static void show_stream(const AudioStream *stream) {
+  StreamRow *row =
+      g_hash_table_lookup(rows[stream->direction], GUINT_TO_POINTER(stream->index));
+
+  if (row == NULL) {
+    row = stream_row_new(stream);
+    g_hash_table_insert(rows[stream->direction],
+                        GUINT_TO_POINTER(stream->index), row);
+  }
+  stream_row_update(row, stream);
+}
+
+static void on_stream_change(AudioChange change, const AudioStream *stream,
+                             gpointer user_data) {
+  if (change == AUDIO_CHANGE_STREAM)
+    show_stream(stream);
+  else if (change == AUDIO_CHANGE_STREAM_REMOVED)
+    g_hash_table_remove(rows[stream->direction],
+                        GUINT_TO_POINTER(stream->index));
+}
+
+// Streams are not announced one by one on (re)connect; list them all
+static void on_pulse_change(AudioChange change, const AudioDevice *device,
+                            gpointer user_data) {
+  if (change != AUDIO_CHANGE_STATE)
+    return;
+
+  for (AudioDirection direction = AUDIO_SINK; direction <= AUDIO_SOURCE;
+       direction++) {
+    g_hash_table_remove_all(rows[direction]);
+    if (audio_pulse_get_state() != AUDIO_PULSE_READY)
+      continue;
+
+    GPtrArray *streams = audio_pulse_streams(direction);
+    for (guint i = 0; i < streams->len; i++)
+      show_stream(streams->pdata[i]);
+    g_ptr_array_unref(streams);
+  }
+}
+
+// One timer moves every meter, so redraws stay at AUDIO_METER_RATE however
+// many streams there are
+static gboolean on_meter_tick(gpointer user_data) {
+  GHashTableIter iter;
+  StreamRow *row;
+
+  for (AudioDirection direction = AUDIO_SINK; direction <= AUDIO_SOURCE;
+       direction++) {
+    g_hash_table_iter_init(&iter, rows[direction]);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&row)) {
+      const AudioStream *stream =
+          audio_pulse_lookup_stream(row->direction, row->index);
+      gdouble peak = stream && !stream->muted ? stream->peak : 0;
+
+      if (ABS(gtk_level_bar_get_value(row->meter) - peak) >= MIXER_METER_EPSILON)
+        gtk_level_bar_set_value(row->meter, peak);
+    }
+  }
+  return G_SOURCE_CONTINUE;
+}
+
+static void on_list_map(GtkWidget *widget, gpointer user_data) {
+  audio_pulse_set_meters(TRUE);
+  if (meter_source_id == 0)
+    meter_source_id =
+        g_timeout_add(1000 / AUDIO_METER_RATE, on_meter_tick, NULL);
+}
+
+static void on_list_unmap(GtkWidget *widget, gpointer user_data) {
+  audio_pulse_set_meters(FALSE);
+  if (meter_source_id != 0) {
+    g_source_remove(meter_source_id);
+    meter_source_id = 0;
+  }
+}
+
+void audio_mixer_attach(GtkListBox *list) {
+  GtkWidget *placeholder =
+      gtk_label_new("No application is playing or recording");
+
+  StreamList = list;
+  for (guint i = 0; i < G_N_ELEMENTS(rows); i++)
+    rows[i] = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                                    (GDestroyNotify)stream_row_free);
+
+  gtk_widget_add_css_class(placeholder, "dim-label");
+  gtk_widget_set_margin_top(placeholder, 12);
+  gtk_widget_set_margin_bottom(placeholder, 12);
+  gtk_list_box_set_placeholder(list, placeholder);
+
+  audio_pulse_listen(on_pulse_change, NULL);
+  audio_pulse_listen_streams(on_stream_change, NULL);
+  g_signal_connect(list, "map", G_CALLBACK(on_list_map), NULL);
+  g_signal_connect(list, "unmap", G_CALLBACK(on_list_unmap), NULL);
+}
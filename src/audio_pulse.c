@@ -0,0 +1,751 @@
+#include "audio/pulse.h"
+#include "command/stats.h"
+#include "listener/listener.h"
+#include <math.h>
+#include <pulse/glib-mainloop.h>
+#include <pulse/pulseaudio.h>
+
+typedef struct {
+  AudioDevice device; // first, so public pointers cast back
+  pa_cvolume volume;  // per channel, to keep the balance when scaling
+  guint32 monitor;    // monitor source of a sink
+} PulseDevice;
+
+typedef struct {
+  AudioStream stream; // first, as above
+  pa_cvolume volume;
+  pa_stream *meter;
+} PulseStream;
+
+typedef struct {
+  AudioChange change;
+  gconstpointer object; // AudioDevice or AudioStream, by the list
+} Emission;
+
+// Times one server round trip for the stats table
+typedef struct {
+  const gchar *key;
+  gint64 start;
+  AudioPulseDoneFunc done;
+  gpointer done_data;
+} PulseOp;
+
+static pa_glib_mainloop *mainloop;
+static pa_context *context;
+static AudioPulseState state = AUDIO_PULSE_FAILED;
+static GHashTable *devices[2]; // index -> PulseDevice, per direction
+static GHashTable *streams[2]; // index -> PulseStream, per direction
+static gboolean meters_on;
+static gchar *default_names[2];
+static ListenerList listeners;        // AudioPulseFunc
+static ListenerList stream_listeners; // AudioPulseStreamFunc
+static guint reconnect_id;
+static gboolean wanted; // between connect() and disconnect()
+static guint pending_loads;
+static gint64 load_start;
+// PulseOps sent and not answered yet. A context that fails or disconnects
+// cancels its operations without calling them back, so these are failed by
+// hand when it goes.
+static GQueue pending_ops = G_QUEUE_INIT;
+
+static void pulse_device_free(PulseDevice *device) {
+  g_free(device->device.name);
+  g_free(device->device.description);
+  g_free(device);
+}
+
+static void call_listener(GCallback func, gpointer user_data, gpointer args) {
+  Emission *emission = args;
+
+  ((AudioPulseFunc)func)(emission->change, emission->object, user_data);
+}
+
+static void call_stream_listener(GCallback func, gpointer user_data,
+                                 gpointer args) {
+  Emission *emission = args;
+
+  ((AudioPulseStreamFunc)func)(emission->change, emission->object, user_data);
+}
+
+static void emit(AudioChange change, const AudioDevice *device) {
+  Emission emission = {change, device};
+
+  listener_list_emit(&listeners, call_listener, &emission);
+}
+
+static void emit_stream(AudioChange change, const AudioStream *stream) {
+  Emission emission = {change, stream};
+
+  listener_list_emit(&stream_listeners, call_stream_listener, &emission);
+}
+
+static gint volume_percent(const pa_cvolume *volume) {
+  return (gint)(((guint64)pa_cvolume_max(volume) * 100 + PA_VOLUME_NORM / 2) /
+                PA_VOLUME_NORM);
+}
+
+// Scale every channel so the loudest one lands on percent
+static void scale_volume(pa_cvolume *volume, gint percent) {
+  pa_volume_t level =
+      (pa_volume_t)((guint64)MAX(percent, 0) * PA_VOLUME_NORM / 100);
+  pa_cvolume_scale(volume, MIN(level, PA_VOLUME_MAX));
+}
+
+static void pulse_op(pa_operation *op) {
+  if (op != NULL)
+    pa_operation_unref(op);
+}
+
+static PulseOp *pulse_op_begin(const gchar *key) {
+  PulseOp *op = g_new0(PulseOp, 1);
+  op->key = key;
+  op->start = g_get_monotonic_time();
+  g_queue_push_tail(&pending_ops, op);
+  return op;
+}
+
+static PulseOp *pulse_op_begin_done(const gchar *key, AudioPulseDoneFunc done,
+                                    gpointer user_data) {
+  PulseOp *op = pulse_op_begin(key);
+  op->done = done;
+  op->done_data = user_data;
+  return op;
+}
+
+// Like pulse_op(), for writes whose caller waits for the answer: a request
+// that could not be sent drops its PulseOp, which will never be answered
+static gboolean pulse_write(pa_operation *op, PulseOp *pending) {
+  if (op == NULL) {
+    g_queue_remove(&pending_ops, pending);
+    g_free(pending);
+    return FALSE;
+  }
+  pa_operation_unref(op);
+  return TRUE;
+}
+
+static void on_op_done(pa_context *c, int success, void *userdata) {
+  PulseOp *op = userdata;
+
+  g_queue_remove(&pending_ops, op);
+
+  if (!success)
+    g_printerr("%s failed: %s\n", op->key, pa_strerror(pa_context_errno(c)));
+  command_stats_add(op->key, g_get_monotonic_time() - op->start, 0, FALSE);
+  if (op->done != NULL)
+    op->done(success, op->done_data);
+  g_free(op);
+}
+
+static PulseDevice *lookup(AudioDirection direction, guint32 index) {
+  if (devices[direction] == NULL)
+    return NULL;
+  return g_hash_table_lookup(devices[direction], GUINT_TO_POINTER(index));
+}
+
+static void store_device(AudioDirection direction, guint32 index,
+                         const char *name, const char *description,
+                         const pa_cvolume *volume, int mute, guint32 monitor) {
+  PulseDevice *device = lookup(direction, index);
+
+  if (device == NULL) {
+    device = g_new0(PulseDevice, 1);
+    device->device.direction = direction;
+    device->device.index = index;
+    g_hash_table_insert(devices[direction], GUINT_TO_POINTER(index), device);
+  }
+
+  g_free(device->device.name);
+  g_free(device->device.description);
+  device->device.name = g_strdup(name);
+  device->device.description = g_strdup(description ? description : name);
+  device->volume = *volume;
+  device->monitor = monitor;
+  device->device.volume = volume_percent(volume);
+  device->device.muted = mute != 0;
+
+  // The initial load announces everything at once when it completes
+  if (state == AUDIO_PULSE_READY)
+    emit(AUDIO_CHANGE_DEVICE, &device->device);
+}
+
+static void remove_device(AudioDirection direction, guint32 index) {
+  PulseDevice *device = lookup(direction, index);
+
+  if (device == NULL)
+    return;
+  if (state == AUDIO_PULSE_READY)
+    emit(AUDIO_CHANGE_REMOVED, &device->device);
+  g_hash_table_remove(devices[direction], GUINT_TO_POINTER(index));
+}
+
+static void load_done(void) {
+  if (--pending_loads > 0)
+    return;
+
+  state = AUDIO_PULSE_READY;
+  command_stats_add("libpulse initial sync", g_get_monotonic_time() - load_start,
+                    0, FALSE);
+  emit(AUDIO_CHANGE_STATE, NULL);
+}
+
+// userdata is non-NULL for the listings of the initial load
+static void on_sink_info(pa_context *c, const pa_sink_info *info, int eol,
+                         void *userdata) {
+  if (eol != 0) {
+    if (userdata != NULL)
+      load_done();
+    return;
+  }
+  store_device(AUDIO_SINK, info->index, info->name, info->description,
+               &info->volume, info->mute, info->monitor_source);
+}
+
+static void on_source_info(pa_context *c, const pa_source_info *info, int eol,
+                           void *userdata) {
+  if (eol != 0) {
+    if (userdata != NULL)
+      load_done();
+    return;
+  }
+  // Monitors of outputs are not microphones
+  if (info->monitor_of_sink != PA_INVALID_INDEX)
+    return;
+  store_device(AUDIO_SOURCE, info->index, info->name, info->description,
+               &info->volume, info->mute, PA_INVALID_INDEX);
+}
+
+static PulseStream *lookup_stream(AudioDirection direction, guint32 index) {
+  if (streams[direction] == NULL)
+    return NULL;
+  return g_hash_table_lookup(streams[direction], GUINT_TO_POINTER(index));
+}
+
+// With PEAK_DETECT each sample already is the peak of one meter period, so
+// there is at most a handful per read
+static gfloat measure_peak(const float *samples, gsize count) {
+  gfloat peak = 0;
+
+  for (gsize i = 0; i < count; i++)
+    peak = MAX(peak, fabsf(samples[i]));
+  return MIN(peak, 1.0f);
+}
+
+static void on_meter_read(pa_stream *meter, size_t nbytes, void *userdata) {
+  PulseStream *stream = userdata;
+  const void *data;
+  size_t length;
+
+  while (pa_stream_readable_size(meter) > 0) {
+    if (pa_stream_peek(meter, &data, &length) < 0 || length == 0)
+      return;
+    // NULL data is a hole in the buffer; it still has to be dropped
+    if (data != NULL)
+      stream->stream.peak = measure_peak(data, length / sizeof(float));
+    pa_stream_drop(meter);
+  }
+}
+
+static void stop_meter(PulseStream *stream) {
+  if (stream->meter == NULL)
+    return;
+  pa_stream_set_read_callback(stream->meter, NULL, NULL);
+  pa_stream_disconnect(stream->meter);
+  g_clear_pointer(&stream->meter, pa_stream_unref);
+  stream->stream.peak = 0;
+}
+
+static void start_meter(PulseStream *stream) {
+  pa_sample_spec spec = {PA_SAMPLE_FLOAT32NE, AUDIO_METER_RATE, 1};
+  // One sample per fragment, so every peak is delivered as it is computed
+  pa_buffer_attr attr = {(uint32_t)-1, (uint32_t)-1, (uint32_t)-1,
+                         (uint32_t)-1, sizeof(float)};
+  guint32 source = stream->stream.device;
+  gchar source_name[16];
+
+  if (stream->meter != NULL || context == NULL)
+    return;
+
+  // Playback is metered on its sink's monitor, restricted to this stream
+  if (stream->stream.direction == AUDIO_SINK) {
+    PulseDevice *sink = lookup(AUDIO_SINK, stream->stream.device);
+    source = sink ? sink->monitor : PA_INVALID_INDEX;
+  }
+  if (source == PA_INVALID_INDEX)
+    return;
+
+  stream->meter = pa_stream_new(context, "Peak meter", &spec, NULL);
+  if (stream->meter == NULL)
+    return;
+  if (stream->stream.direction == AUDIO_SINK)
+    pa_stream_set_monitor_stream(stream->meter, stream->stream.index);
+  pa_stream_set_read_callback(stream->meter, on_meter_read, stream);
+
+  g_snprintf(source_name, sizeof(source_name), "%u", source);
+  if (pa_stream_connect_record(stream->meter, source_name, &attr,
+                               PA_STREAM_DONT_MOVE | PA_STREAM_PEAK_DETECT |
+                                   PA_STREAM_ADJUST_LATENCY |
+                                   PA_STREAM_DONT_INHIBIT_AUTO_SUSPEND) < 0)
+    stop_meter(stream);
+}
+
+static void pulse_stream_free(PulseStream *stream) {
+  stop_meter(stream);
+  g_free(stream->stream.application);
+  g_free(stream->stream.title);
+  g_free(stream->stream.icon_name);
+  g_free(stream);
+}
+
+static void store_stream(AudioDirection direction, guint32 index,
+                         guint32 device, const char *name,
+                         pa_proplist *proplist, const pa_cvolume *volume,
+                         int mute) {
+  PulseStream *stream = lookup_stream(direction, index);
+  const char *application =
+      pa_proplist_gets(proplist, PA_PROP_APPLICATION_NAME);
+  gboolean moved;
+
+  if (stream == NULL) {
+    stream = g_new0(PulseStream, 1);
+    stream->stream.direction = direction;
+    stream->stream.index = index;
+    stream->stream.device = PA_INVALID_INDEX;
+    g_hash_table_insert(streams[direction], GUINT_TO_POINTER(index), stream);
+  }
+
+  moved = stream->stream.device != device;
+  g_free(stream->stream.application);
+  g_free(stream->stream.title);
+  g_free(stream->stream.icon_name);
+  stream->stream.application = g_strdup(application ? application : name);
+  stream->stream.title =
+      g_strdup(pa_proplist_gets(proplist, PA_PROP_MEDIA_NAME));
+  stream->stream.icon_name =
+      g_strdup(pa_proplist_gets(proplist, PA_PROP_APPLICATION_ICON_NAME));
+  stream->stream.device = device;
+  stream->volume = *volume;
+  stream->stream.volume = volume_percent(volume);
+  stream->stream.muted = mute != 0;
+
+  // A moved stream is metered on its new device
+  if (meters_on && (moved || stream->meter == NULL)) {
+    stop_meter(stream);
+    start_meter(stream);
+  }
+
+  if (state == AUDIO_PULSE_READY)
+    emit_stream(AUDIO_CHANGE_STREAM, &stream->stream);
+}
+
+static void remove_stream(AudioDirection direction, guint32 index) {
+  PulseStream *stream = lookup_stream(direction, index);
+
+  if (stream == NULL)
+    return;
+  if (state == AUDIO_PULSE_READY)
+    emit_stream(AUDIO_CHANGE_STREAM_REMOVED, &stream->stream);
+  g_hash_table_remove(streams[direction], GUINT_TO_POINTER(index));
+}
+
+static void on_sink_input_info(pa_context *c, const pa_sink_input_info *info,
+                               int eol, void *userdata) {
+  if (eol != 0) {
+    if (userdata != NULL)
+      load_done();
+    return;
+  }
+  store_stream(AUDIO_SINK, info->index, info->sink, info->name,
+               info->proplist, &info->volume, info->mute);
+}
+
+static void on_source_output_info(pa_context *c,
+                                  const pa_source_output_info *info, int eol,
+                                  void *userdata) {
+  if (eol != 0) {
+    if (userdata != NULL)
+      load_done();
+    return;
+  }
+  // Our own meters record too
+  if (info->client == pa_context_get_index(c))
+    return;
+  store_stream(AUDIO_SOURCE, info->index, info->source, info->name,
+               info->proplist, &info->volume, info->mute);
+}
+
+static gboolean replace_name(gchar **name, const char *value) {
+  if (g_strcmp0(*name, value) == 0)
+    return FALSE;
+  g_free(*name);
+  *name = g_strdup(value);
+  return TRUE;
+}
+
+static void on_server_info(pa_context *c, const pa_server_info *info,
+                           void *userdata) {
+  gboolean changed = FALSE;
+
+  if (info != NULL) {
+    changed |= replace_name(&default_names[AUDIO_SINK], info->default_sink_name);
+    changed |=
+        replace_name(&default_names[AUDIO_SOURCE], info->default_source_name);
+  }
+
+  if (userdata != NULL)
+    load_done();
+  else if (changed && state == AUDIO_PULSE_READY)
+    emit(AUDIO_CHANGE_DEFAULT, NULL);
+}
+
+static void on_subscribe_event(pa_context *c, pa_subscription_event_type_t t,
+                               uint32_t index, void *userdata) {
+  pa_subscription_event_type_t type = t & PA_SUBSCRIPTION_EVENT_TYPE_MASK;
+
+  switch (t & PA_SUBSCRIPTION_EVENT_FACILITY_MASK) {
+  case PA_SUBSCRIPTION_EVENT_SINK:
+    if (type == PA_SUBSCRIPTION_EVENT_REMOVE)
+      remove_device(AUDIO_SINK, index);
+    else
+      pulse_op(pa_context_get_sink_info_by_index(c, index, on_sink_info, NULL));
+    break;
+  case PA_SUBSCRIPTION_EVENT_SOURCE:
+    if (type == PA_SUBSCRIPTION_EVENT_REMOVE)
+      remove_device(AUDIO_SOURCE, index);
+    else
+      pulse_op(
+          pa_context_get_source_info_by_index(c, index, on_source_info, NULL));
+    break;
+  case PA_SUBSCRIPTION_EVENT_SINK_INPUT:
+    if (type == PA_SUBSCRIPTION_EVENT_REMOVE)
+      remove_stream(AUDIO_SINK, index);
+    else
+      pulse_op(pa_context_get_sink_input_info(c, index, on_sink_input_info,
+                                              NULL));
+    break;
+  case PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT:
+    if (type == PA_SUBSCRIPTION_EVENT_REMOVE)
+      remove_stream(AUDIO_SOURCE, index);
+    else
+      pulse_op(pa_context_get_source_output_info(c, index,
+                                                 on_source_output_info, NULL));
+    break;
+  case PA_SUBSCRIPTION_EVENT_SERVER:
+    pulse_op(pa_context_get_server_info(c, on_server_info, NULL));
+    break;
+  default:
+    break;
+  }
+}
+
+static gboolean on_reconnect_due(gpointer user_data) {
+  reconnect_id = 0;
+  audio_pulse_connect();
+  return G_SOURCE_REMOVE;
+}
+
+// Drop the context and everything learned through it
+static void drop_connection(void) {
+  // Meters are streams on the context, so they go first
+  for (guint i = 0; i < G_N_ELEMENTS(streams); i++) {
+    if (streams[i] != NULL)
+      g_hash_table_remove_all(streams[i]);
+  }
+
+  if (context != NULL) {
+    pa_context_set_state_callback(context, NULL, NULL);
+    pa_context_set_subscribe_callback(context, NULL, NULL);
+    pa_context_disconnect(context);
+    g_clear_pointer(&context, pa_context_unref);
+  }
+
+  for (guint i = 0; i < G_N_ELEMENTS(devices); i++) {
+    if (devices[i] != NULL)
+      g_hash_table_remove_all(devices[i]);
+    g_clear_pointer(&default_names[i], g_free);
+  }
+  state = AUDIO_PULSE_FAILED;
+
+  // Callers waiting on a write may queue the next one from done(), which
+  // now fails at once; it must not land in the queue being emptied
+  GQueue cancelled = pending_ops;
+  g_queue_init(&pending_ops);
+  for (GList *l = cancelled.head; l != NULL; l = l->next) {
+    PulseOp *op = l->data;
+
+    if (op->done != NULL)
+      op->done(FALSE, op->done_data);
+    g_free(op);
+  }
+  g_queue_clear(&cancelled);
+}
+
+static void connection_lost(void) {
+  g_printerr("No connection to the sound server: %s\n",
+             pa_strerror(pa_context_errno(context)));
+  drop_connection();
+  emit(AUDIO_CHANGE_STATE, NULL);
+
+  // pipewire-pulse restarts with the session; come back when it does
+  if (wanted && reconnect_id == 0)
+    reconnect_id =
+        g_timeout_add_seconds(AUDIO_PULSE_RECONNECT, on_reconnect_due, NULL);
+}
+
+static void on_context_state(pa_context *c, void *userdata) {
+  switch (pa_context_get_state(c)) {
+  case PA_CONTEXT_READY:
+    pa_context_set_subscribe_callback(c, on_subscribe_event, NULL);
+    pulse_op(pa_context_subscribe(c,
+                                  PA_SUBSCRIPTION_MASK_SINK |
+                                      PA_SUBSCRIPTION_MASK_SOURCE |
+                                      PA_SUBSCRIPTION_MASK_SINK_INPUT |
+                                      PA_SUBSCRIPTION_MASK_SOURCE_OUTPUT |
+                                      PA_SUBSCRIPTION_MASK_SERVER,
+                                  NULL, NULL));
+
+    pending_loads = 5;
+    load_start = g_get_monotonic_time();
+    pulse_op(pa_context_get_server_info(c, on_server_info, GINT_TO_POINTER(1)));
+    pulse_op(pa_context_get_sink_info_list(c, on_sink_info, GINT_TO_POINTER(1)));
+    pulse_op(
+        pa_context_get_source_info_list(c, on_source_info, GINT_TO_POINTER(1)));
+    pulse_op(pa_context_get_sink_input_info_list(c, on_sink_input_info,
+                                                 GINT_TO_POINTER(1)));
+    pulse_op(pa_context_get_source_output_info_list(c, on_source_output_info,
+                                                    GINT_TO_POINTER(1)));
+    break;
+  case PA_CONTEXT_FAILED:
+  case PA_CONTEXT_TERMINATED:
+    // libpulse holds its own reference while calling us, so dropping ours
+    // here is safe
+    connection_lost();
+    break;
+  default:
+    break;
+  }
+}
+
+void audio_pulse_connect(void) {
+  wanted = TRUE;
+  if (context != NULL)
+    return;
+
+  if (mainloop == NULL)
+    mainloop = pa_glib_mainloop_new(NULL);
+  for (guint i = 0; i < G_N_ELEMENTS(devices); i++) {
+    if (devices[i] == NULL)
+      devices[i] = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                                         (GDestroyNotify)pulse_device_free);
+    if (streams[i] == NULL)
+      streams[i] = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                                         (GDestroyNotify)pulse_stream_free);
+  }
+
+  state = AUDIO_PULSE_CONNECTING;
+  context = pa_context_new(pa_glib_mainloop_get_api(mainloop), "SysTune");
+  pa_context_set_state_callback(context, on_context_state, NULL);
+  if (pa_context_connect(context, NULL, PA_CONTEXT_NOAUTOSPAWN, NULL) < 0)
+    connection_lost();
+}
+
+void audio_pulse_disconnect(void) {
+  wanted = FALSE;
+  if (reconnect_id != 0) {
+    g_source_remove(reconnect_id);
+    reconnect_id = 0;
+  }
+  drop_connection();
+}
+
+AudioPulseState audio_pulse_get_state(void) { return state; }
+
+guint audio_pulse_listen(AudioPulseFunc func, gpointer user_data) {
+  return listener_list_add(&listeners, G_CALLBACK(func), user_data);
+}
+
+guint audio_pulse_listen_streams(AudioPulseStreamFunc func,
+                                 gpointer user_data) {
+  return listener_list_add(&stream_listeners, G_CALLBACK(func), user_data);
+}
+
+// Ids are unique across both lists
+void audio_pulse_unlisten(guint id) {
+  if (!listener_list_remove(&listeners, id))
+    listener_list_remove(&stream_listeners, id);
+}
+
+static gint compare_index(gconstpointer a, gconstpointer b) {
+  const AudioDevice *first = *(AudioDevice *const *)a;
+  const AudioDevice *second = *(AudioDevice *const *)b;
+
+  if (first->index == second->index)
+    return 0;
+  return first->index < second->index ? -1 : 1;
+}
+
+// AudioDevice and AudioStream both start with direction and index
+static gint compare_stream_index(gconstpointer a, gconstpointer b) {
+  const AudioStream *first = *(AudioStream *const *)a;
+  const AudioStream *second = *(AudioStream *const *)b;
+
+  if (first->index == second->index)
+    return 0;
+  return first->index < second->index ? -1 : 1;
+}
+
+static GPtrArray *sorted_values(GHashTable *table, GCompareFunc compare) {
+  GPtrArray *result = g_ptr_array_new();
+  GHashTableIter iter;
+  gpointer value;
+
+  if (table != NULL) {
+    g_hash_table_iter_init(&iter, table);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+      g_ptr_array_add(result, value);
+  }
+  g_ptr_array_sort(result, compare);
+  return result;
+}
+
+GPtrArray *audio_pulse_devices(AudioDirection direction) {
+  return sorted_values(devices[direction], compare_index);
+}
+
+const AudioDevice *audio_pulse_lookup(AudioDirection direction,
+                                      guint32 index) {
+  PulseDevice *device = lookup(direction, index);
+  return device ? &device->device : NULL;
+}
+
+const AudioDevice *audio_pulse_default(AudioDirection direction) {
+  GHashTableIter iter;
+  gpointer device;
+
+  if (devices[direction] == NULL || default_names[direction] == NULL)
+    return NULL;
+
+  g_hash_table_iter_init(&iter, devices[direction]);
+  while (g_hash_table_iter_next(&iter, NULL, &device)) {
+    if (g_strcmp0(((AudioDevice *)device)->name, default_names[direction]) == 0)
+      return device;
+  }
+  return NULL;
+}
+
+gboolean audio_pulse_set_volume(AudioDirection direction, guint32 index,
+                                gint percent, AudioPulseDoneFunc done,
+                                gpointer user_data) {
+  PulseDevice *device = lookup(direction, index);
+  PulseOp *op;
+
+  if (state != AUDIO_PULSE_READY || device == NULL)
+    return FALSE;
+
+  scale_volume(&device->volume, percent);
+  device->device.volume = MAX(percent, 0);
+
+  if (direction == AUDIO_SINK) {
+    op = pulse_op_begin_done("libpulse set-sink-volume", done, user_data);
+    return pulse_write(pa_context_set_sink_volume_by_index(
+                           context, index, &device->volume, on_op_done, op),
+                       op);
+  }
+  op = pulse_op_begin_done("libpulse set-source-volume", done, user_data);
+  return pulse_write(pa_context_set_source_volume_by_index(
+                         context, index, &device->volume, on_op_done, op),
+                     op);
+}
+
+gboolean audio_pulse_set_default(AudioDirection direction, guint32 index) {
+  PulseDevice *device = lookup(direction, index);
+
+  if (state != AUDIO_PULSE_READY || device == NULL)
+    return FALSE;
+
+  if (direction == AUDIO_SINK)
+    pulse_op(pa_context_set_default_sink(
+        context, device->device.name, on_op_done,
+        pulse_op_begin("libpulse set-default-sink")));
+  else
+    pulse_op(pa_context_set_default_source(
+        context, device->device.name, on_op_done,
+        pulse_op_begin("libpulse set-default-source")));
+  return TRUE;
+}
+
+GPtrArray *audio_pulse_streams(AudioDirection direction) {
+  return sorted_values(streams[direction], compare_stream_index);
+}
+
+const AudioStream *audio_pulse_lookup_stream(AudioDirection direction,
+                                             guint32 index) {
+  PulseStream *stream = lookup_stream(direction, index);
+  return stream ? &stream->stream : NULL;
+}
+
+gboolean audio_pulse_set_stream_volume(AudioDirection direction, guint32 index,
+                                       gint percent, AudioPulseDoneFunc done,
+                                       gpointer user_data) {
+  PulseStream *stream = lookup_stream(direction, index);
+  PulseOp *op;
+
+  if (state != AUDIO_PULSE_READY || stream == NULL)
+    return FALSE;
+
+  scale_volume(&stream->volume, percent);
+  stream->stream.volume = MAX(percent, 0);
+
+  if (direction == AUDIO_SINK) {
+    op = pulse_op_begin_done("libpulse set-sink-input-volume", done,
+                             user_data);
+    return pulse_write(pa_context_set_sink_input_volume(
+                           context, index, &stream->volume, on_op_done, op),
+                       op);
+  }
+  op = pulse_op_begin_done("libpulse set-source-output-volume", done,
+                           user_data);
+  return pulse_write(pa_context_set_source_output_volume(
+                         context, index, &stream->volume, on_op_done, op),
+                     op);
+}
+
+gboolean audio_pulse_set_stream_mute(AudioDirection direction, guint32 index,
+                                     gboolean muted) {
+  PulseStream *stream = lookup_stream(direction, index);
+
+  if (state != AUDIO_PULSE_READY || stream == NULL)
+    return FALSE;
+
+  stream->stream.muted = muted;
+  if (direction == AUDIO_SINK)
+    pulse_op(pa_context_set_sink_input_mute(
+        context, index, muted, on_op_done,
+        pulse_op_begin("libpulse set-sink-input-mute")));
+  else
+    pulse_op(pa_context_set_source_output_mute(
+        context, index, muted, on_op_done,
+        pulse_op_begin("libpulse set-source-output-mute")));
+  return TRUE;
+}
+
+void audio_pulse_set_meters(gboolean enabled) {
+  GHashTableIter iter;
+  gpointer stream;
+
+  if (meters_on == enabled)
+    return;
+  meters_on = enabled;
+
+  for (guint i = 0; i < G_N_ELEMENTS(streams); i++) {
+    if (streams[i] == NULL)
+      continue;
+    g_hash_table_iter_init(&iter, streams[i]);
+    while (g_hash_table_iter_next(&iter, NULL, &stream)) {
+      if (enabled)
+        start_meter(stream);
+      else
+        stop_meter(stream);
+    }
+  }
+}
@@ -0,0 +1,289 @@
+#include "audio/registry.h"
+
+struct _AudioDeviceItem {
+  GObject parent_instance;
+  guint32 index;
+  gchar *name;
+  gchar *description;
+  gint volume;
+  gboolean muted;
+  gboolean is_default;
+  guint generation; // last begin() pass that saw it
+};
+
+enum {
+  PROP_0,
+  PROP_INDEX,
+  PROP_NAME,
+  PROP_DESCRIPTION,
+  PROP_VOLUME,
+  PROP_MUTED,
+  PROP_IS_DEFAULT,
+  N_PROPS
+};
+
+static GParamSpec *properties[N_PROPS];
+
+G_DEFINE_TYPE(AudioDeviceItem, audio_device_item, G_TYPE_OBJECT)
+
+static void audio_device_item_finalize(GObject *object) {
+  AudioDeviceItem *item = AUDIO_DEVICE_ITEM(object);
+
+  g_free(item->name);
+  g_free(item->description);
+  G_OBJECT_CLASS(audio_device_item_parent_class)->finalize(object);
+}
+
+static void audio_device_item_get_property(GObject *object, guint prop_id,
+                                           GValue *value, GParamSpec *pspec) {
+  AudioDeviceItem *item = AUDIO_DEVICE_ITEM(object);
+
+  switch (prop_id) {
+  case PROP_INDEX:
+    g_value_set_uint(value, item->index);
+    break;
+  case PROP_NAME:
+    g_value_set_string(value, item->name);
+    break;
+  case PROP_DESCRIPTION:
+    g_value_set_string(value, item->description);
+    break;
+  case PROP_VOLUME:
+    g_value_set_int(value, item->volume);
+    break;
+  case PROP_MUTED:
+    g_value_set_boolean(value, item->muted);
+    break;
+  case PROP_IS_DEFAULT:
+    g_value_set_boolean(value, item->is_default);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+  }
+}
+
+static void audio_device_item_class_init(AudioDeviceItemClass *klass) {
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+  GParamFlags flags =
+      G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS;
+
+  object_class->finalize = audio_device_item_finalize;
+  object_class->get_property = audio_device_item_get_property;
+
+  properties[PROP_INDEX] =
+      g_param_spec_uint("index", NULL, NULL, 0, G_MAXUINT32, 0, flags);
+  properties[PROP_NAME] = g_param_spec_string("name", NULL, NULL, NULL, flags);
+  properties[PROP_DESCRIPTION] =
+      g_param_spec_string("description", NULL, NULL, NULL, flags);
+  properties[PROP_VOLUME] =
+      g_param_spec_int("volume", NULL, NULL, 0, G_MAXINT, 0, flags);
+  properties[PROP_MUTED] =
+      g_param_spec_boolean("muted", NULL, NULL, FALSE, flags);
+  properties[PROP_IS_DEFAULT] =
+      g_param_spec_boolean("is-default", NULL, NULL, FALSE, flags);
+  g_object_class_install_properties(object_class, N_PROPS, properties);
+}
+
+static void audio_device_item_init(AudioDeviceItem *item) {}
+
+guint32 audio_device_item_get_index(AudioDeviceItem *item) {
+  return item->index;
+}
+
+const gchar *audio_device_item_get_name(AudioDeviceItem *item) {
+  return item->name;
+}
+
+const gchar *audio_device_item_get_description(AudioDeviceItem *item) {
+  return item->description;
+}
+
+gint audio_device_item_get_volume(AudioDeviceItem *item) {
+  return item->volume;
+}
+
+gboolean audio_device_item_get_is_default(AudioDeviceItem *item) {
+  return item->is_default;
+}
+
+typedef struct {
+  GListStore *store;
+  GHashTable *items; // index -> AudioDeviceItem, owned by the store
+  gchar *default_name;
+  guint generation;
+} DeviceList;
+
+static DeviceList lists[2];
+
+static DeviceList *device_list(AudioDirection direction) {
+  DeviceList *list = &lists[direction];
+
+  if (list->store == NULL) {
+    list->store = g_list_store_new(AUDIO_TYPE_DEVICE_ITEM);
+    list->items = g_hash_table_new(g_direct_hash, g_direct_equal);
+  }
+  return list;
+}
+
+static gint compare_index(gconstpointer a, gconstpointer b,
+                          gpointer user_data) {
+  guint32 first = AUDIO_DEVICE_ITEM((gpointer)a)->index;
+  guint32 second = AUDIO_DEVICE_ITEM((gpointer)b)->index;
+
+  if (first == second)
+    return 0;
+  return first < second ? -1 : 1;
+}
+
+GListModel *audio_sink_list(void) {
+  return G_LIST_MODEL(device_list(AUDIO_SINK)->store);
+}
+
+GListModel *audio_source_list(void) {
+  return G_LIST_MODEL(device_list(AUDIO_SOURCE)->store);
+}
+
+AudioDeviceItem *audio_registry_lookup(AudioDirection direction,
+                                       guint32 index) {
+  return g_hash_table_lookup(device_list(direction)->items,
+                             GUINT_TO_POINTER(index));
+}
+
+AudioDeviceItem *audio_registry_get_default(AudioDirection direction) {
+  GHashTableIter iter;
+  gpointer item;
+
+  g_hash_table_iter_init(&iter, device_list(direction)->items);
+  while (g_hash_table_iter_next(&iter, NULL, &item)) {
+    if (AUDIO_DEVICE_ITEM(item)->is_default)
+      return item;
+  }
+  return NULL;
+}
+
+static gboolean replace_string(gchar **field, const gchar *value) {
+  if (g_strcmp0(*field, value) == 0)
+    return FALSE;
+  g_free(*field);
+  *field = g_strdup(value);
+  return TRUE;
+}
+
+static void set_is_default(AudioDeviceItem *item, const gchar *default_name) {
+  gboolean is_default = default_name != NULL &&
+                        g_strcmp0(item->name, default_name) == 0;
+
+  if (item->is_default != is_default) {
+    item->is_default = is_default;
+    g_object_notify_by_pspec(G_OBJECT(item), properties[PROP_IS_DEFAULT]);
+  }
+}
+
+void audio_registry_update(const AudioDevice *device) {
+  DeviceList *list = device_list(device->direction);
+  AudioDeviceItem *item = audio_registry_lookup(device->direction,
+                                                device->index);
+  gboolean renamed;
+  guint position;
+
+  if (item == NULL) {
+    item = g_object_new(AUDIO_TYPE_DEVICE_ITEM, NULL);
+    item->index = device->index;
+    item->name = g_strdup(device->name);
+    item->description = g_strdup(device->description);
+    item->volume = device->volume;
+    item->muted = device->muted;
+    item->is_default = list->default_name != NULL &&
+                       g_strcmp0(item->name, list->default_name) == 0;
+    item->generation = list->generation;
+
+    g_hash_table_insert(list->items, GUINT_TO_POINTER(item->index), item);
+    g_list_store_insert_sorted(list->store, item, compare_index, NULL);
+    g_object_unref(item);
+    return;
+  }
+
+  item->generation = list->generation;
+  g_object_freeze_notify(G_OBJECT(item));
+  if (replace_string(&item->name, device->name)) {
+    g_object_notify_by_pspec(G_OBJECT(item), properties[PROP_NAME]);
+    set_is_default(item, list->default_name);
+  }
+  renamed = replace_string(&item->description, device->description);
+  if (renamed)
+    g_object_notify_by_pspec(G_OBJECT(item), properties[PROP_DESCRIPTION]);
+  if (item->volume != device->volume) {
+    item->volume = device->volume;
+    g_object_notify_by_pspec(G_OBJECT(item), properties[PROP_VOLUME]);
+  }
+  if (item->muted != device->muted) {
+    item->muted = device->muted;
+    g_object_notify_by_pspec(G_OBJECT(item), properties[PROP_MUTED]);
+  }
+  g_object_thaw_notify(G_OBJECT(item));
+
+  // Rows show the description as it was when they were bound; swapping the
+  // item for itself rebinds just that row
+  if (renamed && g_list_store_find(list->store, item, &position)) {
+    g_object_ref(item);
+    g_list_store_splice(list->store, position, 1, (gpointer *)&item, 1);
+    g_object_unref(item);
+  }
+}
+
+void audio_registry_remove(AudioDirection direction, guint32 index) {
+  DeviceList *list = device_list(direction);
+  AudioDeviceItem *item = audio_registry_lookup(direction, index);
+  guint position;
+
+  if (item == NULL)
+    return;
+
+  g_hash_table_remove(list->items, GUINT_TO_POINTER(index));
+  if (g_list_store_find(list->store, item, &position))
+    g_list_store_remove(list->store, position);
+}
+
+void audio_registry_set_default(AudioDirection direction, const gchar *name) {
+  DeviceList *list = device_list(direction);
+  GHashTableIter iter;
+  gpointer item;
+
+  if (!replace_string(&list->default_name, name))
+    return;
+
+  g_hash_table_iter_init(&iter, list->items);
+  while (g_hash_table_iter_next(&iter, NULL, &item))
+    set_is_default(item, name);
+}
+
+void audio_registry_begin(AudioDirection direction) {
+  device_list(direction)->generation++;
+}
+
+void audio_registry_end(AudioDirection direction) {
+  DeviceList *list = device_list(direction);
+  GHashTableIter iter;
+  gpointer item;
+  GArray *gone = g_array_new(FALSE, FALSE, sizeof(guint32));
+
+  g_hash_table_iter_init(&iter, list->items);
+  while (g_hash_table_iter_next(&iter, NULL, &item)) {
+    if (AUDIO_DEVICE_ITEM(item)->generation != list->generation)
+      g_array_append_val(gone, AUDIO_DEVICE_ITEM(item)->index);
+  }
+
+  for (guint i = 0; i < gone->len; i++)
+    audio_registry_remove(direction, g_array_index(gone, guint32, i));
+  g_array_free(gone, TRUE);
+}
+
+void audio_registry_clear(void) {
+  for (guint i = 0; i < G_N_ELEMENTS(lists); i++) {
+    if (lists[i].store == NULL)
+      continue;
+    g_hash_table_remove_all(lists[i].items);
+    g_list_store_remove_all(lists[i].store);
+    g_clear_pointer(&lists[i].default_name, g_free);
+  }
+}
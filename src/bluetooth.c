@@ -1,5 +1,10 @@
 #include "option/bluetooth.h"
-#include "command/command.h"
+#include "capability/capability.h"
+#include "command/cache.h"
+#include "command/coprocess.h"
+#include "command/stats.h"
+#include "parse/parse.h"
+#include "window/refresh.h"
 #include <adwaita.h>
 #include <gio/gio.h>
 #include <glib.h>
@@ -8,6 +13,13 @@
 #include <stdio.h>
 #include <string.h>
 
+// Adapter and device state is reused for this long unless we change it
+#define BLUETOOTH_DEVICES_TTL 5000
+// Device events arrive pushed from bluetoothctl; the poll only resyncs, and
+// less often while nothing changes
+#define BLUETOOTH_RESYNC_INTERVAL 60
+#define BLUETOOTH_RESYNC_MAX_INTERVAL 600
+
 // Structures
 typedef struct {
   char address[18];
@@ -23,25 +35,22 @@ typedef struct {
 
 // Global variables
 GtkWidget *BluetoothPage = NULL;
-guint refresh_timeout_id = 0;
+static GtkListBox *DevicesList = NULL;
+static gboolean scanning = FALSE;
+static guint resync_job = 0;
+static gchar *last_devices = NULL; // `devices` output the list was built from
 
 // Forward declarations
 void clear_list_box(GtkListBox *list_box);
 const char *get_signal_icon_name(int signal_strength);
 void on_bluetooth_switch_active(GObject *bluetooth_switch, GParamSpec *pspec,
                                 gpointer user_data);
-gboolean get_bluetooth_status(void);
 void set_bluetooth_switch_state(GtkWidget *bluetooth_switch,
                                 gboolean is_active);
 void toggle_bluetooth(gboolean enable);
 void bluetooth_to_stack(GtkStack *stack);
-gboolean on_refresh_timeout(gpointer user_data);
 void on_device_row_activated(GtkListBox *box, GtkListBoxRow *row,
                              gpointer user_data);
-gboolean connect_bluetooth_device(const char *address);
-gboolean disconnect_bluetooth_device(const char *address);
-gboolean is_device_connected(const char *address);
-void scan_bluetooth_devices(GtkListBox *devices_list);
 void initialize_bluetooth_page(GtkBuilder *builder);
 void complete_initialization(InitData *init_data);
 void bluetooth_status_thread(GTask *task, gpointer source_object,
@@ -88,138 +97,242 @@ GtkWidget *create_device_row(const char *name, const char *status,
   return GTK_WIDGET(row);
 }
 
+// The shared interactive bluetoothctl all operations and events go through
+static Coprocess *bluetoothctl(void) {
+  static const gchar *argv[] = {"bluetoothctl", NULL};
+  return coprocess_get(argv);
+}
+
+static void on_device_action_done(GObject *source, GAsyncResult *res,
+                                  gpointer user_data) {
+  GtkListBoxRow *row = GTK_LIST_BOX_ROW(user_data);
+  BluetoothDevice *device = g_object_get_data(G_OBJECT(row), "device-data");
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *response = coprocess_request_finish(res, &error);
+
+  if (error) {
+    g_printerr("Bluetooth operation failed: %s\n", error->message);
+  } else if (device->is_connected &&
+             g_strstr_len(response, -1, "Successful disconnected")) {
+    device->is_connected = FALSE;
+  } else if (!device->is_connected &&
+             g_strstr_len(response, -1, "Connection successful")) {
+    device->is_connected = TRUE;
+  }
+
+  // Cached `info` output no longer matches the device
+  command_cache_invalidate("bluetoothctl");
+
+  adw_action_row_set_subtitle(ADW_ACTION_ROW(row),
+                              device->is_connected ? "Connected" : "Available");
+  gtk_widget_set_sensitive(GTK_WIDGET(row), TRUE);
+  g_object_unref(row);
+}
+
 void on_device_row_activated(GtkListBox *box, GtkListBoxRow *row,
                              gpointer user_data) {
-  g_print("clicked");
   BluetoothDevice *device = g_object_get_data(G_OBJECT(row), "device-data");
-  GtkSpinner *spinner =
-      GTK_SPINNER(g_object_get_data(G_OBJECT(row), "spinner"));
   if (!device)
     return;
 
-  // Show spinner during operation
-  gtk_widget_set_visible(GTK_WIDGET(spinner), TRUE);
-  gtk_spinner_start(spinner);
-
   // Disable row during operation
   gtk_widget_set_sensitive(GTK_WIDGET(row), FALSE);
-
-  if (device->is_connected) {
-    g_print("connected");
-    if (disconnect_bluetooth_device(device->address)) {
-      device->is_connected = FALSE;
-      adw_action_row_set_subtitle(ADW_ACTION_ROW(row), "Available");
-    }
-  } else {
-    g_print("not connected");
-    if (connect_bluetooth_device(device->address)) {
-      device->is_connected = TRUE;
-      adw_action_row_set_subtitle(ADW_ACTION_ROW(row), "Connected");
-    }
-  }
-
-  // Hide spinner and re-enable row
-  gtk_spinner_stop(spinner);
-  gtk_widget_set_visible(GTK_WIDGET(spinner), FALSE);
-  gtk_widget_set_sensitive(GTK_WIDGET(row), TRUE);
+  adw_action_row_set_subtitle(ADW_ACTION_ROW(row), device->is_connected
+                                                       ? "Disconnecting..."
+                                                       : "Connecting...");
+
+  static const gchar *connect_markers[] = {"Connection successful",
+                                          "Failed to connect", "not available",
+                                          NULL};
+  static const gchar *disconnect_markers[] = {"Successful disconnected",
+                                             "Failed to disconnect",
+                                             "not available", NULL};
+  gchar *line = g_strdup_printf(
+      "%s %s", device->is_connected ? "disconnect" : "connect", device->address);
+
+  coprocess_request_async(
+      bluetoothctl(), line,
+      device->is_connected ? disconnect_markers : connect_markers, 30000, NULL,
+      on_device_action_done, g_object_ref(row));
+  g_free(line);
 }
 
-gboolean connect_bluetooth_device(const char *address) {
-  GError *error = NULL;
-  gchar *command = g_strdup_printf("bluetoothctl connect %s", address);
-  gchar *output = NULL;
-  gint exit_status;
-
-  g_spawn_command_line_sync(command, &output, NULL, &exit_status, &error);
-  g_free(command);
+// "Device <address> <name>" as printed by `devices` and in events
+static gboolean parse_device_line(StrView line, char *address, char *rest,
+                                  gsize rest_size) {
+  StrView tail, head;
 
-  if (error) {
-    g_printerr("Failed to connect device: %s\n", error->message);
-    g_error_free(error);
-    g_free(output);
+  if (!str_view_has_prefix(line, "Device "))
     return FALSE;
+  tail = str_view_skip(line, strlen("Device "));
+  if (!str_view_split(&tail, ' ', &head)) {
+    head = tail;
+    tail = str_view_skip(tail, tail.len);
   }
+  if (head.len != 17)
+    return FALSE;
 
-  gboolean success =
-      (g_strstr_len(output, -1, "Connection successful") != NULL);
-  g_free(output);
-  return success;
+  str_view_copy(head, address, 18);
+  str_view_copy(str_view_strip(tail), rest, rest_size);
+  return TRUE;
 }
 
-gboolean disconnect_bluetooth_device(const char *address) {
-  GError *error = NULL;
-  gchar *command = g_strdup_printf("bluetoothctl disconnect %s", address);
-  gchar *output = NULL;
-  gint exit_status;
-
-  g_spawn_command_line_sync(command, &output, NULL, &exit_status, &error);
-  g_free(command);
+// Look up one "Key: value" field of `bluetoothctl info`
+static gboolean find_info_field(const char *info, gsize len, const char *name,
+                                StrView *value) {
+  LineReader reader;
+  StrView line, key;
 
-  if (error) {
-    g_printerr("Failed to disconnect device: %s\n", error->message);
-    g_error_free(error);
-    g_free(output);
-    return FALSE;
+  line_reader_init(&reader, info, len);
+  while (line_reader_next(&reader, &line)) {
+    if (parse_key_value(line, &key, value) && str_view_equal(key, name))
+      return TRUE;
   }
-
-  gboolean success =
-      (g_strstr_len(output, -1, "Successful disconnected") != NULL);
-  g_free(output);
-  return success;
+  return FALSE;
 }
 
-gboolean is_device_connected(const char *address) {
-  GError *error = NULL;
-  gchar *command = g_strdup_printf("bluetoothctl info %s", address);
-  gchar *output = NULL;
-  gint exit_status;
-
-  g_spawn_command_line_sync(command, &output, NULL, &exit_status, &error);
-  g_free(command);
+static void on_device_info_ready(GObject *source, GAsyncResult *res,
+                                 gpointer user_data) {
+  GtkListBoxRow *row = GTK_LIST_BOX_ROW(user_data);
+  BluetoothDevice *device = g_object_get_data(G_OBJECT(row), "device-data");
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *info = coprocess_request_finish(res, &error);
+  StrView connected;
+
+  // A device removed meanwhile answers "not available" and keeps its row
+  // until the [DEL] event
+  if (!error &&
+      find_info_field(info, strlen(info), "Connected", &connected)) {
+    device->is_connected = str_view_equal(connected, "yes");
+    adw_action_row_set_subtitle(ADW_ACTION_ROW(row), device->is_connected
+                                                         ? "Connected"
+                                                         : "Available");
+  }
+  g_object_unref(row);
+}
 
-  if (error) {
-    g_printerr("Failed to get device info: %s\n", error->message);
-    g_error_free(error);
-    g_free(output);
-    return FALSE;
+static GtkListBoxRow *find_device_row(GtkListBox *devices_list,
+                                      const char *address) {
+  for (GtkWidget *child = gtk_widget_get_first_child(GTK_WIDGET(devices_list));
+       child != NULL; child = gtk_widget_get_next_sibling(child)) {
+    BluetoothDevice *device = g_object_get_data(G_OBJECT(child), "device-data");
+    if (device && g_strcmp0(device->address, address) == 0)
+      return GTK_LIST_BOX_ROW(child);
   }
+  return NULL;
+}
 
-  gboolean connected = (g_strstr_len(output, -1, "Connected: yes") != NULL);
-  g_free(output);
-  return connected;
+static void add_device_row(GtkListBox *devices_list, const char *address,
+                           const char *name) {
+  BluetoothDevice *device = g_new0(BluetoothDevice, 1);
+  g_strlcpy(device->address, address, sizeof(device->address));
+  g_strlcpy(device->name, name, sizeof(device->name));
+
+  GtkWidget *row = create_device_row(device->name, address, "*");
+  g_object_set_data_full(G_OBJECT(row), "device-data", device, g_free);
+  gtk_list_box_append(devices_list, row);
+
+  // Through the shared bluetoothctl rather than a process per device. The
+  // reply is done at its "Connected:" line, which events never start with.
+  static const gchar *info_markers[] = {"^Connected: ", "not available",
+                                        NULL};
+  g_autofree gchar *line = g_strdup_printf("info %s", address);
+  coprocess_request_async(bluetoothctl(), line, info_markers, 5000, NULL,
+                          on_device_info_ready, g_object_ref(row));
 }
 
-void scan_bluetooth_devices(GtkListBox *devices_list) {
-  clear_list_box(devices_list);
+static void on_devices_ready(GObject *source, GAsyncResult *res,
+                             gpointer user_data) {
+  g_autoptr(GCancellable) cancellable = user_data;
+  g_autoptr(GError) error = NULL;
+  g_autoptr(CommandResult) result = command_query_finish(res, &error);
 
-  // Start scanning
-  system("bluetoothctl scan on &");
+  if (error) {
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      g_printerr("Failed to list Bluetooth devices: %s\n", error->message);
+    refresh_done(cancellable, FALSE);
+    return;
+  }
 
-  // Get list of devices
-  char *output = execute_command("bluetoothctl devices");
-  if (!output)
+  // Events already keep the rows current; a listing like the last one
+  // leaves them alone
+  if (g_strcmp0(result->out, last_devices) == 0) {
+    refresh_done(cancellable, FALSE);
     return;
+  }
+  g_free(last_devices);
+  last_devices = g_strdup(result->out);
 
-  // Connect row activation handler
-  g_signal_connect(devices_list, "pressed",
-                   G_CALLBACK(on_device_row_activated), NULL);
+  // Clear only now so overlapping refreshes never stack up duplicate rows
+  clear_list_box(DevicesList);
 
   // Parse and add devices
-  char *line = strtok(output, "\n");
-  while (line) {
-    char address[18], name[128];
-    if (sscanf(line, "Device %17s %[^\n]", address, name) == 2) {
-      gboolean is_connected = is_device_connected(address);
-      GtkWidget *row = create_device_row(name, address, "*");
-      g_signal_connect(row, "pressed", G_CALLBACK(on_device_row_activated), NULL);
-      gtk_list_box_append(devices_list, row);
-    }
-    line = strtok(NULL, "\n");
+  LineReader reader;
+  StrView line;
+  char address[18], name[128];
+
+  line_reader_init(&reader, result->out, result->out_len);
+  while (line_reader_next(&reader, &line)) {
+    if (parse_device_line(line, address, name, sizeof(name)) && *name)
+      add_device_row(DevicesList, address, name);
+  }
+  refresh_done(cancellable, TRUE);
+}
+
+// Handle "[NEW]/[DEL]/[CHG] Device <address> ..." pushed by bluetoothctl
+static void on_device_event(const gchar *line, gpointer user_data) {
+  StrView event = str_view(line), kind;
+  char address[18], rest[128];
+
+  if (DevicesList == NULL || !str_view_has_prefix(event, "[") ||
+      !str_view_split(&event, ']', &kind) ||
+      !parse_device_line(str_view_strip(event), address, rest, sizeof(rest)))
+    return;
+  kind = str_view_skip(kind, 1);
+
+  GtkListBoxRow *row = find_device_row(DevicesList, address);
+
+  if (str_view_equal(kind, "NEW")) {
+    if (row == NULL)
+      add_device_row(DevicesList, address, *rest ? rest : address);
+  } else if (str_view_equal(kind, "DEL")) {
+    if (row != NULL)
+      gtk_list_box_remove(DevicesList, GTK_WIDGET(row));
+  } else if (row != NULL && g_str_has_prefix(rest, "Connected: ")) {
+    BluetoothDevice *device = g_object_get_data(G_OBJECT(row), "device-data");
+    device->is_connected = g_str_has_suffix(rest, "yes");
+    command_cache_invalidate("bluetoothctl");
+    adw_action_row_set_subtitle(ADW_ACTION_ROW(row), device->is_connected
+                                                         ? "Connected"
+                                                         : "Available");
   }
+}
+
+static void list_devices(GCancellable *cancellable, gpointer user_data) {
+  const gchar *argv[] = {"bluetoothctl", "devices", NULL};
+  command_query_async(argv, BLUETOOTH_DEVICES_TTL, cancellable,
+                      on_devices_ready,
+                      cancellable ? g_object_ref(cancellable) : NULL);
+}
 
-  free(output);
+// One discovery session lives in the shared bluetoothctl while the page is
+// seen; found devices arrive as [NEW] events instead of being polled.
+// Discovery keeps the radio busy, so it stops when nobody is looking.
+static void on_devices_visible(gboolean visible, gpointer user_data) {
+  if (scanning == visible)
+    return;
+  coprocess_send(bluetoothctl(), visible ? "scan on" : "scan off");
+  scanning = visible;
 }
 
+static const RefreshJob resync_devices_job = {
+    .name = "bluetooth devices",
+    .interval = BLUETOOTH_RESYNC_INTERVAL,
+    .max_interval = BLUETOOTH_RESYNC_MAX_INTERVAL,
+    .run = list_devices,
+    .visible = on_devices_visible,
+};
+
 void on_bluetooth_switch_active(GObject *bluetooth_switch, GParamSpec *pspec,
                                 gpointer user_data) {
   gboolean is_active;
@@ -232,64 +345,23 @@ void on_discoverable_switch_active(GObject *discoverable_switch,
   gboolean is_active;
   g_object_get(discoverable_switch, "active", &is_active, NULL);
 
-  GError *error = NULL;
-  gchar *command =
-      g_strdup_printf("bluetoothctl discoverable %s", is_active ? "on" : "off");
-  g_spawn_command_line_sync(command, NULL, NULL, NULL, &error);
-  g_free(command);
-
-  if (error) {
-    g_printerr("Failed to set discoverable: %s\n", error->message);
-    g_error_free(error);
-  }
-}
-
-gboolean get_bluetooth_status(void) {
-  gchar *command = "bluetoothctl show | grep Powered";
-  gchar *output = NULL;
-  GError *error = NULL;
-  gint exit_status;
-
-  g_spawn_command_line_sync(command, &output, NULL, &exit_status, &error);
-  if (error) {
-    g_printerr("Failed to get Bluetooth status: %s\n", error->message);
-    g_error_free(error);
-    return FALSE;
-  }
-
-  gboolean bluetooth_enabled =
-      (g_strstr_len(output, -1, "Powered: yes") != NULL);
-  g_free(output);
-  return bluetooth_enabled;
+  coprocess_send(bluetoothctl(),
+                 is_active ? "discoverable on" : "discoverable off");
 }
 
 void set_bluetooth_switch_state(GtkWidget *bluetooth_switch,
                                 gboolean is_active) {
+  // Reflecting the adapter state must not power it on or off again
+  g_signal_handlers_block_by_func(bluetooth_switch, on_bluetooth_switch_active,
+                                  NULL);
   g_object_set(bluetooth_switch, "active", is_active, NULL);
+  g_signal_handlers_unblock_by_func(bluetooth_switch,
+                                    on_bluetooth_switch_active, NULL);
 }
 
 void toggle_bluetooth(gboolean enable) {
-  gchar *command =
-      g_strdup_printf("bluetoothctl power %s", enable ? "on" : "off");
-  g_print("Executing command: %s\n", command);
-
-  GError *error = NULL;
-  gint exit_status;
-  g_spawn_command_line_sync(command, NULL, NULL, &exit_status, &error);
-  g_free(command);
-
-  if (error) {
-    g_printerr("Failed to toggle Bluetooth: %s\n", error->message);
-    g_error_free(error);
-  }
-}
-
-gboolean on_refresh_timeout(gpointer user_data) {
-  GtkListBox *devices_list = GTK_LIST_BOX(user_data);
-  if (devices_list) {
-    scan_bluetooth_devices(devices_list);
-  }
-  return G_SOURCE_CONTINUE;
+  coprocess_send(bluetoothctl(), enable ? "power on" : "power off");
+  command_cache_invalidate("bluetoothctl");
 }
 
 void complete_initialization(InitData *init_data) {
@@ -304,17 +376,20 @@ void complete_initialization(InitData *init_data) {
 
 void bluetooth_status_thread(GTask *task, gpointer source_object,
                              gpointer task_data, GCancellable *cancellable) {
+  g_auto(CommandStatsSpan) span =
+      command_stats_begin("task bluetooth status");
   GError *error = NULL;
-  gchar *output = NULL;
+  const gchar *argv[] = {"bluetoothctl", "show", NULL};
+  CommandResult *result =
+      command_query_sync(argv, BLUETOOTH_DEVICES_TTL, cancellable, &error);
 
-  if (!g_spawn_command_line_sync("bluetoothctl show", &output, NULL, NULL,
-                                 &error)) {
+  if (error) {
     g_task_return_error(task, error);
     return;
   }
 
-  gboolean bt_enabled = (g_strstr_len(output, -1, "Powered: yes") != NULL);
-  g_free(output);
+  gboolean bt_enabled = (g_strstr_len(result->out, -1, "Powered: yes") != NULL);
+  command_result_free(result);
   g_task_return_boolean(task, bt_enabled);
 }
 
@@ -341,16 +416,20 @@ void initialize_bluetooth_page(GtkBuilder *builder) {
       GTK_LIST_BOX(gtk_builder_get_object(builder, "bluetooth_devices_list"));
 
   if (bluetooth_switch && discoverable_switch && devices_list) {
-    scan_bluetooth_devices(devices_list);
+    g_signal_connect(devices_list, "row-activated",
+                     G_CALLBACK(on_device_row_activated), NULL);
+
+    DevicesList = devices_list;
+    coprocess_subscribe(bluetoothctl(), "[NEW] Device ", on_device_event, NULL);
+    coprocess_subscribe(bluetoothctl(), "[DEL] Device ", on_device_event, NULL);
+    coprocess_subscribe(bluetoothctl(), "[CHG] Device ", on_device_event, NULL);
 
-    g_signal_connect(bluetooth_switch, "notify::active",
-                     G_CALLBACK(on_bluetooth_switch_active), devices_list);
+    // The power switch itself is wired up in bluetooth_to_stack()
     g_signal_connect(discoverable_switch, "notify::active",
                      G_CALLBACK(on_discoverable_switch_active), NULL);
 
-    // Start periodic refresh
-    refresh_timeout_id =
-        g_timeout_add_seconds(10, on_refresh_timeout, devices_list);
+    // Lists devices and starts discovery once the page is on screen
+    resync_job = refresh_add(BluetoothPage, &resync_devices_job, NULL);
   }
 }
 
@@ -405,6 +484,17 @@ void bluetooth_to_stack(GtkStack *stack) {
     return;
   }
 
+  // No adapter or no bluetoothctl: show the page greyed out and never
+  // start the co-process
+  if (!capabilities()->bluetoothctl || !capabilities()->bluetooth_adapter) {
+    g_print("Bluetooth settings need bluetoothctl and an adapter\n");
+    gtk_widget_set_sensitive(BluetoothPage, FALSE);
+    gtk_stack_add_named(stack, BluetoothPage, "bluetooth_page");
+    gtk_stack_set_visible_child_name(stack, "bluetooth_page");
+    g_object_unref(bluetooth_builder);
+    return;
+  }
+
   InitData *init_data = g_new0(InitData, 1);
   init_data->stack = stack;
   init_data->builder = bluetooth_builder;
@@ -415,10 +505,6 @@ void bluetooth_to_stack(GtkStack *stack) {
   if (init_data->bluetooth_switch != NULL) {
     g_signal_connect(init_data->bluetooth_switch, "notify::active",
                      G_CALLBACK(on_bluetooth_switch_active), NULL);
-
-    // Initialize switch state
-    gboolean bt_status = get_bluetooth_status();
-    set_bluetooth_switch_state(init_data->bluetooth_switch, bt_status);
   }
 
   // Initialize Bluetooth page
@@ -434,28 +520,16 @@ void bluetooth_to_stack(GtkStack *stack) {
   g_object_unref(bt_task);
 }
 
-void refresh_bluetooth_devices(GtkBuilder *builder) {
-  if (BluetoothPage && builder) {
-    // Get the devices_list from the builder
-    GtkListBox *devices_list =
-        GTK_LIST_BOX(gtk_builder_get_object(builder, "bluetooth_devices_list"));
-    if (devices_list) {
-      // Clear the existing list and scan for new devices
-      clear_list_box(devices_list);
-      scan_bluetooth_devices(devices_list);
-    }
-  }
-}
-
 // Cleanup function
 void cleanup_bluetooth(void) {
-  if (refresh_timeout_id > 0) {
-    g_source_remove(refresh_timeout_id);
-    refresh_timeout_id = 0;
-  }
+  refresh_remove(resync_job);
+  resync_job = 0;
 
   // Stop scanning
-  system("bluetoothctl scan off");
+  if (scanning) {
+    coprocess_send(bluetoothctl(), "scan off");
+    scanning = FALSE;
+  }
 
   // Cleanup any remaining device data
   if (BluetoothPage) {
@@ -477,82 +551,3 @@ void cleanup_bluetooth(void) {
     g_object_unref(builder);
   }
 }
-
-// Function to get device name from address
-char *get_device_name(const char *address) {
-  GError *error = NULL;
-  gchar *command = g_strdup_printf("bluetoothctl info %s", address);
-  gchar *output = NULL;
-  char *name = NULL;
-
-  g_spawn_command_line_sync(command, &output, NULL, NULL, &error);
-  g_free(command);
-
-  if (error) {
-    g_printerr("Failed to get device info: %s\n", error->message);
-    g_error_free(error);
-    g_free(output);
-    return NULL;
-  }
-
-  // Parse name from output
-  char *name_line = g_strstr_len(output, -1, "Name: ");
-  if (name_line) {
-    name_line += 6; // Skip "Name: "
-    char *end = strchr(name_line, '\n');
-    if (end) {
-      size_t len = end - name_line;
-      name = g_malloc(len + 1);
-      strncpy(name, name_line, len);
-      name[len] = '\0';
-    }
-  }
-
-  g_free(output);
-  return name;
-}
-
-// Function to pair with a device
-gboolean pair_device(const char *address) {
-  GError *error = NULL;
-  gchar *command = g_strdup_printf("bluetoothctl pair %s", address);
-  gchar *output = NULL;
-  gint exit_status;
-
-  g_spawn_command_line_sync(command, &output, NULL, &exit_status, &error);
-  g_free(command);
-
-  if (error) {
-    g_printerr("Failed to pair device: %s\n", error->message);
-    g_error_free(error);
-    g_free(output);
-    return FALSE;
-  }
-
-  gboolean success = (g_strstr_len(output, -1, "Pairing successful") != NULL);
-  g_free(output);
-  return success;
-}
-
-// Function to remove a paired device
-gboolean remove_device(const char *address) {
-  GError *error = NULL;
-  gchar *command = g_strdup_printf("bluetoothctl remove %s", address);
-  gchar *output = NULL;
-  gint exit_status;
-
-  g_spawn_command_line_sync(command, &output, NULL, &exit_status, &error);
-  g_free(command);
-
-  if (error) {
-    g_printerr("Failed to remove device: %s\n", error->message);
-    g_error_free(error);
-    g_free(output);
-    return FALSE;
-  }
-
-  gboolean success =
-      (g_strstr_len(output, -1, "Device has been removed") != NULL);
-  g_free(output);
-  return success;
-}
@@ -0,0 +1,271 @@
+#include "capability/capability.h"
+#include "command/stats.h"
+#include <gio/gio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+typedef enum {
+  PROBE_PROGRAM,
+  PROBE_SYSTEM_BUS,
+  PROBE_SYSFS,
+  N_PROBE_KINDS,
+} ProbeKind;
+
+typedef struct {
+  ProbeKind kind;
+  const gchar *key;    // in the cache file
+  const gchar *target; // program, bus name, or sysfs path where one '*'
+                       // stands for any entry of that directory
+  glong offset;
+} Probe;
+
+#define PROBE(kind, field, target)                                             \
+  { kind, #field, target, G_STRUCT_OFFSET(Capabilities, field) }
+
+static const Probe probes[] = {
+    PROBE(PROBE_PROGRAM, nmcli, "nmcli"),
+    PROBE(PROBE_PROGRAM, pactl, "pactl"),
+    PROBE(PROBE_PROGRAM, bluetoothctl, "bluetoothctl"),
+    PROBE(PROBE_PROGRAM, ufw, "ufw"),
+    PROBE(PROBE_PROGRAM, pkexec, "pkexec"),
+    PROBE(PROBE_PROGRAM, brightnessctl, "brightnessctl"),
+    PROBE(PROBE_PROGRAM, swww, "swww"),
+    PROBE(PROBE_PROGRAM, feh, "feh"),
+    PROBE(PROBE_PROGRAM, hyprctl, "hyprctl"),
+    PROBE(PROBE_SYSTEM_BUS, network_manager, "org.freedesktop.NetworkManager"),
+    PROBE(PROBE_SYSTEM_BUS, bluez, "org.bluez"),
+    PROBE(PROBE_SYSTEM_BUS, logind, "org.freedesktop.login1"),
+    PROBE(PROBE_SYSFS, backlight, "/sys/class/backlight/*"),
+    PROBE(PROBE_SYSFS, wireless, "/sys/class/net/*/wireless"),
+    PROBE(PROBE_SYSFS, bluetooth_adapter, "/sys/class/bluetooth/*"),
+};
+
+// Only programs are cached: a service or a device can come and go between
+// two runs without anything the stamp could see
+#define CACHE_GROUP "programs"
+
+static Capabilities found;
+static gboolean initialized = FALSE;
+
+#define PROBE_FIELD(probe) G_STRUCT_MEMBER(gboolean, &found, (probe)->offset)
+
+static gboolean sysfs_exists(const gchar *pattern) {
+  const gchar *star = strchr(pattern, '*');
+  g_autofree gchar *parent = NULL;
+  g_autoptr(GDir) directory = NULL;
+  const gchar *name;
+
+  if (star == NULL)
+    return g_file_test(pattern, G_FILE_TEST_EXISTS);
+
+  parent = g_strndup(pattern, star - pattern);
+  directory = g_dir_open(parent, 0, NULL);
+  while (directory != NULL && (name = g_dir_read_name(directory)) != NULL) {
+    g_autofree gchar *path = g_strconcat(parent, name, star + 1, NULL);
+
+    if (star[1] == '\0' || g_file_test(path, G_FILE_TEST_EXISTS))
+      return TRUE;
+  }
+  return FALSE;
+}
+
+static void add_bus_names(GDBusConnection *bus, const gchar *method,
+                          GHashTable *names) {
+  g_autoptr(GVariant) reply = g_dbus_connection_call_sync(
+      bus, "org.freedesktop.DBus", "/org/freedesktop/DBus",
+      "org.freedesktop.DBus", method, NULL, G_VARIANT_TYPE("(as)"),
+      G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL);
+  g_autoptr(GVariantIter) iter = NULL;
+  const gchar *name;
+
+  if (reply == NULL)
+    return;
+  g_variant_get(reply, "(as)", &iter);
+  while (g_variant_iter_next(iter, "&s", &name))
+    g_hash_table_add(names, g_strdup(name));
+}
+
+// Services that are running now or would start on the first call
+static GHashTable *system_bus_names(void) {
+  GHashTable *names = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                            NULL);
+  g_autoptr(GDBusConnection) bus = g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL,
+                                                  NULL);
+
+  if (bus != NULL) {
+    add_bus_names(bus, "ListNames", names);
+    add_bus_names(bus, "ListActivatableNames", names);
+  }
+  return names;
+}
+
+// Each kind of probe runs on its own thread, writing only its own fields
+static gpointer probe_thread(gpointer data) {
+  ProbeKind kind = GPOINTER_TO_INT(data);
+  g_autoptr(GHashTable) names = NULL;
+
+  if (kind == PROBE_SYSTEM_BUS)
+    names = system_bus_names();
+
+  for (guint i = 0; i < G_N_ELEMENTS(probes); i++) {
+    const Probe *probe = &probes[i];
+    g_autofree gchar *program = NULL;
+
+    if (probe->kind != kind)
+      continue;
+    switch (kind) {
+    case PROBE_PROGRAM:
+      program = g_find_program_in_path(probe->target);
+      PROBE_FIELD(probe) = program != NULL;
+      break;
+    case PROBE_SYSTEM_BUS:
+      PROBE_FIELD(probe) = g_hash_table_contains(names, probe->target);
+      break;
+    case PROBE_SYSFS:
+      PROBE_FIELD(probe) = sysfs_exists(probe->target);
+      break;
+    default:
+      break;
+    }
+  }
+  return NULL;
+}
+
+static void probe(gboolean programs) {
+  GThread *threads[N_PROBE_KINDS] = {NULL};
+
+  for (gint kind = 0; kind < N_PROBE_KINDS; kind++)
+    if (kind != PROBE_PROGRAM || programs)
+      threads[kind] = g_thread_new("capability probe", probe_thread,
+                                   GINT_TO_POINTER(kind));
+  for (gint kind = 0; kind < N_PROBE_KINDS; kind++)
+    if (threads[kind] != NULL)
+      g_thread_join(threads[kind]);
+}
+
+static gchar *cache_path(void) {
+  return g_build_filename(g_get_user_cache_dir(), "systune", "capabilities",
+                          NULL);
+}
+
+static void append_mtime(GString *stamp, const struct stat *info) {
+  g_string_append_printf(stamp, "%lld.%09ld", (long long)info->st_mtim.tv_sec,
+                         (long)info->st_mtim.tv_nsec);
+}
+
+// A rebuilt binary may look for things it did not before, and a different
+// PATH finds different programs. Installing or removing a program changes
+// the mtime of its PATH directory, so each directory's is in the stamp too.
+static gchar *cache_stamp(void) {
+  const gchar *path = g_getenv("PATH");
+  g_auto(GStrv) directories = g_strsplit(path ? path : "", ":", -1);
+  GString *stamp = g_string_new(NULL);
+  struct stat info;
+
+  if (stat("/proc/self/exe", &info) != 0) {
+    g_string_free(stamp, TRUE);
+    return NULL;
+  }
+  append_mtime(stamp, &info);
+
+  for (gchar **directory = directories; *directory != NULL; directory++) {
+    g_string_append_printf(stamp, " %s=", *directory);
+    if (**directory != '\0' && stat(*directory, &info) == 0)
+      append_mtime(stamp, &info);
+  }
+  return g_string_free(stamp, FALSE);
+}
+
+static gboolean load_cache(const gchar *path, const gchar *stamp) {
+  g_autoptr(GKeyFile) file = g_key_file_new();
+  g_autofree gchar *cached_stamp = NULL;
+  Capabilities loaded = {0};
+
+  if (!g_key_file_load_from_file(file, path, G_KEY_FILE_NONE, NULL))
+    return FALSE;
+  cached_stamp = g_key_file_get_string(file, "cache", "stamp", NULL);
+  if (g_strcmp0(cached_stamp, stamp) != 0)
+    return FALSE;
+
+  for (guint i = 0; i < G_N_ELEMENTS(probes); i++) {
+    const Probe *probe = &probes[i];
+    g_autoptr(GError) error = NULL;
+    gboolean value;
+
+    if (probe->kind != PROBE_PROGRAM)
+      continue;
+    value = g_key_file_get_boolean(file, CACHE_GROUP, probe->key, &error);
+    if (error != NULL)
+      return FALSE;
+    G_STRUCT_MEMBER(gboolean, &loaded, probe->offset) = value;
+  }
+
+  for (guint i = 0; i < G_N_ELEMENTS(probes); i++)
+    if (probes[i].kind == PROBE_PROGRAM)
+      PROBE_FIELD(&probes[i]) =
+          G_STRUCT_MEMBER(gboolean, &loaded, probes[i].offset);
+  return TRUE;
+}
+
+static void save_cache(const gchar *path, const gchar *stamp) {
+  g_autoptr(GKeyFile) file = g_key_file_new();
+  g_autofree gchar *directory = g_path_get_dirname(path);
+  g_autoptr(GError) error = NULL;
+
+  g_key_file_set_string(file, "cache", "stamp", stamp);
+  for (guint i = 0; i < G_N_ELEMENTS(probes); i++)
+    if (probes[i].kind == PROBE_PROGRAM)
+      g_key_file_set_boolean(file, CACHE_GROUP, probes[i].key,
+                             PROBE_FIELD(&probes[i]));
+
+  g_mkdir_with_parents(directory, 0700);
+  if (!g_key_file_save_to_file(file, path, &error))
+    g_printerr("Failed to cache capabilities: %s\n", error->message);
+}
+
+static void read_session(void) {
+  const gchar *type = g_getenv("XDG_SESSION_TYPE");
+  const gchar *desktop = g_getenv("XDG_CURRENT_DESKTOP");
+
+  // The display variables win over the session type, which says "tty" for
+  // compositors started from a console
+  if (g_getenv("WAYLAND_DISPLAY") != NULL || g_strcmp0(type, "wayland") == 0)
+    found.session = CAPABILITY_SESSION_WAYLAND;
+  else if (g_getenv("DISPLAY") != NULL || g_strcmp0(type, "x11") == 0)
+    found.session = CAPABILITY_SESSION_X11;
+  else
+    found.session = CAPABILITY_SESSION_OTHER;
+
+  found.desktop = g_strdup(desktop ? desktop : g_getenv("DESKTOP_SESSION"));
+  if (g_getenv("HYPRLAND_INSTANCE_SIGNATURE") != NULL)
+    found.compositor = g_strdup("Hyprland");
+  else if (g_getenv("SWAYSOCK") != NULL)
+    found.compositor = g_strdup("sway");
+}
+
+static void load_or_probe(void) {
+  g_auto(CommandStatsSpan) span = command_stats_begin("capability probe");
+  g_autofree gchar *path = cache_path();
+  g_autofree gchar *stamp = cache_stamp();
+  gboolean cached = stamp != NULL && load_cache(path, stamp);
+
+  // Services and devices are probed every time, alongside the programs
+  // when those were not cached
+  probe(!cached);
+  if (stamp != NULL && !cached)
+    save_cache(path, stamp);
+}
+
+void capabilities_init(void) {
+  if (initialized)
+    return;
+  initialized = TRUE;
+
+  read_session();
+  load_or_probe();
+}
+
+const Capabilities *capabilities(void) {
+  capabilities_init();
+  return &found;
+}
@@ -1,20 +1,287 @@
-#include <stdlib.h>
+#include "command/command.h"
+#include "command/stats.h"
 #include <string.h>
-#include <stdio.h>
-
-// Function to execute a command and capture its output
-char* execute_command(const char* command) {
-    FILE* fp = popen(command, "r");
-    if (!fp) {
-        perror("Failed to execute command");
-        exit(EXIT_FAILURE);
-    }
-
-    // Read the output into a buffer
-    char* buffer = malloc(4096);
-    size_t len = fread(buffer, 1, 4096, fp);
-    buffer[len] = '\0'; // Null-terminate the string
-
-    pclose(fp);
-    return buffer;
+
+#define COMMAND_READ_SIZE 8192
+
+static gint running_count;
+
+typedef struct {
+  gchar *name;
+  gchar *stats_key;
+  gint64 start;
+  GSubprocess *process;
+  GString *out;
+  GString *err;
+  CommandOutputFunc on_output;
+  gpointer output_data;
+  GSource *timeout_source;
+  gboolean timed_out;
+  gulong cancel_id;
+  gint pending; // stdout reader, stderr reader and the wait
+} CommandState;
+
+static void command_state_free(CommandState *state) {
+  if (state->timeout_source) {
+    g_source_destroy(state->timeout_source);
+    g_source_unref(state->timeout_source);
+  }
+  if (state->out)
+    g_string_free(state->out, TRUE);
+  if (state->err)
+    g_string_free(state->err, TRUE);
+  g_clear_object(&state->process);
+  g_free(state->stats_key);
+  g_free(state->name);
+  g_free(state);
+}
+
+void command_result_free(CommandResult *result) {
+  if (result == NULL)
+    return;
+  g_free(result->out);
+  g_free(result->err);
+  g_free(result);
+}
+
+gboolean command_result_success(const CommandResult *result) {
+  return result != NULL && result->exit_status == 0;
+}
+
+guint command_running_count(void) {
+  return g_atomic_int_get(&running_count);
+}
+
+// Called once per finished sub-operation; the last one returns the task
+static void command_complete_one(GTask *task) {
+  CommandState *state = g_task_get_task_data(task);
+  GCancellable *cancellable = g_task_get_cancellable(task);
+
+  if (--state->pending > 0)
+    return;
+
+  if (state->timeout_source) {
+    g_source_destroy(state->timeout_source);
+    g_clear_pointer(&state->timeout_source, g_source_unref);
+  }
+  if (state->cancel_id) {
+    g_cancellable_disconnect(cancellable, state->cancel_id);
+    state->cancel_id = 0;
+  }
+
+  command_stats_add(state->stats_key, g_get_monotonic_time() - state->start,
+                    state->out->len + state->err->len, TRUE);
+  g_atomic_int_add(&running_count, -1);
+
+  if (state->timed_out) {
+    g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+                            "'%s' timed out", state->name);
+    return;
+  }
+  if (g_cancellable_is_cancelled(cancellable)) {
+    g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                            "'%s' was cancelled", state->name);
+    return;
+  }
+
+  CommandResult *result = g_new0(CommandResult, 1);
+  result->out_len = state->out->len;
+  result->out = g_string_free(state->out, FALSE);
+  result->err = g_string_free(state->err, FALSE);
+  state->out = NULL;
+  state->err = NULL;
+
+  if (g_subprocess_get_if_exited(state->process)) {
+    result->exit_status = g_subprocess_get_exit_status(state->process);
+  } else {
+    result->exit_status = -1;
+    if (g_subprocess_get_if_signaled(state->process))
+      result->term_signal = g_subprocess_get_term_sig(state->process);
+  }
+
+  g_task_return_pointer(task, result, (GDestroyNotify)command_result_free);
+}
+
+static void on_command_read(GObject *source, GAsyncResult *res,
+                            gpointer user_data) {
+  GTask *task = user_data;
+  CommandState *state = g_task_get_task_data(task);
+  GInputStream *stream = G_INPUT_STREAM(source);
+  g_autoptr(GError) error = NULL;
+
+  GBytes *bytes = g_input_stream_read_bytes_finish(stream, res, &error);
+  gsize len = bytes ? g_bytes_get_size(bytes) : 0;
+
+  // EOF, or the pipe went away because the child was killed
+  if (len == 0) {
+    if (error)
+      g_debug("Reading output of '%s' failed: %s", state->name,
+              error->message);
+    if (bytes)
+      g_bytes_unref(bytes);
+    command_complete_one(task);
+    g_object_unref(task);
+    return;
+  }
+
+  const gchar *data = g_bytes_get_data(bytes, NULL);
+  if (stream == g_subprocess_get_stdout_pipe(state->process)) {
+    g_string_append_len(state->out, data, len);
+    if (state->on_output)
+      state->on_output(data, len, state->output_data);
+  } else {
+    g_string_append_len(state->err, data, len);
+  }
+  g_bytes_unref(bytes);
+
+  // Keep the task reference for the next read
+  g_input_stream_read_bytes_async(stream, COMMAND_READ_SIZE,
+                                  G_PRIORITY_DEFAULT, NULL, on_command_read,
+                                  task);
+}
+
+static void on_command_exited(GObject *source, GAsyncResult *res,
+                              gpointer user_data) {
+  GTask *task = user_data;
+
+  g_subprocess_wait_finish(G_SUBPROCESS(source), res, NULL);
+  command_complete_one(task);
+  g_object_unref(task);
+}
+
+static gboolean on_command_timeout(gpointer user_data) {
+  CommandState *state = user_data;
+
+  g_warning("'%s' did not finish in time, killing it", state->name);
+  state->timed_out = TRUE;
+  g_subprocess_force_exit(state->process);
+
+  g_clear_pointer(&state->timeout_source, g_source_unref);
+  return G_SOURCE_REMOVE;
+}
+
+// May run on whichever thread cancelled; force_exit is thread safe
+static void on_command_cancelled(GCancellable *cancellable,
+                                 gpointer user_data) {
+  CommandState *state = user_data;
+  g_subprocess_force_exit(state->process);
+}
+
+void command_run_async(const gchar *const *argv, guint timeout_ms,
+                       CommandOutputFunc on_output, gpointer output_data,
+                       GCancellable *cancellable, GAsyncReadyCallback callback,
+                       gpointer user_data) {
+  g_return_if_fail(argv != NULL && argv[0] != NULL);
+
+  GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+  g_task_set_source_tag(task, command_run_async);
+
+  CommandState *state = g_new0(CommandState, 1);
+  state->name = g_strdup(argv[0]);
+  state->on_output = on_output;
+  state->output_data = output_data;
+  g_task_set_task_data(task, state, (GDestroyNotify)command_state_free);
+
+  GError *error = NULL;
+  if (g_cancellable_set_error_if_cancelled(cancellable, &error)) {
+    g_task_return_error(task, error);
+    g_object_unref(task);
+    return;
+  }
+
+  // Force the C locale so the parsers see untranslated output
+  GSubprocessLauncher *launcher = g_subprocess_launcher_new(
+      G_SUBPROCESS_FLAGS_STDOUT_PIPE | G_SUBPROCESS_FLAGS_STDERR_PIPE);
+  g_subprocess_launcher_setenv(launcher, "LC_ALL", "C", TRUE);
+  state->process = g_subprocess_launcher_spawnv(launcher, argv, &error);
+  g_object_unref(launcher);
+
+  if (state->process == NULL) {
+    g_task_return_error(task, error);
+    g_object_unref(task);
+    return;
+  }
+
+  state->out = g_string_new(NULL);
+  state->err = g_string_new(NULL);
+  state->pending = 3;
+  state->stats_key = command_stats_key(argv);
+  state->start = g_get_monotonic_time();
+  g_atomic_int_inc(&running_count);
+
+  g_input_stream_read_bytes_async(g_subprocess_get_stdout_pipe(state->process),
+                                  COMMAND_READ_SIZE, G_PRIORITY_DEFAULT, NULL,
+                                  on_command_read, g_object_ref(task));
+  g_input_stream_read_bytes_async(g_subprocess_get_stderr_pipe(state->process),
+                                  COMMAND_READ_SIZE, G_PRIORITY_DEFAULT, NULL,
+                                  on_command_read, g_object_ref(task));
+  g_subprocess_wait_async(state->process, NULL, on_command_exited,
+                          g_object_ref(task));
+
+  if (timeout_ms > 0) {
+    state->timeout_source = g_timeout_source_new(timeout_ms);
+    g_source_set_callback(state->timeout_source, on_command_timeout, state,
+                          NULL);
+    g_source_attach(state->timeout_source,
+                    g_main_context_get_thread_default());
+  }
+
+  if (cancellable)
+    state->cancel_id = g_cancellable_connect(
+        cancellable, G_CALLBACK(on_command_cancelled), state, NULL);
+
+  g_object_unref(task);
+}
+
+CommandResult *command_run_finish(GAsyncResult *result, GError **error) {
+  g_return_val_if_fail(g_task_is_valid(result, NULL), NULL);
+  return g_task_propagate_pointer(G_TASK(result), error);
+}
+
+static void on_sync_done(GObject *source, GAsyncResult *res,
+                         gpointer user_data) {
+  GAsyncResult **result = user_data;
+  *result = g_object_ref(res);
+}
+
+CommandResult *command_run_sync(const gchar *const *argv, guint timeout_ms,
+                                GCancellable *cancellable, GError **error) {
+  // Drive the async machinery on a private context so worker threads get the
+  // same timeout and cancellation handling as the main loop
+  GMainContext *context = g_main_context_new();
+  GAsyncResult *res = NULL;
+
+  g_main_context_push_thread_default(context);
+  command_run_async(argv, timeout_ms, NULL, NULL, cancellable, on_sync_done,
+                    &res);
+  while (res == NULL)
+    g_main_context_iteration(context, TRUE);
+
+  CommandResult *result = command_run_finish(res, error);
+  g_object_unref(res);
+
+  g_main_context_pop_thread_default(context);
+  g_main_context_unref(context);
+  return result;
+}
+
+static void on_spawn_done(GObject *source, GAsyncResult *res,
+                          gpointer user_data) {
+  gchar *name = user_data;
+  g_autoptr(GError) error = NULL;
+  g_autoptr(CommandResult) result = command_run_finish(res, &error);
+
+  if (error) {
+    g_printerr("Failed to run %s: %s\n", name, error->message);
+  } else if (!command_result_success(result)) {
+    g_printerr("%s exited with status %d: %s\n", name, result->exit_status,
+               result->err);
+  }
+  g_free(name);
+}
+
+void command_spawn(const gchar *const *argv) {
+  // Writes may wait on a polkit prompt, so they get no timeout
+  command_run_async(argv, 0, NULL, NULL, NULL, on_spawn_done,
+                    g_strdup(argv[0]));
 }
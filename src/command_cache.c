@@ -0,0 +1,273 @@
+#include "command/cache.h"
+#include "command/stats.h"
+#include <string.h>
+
+// Stale entries are dropped at most this often, on the next lookup
+#define CACHE_SWEEP_INTERVAL (60 * G_TIME_SPAN_SECOND)
+
+typedef struct {
+  gchar *tool;
+  CommandResult *result; // NULL until the first successful run
+  gint64 expires;        // monotonic time the result goes stale
+  gboolean in_flight;
+  guint generation; // bumped by invalidation while a run is in flight
+  GList *waiters;   // GTasks of async callers sharing the running query
+  gint64 ttl_us;
+} CacheEntry;
+
+static GMutex cache_lock;
+static GCond cache_cond;
+static GHashTable *cache; // argv joined with \x1f -> CacheEntry
+static gint64 next_sweep;
+
+static void cache_entry_free(CacheEntry *entry) {
+  command_result_free(entry->result);
+  g_free(entry->tool);
+  g_free(entry);
+}
+
+static CommandResult *command_result_copy(const CommandResult *result) {
+  CommandResult *copy = g_new0(CommandResult, 1);
+  copy->out = g_memdup2(result->out, result->out_len + 1);
+  copy->out_len = result->out_len;
+  copy->err = g_strdup(result->err);
+  copy->exit_status = result->exit_status;
+  copy->term_signal = result->term_signal;
+  return copy;
+}
+
+static gchar *cache_key(const gchar *const *argv) {
+  return g_strjoinv("\x1f", (gchar **)argv);
+}
+
+static gboolean cache_entry_fresh(CacheEntry *entry) {
+  return entry->result != NULL && g_get_monotonic_time() < entry->expires;
+}
+
+// Queries with arguments that change, such as a device address, would
+// otherwise leave an entry each behind. Entries with a run in flight stay,
+// since its completion looks them up. Must be called with cache_lock held.
+static void cache_sweep(void) {
+  gint64 now = g_get_monotonic_time();
+  GHashTableIter iter;
+  CacheEntry *entry;
+
+  if (now < next_sweep)
+    return;
+  next_sweep = now + CACHE_SWEEP_INTERVAL;
+
+  g_hash_table_iter_init(&iter, cache);
+  while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&entry)) {
+    if (!entry->in_flight && !cache_entry_fresh(entry))
+      g_hash_table_iter_remove(&iter);
+  }
+}
+
+// Must be called with cache_lock held
+static CacheEntry *cache_lookup(const gchar *key, const gchar *tool,
+                                gint64 ttl_us) {
+  if (cache == NULL)
+    cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                  (GDestroyNotify)cache_entry_free);
+  cache_sweep();
+
+  CacheEntry *entry = g_hash_table_lookup(cache, key);
+  if (entry == NULL) {
+    entry = g_new0(CacheEntry, 1);
+    entry->tool = g_strdup(tool);
+    g_hash_table_insert(cache, g_strdup(key), entry);
+  }
+  entry->ttl_us = ttl_us;
+  return entry;
+}
+
+// Store the outcome of a shared run and hand the async waiters their copies.
+// Takes ownership of result and error.
+static void cache_complete(const gchar *key, guint generation,
+                           CommandResult *result, GError *error) {
+  g_mutex_lock(&cache_lock);
+  CacheEntry *entry = g_hash_table_lookup(cache, key);
+  GList *waiters = g_steal_pointer(&entry->waiters);
+
+  entry->in_flight = FALSE;
+  if (result && command_result_success(result) &&
+      entry->generation == generation) {
+    command_result_free(entry->result);
+    entry->result = command_result_copy(result);
+    entry->expires = g_get_monotonic_time() + entry->ttl_us;
+  }
+  g_cond_broadcast(&cache_cond);
+  g_mutex_unlock(&cache_lock);
+
+  for (GList *l = waiters; l != NULL; l = l->next) {
+    GTask *task = l->data;
+    if (error) {
+      g_task_return_error(task, g_error_copy(error));
+    } else {
+      g_task_return_pointer(task, command_result_copy(result),
+                            (GDestroyNotify)command_result_free);
+    }
+    g_object_unref(task);
+  }
+  g_list_free(waiters);
+
+  command_result_free(result);
+  if (error)
+    g_error_free(error);
+}
+
+static void record_hit(const gchar *const *argv) {
+  g_autofree gchar *stats_key = command_stats_key(argv);
+  command_stats_add_hit(stats_key);
+}
+
+typedef struct {
+  gchar *key;
+  guint generation;
+} QueryRun;
+
+static void on_query_done(GObject *source, GAsyncResult *res,
+                          gpointer user_data) {
+  QueryRun *run = user_data;
+  GError *error = NULL;
+  CommandResult *result = command_run_finish(res, &error);
+
+  cache_complete(run->key, run->generation, result, error);
+  g_free(run->key);
+  g_free(run);
+}
+
+void command_query_async(const gchar *const *argv, guint ttl_ms,
+                         GCancellable *cancellable,
+                         GAsyncReadyCallback callback, gpointer user_data) {
+  g_return_if_fail(argv != NULL && argv[0] != NULL);
+
+  GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+  g_task_set_source_tag(task, command_query_async);
+  gchar *key = cache_key(argv);
+
+  g_mutex_lock(&cache_lock);
+  CacheEntry *entry = cache_lookup(key, argv[0], ttl_ms * G_TIME_SPAN_MILLISECOND);
+
+  if (cache_entry_fresh(entry)) {
+    CommandResult *copy = command_result_copy(entry->result);
+    g_mutex_unlock(&cache_lock);
+    record_hit(argv);
+    g_task_return_pointer(task, copy, (GDestroyNotify)command_result_free);
+    g_object_unref(task);
+    g_free(key);
+    return;
+  }
+
+  // Join the query that is already running, or start it
+  entry->waiters = g_list_append(entry->waiters, task);
+  if (entry->in_flight) {
+    g_mutex_unlock(&cache_lock);
+    record_hit(argv);
+    g_free(key);
+    return;
+  }
+
+  entry->in_flight = TRUE;
+  QueryRun *run = g_new0(QueryRun, 1);
+  run->key = key;
+  run->generation = entry->generation;
+  g_mutex_unlock(&cache_lock);
+
+  // The shared run is not tied to any single caller's cancellable
+  command_run_async(argv, COMMAND_DEFAULT_TIMEOUT, NULL, NULL, NULL,
+                    on_query_done, run);
+}
+
+CommandResult *command_query_finish(GAsyncResult *result, GError **error) {
+  g_return_val_if_fail(g_task_is_valid(result, NULL), NULL);
+  return g_task_propagate_pointer(G_TASK(result), error);
+}
+
+CommandResult *command_query_sync(const gchar *const *argv, guint ttl_ms,
+                                  GCancellable *cancellable, GError **error) {
+  // Waiting here for an async run of the same query would deadlock: its
+  // completion needs the main loop this blocks
+  g_return_val_if_fail(!g_main_context_is_owner(g_main_context_default()),
+                       NULL);
+
+  gchar *key = cache_key(argv);
+
+  g_mutex_lock(&cache_lock);
+  CacheEntry *entry = cache_lookup(key, argv[0], ttl_ms * G_TIME_SPAN_MILLISECOND);
+
+  // Another caller is running this exact query; wait for its result. Once
+  // that run is over the entry may be dropped, so it is looked up again.
+  while (entry->in_flight) {
+    g_cond_wait(&cache_cond, &cache_lock);
+    entry = cache_lookup(key, argv[0], ttl_ms * G_TIME_SPAN_MILLISECOND);
+  }
+
+  if (cache_entry_fresh(entry)) {
+    CommandResult *copy = command_result_copy(entry->result);
+    g_mutex_unlock(&cache_lock);
+    record_hit(argv);
+    g_free(key);
+    return copy;
+  }
+
+  entry->in_flight = TRUE;
+  guint generation = entry->generation;
+  g_mutex_unlock(&cache_lock);
+
+  GError *run_error = NULL;
+  CommandResult *result = command_run_sync(argv, COMMAND_DEFAULT_TIMEOUT,
+                                           cancellable, &run_error);
+  CommandResult *copy = result ? command_result_copy(result) : NULL;
+  if (run_error)
+    g_propagate_error(error, g_error_copy(run_error));
+
+  cache_complete(key, generation, result, run_error);
+  g_free(key);
+  return copy;
+}
+
+void command_cache_invalidate(const gchar *tool) {
+  GHashTableIter iter;
+  CacheEntry *entry;
+
+  g_mutex_lock(&cache_lock);
+  if (cache != NULL) {
+    g_hash_table_iter_init(&iter, cache);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&entry)) {
+      if (tool != NULL && g_strcmp0(entry->tool, tool) != 0)
+        continue;
+      if (!entry->in_flight) {
+        g_hash_table_iter_remove(&iter);
+        continue;
+      }
+      g_clear_pointer(&entry->result, command_result_free);
+      entry->generation++;
+    }
+  }
+  g_mutex_unlock(&cache_lock);
+}
+
+static void on_write_done(GObject *source, GAsyncResult *res,
+                          gpointer user_data) {
+  gchar *tool = user_data;
+  g_autoptr(GError) error = NULL;
+  g_autoptr(CommandResult) result = command_run_finish(res, &error);
+
+  if (error) {
+    g_printerr("Failed to run %s: %s\n", tool, error->message);
+  } else if (!command_result_success(result)) {
+    g_printerr("%s exited with status %d: %s\n", tool, result->exit_status,
+               result->err);
+  }
+
+  // Reads that started while the write was running saw the old state
+  command_cache_invalidate(tool);
+  g_free(tool);
+}
+
+void command_write(const gchar *const *argv) {
+  command_cache_invalidate(argv[0]);
+  command_run_async(argv, 0, NULL, NULL, NULL, on_write_done,
+                    g_strdup(argv[0]));
+}
@@ -0,0 +1,196 @@
+#include "command/setter.h"
+#include "command/cache.h"
+
+typedef struct {
+  gchar **argv; // a process write, or
+  CommandSetFunc func; // an in-process one
+  gpointer data;
+  GDestroyNotify destroy;
+} SetterWrite;
+
+typedef struct {
+  gchar *name;
+  SetterWrite *pending; // newest value not written yet
+  SetterWrite *running;
+  gint64 last_start;
+  guint interval_ms;
+  guint timer_id;
+  CommandSetSettledFunc settled;
+  gpointer settled_data;
+} SetterTarget;
+
+static GHashTable *targets; // name -> SetterTarget, never freed
+static gboolean flushing;
+
+static void setter_start(SetterTarget *target);
+
+static void setter_write_free(SetterWrite *write) {
+  if (write == NULL)
+    return;
+  g_strfreev(write->argv);
+  if (write->destroy)
+    write->destroy(write->data);
+  g_free(write);
+}
+
+static SetterTarget *setter_target(const gchar *name) {
+  if (targets == NULL)
+    targets = g_hash_table_new(g_str_hash, g_str_equal);
+
+  SetterTarget *target = g_hash_table_lookup(targets, name);
+  if (target == NULL) {
+    target = g_new0(SetterTarget, 1);
+    target->name = g_strdup(name);
+    target->interval_ms = COMMAND_SET_INTERVAL;
+    g_hash_table_insert(targets, target->name, target);
+  }
+  return target;
+}
+
+static gboolean on_interval_elapsed(gpointer user_data) {
+  SetterTarget *target = user_data;
+
+  target->timer_id = 0;
+  setter_start(target);
+  return G_SOURCE_REMOVE;
+}
+
+// Start the pending write now, or once the interval since the last one passed
+static void setter_schedule(SetterTarget *target) {
+  if (target->running || target->timer_id || target->pending == NULL)
+    return;
+
+  gint64 wait_us = target->last_start +
+                   target->interval_ms * G_TIME_SPAN_MILLISECOND -
+                   g_get_monotonic_time();
+  if (flushing || wait_us <= 0) {
+    setter_start(target);
+  } else {
+    target->timer_id = g_timeout_add((wait_us + 999) / 1000,
+                                     on_interval_elapsed, target);
+  }
+}
+
+static void setter_finished(SetterTarget *target, gboolean success) {
+  g_clear_pointer(&target->running, setter_write_free);
+
+  if (target->pending) {
+    setter_schedule(target);
+  } else if (target->settled) {
+    target->settled(target->name, success, target->settled_data);
+  }
+}
+
+static void on_process_done(GObject *source, GAsyncResult *res,
+                            gpointer user_data) {
+  SetterTarget *target = user_data;
+  const gchar *tool = target->running->argv[0];
+  g_autoptr(GError) error = NULL;
+  g_autoptr(CommandResult) result = command_run_finish(res, &error);
+
+  if (error) {
+    g_printerr("Failed to run %s: %s\n", tool, error->message);
+  } else if (!command_result_success(result)) {
+    g_printerr("%s exited with status %d: %s\n", tool, result->exit_status,
+               result->err);
+  }
+
+  // Reads that started while the write was running saw the old state
+  command_cache_invalidate(tool);
+  setter_finished(target, error == NULL && command_result_success(result));
+}
+
+static void setter_start(SetterTarget *target) {
+  SetterWrite *write = g_steal_pointer(&target->pending);
+
+  target->running = write;
+  target->last_start = g_get_monotonic_time();
+
+  if (write->argv) {
+    command_cache_invalidate(write->argv[0]);
+    command_run_async((const gchar *const *)write->argv,
+                      COMMAND_DEFAULT_TIMEOUT, NULL, NULL, NULL,
+                      on_process_done, target);
+  } else {
+    // The write stays owned by the target until command_set_done()
+    write->func(target->name, write->data);
+  }
+}
+
+static void setter_queue(const gchar *name, SetterWrite *write) {
+  SetterTarget *target = setter_target(name);
+
+  // Whatever was still waiting is superseded
+  setter_write_free(target->pending);
+  target->pending = write;
+  setter_schedule(target);
+}
+
+void command_set(const gchar *target, const gchar *const *argv) {
+  SetterWrite *write = g_new0(SetterWrite, 1);
+  write->argv = g_strdupv((gchar **)argv);
+  setter_queue(target, write);
+}
+
+void command_set_func(const gchar *target, CommandSetFunc func, gpointer data,
+                      GDestroyNotify destroy) {
+  SetterWrite *write = g_new0(SetterWrite, 1);
+  write->func = func;
+  write->data = data;
+  write->destroy = destroy;
+  setter_queue(target, write);
+}
+
+void command_set_done(const gchar *target, gboolean success) {
+  SetterTarget *entry =
+      targets != NULL ? g_hash_table_lookup(targets, target) : NULL;
+
+  g_return_if_fail(entry != NULL && entry->running != NULL);
+  setter_finished(entry, success);
+}
+
+void command_set_interval(const gchar *target, guint interval_ms) {
+  setter_target(target)->interval_ms = interval_ms;
+}
+
+void command_set_connect_settled(const gchar *target,
+                                 CommandSetSettledFunc callback,
+                                 gpointer user_data) {
+  SetterTarget *entry = setter_target(target);
+  entry->settled = callback;
+  entry->settled_data = user_data;
+}
+
+static gboolean setter_busy(void) {
+  GHashTableIter iter;
+  SetterTarget *target;
+
+  g_hash_table_iter_init(&iter, targets);
+  while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&target)) {
+    if (target->running || target->pending)
+      return TRUE;
+  }
+  return FALSE;
+}
+
+void command_set_flush(void) {
+  GHashTableIter iter;
+  SetterTarget *target;
+
+  if (targets == NULL)
+    return;
+
+  flushing = TRUE;
+  g_hash_table_iter_init(&iter, targets);
+  while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&target)) {
+    if (target->timer_id) {
+      g_source_remove(target->timer_id);
+      target->timer_id = 0;
+    }
+    setter_schedule(target);
+  }
+
+  while (setter_busy())
+    g_main_context_iteration(NULL, TRUE);
+  flushing = FALSE;
+}
@@ -0,0 +1,177 @@
+#include "command/stats.h"
+
+typedef struct {
+  gchar *key;
+  guint calls; // finished runs, requests or spans
+  guint forks; // processes actually started
+  guint hits;  // reads answered from the cache
+  gint64 total_us;
+  gint64 max_us;
+  guint64 bytes;
+  guint buckets[COMMAND_STATS_BUCKETS];
+} CommandStats;
+
+static GMutex stats_lock;
+static GHashTable *stats; // key -> CommandStats
+
+static void command_stats_free(CommandStats *entry) {
+  g_free(entry->key);
+  g_free(entry);
+}
+
+// Must be called with stats_lock held
+static CommandStats *stats_lookup(const gchar *key) {
+  if (stats == NULL)
+    stats = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                  (GDestroyNotify)command_stats_free);
+
+  CommandStats *entry = g_hash_table_lookup(stats, key);
+  if (entry == NULL) {
+    entry = g_new0(CommandStats, 1);
+    entry->key = g_strdup(key);
+    g_hash_table_insert(stats, entry->key, entry);
+  }
+  return entry;
+}
+
+static guint bucket_for(gint64 duration_us) {
+  guint bucket = 0;
+  gint64 limit_us = 1000;
+
+  while (bucket < COMMAND_STATS_BUCKETS - 1 && duration_us >= limit_us) {
+    limit_us *= 2;
+    bucket++;
+  }
+  return bucket;
+}
+
+gchar *command_stats_key(const gchar *const *argv) {
+  GString *key = g_string_new(argv[0]);
+  guint words = 0;
+
+  for (guint i = 1; argv[i] != NULL && words < 2; i++) {
+    // "-f SSID,SIGNAL" and friends: the value is not a subcommand
+    if (argv[i][0] == '-') {
+      if (g_strcmp0(argv[i], "-f") == 0 || g_strcmp0(argv[i], "--fields") == 0)
+        i += argv[i + 1] != NULL;
+      continue;
+    }
+    g_string_append_printf(key, " %s", argv[i]);
+    words++;
+  }
+  return g_string_free(key, FALSE);
+}
+
+void command_stats_add(const gchar *key, gint64 duration_us, gsize bytes,
+                       gboolean forked) {
+  g_mutex_lock(&stats_lock);
+  CommandStats *entry = stats_lookup(key);
+  entry->calls++;
+  entry->forks += forked;
+  entry->total_us += duration_us;
+  entry->max_us = MAX(entry->max_us, duration_us);
+  entry->bytes += bytes;
+  entry->buckets[bucket_for(duration_us)]++;
+  g_mutex_unlock(&stats_lock);
+}
+
+void command_stats_add_hit(const gchar *key) {
+  g_mutex_lock(&stats_lock);
+  stats_lookup(key)->hits++;
+  g_mutex_unlock(&stats_lock);
+}
+
+CommandStatsSpan command_stats_begin(const gchar *key) {
+  CommandStatsSpan span = {key, g_get_monotonic_time()};
+  return span;
+}
+
+void command_stats_end(CommandStatsSpan *span) {
+  if (span->key == NULL)
+    return;
+  command_stats_add(span->key, g_get_monotonic_time() - span->start, 0, FALSE);
+  span->key = NULL;
+}
+
+// Upper bound in ms of the bucket holding the given fraction of calls
+static const gchar *percentile(const CommandStats *entry, double fraction,
+                               gchar *buffer, gsize size) {
+  guint target = (guint)(entry->calls * fraction + 0.5);
+  guint seen = 0;
+
+  for (guint i = 0; i < COMMAND_STATS_BUCKETS; i++) {
+    seen += entry->buckets[i];
+    if (seen >= MAX(target, 1)) {
+      if (i == COMMAND_STATS_BUCKETS - 1)
+        g_snprintf(buffer, size, ">%u", 1u << (i - 1));
+      else
+        g_snprintf(buffer, size, "<%u", 1u << i);
+      return buffer;
+    }
+  }
+  return "-";
+}
+
+static gint compare_total(gconstpointer a, gconstpointer b) {
+  const CommandStats *first = *(CommandStats *const *)a;
+  const CommandStats *second = *(CommandStats *const *)b;
+
+  if (first->total_us != second->total_us)
+    return first->total_us < second->total_us ? 1 : -1;
+  return g_strcmp0(first->key, second->key);
+}
+
+gchar *command_stats_report(void) {
+  GString *report = g_string_new(NULL);
+  GPtrArray *entries = g_ptr_array_new();
+  gchar p50[16], p95[16];
+
+  g_mutex_lock(&stats_lock);
+  if (stats != NULL) {
+    GHashTableIter iter;
+    gpointer entry;
+    g_hash_table_iter_init(&iter, stats);
+    while (g_hash_table_iter_next(&iter, NULL, &entry))
+      g_ptr_array_add(entries, entry);
+  }
+  g_ptr_array_sort(entries, compare_total);
+
+  g_string_append_printf(report, "%-36s %6s %6s %6s %9s %6s %6s %8s %9s\n",
+                         "command", "calls", "forks", "hits", "total ms",
+                         "p50", "p95", "max ms", "bytes");
+  for (guint i = 0; i < entries->len; i++) {
+    const CommandStats *entry = entries->pdata[i];
+    g_string_append_printf(
+        report, "%-36s %6u %6u %6u %9.1f %6s %6s %8.1f %9" G_GUINT64_FORMAT "\n",
+        entry->key, entry->calls, entry->forks, entry->hits,
+        entry->total_us / 1000.0, percentile(entry, 0.5, p50, sizeof(p50)),
+        percentile(entry, 0.95, p95, sizeof(p95)), entry->max_us / 1000.0,
+        entry->bytes);
+  }
+  g_mutex_unlock(&stats_lock);
+
+  g_ptr_array_free(entries, TRUE);
+  return g_string_free(report, FALSE);
+}
+
+guint command_stats_total_forks(void) {
+  GHashTableIter iter;
+  gpointer entry;
+  guint forks = 0;
+
+  g_mutex_lock(&stats_lock);
+  if (stats != NULL) {
+    g_hash_table_iter_init(&iter, stats);
+    while (g_hash_table_iter_next(&iter, NULL, &entry))
+      forks += ((CommandStats *)entry)->forks;
+  }
+  g_mutex_unlock(&stats_lock);
+  return forks;
+}
+
+void command_stats_reset(void) {
+  g_mutex_lock(&stats_lock);
+  if (stats != NULL)
+    g_hash_table_remove_all(stats);
+  g_mutex_unlock(&stats_lock);
+}
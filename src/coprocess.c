@@ -0,0 +1,447 @@
+#include "command/coprocess.h"
+#include "command/stats.h"
+#include "listener/listener.h"
+#include "parse/parse.h"
+#include <string.h>
+
+// Quiet period that ends a response without markers
+#define COPROCESS_SETTLE_MS 250
+// Delay before respawning a backend that exited under its subscribers
+#define COPROCESS_RESTART_MS 2000
+#define COPROCESS_READ_SIZE 8192
+
+typedef struct {
+  GTask *task;
+  gchar *line;
+  gchar **markers;
+  GString *response;
+  guint timeout_ms;
+  guint timeout_id;
+  guint settle_id;
+  gint64 sent_at;
+} CoprocessRequest;
+
+// The listener's own data; its callback is the listener's func
+typedef struct {
+  gchar *prefix;
+  gpointer user_data;
+} CoprocessSubscriber;
+
+struct _Coprocess {
+  gchar **argv;
+  GSubprocess *process;
+  GOutputStream *input;
+  GInputStream *output;
+  LineFeeder lines; // output split into lines across reads
+  GCancellable *cancellable; // cancels the reader of the current process
+  GQueue requests;
+  gboolean head_sent;
+  ListenerList subscribers;
+  GHashTable *subscriber_data; // listener id -> CoprocessSubscriber
+  guint restart_id;
+};
+
+static GHashTable *coprocesses; // joined argv -> Coprocess
+
+static void coprocess_send_head(Coprocess *coprocess);
+static void coprocess_read_next(Coprocess *coprocess);
+
+static void coprocess_request_free(CoprocessRequest *request) {
+  if (request->timeout_id)
+    g_source_remove(request->timeout_id);
+  if (request->settle_id)
+    g_source_remove(request->settle_id);
+  g_string_free(request->response, TRUE);
+  g_strfreev(request->markers);
+  g_free(request->line);
+  g_object_unref(request->task);
+  g_free(request);
+}
+
+// Pop the head request, complete it and move on to the next one
+static void coprocess_finish_head(Coprocess *coprocess, GError *error) {
+  CoprocessRequest *request = g_queue_pop_head(&coprocess->requests);
+
+  if (coprocess->head_sent) {
+    // "bluetoothctl> connect"; settle-framed requests include the quiet period
+    gchar *stats_key = g_strdup_printf("%s> %.*s", coprocess->argv[0],
+                                       (int)strcspn(request->line, " \n"),
+                                       request->line);
+    command_stats_add(stats_key, g_get_monotonic_time() - request->sent_at,
+                      request->response->len, FALSE);
+    g_free(stats_key);
+  }
+  coprocess->head_sent = FALSE;
+
+  if (error) {
+    g_task_return_error(request->task, error);
+  } else {
+    g_task_return_pointer(request->task,
+                          g_strdup(request->response->str), g_free);
+  }
+  coprocess_request_free(request);
+
+  if (!g_queue_is_empty(&coprocess->requests))
+    coprocess_send_head(coprocess);
+}
+
+static gboolean on_request_settled(gpointer user_data) {
+  Coprocess *coprocess = user_data;
+  CoprocessRequest *request = g_queue_peek_head(&coprocess->requests);
+
+  request->settle_id = 0;
+  coprocess_finish_head(coprocess, NULL);
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean on_request_timeout(gpointer user_data) {
+  Coprocess *coprocess = user_data;
+  CoprocessRequest *request = g_queue_peek_head(&coprocess->requests);
+
+  request->timeout_id = 0;
+  coprocess_finish_head(
+      coprocess, g_error_new(G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+                             "'%s' got no answer from %s", request->line,
+                             coprocess->argv[0]));
+  return G_SOURCE_REMOVE;
+}
+
+static void coprocess_restart_settle(Coprocess *coprocess,
+                                     CoprocessRequest *request) {
+  if (request->markers != NULL)
+    return;
+  if (request->settle_id)
+    g_source_remove(request->settle_id);
+  request->settle_id =
+      g_timeout_add(COPROCESS_SETTLE_MS, on_request_settled, coprocess);
+}
+
+// Fail everything queued without sending it; used when the backend goes away
+static void coprocess_fail_all(Coprocess *coprocess, const gchar *message) {
+  CoprocessRequest *request;
+
+  coprocess->head_sent = FALSE;
+  while ((request = g_queue_pop_head(&coprocess->requests)) != NULL) {
+    g_task_return_new_error(request->task, G_IO_ERROR, G_IO_ERROR_BROKEN_PIPE,
+                            "%s: %s", coprocess->argv[0], message);
+    coprocess_request_free(request);
+  }
+}
+
+// Drop colour codes, carriage returns and a leading "[name]# " prompt
+static gchar *coprocess_clean_line(StrView line) {
+  GString *clean = g_string_sized_new(line.len);
+  const gchar *end = line.data + line.len;
+
+  for (const gchar *p = line.data; p < end; p++) {
+    if (*p == '\x1b' && p + 1 < end && p[1] == '[') {
+      p += 2;
+      while (p < end && !g_ascii_isalpha(*p))
+        p++;
+      if (p == end)
+        break;
+      continue;
+    }
+    if (*p == '\r' || *p == '\x01' || *p == '\x02')
+      continue;
+    g_string_append_c(clean, *p);
+  }
+
+  // Prompts may repeat when several commands were echoed back to back
+  gchar *start = clean->str;
+  while (*start == '[') {
+    gchar *end = strstr(start, "]# ");
+    if (end == NULL)
+      break;
+    start = end + 3;
+  }
+
+  gchar *result = g_strstrip(g_strdup(start));
+  g_string_free(clean, TRUE);
+  return result;
+}
+
+static void coprocess_subscriber_free(CoprocessSubscriber *subscriber) {
+  g_free(subscriber->prefix);
+  g_free(subscriber);
+}
+
+static void call_subscriber(GCallback func, gpointer user_data,
+                            gpointer args) {
+  CoprocessSubscriber *subscriber = user_data;
+  const gchar *line = args;
+
+  if (subscriber->prefix == NULL || g_str_has_prefix(line, subscriber->prefix))
+    ((CoprocessEventFunc)func)(line, subscriber->user_data);
+}
+
+static void coprocess_dispatch(Coprocess *coprocess, const gchar *line) {
+  CoprocessRequest *request = g_queue_peek_head(&coprocess->requests);
+
+  if (request != NULL && coprocess->head_sent) {
+    g_string_append(request->response, line);
+    g_string_append_c(request->response, '\n');
+  }
+
+  // Subscribers may unsubscribe, themselves or others, from their callback;
+  // one that left is not called, so its data may go at once
+  listener_list_emit(&coprocess->subscribers, call_subscriber,
+                     (gpointer)line);
+
+  if (request == NULL || !coprocess->head_sent ||
+      request != g_queue_peek_head(&coprocess->requests))
+    return;
+
+  if (request->markers != NULL) {
+    for (gchar **marker = request->markers; *marker != NULL; marker++) {
+      if (**marker == '^' ? g_str_has_prefix(line, *marker + 1)
+                          : strstr(line, *marker) != NULL) {
+        coprocess_finish_head(coprocess, NULL);
+        return;
+      }
+    }
+  } else {
+    coprocess_restart_settle(coprocess, request);
+  }
+}
+
+static gboolean on_restart(gpointer user_data);
+
+static void coprocess_stopped(Coprocess *coprocess) {
+  g_cancellable_cancel(coprocess->cancellable);
+  g_clear_object(&coprocess->cancellable);
+  g_clear_object(&coprocess->output);
+  g_clear_object(&coprocess->input);
+  line_feeder_clear(&coprocess->lines);
+  if (coprocess->process)
+    g_subprocess_force_exit(coprocess->process);
+  g_clear_object(&coprocess->process);
+
+  coprocess_fail_all(coprocess, "backend exited");
+
+  if (listener_list_length(&coprocess->subscribers) > 0 &&
+      coprocess->restart_id == 0)
+    coprocess->restart_id =
+        g_timeout_add(COPROCESS_RESTART_MS, on_restart, coprocess);
+}
+
+static void on_line(StrView line, void *user_data) {
+  Coprocess *coprocess = user_data;
+  gchar *clean = coprocess_clean_line(line);
+
+  if (*clean != '\0')
+    coprocess_dispatch(coprocess, clean);
+  g_free(clean);
+}
+
+static void on_output_read(GObject *source, GAsyncResult *res,
+                           gpointer user_data) {
+  Coprocess *coprocess = user_data;
+  g_autoptr(GError) error = NULL;
+  GBytes *bytes =
+      g_input_stream_read_bytes_finish(G_INPUT_STREAM(source), res, &error);
+
+  // A newer process replaced the one this read belonged to
+  if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    return;
+
+  gsize len = bytes ? g_bytes_get_size(bytes) : 0;
+  if (len == 0) {
+    if (error)
+      g_printerr("Reading from %s failed: %s\n", coprocess->argv[0],
+                 error->message);
+    if (bytes)
+      g_bytes_unref(bytes);
+    line_feeder_flush(&coprocess->lines, on_line, coprocess);
+    coprocess_stopped(coprocess);
+    return;
+  }
+
+  // Whole lines are dispatched straight out of the read buffer
+  line_feeder_feed(&coprocess->lines, g_bytes_get_data(bytes, NULL), len,
+                   on_line, coprocess);
+  g_bytes_unref(bytes);
+
+  if (coprocess->output != NULL)
+    coprocess_read_next(coprocess);
+}
+
+static void coprocess_read_next(Coprocess *coprocess) {
+  g_input_stream_read_bytes_async(coprocess->output, COPROCESS_READ_SIZE,
+                                  G_PRIORITY_DEFAULT, coprocess->cancellable,
+                                  on_output_read, coprocess);
+}
+
+static gboolean coprocess_ensure_running(Coprocess *coprocess,
+                                         GError **error) {
+  if (coprocess->process != NULL)
+    return TRUE;
+
+  GSubprocessLauncher *launcher = g_subprocess_launcher_new(
+      G_SUBPROCESS_FLAGS_STDIN_PIPE | G_SUBPROCESS_FLAGS_STDOUT_PIPE |
+      G_SUBPROCESS_FLAGS_STDERR_MERGE);
+  g_subprocess_launcher_setenv(launcher, "LC_ALL", "C", TRUE);
+  coprocess->process = g_subprocess_launcher_spawnv(
+      launcher, (const gchar *const *)coprocess->argv, error);
+  g_object_unref(launcher);
+
+  if (coprocess->process == NULL)
+    return FALSE;
+
+  gchar *stats_key = g_strdup_printf("%s (coprocess)", coprocess->argv[0]);
+  command_stats_add(stats_key, 0, 0, TRUE);
+  g_free(stats_key);
+
+  coprocess->input = g_object_ref(g_subprocess_get_stdin_pipe(coprocess->process));
+  coprocess->output =
+      g_object_ref(g_subprocess_get_stdout_pipe(coprocess->process));
+  line_feeder_init(&coprocess->lines);
+  coprocess->cancellable = g_cancellable_new();
+  coprocess_read_next(coprocess);
+  return TRUE;
+}
+
+static gboolean on_restart(gpointer user_data) {
+  Coprocess *coprocess = user_data;
+  g_autoptr(GError) error = NULL;
+
+  coprocess->restart_id = 0;
+  if (listener_list_length(&coprocess->subscribers) > 0 &&
+      !coprocess_ensure_running(coprocess, &error)) {
+    g_printerr("Failed to restart %s: %s\n", coprocess->argv[0],
+               error->message);
+    coprocess->restart_id =
+        g_timeout_add(COPROCESS_RESTART_MS, on_restart, coprocess);
+  }
+  return G_SOURCE_REMOVE;
+}
+
+static void on_request_written(GObject *source, GAsyncResult *res,
+                               gpointer user_data) {
+  Coprocess *coprocess = user_data;
+  g_autoptr(GError) error = NULL;
+
+  if (g_output_stream_write_bytes_finish(G_OUTPUT_STREAM(source), res,
+                                         &error) < 0) {
+    g_printerr("Writing to %s failed: %s\n", coprocess->argv[0],
+               error->message);
+    coprocess_stopped(coprocess);
+  }
+}
+
+static void coprocess_send_head(Coprocess *coprocess) {
+  CoprocessRequest *request = g_queue_peek_head(&coprocess->requests);
+  GError *error = NULL;
+
+  if (g_task_return_error_if_cancelled(request->task)) {
+    g_queue_pop_head(&coprocess->requests);
+    coprocess_request_free(request);
+    if (!g_queue_is_empty(&coprocess->requests))
+      coprocess_send_head(coprocess);
+    return;
+  }
+
+  if (!coprocess_ensure_running(coprocess, &error)) {
+    coprocess_finish_head(coprocess, error);
+    return;
+  }
+
+  // request->line already carries its newline. Command lines are far below
+  // PIPE_BUF, so the pipe takes them in a single write.
+  GBytes *bytes = g_bytes_new(request->line, strlen(request->line));
+  coprocess->head_sent = TRUE;
+  request->sent_at = g_get_monotonic_time();
+  g_output_stream_write_bytes_async(coprocess->input, bytes, G_PRIORITY_DEFAULT,
+                                    NULL, on_request_written, coprocess);
+  g_bytes_unref(bytes);
+
+  if (request->timeout_ms > 0)
+    request->timeout_id =
+        g_timeout_add(request->timeout_ms, on_request_timeout, coprocess);
+  coprocess_restart_settle(coprocess, request);
+}
+
+Coprocess *coprocess_get(const gchar *const *argv) {
+  gchar *key = g_strjoinv(" ", (gchar **)argv);
+
+  if (coprocesses == NULL)
+    coprocesses = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+  Coprocess *coprocess = g_hash_table_lookup(coprocesses, key);
+  if (coprocess != NULL) {
+    g_free(key);
+    return coprocess;
+  }
+
+  coprocess = g_new0(Coprocess, 1);
+  coprocess->argv = g_strdupv((gchar **)argv);
+  g_queue_init(&coprocess->requests);
+  g_hash_table_insert(coprocesses, key, coprocess);
+  return coprocess;
+}
+
+void coprocess_request_async(Coprocess *coprocess, const gchar *line,
+                             const gchar *const *markers, guint timeout_ms,
+                             GCancellable *cancellable,
+                             GAsyncReadyCallback callback,
+                             gpointer user_data) {
+  CoprocessRequest *request = g_new0(CoprocessRequest, 1);
+  request->task = g_task_new(NULL, cancellable, callback, user_data);
+  g_task_set_source_tag(request->task, coprocess_request_async);
+  request->line = g_strconcat(line, "\n", NULL);
+  request->markers = markers ? g_strdupv((gchar **)markers) : NULL;
+  request->response = g_string_new(NULL);
+  request->timeout_ms = timeout_ms;
+
+  g_queue_push_tail(&coprocess->requests, request);
+  if (g_queue_get_length(&coprocess->requests) == 1)
+    coprocess_send_head(coprocess);
+}
+
+gchar *coprocess_request_finish(GAsyncResult *result, GError **error) {
+  g_return_val_if_fail(g_task_is_valid(result, NULL), NULL);
+  return g_task_propagate_pointer(G_TASK(result), error);
+}
+
+static void on_send_done(GObject *source, GAsyncResult *res,
+                         gpointer user_data) {
+  g_autoptr(GError) error = NULL;
+  g_free(coprocess_request_finish(res, &error));
+  if (error)
+    g_printerr("%s\n", error->message);
+}
+
+void coprocess_send(Coprocess *coprocess, const gchar *line) {
+  coprocess_request_async(coprocess, line, NULL, 0, NULL, on_send_done, NULL);
+}
+
+guint coprocess_subscribe(Coprocess *coprocess, const gchar *prefix,
+                          CoprocessEventFunc callback, gpointer user_data) {
+  CoprocessSubscriber *subscriber = g_new0(CoprocessSubscriber, 1);
+  guint id;
+
+  subscriber->prefix = g_strdup(prefix);
+  subscriber->user_data = user_data;
+  id = listener_list_add(&coprocess->subscribers, G_CALLBACK(callback),
+                         subscriber);
+  if (coprocess->subscriber_data == NULL)
+    coprocess->subscriber_data = g_hash_table_new_full(
+        NULL, NULL, NULL, (GDestroyNotify)coprocess_subscriber_free);
+  g_hash_table_insert(coprocess->subscriber_data, GUINT_TO_POINTER(id),
+                      subscriber);
+
+  // Event-only backends (pactl subscribe, nmcli monitor) start here
+  g_autoptr(GError) error = NULL;
+  if (!coprocess_ensure_running(coprocess, &error)) {
+    g_printerr("Failed to start %s: %s\n", coprocess->argv[0], error->message);
+    if (coprocess->restart_id == 0)
+      coprocess->restart_id =
+          g_timeout_add(COPROCESS_RESTART_MS, on_restart, coprocess);
+  }
+  return id;
+}
+
+void coprocess_unsubscribe(Coprocess *coprocess, guint id) {
+  if (listener_list_remove(&coprocess->subscribers, id))
+    g_hash_table_remove(coprocess->subscriber_data, GUINT_TO_POINTER(id));
+}
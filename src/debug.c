@@ -0,0 +1,99 @@
+#include "option/debug.h"
+#include "command/stats.h"
+#include "window/refresh.h"
+#include <adwaita.h>
+#include <gtk/gtk.h>
+
+// How often the statistics table is redrawn while the page is shown, and
+// while nothing is recorded
+#define DEBUG_REFRESH_INTERVAL 1
+#define DEBUG_REFRESH_MAX_INTERVAL 8
+
+GtkWidget *DebugPage;
+static GtkLabel *StatsLabel;
+static gchar *last_report = NULL;
+
+static gboolean update_stats_label(void) {
+  gchar *report = command_stats_report();
+
+  if (g_strcmp0(report, last_report) == 0) {
+    g_free(report);
+    return FALSE;
+  }
+  gtk_label_set_text(StatsLabel, report);
+  g_free(last_report);
+  last_report = report;
+  return TRUE;
+}
+
+static void refresh_stats(GCancellable *cancellable, gpointer user_data) {
+  refresh_done(cancellable, update_stats_label());
+}
+
+// Not timed itself, or every run would change the table it draws
+static const RefreshJob stats_job = {
+    .interval = DEBUG_REFRESH_INTERVAL,
+    .max_interval = DEBUG_REFRESH_MAX_INTERVAL,
+    .run = refresh_stats,
+};
+
+static void on_reset_clicked(GtkButton *button, gpointer user_data) {
+  command_stats_reset();
+  update_stats_label();
+}
+
+void change_panel_to_debug(gpointer user_data) {
+  GtkStack *stack = GTK_STACK(user_data);
+  debug_to_stack(stack);
+  if (DebugPage == NULL)
+    return;
+
+  update_stats_label();
+  gtk_stack_set_visible_child_name(stack, "debug_page");
+}
+
+static void debug_to_stack(GtkStack *stack) {
+  if (DebugPage) {
+    return;
+  }
+
+  const char *ui_paths[] = {
+    "ui/debug.ui",
+    "/usr/share/systune/ui/debug.ui"
+  };
+
+  GtkBuilder *debug_builder = NULL;
+  size_t num_paths = sizeof(ui_paths) / sizeof(ui_paths[0]);
+
+  for (size_t i = 0; i < num_paths; i++) {
+    if (g_file_test(ui_paths[i], G_FILE_TEST_EXISTS)) {
+      debug_builder = gtk_builder_new_from_file(ui_paths[i]);
+      if (debug_builder != NULL) {
+        break;
+      }
+    }
+  }
+
+  if (debug_builder == NULL) {
+    g_warning("UI file 'debug.ui' not found in any of the expected locations");
+    return;
+  }
+
+  DebugPage = GTK_WIDGET(gtk_builder_get_object(debug_builder, "debug_page"));
+  if (DebugPage == NULL) {
+    g_printerr("Failed to get debug_page from debug.ui\n");
+    g_object_unref(debug_builder);
+    return;
+  }
+
+  StatsLabel = GTK_LABEL(gtk_builder_get_object(debug_builder, "debug_stats_label"));
+  GtkWidget *reset_button = GTK_WIDGET(gtk_builder_get_object(debug_builder, "debug_reset_button"));
+  g_signal_connect(reset_button, "clicked", G_CALLBACK(on_reset_clicked), NULL);
+
+  // The page lives for the rest of the session and is only redrawn while it
+  // is on screen
+  refresh_add(DebugPage, &stats_job, NULL);
+
+  gtk_stack_add_named(stack, DebugPage, "debug_page");
+  g_object_unref(debug_builder);
+}
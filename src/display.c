@@ -2,19 +2,27 @@
 #include <gtk/gtk.h>
 #include <stdio.h>
 #include "option/display.h"
-#include "command/command.h"
+#include "capability/capability.h"
+#include "display/backlight.h"
+#include "display/layout.h"
+#include "display/output.h"
+#include "display/wallpaper.h"
+#include "command/cache.h"
+#include "command/setter.h"
+#include "parse/parse.h"
 
 GtkWidget *DisplayPage;
 
-typedef struct {
-  char resolution[32]; // Stores resolution as a string (e.g., "1920x1080")
-  float refresh_rate;  // Stores refresh rate (e.g., 59.98)
-} DisplayMode;
+// The output whose modes the resolution row lists, and the modes behind its
+// rows
+static AdwComboRow *OutputCombo = NULL;
+static AdwComboRow *ModeCombo = NULL;
+static gchar *SelectedOutput = NULL;
+static GPtrArray *ShownModes = NULL;
 
-DisplayMode *DisplayList;
-DisplayMode CurrentDisplay;
-
-int count;
+// Without a sysfs backlight, brightnessctl is re-read at most this often
+// unless we change it ourselves
+#define DISPLAY_QUERY_TTL 5000
 
 void change_panel_to_display(gpointer user_data) {
   GtkStack *stack = GTK_STACK(user_data);
@@ -22,279 +30,173 @@ void change_panel_to_display(gpointer user_data) {
   gtk_stack_set_visible_child_name(stack, "display_page");
 }
 
-// Return the current brightness of the system
-int currrent_brightness() {
-  char *result = execute_command("brightnessctl");
-  int brightness;
-
-  char *line = strtok(result, "\n");
-  while (line != NULL) {
-    if (strstr(line, "Current brightness:") == NULL) {
-      g_print("1 null\n");
-      line = strtok(NULL, "\n");
-      continue;
-    }
-
-    sscanf(line, "%*[^(](%d)", &brightness);
-    return brightness;
-  }
-}
-
-// Function to parse the xrandr output and update the global DisplayList
-void get_available_resolutions_xorg(GtkStringList *sink_list) {
-  char *result = execute_command("xrandr");
-  if (result == NULL) {
-    g_print("Failed to execute command.\n");
-    return;
-  }
-
-  // Parse the result line by line
-  char *line = strtok(result, "\n");
-  while (line != NULL) {
-    // Check if the line contains the current resolution (marked with '*')
-    if (strstr(line, "*") != NULL && strstr(line, "x") != NULL && strstr(line, ".") != NULL) {
-      sscanf(line, " %31s %f", CurrentDisplay.resolution, &CurrentDisplay.refresh_rate);
-      line = strtok(NULL, "\n");
-      continue;
-    }
-    // Check if the line contains a resolution (e.g., "1920x1080 60.00")
-    if (strstr(line, "x") != NULL && strstr(line, ".") != NULL) {
-      char resolution[32];
-      float refresh_rate;
-
-      // Parse the resolution and refresh rate
-      if (sscanf(line, " %31s %f", resolution, &refresh_rate) == 2) {
-        // Resize the global DisplayList to accommodate the new mode
-        DisplayList = realloc(DisplayList, (count + 1) * sizeof(DisplayMode));
-        if (DisplayList == NULL) {
-          perror("realloc");
-          free(result);
-          return;
-        }
-
-        // Store the resolution and refresh rate in the global DisplayList
-        strncpy(DisplayList[count].resolution, resolution,
-                sizeof(DisplayList[count].resolution) - 1);
-        DisplayList[count]
-            .resolution[sizeof(DisplayList[count].resolution) - 1] =
-            '\0'; // Ensure null-termination
-        DisplayList[count].refresh_rate = refresh_rate;
-
-        count++;
+static void on_slider_value_changed(GtkRange *range, gpointer user_data);
+static void on_res_change(AdwComboRow *combo, gpointer user_data);
+
+// Parse the percentage out of brightnessctl's "Current brightness:" line
+static int parse_brightness(const CommandResult *result) {
+  LineReader reader;
+  StrView line, key, value;
+  long brightness = 0;
+
+  line_reader_init(&reader, result->out, result->out_len);
+  while (line_reader_next(&reader, &line)) {
+    // "Current brightness: 9600 (50%)"
+    if (parse_key_value(line, &key, &value) &&
+        str_view_equal(key, "Current brightness")) {
+      long open = str_view_find_char(value, '(');
+      if (open >= 0) {
+        value = str_view_skip(value, open + 1);
+        str_view_take_int(&value, &brightness);
       }
+      break;
     }
-    line = strtok(NULL, "\n");
-  }
-
-  // Debug: Print the first resolution
-  if (count > 0) {
-    g_print("res-%s\n", DisplayList[0].resolution);
   }
+  return (int)brightness;
+}
 
-  char res[50];
-  sprintf(res, "%s@%dHz", CurrentDisplay.resolution, (int)CurrentDisplay.refresh_rate);
-  gtk_string_list_append(sink_list,res);
+static void on_brightness_ready(GObject *source, GAsyncResult *res,
+                                gpointer user_data) {
+  GtkRange *slider = GTK_RANGE(user_data);
+  g_autoptr(GError) error = NULL;
+  g_autoptr(CommandResult) result = command_query_finish(res, &error);
 
-  for (int i = 0; i < count; i++) {
-    // Append the resolution to the GTK string list
-    char res[50];
-    sprintf(res, "%s@%dHz", DisplayList[i].resolution, (int)DisplayList[i].refresh_rate);
-    gtk_string_list_append(sink_list,res);
+  if (error) {
+    g_printerr("Failed to read brightness: %s\n", error->message);
+    return;
   }
 
-  free(result);
+  g_signal_handlers_block_by_func(slider, on_slider_value_changed, NULL);
+  gtk_range_set_value(slider, parse_brightness(result));
+  g_signal_handlers_unblock_by_func(slider, on_slider_value_changed, NULL);
 }
 
-void get_available_resolutions_wayland(GtkStringList *sink_list) {
-  char *result = execute_command("wlr-randr");
-  if (result == NULL) {
-    g_print("Failed to execute command.\n");
-    return;
-  }
-
-  // Parse the result line by line
-  char *line = strtok(result, "\n");
-  while (line != NULL) {
-    // Check if the line contains the current resolution (marked with '*')
-    if (strstr(line, "current") != NULL && strstr(line, "px,") != NULL && strstr(line, "Hz") != NULL) {
-      sscanf(line, " %31[0-9x] px, %f Hz", CurrentDisplay.resolution, &CurrentDisplay.refresh_rate);
-      line = strtok(NULL, "\n");
-      continue;
-    }
-    // Check if the line contains a resolution (e.g., "1920x1200 px, 60.026001
-    // Hz")
-    if (strstr(line, "px,") != NULL && strstr(line, "Hz") != NULL) {
-      char resolution[32];
-      float refresh_rate;
-
-      // Parse the resolution and refresh rate
-      if (sscanf(line, " %31[0-9x] px, %f Hz", resolution, &refresh_rate) ==
-          2) {
-        // Resize the global DisplayList to accommodate the new mode
-        DisplayList = realloc(DisplayList, (count + 1) * sizeof(DisplayMode));
-        if (DisplayList == NULL) {
-          perror("realloc");
-          free(result);
-          return;
-        }
-
-        // Store the resolution and refresh rate in the global DisplayList
-        strncpy(DisplayList[count].resolution, resolution,
-                sizeof(DisplayList[count].resolution) - 1);
-        DisplayList[count]
-            .resolution[sizeof(DisplayList[count].resolution) - 1] =
-            '\0'; // Ensure null-termination
-        DisplayList[count].refresh_rate = refresh_rate;
-
-        count++;
-      }
-    }
-    line = strtok(NULL, "\n");
-  }
+// Hotkeys and other programs moved the backlight
+static void on_backlight_changed(gdouble percent, gpointer user_data) {
+  GtkRange *slider = GTK_RANGE(user_data);
 
-  char res[50];
-  sprintf(res, "%s@%dHz", CurrentDisplay.resolution, (int)CurrentDisplay.refresh_rate);
-  gtk_string_list_append(sink_list,res);
+  g_signal_handlers_block_by_func(slider, on_slider_value_changed, NULL);
+  gtk_range_set_value(slider, percent);
+  g_signal_handlers_unblock_by_func(slider, on_slider_value_changed, NULL);
+}
 
-  for (int i = 0; i < count; i++) {
-    // Append the resolution to the GTK string list
-    char res[50];
-    sprintf(res, "%s@%dHz", DisplayList[i].resolution, (int)DisplayList[i].refresh_rate);
-    gtk_string_list_append(sink_list,res);
+// List the selected output's modes with exact rates, the current one selected
+static void show_modes(void) {
+  DisplayOutput *output = display_outputs_lookup(SelectedOutput);
+  g_autoptr(GtkStringList) labels = gtk_string_list_new(NULL);
+  guint current = GTK_INVALID_LIST_POSITION;
+
+  g_ptr_array_set_size(ShownModes, 0);
+  for (guint i = 0; output != NULL && i < output->mode_table->len; i++) {
+    DisplayMode *mode = output->mode_table->pdata[i];
+    g_autofree gchar *label = display_mode_label(mode);
+
+    if (mode == output->current)
+      current = ShownModes->len;
+    g_ptr_array_add(ShownModes, mode);
+    gtk_string_list_append(labels, label);
   }
 
-  free(result);
+  // Swapping the model selects its first row; that is not a user choice
+  g_signal_handlers_block_by_func(ModeCombo, on_res_change, NULL);
+  adw_combo_row_set_model(ModeCombo, G_LIST_MODEL(labels));
+  adw_combo_row_set_selected(ModeCombo, current);
+  g_signal_handlers_unblock_by_func(ModeCombo, on_res_change, NULL);
 }
 
-// Callback function for when the slider value changes
-static void on_res_change(AdwComboRow *combo, gpointer user_data) {
-  GtkStringList *sink_list = GTK_STRING_LIST(adw_combo_row_get_model(combo));
-  guint selected_index = adw_combo_row_get_selected(combo);
+static void on_output_change(AdwComboRow *combo, GParamSpec *pspec,
+                             gpointer user_data) {
+  GPtrArray *outputs = display_outputs();
+  guint selected = adw_combo_row_get_selected(combo);
 
-  if (selected_index == GTK_INVALID_LIST_POSITION) {
-    g_print("No device selected.\n");
+  if (selected >= outputs->len)
     return;
-  }
-
-  DisplayMode res;
-  if (selected_index == 0) {
-    res = CurrentDisplay;
-  } else {
-    res = DisplayList[selected_index - 1];
-  }
-
-  g_print("%s", res.resolution);
-  g_print("%f", res.refresh_rate);
 
-  char command[512];
-
-  char *display_server = execute_command("echo $XDG_SESSION_TYPE");
-  g_strchomp(display_server);
+  g_free(SelectedOutput);
+  SelectedOutput = g_strdup(((DisplayOutput *)outputs->pdata[selected])->name);
+  show_modes();
+}
 
-  if (g_strcmp0(display_server, "wayland") == 0) {
-    char *compositor = execute_command("echo $DESKTOP_SESSION");
-    g_strchomp(compositor);
+// Runs after every complete update from the display server, ours included
+static void on_outputs_changed(gpointer user_data) {
+  GPtrArray *outputs = display_outputs();
+  g_autoptr(GtkStringList) names = gtk_string_list_new(NULL);
+  guint selected = 0;
 
-    if(g_strcmp0(compositor, "hyprland") == 0) {
-      snprintf(command, sizeof(command), "hyprctl keyword monitor ,%s@%d,0x0,1", res.resolution, (int)res.refresh_rate);
-    } else {
-      snprintf(command, sizeof(command), "wlr-randr --output eDP-1 --mode %s", res.resolution);
-    }
+  for (guint i = 0; i < outputs->len; i++) {
+    DisplayOutput *output = outputs->pdata[i];
 
-    g_print("command is %s  ", command);
-  } else {
-    g_print("%s", display_server);
-    snprintf(command, sizeof(command), "xrandr -s %s", res.resolution);
+    if (g_strcmp0(output->name, SelectedOutput) == 0)
+      selected = i;
+    gtk_string_list_append(names, output->description ? output->description
+                                                      : output->name);
   }
 
-  char *result = execute_command(command);
+  g_free(SelectedOutput);
+  SelectedOutput = outputs->len > 0
+      ? g_strdup(((DisplayOutput *)outputs->pdata[selected])->name)
+      : NULL;
 
-  // Execute the command
-  execute_command(command);
-}
-
-static void on_slider_value_changed(GtkRange *range, gpointer user_data) {
-  gdouble value = gtk_range_get_value(range);
+  g_signal_handlers_block_by_func(OutputCombo, on_output_change, NULL);
+  adw_combo_row_set_model(OutputCombo, G_LIST_MODEL(names));
+  adw_combo_row_set_selected(OutputCombo, selected);
+  g_signal_handlers_unblock_by_func(OutputCombo, on_output_change, NULL);
+  gtk_widget_set_visible(GTK_WIDGET(OutputCombo), outputs->len > 1);
 
-  gchar *command = g_strdup_printf("brightnessctl set %.0f%%\n", value);
-  g_print("Executing command: %s\n", command);
+  show_modes();
+}
 
-  GError *error = NULL;
-  gint exit_status;
-  g_spawn_command_line_sync(command, NULL, NULL, &exit_status, &error);
-  g_free(command);
+static void on_layout_applied(GObject *source, GAsyncResult *res,
+                              gpointer user_data) {
+  g_autoptr(GError) error = NULL;
 
-  if (error) {
-    g_printerr("Failed to toggle Brigthness: %s\n", error->message);
-    g_error_free(error);
+  if (!display_outputs_apply_finish(res, &error)) {
+    g_printerr("Failed to change resolution: %s\n", error->message);
+    // Nothing changed, so put the row back on the mode still in use
+    show_modes();
   }
 }
 
-static void on_file_dialog_response(GtkDialog *dialog, gint response_id,
-                                    GtkImage *preview_image) {
-  if (response_id == GTK_RESPONSE_ACCEPT) {
-    GtkFileChooser *chooser = GTK_FILE_CHOOSER(dialog);
-    GFile *file = gtk_file_chooser_get_file(chooser);
-    char *file_path = g_file_get_path(file);
-
-    // Set the selected image file to the GtkImage widget
-    gtk_image_set_from_file(preview_image, file_path);
-
-    char *display_server = execute_command("echo $XDG_SESSION_TYPE");
-    char command[512];
-    g_strchomp(display_server);
-
-    if (g_strcmp0(display_server, "wayland") == 0) {
-      snprintf(command, sizeof(command), "swww img %s", file_path);
-    } else {
-      g_print("%s", display_server);
-      snprintf(command, sizeof(command), "feh --bg-scale %s", file_path);
-    }
-
-    char *result = execute_command(command);
+static void on_res_change(AdwComboRow *combo, gpointer user_data) {
+  DisplayOutput *output = display_outputs_lookup(SelectedOutput);
+  guint selected_index = adw_combo_row_get_selected(combo);
+  DisplayOutputConfig config;
 
-    g_free(file_path);
-    g_object_unref(file);
-  }
+  if (output == NULL || selected_index >= ShownModes->len)
+    return;
 
-  // Destroy the dialog
-  gtk_window_destroy(GTK_WINDOW(dialog));
+  display_output_config_init(&config, output);
+  config.enabled = TRUE;
+  config.mode = ShownModes->pdata[selected_index];
+  display_outputs_apply_async(&config, 1, NULL, on_layout_applied, NULL);
 }
 
-static void on_choose_background(GtkButton *button, GtkImage *preview_image) {
-  GtkWidget *dialog;
-  GtkFileChooserAction action = GTK_FILE_CHOOSER_ACTION_OPEN;
-
-  // Create a new file chooser dialog
-  dialog = gtk_file_chooser_dialog_new(
-      "Open File", GTK_WINDOW(gtk_widget_get_root(GTK_WIDGET(button))), action,
-      "_Cancel", GTK_RESPONSE_CANCEL, "_Open", GTK_RESPONSE_ACCEPT, NULL);
+static void on_slider_value_changed(GtkRange *range, gpointer user_data) {
+  gdouble value = gtk_range_get_value(range);
 
-  // Connect a callback to handle the response asynchronously
-  gtk_window_set_modal(GTK_WINDOW(dialog), TRUE);
-  gtk_window_present(GTK_WINDOW(dialog));
+  if (backlight_device() != NULL) {
+    backlight_set(value);
+    return;
+  }
 
-  g_signal_connect(dialog, "response", G_CALLBACK(on_file_dialog_response),
-                   preview_image);
+  gchar *level = g_strdup_printf("%.0f%%", value);
+  const gchar *argv[] = {"brightnessctl", "set", level, NULL};
+  command_set("brightness", argv);
+  g_free(level);
 }
 
-// Function to get available resolutions based on the session type
-void get_available_resolutions(GtkStringList *sink_list) {
-  const char *session_type = g_getenv("XDG_SESSION_TYPE");
-  if (session_type == NULL) {
-    g_print("XDG_SESSION_TYPE environment variable not set.\n");
+// Outputs come from the compositor or the X server directly; other sessions
+// have no way to change modes
+void get_available_resolutions(AdwComboRow *combo) {
+  if (!display_outputs_init()) {
+    g_print("Resolution changes are not supported in this session\n");
+    gtk_widget_set_sensitive(GTK_WIDGET(combo), FALSE);
     return;
   }
 
-  if (g_strcmp0(session_type, "wayland") == 0) {
-    g_print("Detected Wayland session. Using wlr-randr.\n");
-    get_available_resolutions_wayland(sink_list);
-  } else if (g_strcmp0(session_type, "x11") == 0) {
-    g_print("Detected Xorg session. Using xrandr.\n");
-    get_available_resolutions_xorg(sink_list);
-  } else {
-    g_print("Unsupported session type: %s\n", session_type);
-  }
+  ShownModes = g_ptr_array_new();
+  display_outputs_listen(on_outputs_changed, NULL);
+  on_outputs_changed(NULL);
 }
 
 static void display_to_stack(GtkStack *stack) {
@@ -341,8 +243,6 @@ static void display_to_stack(GtkStack *stack) {
     return;
   }
 
-  gtk_adjustment_set_value(adjustment, currrent_brightness());
-
   GtkWidget *slider =
       GTK_WIDGET(gtk_builder_get_object(display_builder, "slider"));
   if (!slider) {
@@ -355,25 +255,32 @@ static void display_to_stack(GtkStack *stack) {
   g_signal_connect(slider, "value-changed", G_CALLBACK(on_slider_value_changed),
                    NULL);
 
-  GtkStringList *sink_list = GTK_STRING_LIST(
-      gtk_builder_get_object(display_builder, "display_res_sink_list"));
-
-  get_available_resolutions(sink_list);
+  if (backlight_init()) {
+    on_backlight_changed(backlight_get(), slider);
+    backlight_listen(on_backlight_changed, slider);
+  } else if (!capabilities()->brightnessctl) {
+    gtk_widget_set_visible(
+        gtk_widget_get_ancestor(slider, ADW_TYPE_PREFERENCES_GROUP), FALSE);
+  } else {
+    const gchar *brightness_argv[] = {"brightnessctl", NULL};
+    command_query_async(brightness_argv, DISPLAY_QUERY_TTL, NULL,
+                        on_brightness_ready, slider);
+  }
 
-  AdwComboRow *combo =
+  OutputCombo =
+      ADW_COMBO_ROW(gtk_builder_get_object(display_builder, "display_output"));
+  ModeCombo =
       ADW_COMBO_ROW(gtk_builder_get_object(display_builder, "display_res"));
 
-  // Connect the selection change event
-  g_signal_connect(combo, "notify::selected", G_CALLBACK(on_res_change), NULL);
-
-  GtkWidget *choose_bg_button =
-      GTK_WIDGET(gtk_builder_get_object(display_builder, "choose_bg_button"));
-  GtkWidget *preview_image =
-      GTK_WIDGET(gtk_builder_get_object(display_builder, "preview_image"));
+  // Connect the selection change events
+  g_signal_connect(OutputCombo, "notify::selected",
+                   G_CALLBACK(on_output_change), NULL);
+  g_signal_connect(ModeCombo, "notify::selected", G_CALLBACK(on_res_change),
+                   NULL);
 
-  // Connect the "clicked" signal of the button to the callback function
-  g_signal_connect(choose_bg_button, "clicked",
-                   G_CALLBACK(on_choose_background), preview_image);
+  get_available_resolutions(ModeCombo);
+  display_layout_attach(display_builder);
+  display_wallpaper_attach(display_builder);
 
   gtk_stack_add_named(stack, DisplayPage, "display_page");
   g_object_unref(display_builder);
@@ -0,0 +1,343 @@
+#include "display/backlight.h"
+#include "capability/capability.h"
+#include "command/stats.h"
+#include "listener/listener.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <gio/gio.h>
+#include <glib-unix.h>
+#include <libudev.h>
+#include <math.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define BACKLIGHT_CLASS "/sys/class/backlight"
+
+static gchar *device = NULL;
+static gint fd = -1;
+static gboolean writable = FALSE;
+static glong max_level = 0;
+static glong level = 0; // last level read or written
+
+static gdouble ramp_from, ramp_to, ramp_percent;
+static gint64 ramp_start;
+static guint ramp_id = 0;
+
+// Without write access every level goes over the bus, one call at a time;
+// levels that arrive meanwhile collapse into the newest. The bus is only
+// connected once a level needs it.
+static GDBusConnection *system_bus = NULL;
+static gboolean logind_busy = FALSE;
+static gboolean logind_unavailable = FALSE; // said so once, not tried again
+static glong logind_pending = -1;
+static gint64 logind_start;
+static gint write_errno = 0; // of the last direct write, 0 once one worked
+
+static struct udev *udev = NULL;
+static struct udev_monitor *monitor = NULL;
+
+static ListenerList listeners;
+
+static void logind_write(glong value);
+
+// Firmware interfaces know the panel best; raw ones may skip the platform's
+// own curve
+static gint type_rank(const gchar *name) {
+  g_autofree gchar *path = g_build_filename(BACKLIGHT_CLASS, name, "type", NULL);
+  g_autofree gchar *type = NULL;
+
+  if (!g_file_get_contents(path, &type, NULL, NULL))
+    return 3;
+  g_strstrip(type);
+  if (g_strcmp0(type, "firmware") == 0)
+    return 0;
+  if (g_strcmp0(type, "platform") == 0)
+    return 1;
+  return 2;
+}
+
+static gchar *pick_device(void) {
+  g_autoptr(GDir) dir = g_dir_open(BACKLIGHT_CLASS, 0, NULL);
+  const gchar *name;
+  gchar *best = NULL;
+  gint best_rank = G_MAXINT;
+
+  while (dir != NULL && (name = g_dir_read_name(dir)) != NULL) {
+    gint rank = type_rank(name);
+
+    // Directory order is arbitrary; break ties by name so the pick is stable
+    if (rank < best_rank ||
+        (rank == best_rank && g_strcmp0(name, best) < 0)) {
+      g_free(best);
+      best = g_strdup(name);
+      best_rank = rank;
+    }
+  }
+  return best;
+}
+
+static glong read_attribute(const gchar *attribute) {
+  g_autofree gchar *path =
+      g_build_filename(BACKLIGHT_CLASS, device, attribute, NULL);
+  g_autofree gchar *contents = NULL;
+
+  if (!g_file_get_contents(path, &contents, NULL, NULL))
+    return -1;
+  return strtol(contents, NULL, 10);
+}
+
+static glong read_level(void) {
+  gchar buffer[32];
+  gssize length = pread(fd, buffer, sizeof(buffer) - 1, 0);
+
+  if (length <= 0)
+    return -1;
+  buffer[length] = '\0';
+  return strtol(buffer, NULL, 10);
+}
+
+static glong percent_to_level(gdouble percent) {
+  gdouble fraction = CLAMP(percent, 0, 100) / 100.0;
+  glong value = lround(max_level * fraction * fraction);
+
+  // The bottom of the slider is dim, not off
+  return percent > 0 ? MAX(value, 1) : 0;
+}
+
+static gdouble level_to_percent(glong value) {
+  if (max_level <= 0)
+    return 0;
+  return 100.0 * sqrt((gdouble)CLAMP(value, 0, max_level) / max_level);
+}
+
+static void write_level(glong value) {
+  gchar buffer[32];
+  gint length;
+
+  if (value == level)
+    return;
+  level = value;
+
+  if (!writable) {
+    logind_write(value);
+    return;
+  }
+
+  length = g_snprintf(buffer, sizeof(buffer), "%ld", value);
+  if (pwrite(fd, buffer, length, 0) == length) {
+    write_errno = 0;
+    return;
+  }
+
+  // logind writes as root, past both missing permissions and a driver that
+  // refuses the write from us; only the former lasts
+  write_errno = errno;
+  if (errno == EACCES || errno == EPERM)
+    writable = FALSE;
+  logind_write(value);
+}
+
+// Both ways failed, or logind was the only one
+static void report_failure(const gchar *logind_message) {
+  if (write_errno != 0)
+    g_printerr("Failed to set brightness on %s: %s; logind failed too: %s\n",
+               device, g_strerror(write_errno), logind_message);
+  else
+    g_printerr("Failed to set brightness through logind: %s\n",
+               logind_message);
+}
+
+static void on_logind_done(GObject *source, GAsyncResult *res,
+                           gpointer user_data) {
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GVariant) reply =
+      g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res, &error);
+  glong pending = logind_pending;
+
+  command_stats_add("logind SetBrightness",
+                    g_get_monotonic_time() - logind_start, 0, FALSE);
+  if (error)
+    report_failure(error->message);
+
+  logind_busy = FALSE;
+  logind_pending = -1;
+  if (pending >= 0)
+    logind_write(pending);
+}
+
+static void on_system_bus_ready(GObject *source, GAsyncResult *res,
+                                gpointer user_data) {
+  g_autoptr(GError) error = NULL;
+  glong pending = logind_pending;
+
+  system_bus = g_bus_get_finish(res, &error);
+  logind_busy = FALSE;
+  logind_pending = -1;
+  if (system_bus == NULL) {
+    logind_unavailable = TRUE;
+    report_failure(error->message);
+    return;
+  }
+  if (pending >= 0)
+    logind_write(pending);
+}
+
+static void logind_write(glong value) {
+  if (logind_unavailable)
+    return;
+  if (logind_busy) {
+    logind_pending = value;
+    return;
+  }
+  if (system_bus == NULL) {
+    if (!capabilities()->logind) {
+      logind_unavailable = TRUE;
+      report_failure("logind is not running");
+      return;
+    }
+    logind_busy = TRUE;
+    logind_pending = value;
+    g_bus_get(G_BUS_TYPE_SYSTEM, NULL, on_system_bus_ready, NULL);
+    return;
+  }
+
+  logind_busy = TRUE;
+  logind_start = g_get_monotonic_time();
+  g_dbus_connection_call(
+      system_bus, "org.freedesktop.login1",
+      "/org/freedesktop/login1/session/auto", "org.freedesktop.login1.Session",
+      "SetBrightness",
+      g_variant_new("(ssu)", "backlight", device, (guint32)value), NULL,
+      G_DBUS_CALL_FLAGS_NONE, -1, NULL, on_logind_done, NULL);
+}
+
+static gboolean on_ramp_step(gpointer user_data) {
+  gdouble t = (g_get_monotonic_time() - ramp_start) /
+              (BACKLIGHT_RAMP_MS * 1000.0);
+
+  t = MIN(t, 1.0);
+  // Ease out: most of the change lands right away, so the slider still
+  // feels direct
+  ramp_percent = ramp_from + (ramp_to - ramp_from) * t * (2 - t);
+  write_level(percent_to_level(ramp_percent));
+
+  if (t < 1.0)
+    return G_SOURCE_CONTINUE;
+  ramp_id = 0;
+  return G_SOURCE_REMOVE;
+}
+
+static void call_listener(GCallback func, gpointer user_data, gpointer args) {
+  ((BacklightFunc)func)(*(gdouble *)args, user_data);
+}
+
+static void notify(gdouble percent) {
+  listener_list_emit(&listeners, call_listener, &percent);
+}
+
+// The kernel announces every change, ours included. Only a level that
+// differs from what we last wrote is news, and none is trusted while our own
+// writes are still landing.
+static gboolean on_udev_event(gint monitor_fd, GIOCondition condition,
+                              gpointer user_data) {
+  struct udev_device *udev_device = udev_monitor_receive_device(monitor);
+  glong value;
+
+  if (udev_device == NULL)
+    return G_SOURCE_CONTINUE;
+
+  if (g_strcmp0(udev_device_get_sysname(udev_device), device) == 0 &&
+      ramp_id == 0 && !logind_busy) {
+    value = read_level();
+    if (value >= 0 && value != level) {
+      level = value;
+      notify(level_to_percent(level));
+    }
+  }
+  udev_device_unref(udev_device);
+  return G_SOURCE_CONTINUE;
+}
+
+static void watch_changes(void) {
+  udev = udev_new();
+  if (udev == NULL)
+    return;
+
+  monitor = udev_monitor_new_from_netlink(udev, "udev");
+  if (monitor == NULL ||
+      udev_monitor_filter_add_match_subsystem_devtype(monitor, "backlight",
+                                                      NULL) < 0 ||
+      udev_monitor_enable_receiving(monitor) < 0) {
+    g_printerr("Not watching for brightness changes: no udev monitor\n");
+    g_clear_pointer(&monitor, udev_monitor_unref);
+    return;
+  }
+  g_unix_fd_add(udev_monitor_get_fd(monitor), G_IO_IN, on_udev_event, NULL);
+}
+
+gboolean backlight_init(void) {
+  g_autofree gchar *path = NULL;
+  g_autoptr(GError) error = NULL;
+
+  if (device != NULL)
+    return TRUE;
+  if (!capabilities()->backlight)
+    return FALSE;
+
+  device = pick_device();
+  if (device == NULL)
+    return FALSE;
+
+  max_level = read_attribute("max_brightness");
+  path = g_build_filename(BACKLIGHT_CLASS, device, "brightness", NULL);
+  fd = open(path, O_RDWR | O_CLOEXEC);
+  writable = fd >= 0;
+  if (fd < 0)
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0 || max_level <= 0) {
+    g_printerr("Failed to open backlight %s\n", device);
+    if (fd >= 0)
+      close(fd);
+    fd = -1;
+    g_clear_pointer(&device, g_free);
+    return FALSE;
+  }
+  level = MAX(read_level(), 0);
+
+  if (!writable && !capabilities()->logind) {
+    g_printerr("Brightness is read-only: no logind to write it\n");
+    logind_unavailable = TRUE;
+  } else if (!writable) {
+    system_bus = g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL, &error);
+    if (system_bus == NULL) {
+      g_printerr("Brightness is read-only: %s\n", error->message);
+      logind_unavailable = TRUE;
+    }
+  }
+
+  watch_changes();
+  return TRUE;
+}
+
+const gchar *backlight_device(void) { return device; }
+
+gdouble backlight_get(void) {
+  return ramp_id != 0 ? ramp_to : level_to_percent(level);
+}
+
+void backlight_set(gdouble percent) {
+  if (device == NULL)
+    return;
+
+  ramp_from = ramp_id != 0 ? ramp_percent : level_to_percent(level);
+  ramp_to = CLAMP(percent, 0, 100);
+  ramp_start = g_get_monotonic_time();
+  if (ramp_id == 0)
+    ramp_id = g_timeout_add(BACKLIGHT_RAMP_STEP_MS, on_ramp_step, NULL);
+}
+
+guint backlight_listen(BacklightFunc func, gpointer user_data) {
+  return listener_list_add(&listeners, G_CALLBACK(func), user_data);
+}
+
+void backlight_unlisten(guint id) { listener_list_remove(&listeners, id); }
@@ -0,0 +1,237 @@
+#include "display/hyprland_output.h"
+#include "hyprland/ipc.h"
+#include "parse/parse.h"
+#include <math.h>
+
+// availableModes carries two decimals while refreshRate is exact, so the
+// current mode is matched to within this
+#define HYPRLAND_REFRESH_SLACK_MHZ 10
+
+static gboolean connected = FALSE;
+static guint reload_id = 0;
+static GCancellable *load_cancellable = NULL;
+
+// "1920x1080@59.95Hz"
+static gboolean parse_mode(const gchar *text, DisplayMode *mode) {
+  StrView view = str_view(text);
+  long width, height, refresh_mhz;
+
+  if (!str_view_take_int(&view, &width) || !str_view_has_prefix(view, "x"))
+    return FALSE;
+  view = str_view_skip(view, 1);
+  if (!str_view_take_int(&view, &height) || !str_view_has_prefix(view, "@"))
+    return FALSE;
+  view = str_view_skip(view, 1);
+  if (!str_view_take_milli(&view, &refresh_mhz))
+    return FALSE;
+
+  mode->width = (gint)width;
+  mode->height = (gint)height;
+  mode->refresh_mhz = (gint)refresh_mhz;
+  return TRUE;
+}
+
+static void add_output(JsonObject *monitor) {
+  const gchar *name =
+      json_object_get_string_member_with_default(monitor, "name", NULL);
+  JsonArray *modes = json_object_has_member(monitor, "availableModes")
+                         ? json_object_get_array_member(monitor, "availableModes")
+                         : NULL;
+  gint width = json_object_get_int_member_with_default(monitor, "width", 0);
+  gint height = json_object_get_int_member_with_default(monitor, "height", 0);
+  gint refresh_mhz = (gint)lround(
+      json_object_get_double_member_with_default(monitor, "refreshRate", 0) *
+      1000);
+  DisplayOutput *output;
+
+  if (name == NULL)
+    return;
+
+  output = display_output_new(name, NULL);
+  output->description = g_strdup(
+      json_object_get_string_member_with_default(monitor, "description", NULL));
+  output->enabled =
+      !json_object_get_boolean_member_with_default(monitor, "disabled", FALSE);
+  output->x = json_object_get_int_member_with_default(monitor, "x", 0);
+  output->y = json_object_get_int_member_with_default(monitor, "y", 0);
+  output->scale =
+      json_object_get_double_member_with_default(monitor, "scale", 1.0);
+  output->transform =
+      json_object_get_int_member_with_default(monitor, "transform", 0);
+
+  for (guint i = 0; modes != NULL && i < json_array_get_length(modes); i++) {
+    DisplayMode *mode = display_mode_new(output, NULL);
+
+    if (!parse_mode(json_array_get_string_element(modes, i), mode)) {
+      display_output_remove_mode(output, mode);
+      continue;
+    }
+    // Hyprland lists the monitor's preferred mode first
+    mode->preferred = i == 0;
+    if (output->enabled && output->current == NULL && mode->width == width &&
+        mode->height == height &&
+        ABS(mode->refresh_mhz - refresh_mhz) <= HYPRLAND_REFRESH_SLACK_MHZ)
+      output->current = mode;
+  }
+
+  // A custom mode from the config is in use but not in the list
+  if (output->enabled && output->current == NULL && width > 0 && height > 0) {
+    output->current = display_mode_new(output, NULL);
+    output->current->width = width;
+    output->current->height = height;
+    output->current->refresh_mhz = refresh_mhz;
+  }
+
+  display_outputs_add(output);
+}
+
+static void on_monitors_ready(GObject *source, GAsyncResult *res,
+                              gpointer user_data) {
+  g_autoptr(GError) error = NULL;
+  g_autoptr(JsonNode) root = hyprland_query_finish(res, &error);
+  JsonArray *monitors;
+
+  if (root == NULL) {
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      g_printerr("Failed to list Hyprland monitors: %s\n", error->message);
+    return;
+  }
+  if (!JSON_NODE_HOLDS_ARRAY(root))
+    return;
+
+  monitors = json_node_get_array(root);
+  g_ptr_array_set_size(display_outputs(), 0);
+  for (guint i = 0; i < json_array_get_length(monitors); i++) {
+    JsonNode *monitor = json_array_get_element(monitors, i);
+    if (JSON_NODE_HOLDS_OBJECT(monitor))
+      add_output(json_node_get_object(monitor));
+  }
+  display_outputs_changed();
+}
+
+// A reload still in flight would only bring older state
+static void load_outputs(void) {
+  g_cancellable_cancel(load_cancellable);
+  g_clear_object(&load_cancellable);
+  load_cancellable = g_cancellable_new();
+  hyprland_query_async("monitors all", load_cancellable, on_monitors_ready,
+                       NULL);
+}
+
+static gboolean on_reload(gpointer user_data) {
+  reload_id = 0;
+  load_outputs();
+  return G_SOURCE_REMOVE;
+}
+
+// Plugging a monitor in brings monitoradded and monitoraddedv2 together;
+// reload once after the burst
+static void schedule_reload(void) {
+  if (reload_id == 0)
+    reload_id = g_idle_add(on_reload, NULL);
+}
+
+static void on_hyprland_event(const gchar *event, const gchar *data,
+                              gpointer user_data) {
+  if (g_str_has_prefix(event, "monitoradded") ||
+      g_str_has_prefix(event, "monitorremoved") ||
+      g_strcmp0(event, "configreloaded") == 0)
+    schedule_reload();
+}
+
+// Decimals always with a '.', since ',' separates the rule's fields
+static gchar *monitor_rule(const DisplayOutputConfig *config) {
+  DisplayOutput *output = config->output;
+  DisplayMode *mode = config->mode != NULL ? config->mode : output->current;
+  gchar refresh[G_ASCII_DTOSTR_BUF_SIZE];
+  gchar scale[G_ASCII_DTOSTR_BUF_SIZE];
+
+  if (!config->enabled)
+    return g_strdup_printf("keyword monitor %s,disable", output->name);
+
+  g_ascii_formatd(scale, sizeof(scale), "%.2f",
+                  config->scale > 0 ? config->scale : 1.0);
+  if (mode == NULL)
+    return g_strdup_printf("keyword monitor %s,preferred,%dx%d,%s,transform,%d",
+                           output->name, config->x, config->y, scale,
+                           output->transform);
+
+  g_ascii_formatd(refresh, sizeof(refresh), "%.3f", mode->refresh_mhz / 1000.0);
+  return g_strdup_printf("keyword monitor %s,%dx%d@%s,%dx%d,%s,transform,%d",
+                         output->name, mode->width, mode->height, refresh,
+                         config->x, config->y, scale, output->transform);
+}
+
+static gchar **monitor_rules(const DisplayOutputConfig *configs, guint n) {
+  gchar **rules = g_new0(gchar *, n + 1);
+
+  for (guint i = 0; i < n; i++)
+    rules[i] = monitor_rule(&configs[i]);
+  return rules;
+}
+
+static void on_rules_restored(GObject *source, GAsyncResult *res,
+                              gpointer user_data) {
+  g_autoptr(GError) error = NULL;
+
+  if (!hyprland_batch_finish(res, &error))
+    g_printerr("Failed to restore the Hyprland monitors: %s\n",
+               error->message);
+  schedule_reload();
+}
+
+static void on_rules_applied(GObject *source, GAsyncResult *res,
+                             gpointer user_data) {
+  GTask *task = G_TASK(user_data);
+  GError *error = NULL;
+
+  if (!hyprland_batch_finish(res, &error)) {
+    // A refused rule fails the batch, but the rules that did take effect
+    // stay; they all go back, also when the batch was cancelled midway
+    hyprland_batch_async((const gchar *const *)g_task_get_task_data(task),
+                         NULL, on_rules_restored, NULL);
+    g_task_return_error(task, error);
+    g_object_unref(task);
+    return;
+  }
+
+  // Rules set at runtime raise no event of their own
+  schedule_reload();
+  g_task_return_boolean(task, TRUE);
+  g_object_unref(task);
+}
+
+// The rules that bring the outputs back are taken from the model now, as
+// it may be reloaded while the batch runs
+static void hyprland_apply(GArray *configs, GTask *task) {
+  g_autofree DisplayOutputConfig *current =
+      g_new(DisplayOutputConfig, MAX(configs->len, 1));
+  g_auto(GStrv) rules = NULL;
+
+  for (guint i = 0; i < configs->len; i++)
+    display_output_config_init(
+        &current[i], g_array_index(configs, DisplayOutputConfig, i).output);
+  g_task_set_task_data(task, monitor_rules(current, configs->len),
+                       (GDestroyNotify)g_strfreev);
+
+  rules = monitor_rules((DisplayOutputConfig *)configs->data, configs->len);
+  hyprland_batch_async((const gchar *const *)rules,
+                       g_task_get_cancellable(task), on_rules_applied, task);
+}
+
+static const DisplayBackend hyprland_backend = {
+    .name = "Hyprland IPC",
+    .apply = hyprland_apply,
+};
+
+const DisplayBackend *display_hyprland_connect(void) {
+  if (connected)
+    return &hyprland_backend;
+  if (!hyprland_ipc_available())
+    return NULL;
+
+  connected = TRUE;
+  hyprland_events_listen(on_hyprland_event, NULL);
+  load_outputs();
+  return &hyprland_backend;
+}
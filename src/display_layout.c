@@ -0,0 +1,430 @@
+#include "display/layout.h"
+#include "display/output.h"
+#include <adwaita.h>
+
+// Widget pixels kept free around the drawing
+#define LAYOUT_MARGIN 16
+// Neighbours whose edges are this close, as a fraction of the output's
+// side, get lined up exactly when dropped
+#define LAYOUT_ALIGN_FRACTION 0.1
+
+typedef struct {
+  gint x, y, width, height;
+} LayoutRect;
+
+static GtkWidget *LayoutGroup = NULL;
+static GtkWidget *LayoutArea = NULL;
+static GtkListBox *LayoutOutputs = NULL;
+static GtkWidget *ApplyButton = NULL;
+static GtkWidget *ResetButton = NULL;
+
+static GArray *drafts = NULL; // DisplayOutputConfig, in display_outputs() order
+static gint selected = -1;
+static gint dragged = -1;
+static gint drag_x, drag_y; // dragged draft's position when the drag began
+static gboolean applying = FALSE;
+
+// widget = view_offset + layout * view_scale. Held still during a drag so
+// the drawing doesn't rescale under the pointer.
+static gdouble view_scale = 1, view_x = 0, view_y = 0;
+
+static DisplayOutputConfig *draft(gint index) {
+  return &g_array_index(drafts, DisplayOutputConfig, index);
+}
+
+static DisplayMode *draft_mode(const DisplayOutputConfig *config) {
+  GPtrArray *table = config->output->mode_table;
+
+  if (config->mode != NULL)
+    return config->mode;
+  for (guint i = 0; i < table->len; i++) {
+    DisplayMode *mode = table->pdata[i];
+    if (mode->preferred)
+      return mode;
+  }
+  return table->len > 0 ? table->pdata[0] : NULL;
+}
+
+static gboolean draft_rect(gint index, LayoutRect *rect) {
+  DisplayOutputConfig *config = draft(index);
+  DisplayMode *mode = draft_mode(config);
+
+  if (!config->enabled || mode == NULL)
+    return FALSE;
+
+  rect->x = config->x;
+  rect->y = config->y;
+  display_mode_extent(mode, config->output->transform, config->scale,
+                      &rect->width, &rect->height);
+  return TRUE;
+}
+
+static gboolean rects_overlap(const LayoutRect *a, const LayoutRect *b) {
+  return a->x < b->x + b->width && b->x < a->x + a->width &&
+         a->y < b->y + b->height && b->y < a->y + a->height;
+}
+
+static gboolean drafts_changed(void) {
+  for (guint i = 0; i < drafts->len; i++) {
+    DisplayOutputConfig current;
+    DisplayOutputConfig *config = draft(i);
+
+    display_output_config_init(&current, config->output);
+    if (config->enabled != current.enabled ||
+        (config->enabled &&
+         (config->x != current.x || config->y != current.y ||
+          config->mode != current.mode || config->scale != current.scale)))
+      return TRUE;
+  }
+  return FALSE;
+}
+
+static void sync_buttons(void) {
+  gboolean changed = !applying && drafts_changed();
+
+  gtk_widget_set_sensitive(ApplyButton, changed);
+  gtk_widget_set_sensitive(ResetButton, changed);
+}
+
+// Move the layout so it starts at 0,0; X11 has no negative coordinates
+static void normalize(void) {
+  gint min_x = G_MAXINT, min_y = G_MAXINT;
+  LayoutRect rect;
+
+  for (guint i = 0; i < drafts->len; i++) {
+    if (draft_rect(i, &rect)) {
+      min_x = MIN(min_x, rect.x);
+      min_y = MIN(min_y, rect.y);
+    }
+  }
+  if (min_x == G_MAXINT)
+    return;
+
+  for (guint i = 0; i < drafts->len; i++) {
+    if (draft(i)->enabled) {
+      draft(i)->x -= min_x;
+      draft(i)->y -= min_y;
+    }
+  }
+}
+
+static gboolean fits(gint index, const LayoutRect *rect) {
+  LayoutRect other;
+
+  for (guint i = 0; i < drafts->len; i++) {
+    if ((gint)i != index && draft_rect(i, &other) &&
+        rects_overlap(rect, &other))
+      return FALSE;
+  }
+  return TRUE;
+}
+
+// Slide `along` so the two spans share at least a pixel, then line the
+// edges up if they are nearly lined up already
+static gint place_along(gint along, gint length, gint other, gint other_length) {
+  gint slack = (gint)(other_length * LAYOUT_ALIGN_FRACTION);
+
+  along = CLAMP(along, other - length + 1, other + other_length - 1);
+  if (ABS(along - other) <= slack)
+    return other;
+  if (ABS(along + length - (other + other_length)) <= slack)
+    return other + other_length - length;
+  return along;
+}
+
+// Put a dropped output flush against the nearest side of a neighbour,
+// wherever that moves it least without overlapping anything
+static void snap(gint index) {
+  LayoutRect rect, other, best = {0};
+  gint64 best_distance = G_MAXINT64;
+
+  if (!draft_rect(index, &rect))
+    return;
+
+  for (guint i = 0; i < drafts->len; i++) {
+    LayoutRect candidates[4];
+
+    if ((gint)i == index || !draft_rect(i, &other))
+      continue;
+
+    for (guint side = 0; side < G_N_ELEMENTS(candidates); side++)
+      candidates[side] = rect;
+    candidates[0].x = other.x + other.width;
+    candidates[1].x = other.x - rect.width;
+    candidates[0].y = candidates[1].y =
+        place_along(rect.y, rect.height, other.y, other.height);
+    candidates[2].y = other.y + other.height;
+    candidates[3].y = other.y - rect.height;
+    candidates[2].x = candidates[3].x =
+        place_along(rect.x, rect.width, other.x, other.width);
+
+    for (guint side = 0; side < G_N_ELEMENTS(candidates); side++) {
+      gint64 distance = (gint64)ABS(candidates[side].x - rect.x) +
+                        ABS(candidates[side].y - rect.y);
+
+      if (distance < best_distance && fits(index, &candidates[side])) {
+        best = candidates[side];
+        best_distance = distance;
+      }
+    }
+  }
+
+  if (best_distance == G_MAXINT64) {
+    // Alone, or boxed in: stand it at the right end of everything else
+    best.x = best.y = 0;
+    for (guint i = 0; i < drafts->len; i++) {
+      if ((gint)i != index && draft_rect(i, &other))
+        best.x = MAX(best.x, other.x + other.width);
+    }
+  }
+  draft(index)->x = best.x;
+  draft(index)->y = best.y;
+}
+
+static void update_view(gint width, gint height) {
+  gint min_x = G_MAXINT, min_y = G_MAXINT, max_x = G_MININT, max_y = G_MININT;
+  LayoutRect rect;
+
+  for (guint i = 0; i < drafts->len; i++) {
+    if (!draft_rect(i, &rect))
+      continue;
+    min_x = MIN(min_x, rect.x);
+    min_y = MIN(min_y, rect.y);
+    max_x = MAX(max_x, rect.x + rect.width);
+    max_y = MAX(max_y, rect.y + rect.height);
+  }
+  if (min_x == G_MAXINT || width <= 2 * LAYOUT_MARGIN ||
+      height <= 2 * LAYOUT_MARGIN)
+    return;
+
+  view_scale = MIN((gdouble)(width - 2 * LAYOUT_MARGIN) / (max_x - min_x),
+                   (gdouble)(height - 2 * LAYOUT_MARGIN) / (max_y - min_y));
+  view_x = (width - (max_x - min_x) * view_scale) / 2 - min_x * view_scale;
+  view_y = (height - (max_y - min_y) * view_scale) / 2 - min_y * view_scale;
+}
+
+static void draw_layout(GtkDrawingArea *area, cairo_t *cr, int width,
+                        int height, gpointer user_data) {
+  GtkWidget *widget = GTK_WIDGET(area);
+  GdkRGBA color;
+  LayoutRect rect;
+
+  if (dragged < 0)
+    update_view(width, height);
+  gtk_widget_get_color(widget, &color);
+  cairo_set_line_width(cr, 1);
+
+  for (guint i = 0; i < drafts->len; i++) {
+    DisplayOutputConfig *config = draft(i);
+    g_autoptr(PangoLayout) label = NULL;
+    gdouble x, y, w, h;
+    gint label_width, label_height;
+
+    if (!draft_rect(i, &rect))
+      continue;
+
+    // A pixel of gap keeps neighbours apart on screen
+    x = view_x + rect.x * view_scale + 1;
+    y = view_y + rect.y * view_scale + 1;
+    w = rect.width * view_scale - 2;
+    h = rect.height * view_scale - 2;
+
+    cairo_rectangle(cr, x + 0.5, y + 0.5, w - 1, h - 1);
+    cairo_set_source_rgba(cr, color.red, color.green, color.blue,
+                          (gint)i == selected ? 0.3 : 0.12);
+    cairo_fill_preserve(cr);
+    cairo_set_source_rgba(cr, color.red, color.green, color.blue, 0.6);
+    cairo_stroke(cr);
+
+    label = gtk_widget_create_pango_layout(widget, config->output->name);
+    pango_layout_get_pixel_size(label, &label_width, &label_height);
+    if (label_width > w || label_height > h)
+      continue;
+    gdk_cairo_set_source_rgba(cr, &color);
+    cairo_move_to(cr, x + (w - label_width) / 2, y + (h - label_height) / 2);
+    pango_cairo_show_layout(cr, label);
+  }
+}
+
+static gint output_at(gdouble x, gdouble y) {
+  LayoutRect rect;
+
+  // Last drawn is on top
+  for (gint i = drafts->len - 1; i >= 0; i--) {
+    if (!draft_rect(i, &rect))
+      continue;
+    if (x >= view_x + rect.x * view_scale &&
+        x < view_x + (rect.x + rect.width) * view_scale &&
+        y >= view_y + rect.y * view_scale &&
+        y < view_y + (rect.y + rect.height) * view_scale)
+      return i;
+  }
+  return -1;
+}
+
+static void on_drag_begin(GtkGestureDrag *gesture, gdouble x, gdouble y,
+                          gpointer user_data) {
+  dragged = applying ? -1 : output_at(x, y);
+  if (dragged < 0) {
+    gtk_gesture_set_state(GTK_GESTURE(gesture), GTK_EVENT_SEQUENCE_DENIED);
+    return;
+  }
+
+  selected = dragged;
+  drag_x = draft(dragged)->x;
+  drag_y = draft(dragged)->y;
+  gtk_widget_queue_draw(LayoutArea);
+}
+
+static void on_drag_update(GtkGestureDrag *gesture, gdouble offset_x,
+                           gdouble offset_y, gpointer user_data) {
+  if (dragged < 0)
+    return;
+
+  draft(dragged)->x = drag_x + (gint)(offset_x / view_scale);
+  draft(dragged)->y = drag_y + (gint)(offset_y / view_scale);
+  gtk_widget_queue_draw(LayoutArea);
+}
+
+static void on_drag_end(GtkGestureDrag *gesture, gdouble offset_x,
+                        gdouble offset_y, gpointer user_data) {
+  if (dragged < 0)
+    return;
+
+  snap(dragged);
+  normalize();
+  dragged = -1;
+  sync_buttons();
+  gtk_widget_queue_draw(LayoutArea);
+}
+
+static void on_output_toggled(GtkSwitch *toggle, GParamSpec *pspec,
+                              gpointer user_data) {
+  gint index = GPOINTER_TO_INT(user_data);
+  gboolean active = gtk_switch_get_active(toggle);
+  LayoutRect rect;
+
+  if (!active) {
+    gboolean others = FALSE;
+
+    for (guint i = 0; i < drafts->len; i++)
+      others |= (gint)i != index && draft(i)->enabled;
+    // Turning off the last screen leaves no way to turn it back on
+    if (!others) {
+      g_signal_handlers_block_by_func(toggle, on_output_toggled, user_data);
+      gtk_switch_set_active(toggle, TRUE);
+      g_signal_handlers_unblock_by_func(toggle, on_output_toggled, user_data);
+      return;
+    }
+  }
+
+  draft(index)->enabled = active;
+  if (active && draft_rect(index, &rect)) {
+    // Start from where it last was, and move only if that is now taken
+    if (!fits(index, &rect))
+      snap(index);
+  }
+  normalize();
+  sync_buttons();
+  gtk_widget_queue_draw(LayoutArea);
+}
+
+static void reset_drafts(void) {
+  GPtrArray *outputs = display_outputs();
+
+  g_array_set_size(drafts, outputs->len);
+  for (guint i = 0; i < outputs->len; i++)
+    display_output_config_init(draft(i), outputs->pdata[i]);
+  if (selected >= (gint)drafts->len)
+    selected = -1;
+  dragged = -1;
+}
+
+static void show_outputs(void) {
+  gtk_list_box_remove_all(LayoutOutputs);
+
+  for (guint i = 0; i < drafts->len; i++) {
+    DisplayOutput *output = draft(i)->output;
+    GtkWidget *row = adw_action_row_new();
+    GtkWidget *toggle = gtk_switch_new();
+
+    adw_preferences_row_set_use_markup(ADW_PREFERENCES_ROW(row), FALSE);
+    adw_preferences_row_set_title(ADW_PREFERENCES_ROW(row),
+                                  output->description ? output->description
+                                                      : output->name);
+    if (output->description)
+      adw_action_row_set_subtitle(ADW_ACTION_ROW(row), output->name);
+
+    gtk_switch_set_active(GTK_SWITCH(toggle), draft(i)->enabled);
+    gtk_widget_set_valign(toggle, GTK_ALIGN_CENTER);
+    adw_action_row_add_suffix(ADW_ACTION_ROW(row), toggle);
+    adw_action_row_set_activatable_widget(ADW_ACTION_ROW(row), toggle);
+    g_signal_connect(toggle, "notify::active", G_CALLBACK(on_output_toggled),
+                     GINT_TO_POINTER(i));
+
+    gtk_list_box_append(LayoutOutputs, row);
+  }
+}
+
+// Output pointers may not survive a change, so drafts never do
+static void on_outputs_changed(gpointer user_data) {
+  reset_drafts();
+  show_outputs();
+  gtk_widget_set_visible(LayoutGroup, drafts->len > 1);
+  sync_buttons();
+  gtk_widget_queue_draw(LayoutArea);
+}
+
+static void on_layout_applied(GObject *source, GAsyncResult *res,
+                              gpointer user_data) {
+  g_autoptr(GError) error = NULL;
+
+  applying = FALSE;
+  if (!display_outputs_apply_finish(res, &error)) {
+    g_printerr("Failed to apply the layout: %s\n", error->message);
+    on_outputs_changed(NULL);
+    return;
+  }
+  sync_buttons();
+}
+
+static void on_apply_clicked(GtkButton *button, gpointer user_data) {
+  applying = TRUE;
+  sync_buttons();
+  display_outputs_apply_async((DisplayOutputConfig *)drafts->data,
+                              drafts->len, NULL, on_layout_applied, NULL);
+}
+
+static void on_reset_clicked(GtkButton *button, gpointer user_data) {
+  on_outputs_changed(NULL);
+}
+
+void display_layout_attach(GtkBuilder *builder) {
+  GtkGesture *drag = gtk_gesture_drag_new();
+
+  LayoutGroup = GTK_WIDGET(gtk_builder_get_object(builder, "layout_group"));
+  LayoutArea = GTK_WIDGET(gtk_builder_get_object(builder, "layout_area"));
+  LayoutOutputs = GTK_LIST_BOX(gtk_builder_get_object(builder, "layout_outputs"));
+  ApplyButton = GTK_WIDGET(gtk_builder_get_object(builder, "layout_apply"));
+  ResetButton = GTK_WIDGET(gtk_builder_get_object(builder, "layout_reset"));
+
+  if (display_outputs_backend() == NULL) {
+    gtk_widget_set_visible(LayoutGroup, FALSE);
+    g_object_unref(drag);
+    return;
+  }
+
+  drafts = g_array_new(FALSE, TRUE, sizeof(DisplayOutputConfig));
+  gtk_drawing_area_set_draw_func(GTK_DRAWING_AREA(LayoutArea), draw_layout,
+                                 NULL, NULL);
+  g_signal_connect(drag, "drag-begin", G_CALLBACK(on_drag_begin), NULL);
+  g_signal_connect(drag, "drag-update", G_CALLBACK(on_drag_update), NULL);
+  g_signal_connect(drag, "drag-end", G_CALLBACK(on_drag_end), NULL);
+  gtk_widget_add_controller(LayoutArea, GTK_EVENT_CONTROLLER(drag));
+
+  g_signal_connect(ApplyButton, "clicked", G_CALLBACK(on_apply_clicked), NULL);
+  g_signal_connect(ResetButton, "clicked", G_CALLBACK(on_reset_clicked), NULL);
+
+  display_outputs_listen(on_outputs_changed, NULL);
+  on_outputs_changed(NULL);
+}
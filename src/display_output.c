@@ -0,0 +1,222 @@
+#include "display/output.h"
+#include "display/hyprland_output.h"
+#include "display/wlr_output.h"
+#include "display/xrandr_output.h"
+#include "listener/listener.h"
+
+static const DisplayBackend *backend = NULL;
+static GPtrArray *outputs = NULL;
+static ListenerList listeners;
+
+static void display_mode_free(DisplayMode *mode) { g_free(mode); }
+
+static void display_output_free(DisplayOutput *output) {
+  g_free(output->name);
+  g_free(output->description);
+  g_ptr_array_unref(output->mode_table);
+  g_ptr_array_unref(output->modes);
+  g_free(output);
+}
+
+gboolean display_outputs_init(void) {
+  if (backend != NULL)
+    return TRUE;
+
+  outputs = g_ptr_array_new_with_free_func((GDestroyNotify)display_output_free);
+  // Hyprland's own rules before output management: they are what hyprctl
+  // sets, and its events keep the model live
+  backend = display_hyprland_connect();
+  if (backend == NULL)
+    backend = display_wlr_connect();
+  if (backend == NULL)
+    backend = display_xrandr_connect();
+  if (backend == NULL) {
+    g_clear_pointer(&outputs, g_ptr_array_unref);
+    return FALSE;
+  }
+
+  g_debug("Display outputs from %s", backend->name);
+  return TRUE;
+}
+
+const DisplayBackend *display_outputs_backend(void) { return backend; }
+
+guint display_outputs_listen(DisplayOutputsFunc func, gpointer user_data) {
+  return listener_list_add(&listeners, G_CALLBACK(func), user_data);
+}
+
+void display_outputs_unlisten(guint id) {
+  listener_list_remove(&listeners, id);
+}
+
+GPtrArray *display_outputs(void) {
+  if (outputs == NULL)
+    outputs =
+        g_ptr_array_new_with_free_func((GDestroyNotify)display_output_free);
+  return outputs;
+}
+
+DisplayOutput *display_outputs_lookup(const gchar *name) {
+  for (guint i = 0; outputs != NULL && i < outputs->len; i++) {
+    DisplayOutput *output = outputs->pdata[i];
+    if (g_strcmp0(output->name, name) == 0)
+      return output;
+  }
+  return NULL;
+}
+
+void display_output_config_init(DisplayOutputConfig *config,
+                                DisplayOutput *output) {
+  config->output = output;
+  config->enabled = output->enabled;
+  config->mode = output->current;
+  config->x = output->x;
+  config->y = output->y;
+  config->scale = output->scale;
+}
+
+// Two decimals keep 59.94 and 60 Hz apart; whole rates drop them
+gchar *display_mode_label(const DisplayMode *mode) {
+  if (mode->refresh_mhz % 1000 == 0)
+    return g_strdup_printf("%dx%d @ %d Hz", mode->width, mode->height,
+                           mode->refresh_mhz / 1000);
+  return g_strdup_printf("%dx%d @ %.2f Hz", mode->width, mode->height,
+                         mode->refresh_mhz / 1000.0);
+}
+
+void display_mode_extent(const DisplayMode *mode, gint transform,
+                         gdouble scale, gint *width, gint *height) {
+  // Odd transforms are quarter turns, which swap the sides
+  gboolean turned = transform % 2 == 1;
+  gint mode_width = turned ? mode->height : mode->width;
+  gint mode_height = turned ? mode->width : mode->height;
+
+  if (scale <= 0)
+    scale = 1;
+  *width = (gint)(mode_width / scale + 0.5);
+  *height = (gint)(mode_height / scale + 0.5);
+}
+
+void display_outputs_apply_async(const DisplayOutputConfig *configs,
+                                 guint n_configs, GCancellable *cancellable,
+                                 GAsyncReadyCallback callback,
+                                 gpointer user_data) {
+  GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+  GArray *layout = g_array_sized_new(FALSE, FALSE, sizeof(DisplayOutputConfig),
+                                     n_configs);
+
+  g_task_set_source_tag(task, display_outputs_apply_async);
+  if (backend == NULL) {
+    g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                            "No display backend");
+    g_object_unref(task);
+    g_array_unref(layout);
+    return;
+  }
+
+  g_array_append_vals(layout, configs, n_configs);
+  g_task_set_task_data(task, layout, (GDestroyNotify)g_array_unref);
+  backend->apply(layout, task);
+}
+
+gboolean display_outputs_apply_finish(GAsyncResult *result, GError **error) {
+  g_return_val_if_fail(g_task_is_valid(result, NULL), FALSE);
+  return g_task_propagate_boolean(G_TASK(result), error);
+}
+
+DisplayOutput *display_output_new(const gchar *name, gpointer handle) {
+  DisplayOutput *output = g_new0(DisplayOutput, 1);
+
+  output->name = g_strdup(name);
+  output->scale = 1.0;
+  output->modes =
+      g_ptr_array_new_with_free_func((GDestroyNotify)display_mode_free);
+  output->mode_table = g_ptr_array_new();
+  output->handle = handle;
+  return output;
+}
+
+DisplayMode *display_mode_new(DisplayOutput *output, gpointer handle) {
+  DisplayMode *mode = g_new0(DisplayMode, 1);
+
+  mode->output = output;
+  mode->handle = handle;
+  g_ptr_array_add(output->modes, mode);
+  return mode;
+}
+
+static gint compare_name(gconstpointer a, gconstpointer b) {
+  const DisplayOutput *first = *(DisplayOutput **)a;
+  const DisplayOutput *second = *(DisplayOutput **)b;
+
+  return g_strcmp0(first->name, second->name);
+}
+
+void display_outputs_add(DisplayOutput *output) {
+  g_ptr_array_add(display_outputs(), output);
+}
+
+void display_outputs_remove(DisplayOutput *output) {
+  g_ptr_array_remove(display_outputs(), output);
+}
+
+void display_output_remove_mode(DisplayOutput *output, DisplayMode *mode) {
+  if (output->current == mode)
+    output->current = NULL;
+  g_ptr_array_remove(output->mode_table, mode);
+  g_ptr_array_remove(output->modes, mode);
+}
+
+static gint compare_mode(gconstpointer a, gconstpointer b) {
+  const DisplayMode *first = *(DisplayMode **)a;
+  const DisplayMode *second = *(DisplayMode **)b;
+  gint64 first_area = (gint64)first->width * first->height;
+  gint64 second_area = (gint64)second->width * second->height;
+
+  if (first_area != second_area)
+    return first_area > second_area ? -1 : 1;
+  if (first->width != second->width)
+    return second->width - first->width;
+  return second->refresh_mhz - first->refresh_mhz;
+}
+
+// Servers list some timings more than once (interlaced, reduced blanking,
+// the same mode under two flags); people need each size and rate once. The
+// copy kept is the one in use, if any.
+static void build_mode_table(DisplayOutput *output) {
+  GPtrArray *table = output->mode_table;
+  guint kept = 0;
+
+  g_ptr_array_set_size(table, 0);
+  for (guint i = 0; i < output->modes->len; i++)
+    g_ptr_array_add(table, output->modes->pdata[i]);
+  g_ptr_array_sort(table, compare_mode);
+
+  for (guint i = 0; i < table->len; i++) {
+    DisplayMode *mode = table->pdata[i];
+    DisplayMode *last = kept > 0 ? table->pdata[kept - 1] : NULL;
+
+    if (last != NULL && compare_mode(&last, &mode) == 0) {
+      if (mode == output->current)
+        table->pdata[kept - 1] = mode;
+      continue;
+    }
+    table->pdata[kept++] = mode;
+  }
+  g_ptr_array_set_size(table, kept);
+}
+
+static void call_listener(GCallback func, gpointer user_data, gpointer args) {
+  ((DisplayOutputsFunc)func)(user_data);
+}
+
+void display_outputs_changed(void) {
+  GPtrArray *all = display_outputs();
+
+  // Names can arrive after the output itself, so sort once it is complete
+  g_ptr_array_sort(all, compare_name);
+  for (guint i = 0; i < all->len; i++)
+    build_mode_table(all->pdata[i]);
+
+  listener_list_emit(&listeners, call_listener, NULL);
+}
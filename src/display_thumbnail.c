@@ -0,0 +1,279 @@
+#include "display/thumbnail.h"
+#include "command/stats.h"
+#include <fcntl.h>
+#include <glib/gstdio.h>
+#include <unistd.h>
+
+// Failed thumbnails go under the application's own name, per the spec
+#define THUMBNAIL_FAIL_DIR "fail/systune"
+
+typedef struct {
+  GFile *file;
+  gchar *uri;
+  gchar *key; // memory cache key: size and URI
+  guint64 mtime;
+  ThumbnailSize size;
+  guint64 sequence; // newer requests decode first
+} ThumbnailRequest;
+
+typedef struct {
+  gchar *key;
+  guint64 mtime;
+  GdkTexture *texture;
+} MemoryEntry;
+
+static GThreadPool *pool = NULL;
+static guint64 next_sequence = 0;
+static GHashTable *memory = NULL; // key -> GList link in recent
+static GQueue recent = G_QUEUE_INIT; // MemoryEntry, most recent first
+
+static void thumbnail_request_free(ThumbnailRequest *request) {
+  g_object_unref(request->file);
+  g_free(request->uri);
+  g_free(request->key);
+  g_free(request);
+}
+
+static void memory_entry_free(MemoryEntry *entry) {
+  g_free(entry->key);
+  g_object_unref(entry->texture);
+  g_free(entry);
+}
+
+static GdkTexture *memory_lookup(const gchar *key, guint64 mtime) {
+  GList *link = memory ? g_hash_table_lookup(memory, key) : NULL;
+  MemoryEntry *entry;
+
+  if (link == NULL)
+    return NULL;
+  entry = link->data;
+  if (entry->mtime != mtime)
+    return NULL;
+
+  g_queue_unlink(&recent, link);
+  g_queue_push_head_link(&recent, link);
+  return entry->texture;
+}
+
+static void memory_insert(const gchar *key, guint64 mtime,
+                          GdkTexture *texture) {
+  MemoryEntry *entry;
+  GList *link;
+
+  if (memory == NULL)
+    memory = g_hash_table_new(g_str_hash, g_str_equal);
+
+  link = g_hash_table_lookup(memory, key);
+  if (link != NULL) {
+    g_hash_table_remove(memory, key);
+    g_queue_unlink(&recent, link);
+    memory_entry_free(link->data);
+    g_list_free(link);
+  }
+
+  entry = g_new0(MemoryEntry, 1);
+  entry->key = g_strdup(key);
+  entry->mtime = mtime;
+  entry->texture = g_object_ref(texture);
+  g_queue_push_head(&recent, entry);
+  g_hash_table_insert(memory, entry->key, recent.head);
+
+  while (recent.length > THUMBNAIL_MEMORY_ITEMS) {
+    MemoryEntry *oldest = g_queue_pop_tail(&recent);
+    g_hash_table_remove(memory, oldest->key);
+    memory_entry_free(oldest);
+  }
+}
+
+static gchar *cache_path(const gchar *directory, const gchar *uri) {
+  g_autofree gchar *md5 = g_compute_checksum_for_string(G_CHECKSUM_MD5, uri, -1);
+  g_autofree gchar *name = g_strconcat(md5, ".png", NULL);
+
+  return g_build_filename(g_get_user_cache_dir(), "thumbnails", directory,
+                          name, NULL);
+}
+
+// A cached file is only good for the version of the image it was made from
+static gboolean cache_matches(GdkPixbuf *pixbuf, const ThumbnailRequest *request) {
+  const gchar *uri = gdk_pixbuf_get_option(pixbuf, "tEXt::Thumb::URI");
+  const gchar *mtime = gdk_pixbuf_get_option(pixbuf, "tEXt::Thumb::MTime");
+
+  return g_strcmp0(uri, request->uri) == 0 && mtime != NULL &&
+         g_ascii_strtoull(mtime, NULL, 10) == request->mtime;
+}
+
+static GdkPixbuf *load_cached(const gchar *path,
+                              const ThumbnailRequest *request) {
+  GdkPixbuf *pixbuf = gdk_pixbuf_new_from_file(path, NULL);
+
+  if (pixbuf != NULL && !cache_matches(pixbuf, request))
+    g_clear_object(&pixbuf);
+  return pixbuf;
+}
+
+// Written under a temporary name and renamed, so a reader never sees half a
+// file; the cache is private to the user
+static void save_cached(GdkPixbuf *pixbuf, const gchar *path,
+                        const ThumbnailRequest *request) {
+  g_autofree gchar *directory = g_path_get_dirname(path);
+  g_autofree gchar *temporary = g_strconcat(path, ".XXXXXX", NULL);
+  g_autofree gchar *mtime = g_strdup_printf("%" G_GUINT64_FORMAT,
+                                            request->mtime);
+  gint fd;
+
+  if (g_mkdir_with_parents(directory, 0700) != 0)
+    return;
+  fd = g_mkstemp_full(temporary, O_RDWR, 0600);
+  if (fd < 0)
+    return;
+  close(fd);
+
+  if (gdk_pixbuf_save(pixbuf, temporary, "png", NULL, "tEXt::Thumb::URI",
+                      request->uri, "tEXt::Thumb::MTime", mtime,
+                      "tEXt::Software", "SysTune", NULL) &&
+      g_rename(temporary, path) == 0)
+    return;
+  g_unlink(temporary);
+}
+
+static GdkPixbuf *decode(const ThumbnailRequest *request, GError **error) {
+  g_autofree gchar *path = g_file_get_path(request->file);
+  g_autoptr(GdkPixbuf) pixbuf = NULL;
+  gint width, height;
+
+  if (path == NULL) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                "Only local images get thumbnails");
+    return NULL;
+  }
+  // The header alone says whether the image needs shrinking
+  if (gdk_pixbuf_get_file_info(path, &width, &height) == NULL) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                "%s is not an image", path);
+    return NULL;
+  }
+
+  // Loaders that can decode at a fraction of the size (JPEG) do so here
+  if (width > (gint)request->size || height > (gint)request->size)
+    pixbuf = gdk_pixbuf_new_from_file_at_scale(path, request->size,
+                                               request->size, TRUE, error);
+  else
+    pixbuf = gdk_pixbuf_new_from_file(path, error);
+  if (pixbuf == NULL)
+    return NULL;
+  return gdk_pixbuf_apply_embedded_orientation(pixbuf);
+}
+
+static GdkTexture *make_thumbnail(const ThumbnailRequest *request,
+                                  GCancellable *cancellable, GError **error) {
+  const gchar *directory =
+      request->size == THUMBNAIL_LARGE ? "large" : "normal";
+  g_autofree gchar *path = cache_path(directory, request->uri);
+  g_autofree gchar *fail_path = cache_path(THUMBNAIL_FAIL_DIR, request->uri);
+  g_autoptr(GdkPixbuf) pixbuf = load_cached(path, request);
+  g_autoptr(GdkPixbuf) failed = NULL;
+  GError *decode_error = NULL;
+
+  if (pixbuf != NULL)
+    return gdk_texture_new_for_pixbuf(pixbuf);
+
+  failed = load_cached(fail_path, request);
+  if (failed != NULL) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                "No thumbnail for %s", request->uri);
+    return NULL;
+  }
+  if (g_cancellable_set_error_if_cancelled(cancellable, error))
+    return NULL;
+
+  pixbuf = decode(request, &decode_error);
+  if (pixbuf == NULL) {
+    // Remember broken images so they are not decoded again on every visit
+    if (!g_error_matches(decode_error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED)) {
+      g_autoptr(GdkPixbuf) marker =
+          gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, 1, 1);
+      gdk_pixbuf_fill(marker, 0);
+      save_cached(marker, fail_path, request);
+    }
+    g_propagate_error(error, decode_error);
+    return NULL;
+  }
+
+  save_cached(pixbuf, path, request);
+  return gdk_texture_new_for_pixbuf(pixbuf);
+}
+
+static void run_request(gpointer data, gpointer user_data) {
+  g_autoptr(GTask) task = data;
+  ThumbnailRequest *request = g_task_get_task_data(task);
+  GCancellable *cancellable = g_task_get_cancellable(task);
+  g_auto(CommandStatsSpan) span = command_stats_begin("task thumbnail");
+  GError *error = NULL;
+  GdkTexture *texture;
+
+  // Scrolled past while it waited
+  if (g_task_return_error_if_cancelled(task))
+    return;
+
+  texture = make_thumbnail(request, cancellable, &error);
+  if (texture == NULL)
+    g_task_return_error(task, error);
+  else
+    g_task_return_pointer(task, texture, g_object_unref);
+}
+
+static gint compare_requests(gconstpointer a, gconstpointer b,
+                             gpointer user_data) {
+  ThumbnailRequest *first = g_task_get_task_data(G_TASK((gpointer)a));
+  ThumbnailRequest *second = g_task_get_task_data(G_TASK((gpointer)b));
+
+  if (first->sequence == second->sequence)
+    return 0;
+  return first->sequence > second->sequence ? -1 : 1;
+}
+
+void thumbnail_load_async(GFile *file, guint64 mtime, ThumbnailSize size,
+                          GCancellable *cancellable,
+                          GAsyncReadyCallback callback, gpointer user_data) {
+  GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+  ThumbnailRequest *request = g_new0(ThumbnailRequest, 1);
+  GdkTexture *texture;
+
+  request->file = g_object_ref(file);
+  request->uri = g_file_get_uri(file);
+  request->key = g_strdup_printf("%d:%s", size, request->uri);
+  request->mtime = mtime;
+  request->size = size;
+  request->sequence = next_sequence++;
+  g_task_set_source_tag(task, thumbnail_load_async);
+  g_task_set_task_data(task, request, (GDestroyNotify)thumbnail_request_free);
+
+  texture = memory_lookup(request->key, mtime);
+  if (texture != NULL) {
+    g_task_return_pointer(task, g_object_ref(texture), g_object_unref);
+    g_object_unref(task);
+    return;
+  }
+
+  if (pool == NULL) {
+    pool = g_thread_pool_new(run_request, NULL,
+                             CLAMP(g_get_num_processors(), 1, THUMBNAIL_WORKERS),
+                             FALSE, NULL);
+    g_thread_pool_set_sort_function(pool, compare_requests, NULL);
+  }
+  g_thread_pool_push(pool, task, NULL);
+}
+
+GdkTexture *thumbnail_load_finish(GAsyncResult *result, GError **error) {
+  ThumbnailRequest *request;
+  GdkTexture *texture;
+
+  g_return_val_if_fail(g_task_is_valid(result, NULL), NULL);
+
+  texture = g_task_propagate_pointer(G_TASK(result), error);
+  if (texture != NULL) {
+    request = g_task_get_task_data(G_TASK(result));
+    memory_insert(request->key, request->mtime, texture);
+  }
+  return texture;
+}
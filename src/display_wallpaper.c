@@ -0,0 +1,307 @@
+#include "display/wallpaper.h"
+#include "capability/capability.h"
+#include "command/command.h"
+#include "display/output.h"
+#include "display/thumbnail.h"
+#include "display/wallpaper_cache.h"
+#include <adwaita.h>
+
+// Everything the gallery needs comes with the listing; the content type is
+// guessed from the name so thousands of files are not opened to sniff them
+#define WALLPAPER_ATTRIBUTES                                                   \
+  G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME                                       \
+  "," G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE                              \
+  "," G_FILE_ATTRIBUTE_TIME_MODIFIED
+
+static GtkDirectoryList *Directory = NULL;
+static GtkPicture *Preview = NULL;
+static GCancellable *preview_cancellable = NULL;
+static GCancellable *render_cancellable = NULL;
+
+static GFile *info_file(GFileInfo *info) {
+  return G_FILE(g_file_info_get_attribute_object(info, "standard::file"));
+}
+
+static guint64 info_mtime(GFileInfo *info) {
+  return g_file_info_get_attribute_uint64(info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+}
+
+static gboolean is_image(gpointer item, gpointer user_data) {
+  const gchar *type = g_file_info_get_attribute_string(
+      item, G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE);
+  g_autofree gchar *mime = type ? g_content_type_get_mime_type(type) : NULL;
+
+  return mime != NULL && g_str_has_prefix(mime, "image/");
+}
+
+static gchar *item_name(GFileInfo *info) {
+  return g_strdup(g_file_info_get_display_name(info));
+}
+
+static void cancel_and_unref(gpointer cancellable) {
+  g_cancellable_cancel(cancellable);
+  g_object_unref(cancellable);
+}
+
+static void on_thumbnail_ready(GObject *source, GAsyncResult *res,
+                               gpointer user_data) {
+  GtkPicture *picture = GTK_PICTURE(user_data);
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GdkTexture) texture = thumbnail_load_finish(res, &error);
+
+  // Cancelled means the cell was recycled for another image meanwhile
+  if (texture != NULL)
+    gtk_picture_set_paintable(picture, GDK_PAINTABLE(texture));
+  else if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    g_debug("No thumbnail: %s", error->message);
+  g_object_unref(picture);
+}
+
+static void on_cell_setup(GtkSignalListItemFactory *factory,
+                          GtkListItem *list_item, gpointer user_data) {
+  GtkWidget *picture = gtk_picture_new();
+
+  gtk_picture_set_content_fit(GTK_PICTURE(picture), GTK_CONTENT_FIT_COVER);
+  gtk_widget_set_size_request(picture, THUMBNAIL_NORMAL, THUMBNAIL_NORMAL * 3 / 4);
+  gtk_list_item_set_child(list_item, picture);
+}
+
+// Cells exist only for what is on screen, so this is where loading happens
+static void on_cell_bind(GtkSignalListItemFactory *factory,
+                         GtkListItem *list_item, gpointer user_data) {
+  GFileInfo *info = gtk_list_item_get_item(list_item);
+  GtkWidget *picture = gtk_list_item_get_child(list_item);
+  GCancellable *cancellable = g_cancellable_new();
+
+  gtk_widget_set_tooltip_text(picture, g_file_info_get_display_name(info));
+  g_object_set_data_full(G_OBJECT(list_item), "cancellable", cancellable,
+                         cancel_and_unref);
+  thumbnail_load_async(info_file(info), info_mtime(info), THUMBNAIL_NORMAL,
+                       cancellable, on_thumbnail_ready, g_object_ref(picture));
+}
+
+static void on_cell_unbind(GtkSignalListItemFactory *factory,
+                           GtkListItem *list_item, gpointer user_data) {
+  g_object_set_data(G_OBJECT(list_item), "cancellable", NULL);
+  gtk_picture_set_paintable(GTK_PICTURE(gtk_list_item_get_child(list_item)),
+                            NULL);
+}
+
+static void on_preview_ready(GObject *source, GAsyncResult *res,
+                             gpointer user_data) {
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GdkTexture) texture = thumbnail_load_finish(res, &error);
+
+  if (texture != NULL)
+    gtk_picture_set_paintable(Preview, GDK_PAINTABLE(texture));
+  else if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    g_printerr("Failed to preview the wallpaper: %s\n", error->message);
+}
+
+static gboolean is_wayland(void) {
+  return capabilities()->session == CAPABILITY_SESSION_WAYLAND;
+}
+
+// swww is the only setter on Wayland, feh on X11
+static gboolean has_setter(void) {
+  return is_wayland() ? capabilities()->swww : capabilities()->feh;
+}
+
+// Without an output model the setter has to scale the original itself
+static void set_unscaled(const gchar *path) {
+  if (is_wayland()) {
+    const gchar *argv[] = {"swww", "img", path, NULL};
+    command_spawn(argv);
+  } else {
+    const gchar *argv[] = {"feh", "--bg-scale", path, NULL};
+    command_spawn(argv);
+  }
+}
+
+// Every enabled output at its native pixel size
+static GArray *wallpaper_targets(void) {
+  GArray *targets = g_array_new(FALSE, TRUE, sizeof(WallpaperTarget));
+  GPtrArray *outputs;
+
+  g_array_set_clear_func(targets, (GDestroyNotify)wallpaper_target_clear);
+  if (!display_outputs_init())
+    return targets;
+
+  outputs = display_outputs();
+  for (guint i = 0; i < outputs->len; i++) {
+    DisplayOutput *output = outputs->pdata[i];
+    WallpaperTarget target = {0};
+
+    if (!output->enabled || output->current == NULL)
+      continue;
+    target.name = g_strdup(output->name);
+    target.x = output->x;
+    target.y = output->y;
+    display_mode_extent(output->current, output->transform, 1, &target.width,
+                        &target.height);
+    g_array_append_val(targets, target);
+  }
+  return targets;
+}
+
+typedef struct {
+  GFile *file;
+  GArray *targets; // WallpaperTarget, as rendered
+} WallpaperRender;
+
+static void wallpaper_render_free(WallpaperRender *render) {
+  g_object_unref(render->file);
+  g_array_unref(render->targets);
+  g_free(render);
+}
+
+static void on_render_ready(GObject *source, GAsyncResult *res,
+                            gpointer user_data) {
+  WallpaperRender *render = user_data;
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GPtrArray) paths = wallpaper_cache_render_finish(res, &error);
+
+  if (paths == NULL) {
+    // Cancelled means a newer choice replaced this one
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      g_autofree gchar *path = g_file_get_path(render->file);
+      g_printerr("Failed to prepare the wallpaper: %s\n", error->message);
+      set_unscaled(path);
+    }
+    wallpaper_render_free(render);
+    return;
+  }
+
+  // Renders are already the exact size, so neither setter scales anything
+  if (is_wayland()) {
+    for (guint i = 0; i < paths->len; i++) {
+      WallpaperTarget *target =
+          &g_array_index(render->targets, WallpaperTarget, i);
+      const gchar *argv[] = {"swww",     "img", "--outputs",     target->name,
+                             "--resize", "no",  paths->pdata[i], NULL};
+      command_spawn(argv);
+    }
+  } else {
+    const gchar *argv[] = {"feh", "--no-xinerama", "--bg-center",
+                           paths->pdata[0], NULL};
+    command_spawn(argv);
+  }
+  wallpaper_render_free(render);
+}
+
+static void set_wallpaper(GFileInfo *info) {
+  GFile *file = info_file(info);
+  g_autofree gchar *path = g_file_get_path(file);
+  g_autoptr(GArray) targets = NULL;
+
+  if (path == NULL)
+    return;
+
+  g_cancellable_cancel(render_cancellable);
+  g_clear_object(&render_cancellable);
+  targets = wallpaper_targets();
+  if (targets->len == 0) {
+    set_unscaled(path);
+  } else {
+    WallpaperRender *render = g_new0(WallpaperRender, 1);
+
+    render->file = g_object_ref(file);
+    render->targets = g_array_ref(targets);
+    render_cancellable = g_cancellable_new();
+    // feh paints the whole X screen at once, swww each output on its own
+    wallpaper_cache_render_async(file, targets, !is_wayland(),
+                                 render_cancellable, on_render_ready, render);
+  }
+
+  // The preview is a large thumbnail, never the full image
+  g_cancellable_cancel(preview_cancellable);
+  g_clear_object(&preview_cancellable);
+  preview_cancellable = g_cancellable_new();
+  thumbnail_load_async(file, info_mtime(info), THUMBNAIL_LARGE,
+                       preview_cancellable, on_preview_ready, NULL);
+}
+
+static void on_cell_activate(GtkGridView *grid, guint position,
+                             gpointer user_data) {
+  GListModel *model = G_LIST_MODEL(gtk_grid_view_get_model(grid));
+  g_autoptr(GFileInfo) info = g_list_model_get_item(model, position);
+
+  if (info != NULL)
+    set_wallpaper(info);
+}
+
+static void on_folder_response(GtkDialog *dialog, gint response_id,
+                               gpointer user_data) {
+  if (response_id == GTK_RESPONSE_ACCEPT) {
+    g_autoptr(GFile) folder = gtk_file_chooser_get_file(GTK_FILE_CHOOSER(dialog));
+    gtk_directory_list_set_file(Directory, folder);
+  }
+
+  gtk_window_destroy(GTK_WINDOW(dialog));
+}
+
+static void on_choose_folder(GtkButton *button, gpointer user_data) {
+  GtkWidget *dialog = gtk_file_chooser_dialog_new(
+      "Choose Wallpaper Folder",
+      GTK_WINDOW(gtk_widget_get_root(GTK_WIDGET(button))),
+      GTK_FILE_CHOOSER_ACTION_SELECT_FOLDER, "_Cancel", GTK_RESPONSE_CANCEL,
+      "_Select", GTK_RESPONSE_ACCEPT, NULL);
+
+  gtk_window_set_modal(GTK_WINDOW(dialog), TRUE);
+  gtk_window_present(GTK_WINDOW(dialog));
+  g_signal_connect(dialog, "response", G_CALLBACK(on_folder_response), NULL);
+}
+
+void display_wallpaper_attach(GtkBuilder *builder) {
+  GtkGridView *grid =
+      GTK_GRID_VIEW(gtk_builder_get_object(builder, "wallpaper_grid"));
+  GtkWidget *button =
+      GTK_WIDGET(gtk_builder_get_object(builder, "wallpaper_folder"));
+  const gchar *pictures = g_get_user_special_dir(G_USER_DIRECTORY_PICTURES);
+  g_autoptr(GFile) folder = g_file_new_for_path(pictures ? pictures
+                                                         : g_get_home_dir());
+  GtkListItemFactory *factory = gtk_signal_list_item_factory_new();
+  GtkFilterListModel *images;
+  GtkSortListModel *sorted;
+  GtkStringSorter *sorter;
+  GtkSingleSelection *selection;
+
+  Preview = GTK_PICTURE(gtk_builder_get_object(builder, "wallpaper_preview"));
+
+  // Without a setter the section is hidden and the folder never listed
+  if (!has_setter()) {
+    const gchar *ids[] = {"wallpaper_title", "wallpaper_folder",
+                          "wallpaper_scroll", "wallpaper_preview"};
+    for (gsize i = 0; i < G_N_ELEMENTS(ids); i++)
+      gtk_widget_set_visible(GTK_WIDGET(gtk_builder_get_object(builder, ids[i])),
+                             FALSE);
+    g_object_unref(factory);
+    return;
+  }
+
+  // Listing, filtering and sorting all run in chunks off the main loop, so
+  // a huge folder fills in gradually instead of blocking
+  Directory = gtk_directory_list_new(WALLPAPER_ATTRIBUTES, folder);
+  gtk_directory_list_set_io_priority(Directory, G_PRIORITY_LOW);
+  images = gtk_filter_list_model_new(
+      G_LIST_MODEL(Directory),
+      GTK_FILTER(gtk_custom_filter_new(is_image, NULL, NULL)));
+  gtk_filter_list_model_set_incremental(images, TRUE);
+  sorter = gtk_string_sorter_new(gtk_cclosure_expression_new(
+      G_TYPE_STRING, NULL, 0, NULL, G_CALLBACK(item_name), NULL, NULL));
+  sorted = gtk_sort_list_model_new(G_LIST_MODEL(images), GTK_SORTER(sorter));
+  gtk_sort_list_model_set_incremental(sorted, TRUE);
+
+  g_signal_connect(factory, "setup", G_CALLBACK(on_cell_setup), NULL);
+  g_signal_connect(factory, "bind", G_CALLBACK(on_cell_bind), NULL);
+  g_signal_connect(factory, "unbind", G_CALLBACK(on_cell_unbind), NULL);
+  selection = gtk_single_selection_new(G_LIST_MODEL(sorted));
+  gtk_single_selection_set_autoselect(selection, FALSE);
+  gtk_grid_view_set_factory(grid, factory);
+  gtk_grid_view_set_model(grid, GTK_SELECTION_MODEL(selection));
+  g_object_unref(selection);
+  g_object_unref(factory);
+
+  g_signal_connect(grid, "activate", G_CALLBACK(on_cell_activate), NULL);
+  g_signal_connect(button, "clicked", G_CALLBACK(on_choose_folder), NULL);
+}
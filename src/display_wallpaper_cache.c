@@ -0,0 +1,321 @@
+#include "display/wallpaper_cache.h"
+#include "command/stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <glib/gstdio.h>
+#include <math.h>
+#include <unistd.h>
+
+typedef struct {
+  GFile *source;
+  GArray *targets; // WallpaperTarget
+  gboolean canvas;
+} RenderRequest;
+
+void wallpaper_target_clear(WallpaperTarget *target) {
+  g_clear_pointer(&target->name, g_free);
+}
+
+static void render_request_free(RenderRequest *request) {
+  g_object_unref(request->source);
+  g_array_unref(request->targets);
+  g_free(request);
+}
+
+static gchar *cache_dir(void) {
+  return g_build_filename(g_get_user_cache_dir(), "systune", "wallpapers",
+                          NULL);
+}
+
+// A cheap stand-in for hashing the whole image: any edit changes the size
+// or the mtime
+static gchar *source_identity(GFile *source, GCancellable *cancellable,
+                              GError **error) {
+  g_autoptr(GFileInfo) info = g_file_query_info(
+      source, G_FILE_ATTRIBUTE_STANDARD_SIZE "," G_FILE_ATTRIBUTE_TIME_MODIFIED,
+      G_FILE_QUERY_INFO_NONE, cancellable, error);
+  g_autofree gchar *uri = g_file_get_uri(source);
+
+  if (info == NULL)
+    return NULL;
+  return g_strdup_printf(
+      "%s\n%" G_GOFFSET_FORMAT "\n%" G_GUINT64_FORMAT, uri,
+      g_file_info_get_size(info),
+      g_file_info_get_attribute_uint64(info, G_FILE_ATTRIBUTE_TIME_MODIFIED));
+}
+
+static gchar *render_path(const gchar *identity, const gchar *geometry) {
+  g_autofree gchar *key = g_strconcat(identity, "\n", geometry, NULL);
+  g_autofree gchar *hash = g_compute_checksum_for_string(G_CHECKSUM_SHA256, key, -1);
+  g_autofree gchar *directory = cache_dir();
+  g_autofree gchar *name = g_strconcat(hash, ".bmp", NULL);
+
+  return g_build_filename(directory, name, NULL);
+}
+
+// The orientation is only known once decoded, so decode large enough to
+// cover `side` either way round. Loaders that can (JPEG) decode straight at
+// the reduced size.
+static GdkPixbuf *load_oriented(const gchar *path, gint side, GError **error) {
+  g_autoptr(GdkPixbuf) pixbuf = NULL;
+  gint width, height;
+  gdouble factor;
+
+  if (gdk_pixbuf_get_file_info(path, &width, &height) == NULL) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                "%s is not an image", path);
+    return NULL;
+  }
+
+  factor = MAX((gdouble)side / width, (gdouble)side / height);
+  if (factor < 1)
+    pixbuf = gdk_pixbuf_new_from_file_at_scale(path, (gint)ceil(width * factor),
+                                               (gint)ceil(height * factor),
+                                               FALSE, error);
+  else
+    pixbuf = gdk_pixbuf_new_from_file(path, error);
+  if (pixbuf == NULL)
+    return NULL;
+  return gdk_pixbuf_apply_embedded_orientation(pixbuf);
+}
+
+// Scale to cover width x height and paint the centre of it at x, y of dest
+static void paint_fill(GdkPixbuf *image, GdkPixbuf *dest, gint x, gint y,
+                       gint width, gint height) {
+  gint image_width = gdk_pixbuf_get_width(image);
+  gint image_height = gdk_pixbuf_get_height(image);
+  gdouble factor = MAX((gdouble)width / image_width,
+                       (gdouble)height / image_height);
+  gint scaled_width = MAX(width, (gint)ceil(image_width * factor));
+  gint scaled_height = MAX(height, (gint)ceil(image_height * factor));
+  g_autoptr(GdkPixbuf) scaled =
+      scaled_width == image_width && scaled_height == image_height
+          ? g_object_ref(image)
+          : gdk_pixbuf_scale_simple(image, scaled_width, scaled_height,
+                                    GDK_INTERP_BILINEAR);
+
+  gdk_pixbuf_copy_area(scaled, (scaled_width - width) / 2,
+                       (scaled_height - height) / 2, width, height, dest, x, y);
+}
+
+// Under a temporary name first, so a setter never reads half a file
+static gboolean save_render(GdkPixbuf *pixbuf, const gchar *path,
+                            GError **error) {
+  g_autofree gchar *temporary = g_strconcat(path, ".XXXXXX", NULL);
+  gint fd = g_mkstemp_full(temporary, O_RDWR, 0600);
+
+  if (fd < 0) {
+    g_set_error(error, G_IO_ERROR, g_io_error_from_errno(errno),
+                "Failed to create %s: %s", temporary, g_strerror(errno));
+    return FALSE;
+  }
+  close(fd);
+
+  if (!gdk_pixbuf_save(pixbuf, temporary, "bmp", error, NULL)) {
+    g_unlink(temporary);
+    return FALSE;
+  }
+  if (g_rename(temporary, path) != 0) {
+    g_set_error(error, G_IO_ERROR, g_io_error_from_errno(errno),
+                "Failed to store %s: %s", path, g_strerror(errno));
+    g_unlink(temporary);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static gint compare_mtime_desc(gconstpointer a, gconstpointer b) {
+  GFileInfo *first = *(GFileInfo **)a;
+  GFileInfo *second = *(GFileInfo **)b;
+  guint64 first_mtime = g_file_info_get_attribute_uint64(
+      first, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+  guint64 second_mtime = g_file_info_get_attribute_uint64(
+      second, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+
+  if (first_mtime == second_mtime)
+    return 0;
+  return first_mtime > second_mtime ? -1 : 1;
+}
+
+// Renders are touched on every use, so the oldest mtimes are the least
+// recently used. The ones in keep are about to be set and stay regardless.
+static void prune(GPtrArray *keep) {
+  g_autofree gchar *path = cache_dir();
+  g_autoptr(GFile) directory = g_file_new_for_path(path);
+  g_autoptr(GFileEnumerator) children = g_file_enumerate_children(
+      directory,
+      G_FILE_ATTRIBUTE_STANDARD_NAME "," G_FILE_ATTRIBUTE_STANDARD_SIZE
+                                     "," G_FILE_ATTRIBUTE_TIME_MODIFIED,
+      G_FILE_QUERY_INFO_NONE, NULL, NULL);
+  g_autoptr(GPtrArray) renders = g_ptr_array_new_with_free_func(g_object_unref);
+  GFileInfo *info;
+  goffset total = 0;
+
+  while (children != NULL &&
+         (info = g_file_enumerator_next_file(children, NULL, NULL)) != NULL) {
+    if (g_str_has_suffix(g_file_info_get_name(info), ".bmp"))
+      g_ptr_array_add(renders, info);
+    else
+      g_object_unref(info);
+  }
+
+  g_ptr_array_sort(renders, compare_mtime_desc);
+  for (guint i = 0; i < renders->len; i++) {
+    g_autofree gchar *render =
+        g_build_filename(path, g_file_info_get_name(renders->pdata[i]), NULL);
+
+    total += g_file_info_get_size(renders->pdata[i]);
+    if (i >= WALLPAPER_CACHE_FILES || total > WALLPAPER_CACHE_BYTES) {
+      if (!g_ptr_array_find_with_equal_func(keep, render, g_str_equal, NULL))
+        g_unlink(render);
+    }
+  }
+}
+
+static gchar *target_geometry(const WallpaperTarget *target) {
+  return g_strdup_printf("%dx%d", target->width, target->height);
+}
+
+static gchar *canvas_geometry(GArray *targets) {
+  GString *geometry = g_string_new("canvas");
+
+  for (guint i = 0; i < targets->len; i++) {
+    WallpaperTarget *target = &g_array_index(targets, WallpaperTarget, i);
+    g_string_append_printf(geometry, " %dx%d+%d+%d", target->width,
+                           target->height, target->x, target->y);
+  }
+  return g_string_free(geometry, FALSE);
+}
+
+static GdkPixbuf *render_canvas(GdkPixbuf *image, GArray *targets) {
+  gint min_x = G_MAXINT, min_y = G_MAXINT, max_x = 0, max_y = 0;
+  GdkPixbuf *canvas;
+
+  for (guint i = 0; i < targets->len; i++) {
+    WallpaperTarget *target = &g_array_index(targets, WallpaperTarget, i);
+    min_x = MIN(min_x, target->x);
+    min_y = MIN(min_y, target->y);
+    max_x = MAX(max_x, target->x + target->width);
+    max_y = MAX(max_y, target->y + target->height);
+  }
+
+  canvas = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, max_x - min_x,
+                          max_y - min_y);
+  gdk_pixbuf_fill(canvas, 0x000000ff);
+  for (guint i = 0; i < targets->len; i++) {
+    WallpaperTarget *target = &g_array_index(targets, WallpaperTarget, i);
+    paint_fill(image, canvas, target->x - min_x, target->y - min_y,
+               target->width, target->height);
+  }
+  return canvas;
+}
+
+static GdkPixbuf *render_target(GdkPixbuf *image, const WallpaperTarget *target) {
+  GdkPixbuf *render = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8,
+                                     target->width, target->height);
+
+  paint_fill(image, render, 0, 0, target->width, target->height);
+  return render;
+}
+
+static void render_thread(GTask *task, gpointer source_object,
+                          gpointer task_data, GCancellable *cancellable) {
+  RenderRequest *request = task_data;
+  g_auto(CommandStatsSpan) span = command_stats_begin("task wallpaper render");
+  g_autoptr(GPtrArray) paths = g_ptr_array_new_with_free_func(g_free);
+  g_autoptr(GdkPixbuf) image = NULL;
+  g_autofree gchar *identity = NULL;
+  g_autofree gchar *directory = cache_dir();
+  g_autofree gchar *source_path = g_file_get_path(request->source);
+  GError *error = NULL;
+  gboolean rendered = FALSE;
+  guint n_renders = request->canvas ? 1 : request->targets->len;
+  gint side = 0;
+
+  identity = source_identity(request->source, cancellable, &error);
+  if (identity == NULL) {
+    g_task_return_error(task, error);
+    return;
+  }
+  if (source_path == NULL) {
+    g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                            "Wallpapers must be local files");
+    return;
+  }
+  g_mkdir_with_parents(directory, 0700);
+
+  for (guint i = 0; i < request->targets->len; i++) {
+    WallpaperTarget *target =
+        &g_array_index(request->targets, WallpaperTarget, i);
+    side = MAX(side, MAX(target->width, target->height));
+  }
+
+  for (guint i = 0; i < n_renders; i++) {
+    WallpaperTarget *target =
+        &g_array_index(request->targets, WallpaperTarget, i);
+    g_autofree gchar *geometry = request->canvas
+                                     ? canvas_geometry(request->targets)
+                                     : target_geometry(target);
+    gchar *path = render_path(identity, geometry);
+    g_autoptr(GdkPixbuf) render = NULL;
+
+    g_ptr_array_add(paths, path);
+    if (g_file_test(path, G_FILE_TEST_EXISTS)) {
+      g_utime(path, NULL);
+      continue;
+    }
+    if (g_task_return_error_if_cancelled(task))
+      return;
+
+    // One decode serves every target
+    if (image == NULL)
+      image = load_oriented(source_path, side, &error);
+    if (image == NULL) {
+      g_task_return_error(task, error);
+      return;
+    }
+
+    render = request->canvas ? render_canvas(image, request->targets)
+                             : render_target(image, target);
+    if (!save_render(render, path, &error)) {
+      g_task_return_error(task, error);
+      return;
+    }
+    rendered = TRUE;
+  }
+
+  if (rendered)
+    prune(paths);
+  g_task_return_pointer(task, g_steal_pointer(&paths),
+                        (GDestroyNotify)g_ptr_array_unref);
+}
+
+void wallpaper_cache_render_async(GFile *source, GArray *targets,
+                                  gboolean canvas, GCancellable *cancellable,
+                                  GAsyncReadyCallback callback,
+                                  gpointer user_data) {
+  GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+  RenderRequest *request = g_new0(RenderRequest, 1);
+
+  request->source = g_object_ref(source);
+  request->targets = g_array_ref(targets);
+  request->canvas = canvas;
+  g_task_set_source_tag(task, wallpaper_cache_render_async);
+  g_task_set_task_data(task, request, (GDestroyNotify)render_request_free);
+
+  if (targets->len == 0) {
+    g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                            "No outputs to render for");
+    g_object_unref(task);
+    return;
+  }
+
+  g_task_run_in_thread(task, render_thread);
+  g_object_unref(task);
+}
+
+GPtrArray *wallpaper_cache_render_finish(GAsyncResult *result, GError **error) {
+  g_return_val_if_fail(g_task_is_valid(result, NULL), NULL);
+  return g_task_propagate_pointer(G_TASK(result), error);
+}
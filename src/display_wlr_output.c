@@ -0,0 +1,441 @@
+#include "display/wlr_output.h"
+#include <gdk/gdk.h>
+
+#ifdef GDK_WINDOWING_WAYLAND
+#include <gdk/wayland/gdkwayland.h>
+#include <string.h>
+#include <wayland-client.h>
+#include "wlr-output-management-unstable-v1-client-protocol.h"
+
+// Newest protocol version we have handlers for
+#define WLR_OUTPUT_VERSION 4
+
+typedef struct {
+  GTask *task;
+  gboolean testing;
+  guint32 serial; // manager serial the layout was built against
+} WlrApply;
+
+static struct wl_display *display = NULL;
+static struct zwlr_output_manager_v1 *manager = NULL;
+static guint32 serial = 0;
+// Head or mode events arrived since the last done; the model is mid-update
+static gboolean dirty = FALSE;
+
+static void apply_layout(WlrApply *apply);
+
+static void release_mode(struct zwlr_output_mode_v1 *proxy) {
+  if (zwlr_output_mode_v1_get_version(proxy) >=
+      ZWLR_OUTPUT_MODE_V1_RELEASE_SINCE_VERSION)
+    zwlr_output_mode_v1_release(proxy);
+  else
+    zwlr_output_mode_v1_destroy(proxy);
+}
+
+static void on_mode_size(void *data, struct zwlr_output_mode_v1 *proxy,
+                         int32_t width, int32_t height) {
+  DisplayMode *mode = data;
+
+  mode->width = width;
+  mode->height = height;
+  dirty = TRUE;
+}
+
+static void on_mode_refresh(void *data, struct zwlr_output_mode_v1 *proxy,
+                            int32_t refresh) {
+  DisplayMode *mode = data;
+
+  mode->refresh_mhz = refresh;
+  dirty = TRUE;
+}
+
+static void on_mode_preferred(void *data, struct zwlr_output_mode_v1 *proxy) {
+  DisplayMode *mode = data;
+
+  mode->preferred = TRUE;
+  dirty = TRUE;
+}
+
+static void on_mode_finished(void *data, struct zwlr_output_mode_v1 *proxy) {
+  DisplayMode *mode = data;
+
+  release_mode(proxy);
+  display_output_remove_mode(mode->output, mode);
+  dirty = TRUE;
+}
+
+static const struct zwlr_output_mode_v1_listener mode_listener = {
+    .size = on_mode_size,
+    .refresh = on_mode_refresh,
+    .preferred = on_mode_preferred,
+    .finished = on_mode_finished,
+};
+
+static void on_head_name(void *data, struct zwlr_output_head_v1 *head,
+                         const char *name) {
+  DisplayOutput *output = data;
+
+  g_free(output->name);
+  output->name = g_strdup(name);
+  dirty = TRUE;
+}
+
+static void on_head_description(void *data, struct zwlr_output_head_v1 *head,
+                                const char *description) {
+  DisplayOutput *output = data;
+
+  g_free(output->description);
+  output->description = g_strdup(description);
+  dirty = TRUE;
+}
+
+static void on_head_physical_size(void *data, struct zwlr_output_head_v1 *head,
+                                  int32_t width, int32_t height) {}
+
+static void on_head_mode(void *data, struct zwlr_output_head_v1 *head,
+                         struct zwlr_output_mode_v1 *proxy) {
+  DisplayMode *mode = display_mode_new(data, proxy);
+
+  zwlr_output_mode_v1_add_listener(proxy, &mode_listener, mode);
+  dirty = TRUE;
+}
+
+static void on_head_enabled(void *data, struct zwlr_output_head_v1 *head,
+                            int32_t enabled) {
+  DisplayOutput *output = data;
+
+  output->enabled = enabled;
+  // A disabled head has no current mode, and no current_mode event says so
+  if (!enabled)
+    output->current = NULL;
+  dirty = TRUE;
+}
+
+static void on_head_current_mode(void *data, struct zwlr_output_head_v1 *head,
+                                 struct zwlr_output_mode_v1 *proxy) {
+  DisplayOutput *output = data;
+
+  output->current = zwlr_output_mode_v1_get_user_data(proxy);
+  dirty = TRUE;
+}
+
+static void on_head_position(void *data, struct zwlr_output_head_v1 *head,
+                             int32_t x, int32_t y) {
+  DisplayOutput *output = data;
+
+  output->x = x;
+  output->y = y;
+  dirty = TRUE;
+}
+
+static void on_head_transform(void *data, struct zwlr_output_head_v1 *head,
+                              int32_t transform) {
+  DisplayOutput *output = data;
+
+  output->transform = transform;
+  dirty = TRUE;
+}
+
+static void on_head_scale(void *data, struct zwlr_output_head_v1 *head,
+                          wl_fixed_t scale) {
+  DisplayOutput *output = data;
+
+  output->scale = wl_fixed_to_double(scale);
+  dirty = TRUE;
+}
+
+static void on_head_finished(void *data, struct zwlr_output_head_v1 *head) {
+  DisplayOutput *output = data;
+
+  // Modes still listed may get their finished events after this; released
+  // proxies don't receive events, so drop them with the head
+  for (guint i = 0; i < output->modes->len; i++)
+    release_mode(((DisplayMode *)output->modes->pdata[i])->handle);
+  if (zwlr_output_head_v1_get_version(head) >=
+      ZWLR_OUTPUT_HEAD_V1_RELEASE_SINCE_VERSION)
+    zwlr_output_head_v1_release(head);
+  else
+    zwlr_output_head_v1_destroy(head);
+  display_outputs_remove(output);
+  dirty = TRUE;
+}
+
+static void on_head_make(void *data, struct zwlr_output_head_v1 *head,
+                         const char *make) {}
+
+static void on_head_model(void *data, struct zwlr_output_head_v1 *head,
+                          const char *model) {}
+
+static void on_head_serial_number(void *data, struct zwlr_output_head_v1 *head,
+                                  const char *serial_number) {}
+
+static void on_head_adaptive_sync(void *data, struct zwlr_output_head_v1 *head,
+                                  uint32_t state) {}
+
+static const struct zwlr_output_head_v1_listener head_listener = {
+    .name = on_head_name,
+    .description = on_head_description,
+    .physical_size = on_head_physical_size,
+    .mode = on_head_mode,
+    .enabled = on_head_enabled,
+    .current_mode = on_head_current_mode,
+    .position = on_head_position,
+    .transform = on_head_transform,
+    .scale = on_head_scale,
+    .finished = on_head_finished,
+    .make = on_head_make,
+    .model = on_head_model,
+    .serial_number = on_head_serial_number,
+    .adaptive_sync = on_head_adaptive_sync,
+};
+
+static void on_manager_head(void *data, struct zwlr_output_manager_v1 *proxy,
+                            struct zwlr_output_head_v1 *head) {
+  DisplayOutput *output = display_output_new(NULL, head);
+
+  zwlr_output_head_v1_add_listener(head, &head_listener, output);
+  display_outputs_add(output);
+  dirty = TRUE;
+}
+
+static void on_manager_done(void *data, struct zwlr_output_manager_v1 *proxy,
+                            uint32_t done_serial) {
+  serial = done_serial;
+  dirty = FALSE;
+  display_outputs_changed();
+}
+
+static void on_manager_finished(void *data,
+                                struct zwlr_output_manager_v1 *proxy) {
+  GPtrArray *outputs = display_outputs();
+
+  zwlr_output_manager_v1_destroy(proxy);
+  manager = NULL;
+  // No more head events will come to release these
+  while (outputs->len > 0) {
+    DisplayOutput *output = outputs->pdata[outputs->len - 1];
+
+    for (guint i = 0; i < output->modes->len; i++)
+      release_mode(((DisplayMode *)output->modes->pdata[i])->handle);
+    zwlr_output_head_v1_destroy(output->handle);
+    display_outputs_remove(output);
+  }
+  display_outputs_changed();
+}
+
+static const struct zwlr_output_manager_v1_listener manager_listener = {
+    .head = on_manager_head,
+    .done = on_manager_done,
+    .finished = on_manager_finished,
+};
+
+static void apply_finish(WlrApply *apply, GError *error) {
+  if (error)
+    g_task_return_error(apply->task, error);
+  else
+    g_task_return_boolean(apply->task, TRUE);
+  g_object_unref(apply->task);
+  g_free(apply);
+}
+
+static void on_configuration_succeeded(
+    void *data, struct zwlr_output_configuration_v1 *configuration) {
+  WlrApply *apply = data;
+
+  zwlr_output_configuration_v1_destroy(configuration);
+  if (!apply->testing) {
+    apply_finish(apply, NULL);
+    return;
+  }
+
+  // The layout passed; send it again for real, unless the outputs moved
+  // underneath it in the meantime
+  if (manager == NULL || dirty || serial != apply->serial) {
+    apply_finish(apply, g_error_new(G_IO_ERROR, G_IO_ERROR_BUSY,
+                                    "The outputs changed, try again"));
+    return;
+  }
+  if (g_task_return_error_if_cancelled(apply->task)) {
+    g_object_unref(apply->task);
+    g_free(apply);
+    return;
+  }
+
+  apply->testing = FALSE;
+  apply_layout(apply);
+}
+
+static void on_configuration_failed(
+    void *data, struct zwlr_output_configuration_v1 *configuration) {
+  WlrApply *apply = data;
+
+  zwlr_output_configuration_v1_destroy(configuration);
+  apply_finish(apply, g_error_new(G_IO_ERROR, G_IO_ERROR_FAILED,
+                                  apply->testing
+                                      ? "The compositor rejected this layout"
+                                      : "The compositor failed to apply "
+                                        "this layout"));
+}
+
+static void on_configuration_cancelled(
+    void *data, struct zwlr_output_configuration_v1 *configuration) {
+  WlrApply *apply = data;
+
+  zwlr_output_configuration_v1_destroy(configuration);
+  apply_finish(apply, g_error_new(G_IO_ERROR, G_IO_ERROR_BUSY,
+                                  "The outputs changed, try again"));
+}
+
+static const struct zwlr_output_configuration_v1_listener
+    configuration_listener = {
+        .succeeded = on_configuration_succeeded,
+        .failed = on_configuration_failed,
+        .cancelled = on_configuration_cancelled,
+};
+
+static DisplayMode *preferred_mode(DisplayOutput *output) {
+  for (guint i = 0; i < output->modes->len; i++) {
+    DisplayMode *mode = output->modes->pdata[i];
+    if (mode->preferred)
+      return mode;
+  }
+  return output->modes->len > 0 ? output->modes->pdata[0] : NULL;
+}
+
+// The protocol wants every head in every configuration, so outputs the
+// caller did not mention are sent as they are
+static void apply_layout(WlrApply *apply) {
+  GArray *configs = g_task_get_task_data(apply->task);
+  GPtrArray *outputs = display_outputs();
+  struct zwlr_output_configuration_v1 *configuration =
+      zwlr_output_manager_v1_create_configuration(manager, apply->serial);
+
+  for (guint i = 0; i < outputs->len; i++) {
+    DisplayOutput *output = outputs->pdata[i];
+    DisplayOutputConfig state;
+    struct zwlr_output_configuration_head_v1 *head;
+
+    display_output_config_init(&state, output);
+    for (guint j = 0; j < configs->len; j++) {
+      if (g_array_index(configs, DisplayOutputConfig, j).output == output)
+        state = g_array_index(configs, DisplayOutputConfig, j);
+    }
+
+    if (!state.enabled) {
+      zwlr_output_configuration_v1_disable_head(configuration, output->handle);
+      continue;
+    }
+
+    if (state.mode == NULL)
+      state.mode = preferred_mode(output);
+    head = zwlr_output_configuration_v1_enable_head(configuration,
+                                                    output->handle);
+    if (state.mode != NULL)
+      zwlr_output_configuration_head_v1_set_mode(head, state.mode->handle);
+    zwlr_output_configuration_head_v1_set_position(head, state.x, state.y);
+    zwlr_output_configuration_head_v1_set_scale(
+        head, wl_fixed_from_double(state.scale));
+  }
+
+  zwlr_output_configuration_v1_add_listener(configuration,
+                                            &configuration_listener, apply);
+  if (apply->testing)
+    zwlr_output_configuration_v1_test(configuration);
+  else
+    zwlr_output_configuration_v1_apply(configuration);
+  wl_display_flush(display);
+}
+
+static void wlr_apply(GArray *configs, GTask *task) {
+  WlrApply *apply;
+
+  if (manager == NULL) {
+    g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_CLOSED,
+                            "The compositor stopped output management");
+    g_object_unref(task);
+    return;
+  }
+
+  apply = g_new0(WlrApply, 1);
+  apply->task = task;
+  apply->testing = TRUE;
+  apply->serial = serial;
+  apply_layout(apply);
+}
+
+static const DisplayBackend wlr_backend = {
+    .name = "zwlr_output_manager_v1",
+    .apply = wlr_apply,
+};
+
+static void on_registry_global(void *data, struct wl_registry *registry,
+                               uint32_t name, const char *interface,
+                               uint32_t version) {
+  if (strcmp(interface, zwlr_output_manager_v1_interface.name) != 0)
+    return;
+
+  manager = wl_registry_bind(registry, name, &zwlr_output_manager_v1_interface,
+                             MIN(version, WLR_OUTPUT_VERSION));
+  zwlr_output_manager_v1_add_listener(manager, &manager_listener, NULL);
+}
+
+static void on_registry_global_remove(void *data, struct wl_registry *registry,
+                                      uint32_t name) {}
+
+static const struct wl_registry_listener registry_listener = {
+    .global = on_registry_global,
+    .global_remove = on_registry_global_remove,
+};
+
+// Startup runs on a private queue so it can block on two roundtrips without
+// dispatching GTK's events; the objects then move to the default queue,
+// which GTK dispatches from the main loop
+const DisplayBackend *display_wlr_connect(void) {
+  GdkDisplay *gdk_display = gdk_display_get_default();
+  struct wl_event_queue *queue;
+  struct wl_display *wrapper;
+  struct wl_registry *registry;
+  GPtrArray *outputs;
+
+  if (manager != NULL)
+    return &wlr_backend;
+  if (gdk_display == NULL || !GDK_IS_WAYLAND_DISPLAY(gdk_display))
+    return NULL;
+
+  display = gdk_wayland_display_get_wl_display(gdk_display);
+  queue = wl_display_create_queue(display);
+  wrapper = wl_proxy_create_wrapper(display);
+  wl_proxy_set_queue((struct wl_proxy *)wrapper, queue);
+  registry = wl_display_get_registry(wrapper);
+  wl_proxy_wrapper_destroy(wrapper);
+  wl_registry_add_listener(registry, &registry_listener, NULL);
+
+  // Globals, then the heads, their modes and the first done
+  wl_display_roundtrip_queue(display, queue);
+  if (manager != NULL)
+    wl_display_roundtrip_queue(display, queue);
+  wl_display_dispatch_queue_pending(display, queue);
+
+  wl_registry_destroy(registry);
+  if (manager != NULL) {
+    outputs = display_outputs();
+    wl_proxy_set_queue((struct wl_proxy *)manager, NULL);
+    for (guint i = 0; i < outputs->len; i++) {
+      DisplayOutput *output = outputs->pdata[i];
+
+      wl_proxy_set_queue(output->handle, NULL);
+      for (guint j = 0; j < output->modes->len; j++)
+        wl_proxy_set_queue(
+            ((DisplayMode *)output->modes->pdata[j])->handle, NULL);
+    }
+  }
+  wl_event_queue_destroy(queue);
+
+  return manager != NULL ? &wlr_backend : NULL;
+}
+
+#else
+
+const DisplayBackend *display_wlr_connect(void) { return NULL; }
+
+#endif
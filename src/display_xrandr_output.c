@@ -0,0 +1,413 @@
+#include "display/xrandr_output.h"
+#include <gdk/gdk.h>
+
+#ifdef GDK_WINDOWING_X11
+#include <X11/extensions/Xrandr.h>
+#include <gdk/x11/gdkx.h>
+
+static GdkDisplay *gdk_display = NULL;
+static Display *xdisplay = NULL;
+static Window root = None;
+static int event_base = 0;
+static guint reload_id = 0;
+
+// wl_output_transform, which the model uses, from a RandR rotation
+static gint rotation_to_transform(Rotation rotation) {
+  gint transform = 0;
+
+  if (rotation & RR_Rotate_90)
+    transform = 1;
+  else if (rotation & RR_Rotate_180)
+    transform = 2;
+  else if (rotation & RR_Rotate_270)
+    transform = 3;
+  if (rotation & (RR_Reflect_X | RR_Reflect_Y))
+    transform += 4;
+  return transform;
+}
+
+static gint mode_refresh_mhz(const XRRModeInfo *info) {
+  gdouble vtotal = info->vTotal;
+
+  if (info->modeFlags & RR_DoubleScan)
+    vtotal *= 2;
+  if (info->modeFlags & RR_Interlace)
+    vtotal /= 2;
+  if (info->hTotal == 0 || vtotal == 0)
+    return 0;
+  return (gint)(info->dotClock * 1000.0 / (info->hTotal * vtotal) + 0.5);
+}
+
+static const XRRModeInfo *find_mode(const XRRScreenResources *res, RRMode id) {
+  for (int i = 0; i < res->nmode; i++) {
+    if (res->modes[i].id == id)
+      return &res->modes[i];
+  }
+  return NULL;
+}
+
+// Rebuild the model from the server. GetScreenResourcesCurrent reads what
+// the server already knows instead of probing the outputs again.
+static void load_outputs(void) {
+  GPtrArray *outputs = display_outputs();
+  XRRScreenResources *res = XRRGetScreenResourcesCurrent(xdisplay, root);
+
+  g_ptr_array_set_size(outputs, 0);
+  for (int i = 0; res != NULL && i < res->noutput; i++) {
+    XRROutputInfo *info = XRRGetOutputInfo(xdisplay, res, res->outputs[i]);
+    DisplayOutput *output;
+    RRMode current = None;
+
+    if (info == NULL)
+      continue;
+    if (info->connection != RR_Connected) {
+      XRRFreeOutputInfo(info);
+      continue;
+    }
+
+    output = display_output_new(info->name, GSIZE_TO_POINTER(res->outputs[i]));
+    if (info->crtc != None) {
+      XRRCrtcInfo *crtc = XRRGetCrtcInfo(xdisplay, res, info->crtc);
+
+      if (crtc != NULL) {
+        output->enabled = crtc->mode != None;
+        output->x = crtc->x;
+        output->y = crtc->y;
+        output->transform = rotation_to_transform(crtc->rotation);
+        current = crtc->mode;
+        XRRFreeCrtcInfo(crtc);
+      }
+    }
+
+    for (int m = 0; m < info->nmode; m++) {
+      const XRRModeInfo *mode_info = find_mode(res, info->modes[m]);
+      DisplayMode *mode;
+
+      if (mode_info == NULL)
+        continue;
+      mode = display_mode_new(output, GSIZE_TO_POINTER(mode_info->id));
+      mode->width = mode_info->width;
+      mode->height = mode_info->height;
+      mode->refresh_mhz = mode_refresh_mhz(mode_info);
+      mode->preferred = m < info->npreferred;
+      if (mode_info->id == current)
+        output->current = mode;
+    }
+
+    display_outputs_add(output);
+    XRRFreeOutputInfo(info);
+  }
+
+  if (res != NULL)
+    XRRFreeScreenResources(res);
+  display_outputs_changed();
+}
+
+static gboolean on_reload(gpointer user_data) {
+  reload_id = 0;
+  load_outputs();
+  return G_SOURCE_REMOVE;
+}
+
+// One change arrives as a burst of screen, CRTC and output notifies; reload
+// once after the burst
+static gboolean on_xevent(GdkX11Display *display, gpointer xevent,
+                          gpointer user_data) {
+  XEvent *event = xevent;
+
+  if (event->type != event_base + RRScreenChangeNotify &&
+      event->type != event_base + RRNotify)
+    return FALSE;
+
+  XRRUpdateConfiguration(event);
+  if (reload_id == 0)
+    reload_id = g_idle_add(on_reload, NULL);
+  return FALSE;
+}
+
+static const DisplayOutputConfig *find_config(GArray *configs,
+                                              DisplayOutput *output) {
+  for (guint i = 0; i < configs->len; i++) {
+    if (g_array_index(configs, DisplayOutputConfig, i).output == output)
+      return &g_array_index(configs, DisplayOutputConfig, i);
+  }
+  return NULL;
+}
+
+static DisplayMode *config_mode(const DisplayOutputConfig *config) {
+  DisplayOutput *output = config->output;
+
+  if (config->mode != NULL)
+    return config->mode;
+  for (guint i = 0; i < output->modes->len; i++) {
+    DisplayMode *mode = output->modes->pdata[i];
+    if (mode->preferred)
+      return mode;
+  }
+  return output->modes->len > 0 ? output->modes->pdata[0] : NULL;
+}
+
+static RRCrtc free_crtc(XRRScreenResources *res, XRROutputInfo *info) {
+  for (int i = 0; i < info->ncrtc; i++) {
+    XRRCrtcInfo *crtc = XRRGetCrtcInfo(xdisplay, res, info->crtcs[i]);
+    gboolean unused = crtc != NULL && crtc->noutput == 0;
+
+    if (crtc != NULL)
+      XRRFreeCrtcInfo(crtc);
+    if (unused)
+      return info->crtcs[i];
+  }
+  return None;
+}
+
+static void disable_crtc(XRRScreenResources *res, RRCrtc crtc) {
+  XRRSetCrtcConfig(xdisplay, res, crtc, CurrentTime, 0, 0, None, RR_Rotate_0,
+                   NULL, 0);
+}
+
+// One SetCrtcConfig per output; the reply says whether it took
+static gboolean set_output(XRRScreenResources *res,
+                           const DisplayOutputConfig *config, GError **error) {
+  RROutput id = GPOINTER_TO_SIZE(config->output->handle);
+  XRROutputInfo *info = XRRGetOutputInfo(xdisplay, res, id);
+  DisplayMode *mode = config_mode(config);
+  Rotation rotation = RR_Rotate_0;
+  RRCrtc crtc;
+  Status status;
+
+  if (info == NULL) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "%s is gone",
+                config->output->name);
+    return FALSE;
+  }
+
+  crtc = info->crtc;
+  if (!config->enabled) {
+    if (crtc != None)
+      disable_crtc(res, crtc);
+    XRRFreeOutputInfo(info);
+    return TRUE;
+  }
+
+  if (crtc != None) {
+    XRRCrtcInfo *crtc_info = XRRGetCrtcInfo(xdisplay, res, crtc);
+    if (crtc_info != NULL) {
+      rotation = crtc_info->rotation;
+      XRRFreeCrtcInfo(crtc_info);
+    }
+  } else {
+    crtc = free_crtc(res, info);
+  }
+  XRRFreeOutputInfo(info);
+
+  if (crtc == None || mode == NULL) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_NO_SPACE,
+                crtc == None ? "No free CRTC to drive %s"
+                             : "%s has no modes",
+                config->output->name);
+    return FALSE;
+  }
+
+  status = XRRSetCrtcConfig(xdisplay, res, crtc, CurrentTime, config->x,
+                            config->y, GPOINTER_TO_SIZE(mode->handle),
+                            rotation, &id, 1);
+  if (status != RRSetConfigSuccess) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                "The X server refused the mode for %s", config->output->name);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+// What the screen looked like before a layout was applied, to go back to
+// when the server refuses part of it
+typedef struct {
+  gint width, height, mm_width, mm_height;
+  XRRCrtcInfo **crtcs; // per CRTC of the screen resources, may hold NULLs
+} SavedLayout;
+
+static SavedLayout *save_layout(XRRScreenResources *res) {
+  Screen *screen = DefaultScreenOfDisplay(xdisplay);
+  SavedLayout *saved = g_new0(SavedLayout, 1);
+
+  saved->width = WidthOfScreen(screen);
+  saved->height = HeightOfScreen(screen);
+  saved->mm_width = WidthMMOfScreen(screen);
+  saved->mm_height = HeightMMOfScreen(screen);
+  saved->crtcs = g_new0(XRRCrtcInfo *, MAX(res->ncrtc, 1));
+  for (int i = 0; i < res->ncrtc; i++)
+    saved->crtcs[i] = XRRGetCrtcInfo(xdisplay, res, res->crtcs[i]);
+  return saved;
+}
+
+static void saved_layout_free(XRRScreenResources *res, SavedLayout *saved) {
+  for (int i = 0; i < res->ncrtc; i++) {
+    if (saved->crtcs[i] != NULL)
+      XRRFreeCrtcInfo(saved->crtcs[i]);
+  }
+  g_free(saved->crtcs);
+  g_free(saved);
+}
+
+// Every CRTC goes dark first, so none hangs off the old screen size while
+// it is set back
+static void restore_layout(XRRScreenResources *res, SavedLayout *saved) {
+  for (int i = 0; i < res->ncrtc; i++)
+    disable_crtc(res, res->crtcs[i]);
+  XRRSetScreenSize(xdisplay, root, saved->width, saved->height,
+                   saved->mm_width, saved->mm_height);
+  for (int i = 0; i < res->ncrtc; i++) {
+    XRRCrtcInfo *crtc = saved->crtcs[i];
+
+    if (crtc != NULL && crtc->mode != None)
+      XRRSetCrtcConfig(xdisplay, res, res->crtcs[i], CurrentTime, crtc->x,
+                       crtc->y, crtc->mode, crtc->rotation, crtc->outputs,
+                       crtc->noutput);
+  }
+}
+
+static void xrandr_apply(GArray *configs, GTask *task) {
+  GPtrArray *outputs = display_outputs();
+  Screen *screen = DefaultScreenOfDisplay(xdisplay);
+  XRRScreenResources *res;
+  SavedLayout *saved;
+  gint width = 0, height = 0;
+  gboolean resize;
+  GError *error = NULL;
+
+  if (g_task_return_error_if_cancelled(task)) {
+    g_object_unref(task);
+    return;
+  }
+
+  res = XRRGetScreenResourcesCurrent(xdisplay, root);
+  if (res == NULL) {
+    g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                            "Could not read the screen resources");
+    g_object_unref(task);
+    return;
+  }
+
+  // The screen is the bounding box of the new layout
+  for (guint i = 0; i < outputs->len; i++) {
+    DisplayOutputConfig state;
+    const DisplayOutputConfig *config = find_config(configs, outputs->pdata[i]);
+    DisplayMode *mode;
+    gint mode_width, mode_height;
+
+    display_output_config_init(&state, outputs->pdata[i]);
+    if (config != NULL)
+      state = *config;
+    mode = config_mode(&state);
+    if (!state.enabled || mode == NULL)
+      continue;
+    display_mode_extent(mode, state.output->transform, 1, &mode_width,
+                        &mode_height);
+    width = MAX(width, state.x + mode_width);
+    height = MAX(height, state.y + mode_height);
+  }
+  resize = width > 0 && height > 0 &&
+           (width != WidthOfScreen(screen) || height != HeightOfScreen(screen));
+
+  // Nobody else changes the screen between the snapshot and the rollback
+  gdk_x11_display_error_trap_push(gdk_display);
+  XGrabServer(xdisplay);
+  saved = save_layout(res);
+
+  // CRTCs that would hang off a smaller screen go dark before it shrinks
+  for (guint i = 0; resize && i < configs->len; i++) {
+    DisplayOutput *output = g_array_index(configs, DisplayOutputConfig, i).output;
+    XRROutputInfo *info;
+    gint mode_width, mode_height;
+
+    if (output->current == NULL)
+      continue;
+    display_mode_extent(output->current, output->transform, 1, &mode_width,
+                        &mode_height);
+    if (output->x + mode_width <= width && output->y + mode_height <= height)
+      continue;
+
+    info = XRRGetOutputInfo(xdisplay, res, GPOINTER_TO_SIZE(output->handle));
+    if (info != NULL && info->crtc != None)
+      disable_crtc(res, info->crtc);
+    if (info != NULL)
+      XRRFreeOutputInfo(info);
+  }
+
+  if (resize) {
+    // Keep the physical size in step so the DPI does not change
+    gint mm_width = (gint)((gint64)width * WidthMMOfScreen(screen) /
+                           WidthOfScreen(screen));
+    gint mm_height = (gint)((gint64)height * HeightMMOfScreen(screen) /
+                            HeightOfScreen(screen));
+
+    XRRSetScreenSize(xdisplay, root, width, height, mm_width, mm_height);
+  }
+
+  for (guint i = 0; error == NULL && i < configs->len; i++)
+    set_output(res, &g_array_index(configs, DisplayOutputConfig, i), &error);
+
+  // Popping syncs, so errors of the asynchronous requests are in by now
+  if (gdk_x11_display_error_trap_pop(gdk_display) != 0 && error == NULL)
+    g_set_error(&error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                "The X server rejected this layout");
+
+  // A rejected layout changes nothing, as display_outputs_apply_async()
+  // promises: put back whatever part of it did go through
+  if (error != NULL) {
+    gdk_x11_display_error_trap_push(gdk_display);
+    restore_layout(res, saved);
+    gdk_x11_display_error_trap_pop_ignored(gdk_display);
+  }
+  XUngrabServer(xdisplay);
+  XFlush(xdisplay);
+  saved_layout_free(res, saved);
+  XRRFreeScreenResources(res);
+
+  // The model catches up from RRScreenChangeNotify
+  if (error != NULL)
+    g_task_return_error(task, error);
+  else
+    g_task_return_boolean(task, TRUE);
+  g_object_unref(task);
+}
+
+static const DisplayBackend xrandr_backend = {
+    .name = "libXrandr",
+    .apply = xrandr_apply,
+};
+
+const DisplayBackend *display_xrandr_connect(void) {
+  GdkDisplay *display = gdk_display_get_default();
+  int error_base, major, minor;
+
+  if (xdisplay != NULL)
+    return &xrandr_backend;
+  if (display == NULL || !GDK_IS_X11_DISPLAY(display))
+    return NULL;
+
+  xdisplay = gdk_x11_display_get_xdisplay(display);
+  // Outputs and CRTCs arrived with RandR 1.2
+  if (!XRRQueryExtension(xdisplay, &event_base, &error_base) ||
+      !XRRQueryVersion(xdisplay, &major, &minor) ||
+      (major == 1 && minor < 2)) {
+    xdisplay = NULL;
+    return NULL;
+  }
+
+  gdk_display = display;
+  root = DefaultRootWindow(xdisplay);
+  XRRSelectInput(xdisplay, root,
+                 RRScreenChangeNotifyMask | RRCrtcChangeNotifyMask |
+                     RROutputChangeNotifyMask);
+  g_signal_connect(display, "xevent", G_CALLBACK(on_xevent), NULL);
+
+  load_outputs();
+  return &xrandr_backend;
+}
+
+#else
+
+const DisplayBackend *display_xrandr_connect(void) { return NULL; }
+
+#endif
@@ -0,0 +1,367 @@
+#include "hyprland/ipc.h"
+#include "command/stats.h"
+#include "listener/listener.h"
+#include "parse/parse.h"
+#include <gio/gunixsocketaddress.h>
+#include <string.h>
+
+#define HYPRLAND_READ_SIZE 4096
+
+typedef struct {
+  const gchar *event;
+  const gchar *data;
+} Emission;
+
+typedef struct {
+  gchar *request;
+  gchar *stats_key; // "hyprland" and the request's first word
+  GSocketConnection *connection;
+  GOutputStream *reply;
+  gint64 start;
+} Request;
+
+static ListenerList listeners;
+static GSocketConnection *event_connection = NULL;
+static GCancellable *event_cancellable = NULL;
+static LineFeeder event_feeder;
+static gboolean dispatching = FALSE; // events are being handed out
+static gboolean stop_pending = FALSE; // the last listener left meanwhile
+
+static gchar *socket_path(const gchar *name) {
+  const gchar *signature = g_getenv("HYPRLAND_INSTANCE_SIGNATURE");
+  gchar *path;
+
+  if (signature == NULL || *signature == '\0')
+    return NULL;
+
+  path = g_build_filename(g_get_user_runtime_dir(), "hypr", signature, name,
+                          NULL);
+  if (g_file_test(path, G_FILE_TEST_EXISTS))
+    return path;
+  g_free(path);
+
+  // Hyprland before 0.40 kept them under /tmp
+  path = g_build_filename(g_get_tmp_dir(), "hypr", signature, name, NULL);
+  if (g_file_test(path, G_FILE_TEST_EXISTS))
+    return path;
+  g_free(path);
+  return NULL;
+}
+
+gboolean hyprland_ipc_available(void) {
+  g_autofree gchar *path = socket_path(".socket.sock");
+  return path != NULL;
+}
+
+static void request_free(Request *request) {
+  g_free(request->request);
+  g_free(request->stats_key);
+  g_clear_object(&request->connection);
+  g_object_unref(request->reply);
+  g_free(request);
+}
+
+// Hyprland closes the connection once the whole reply is written
+static void on_reply_read(GObject *source, GAsyncResult *res,
+                          gpointer user_data) {
+  GTask *task = G_TASK(user_data);
+  Request *request = g_task_get_task_data(task);
+  GError *error = NULL;
+  gssize size = g_output_stream_splice_finish(G_OUTPUT_STREAM(source), res,
+                                              &error);
+
+  if (size < 0) {
+    g_task_return_error(task, error);
+    g_object_unref(task);
+    return;
+  }
+
+  command_stats_add(request->stats_key,
+                    g_get_monotonic_time() - request->start, size, FALSE);
+  g_output_stream_write_all(request->reply, "", 1, NULL, NULL, NULL);
+  g_output_stream_close(request->reply, NULL, NULL);
+  g_task_return_pointer(
+      task,
+      g_memory_output_stream_steal_data(G_MEMORY_OUTPUT_STREAM(request->reply)),
+      g_free);
+  g_object_unref(task);
+}
+
+static void on_request_written(GObject *source, GAsyncResult *res,
+                               gpointer user_data) {
+  GTask *task = G_TASK(user_data);
+  Request *request = g_task_get_task_data(task);
+  GError *error = NULL;
+
+  if (!g_output_stream_write_all_finish(G_OUTPUT_STREAM(source), res, NULL,
+                                        &error)) {
+    g_task_return_error(task, error);
+    g_object_unref(task);
+    return;
+  }
+
+  g_output_stream_splice_async(
+      request->reply,
+      g_io_stream_get_input_stream(G_IO_STREAM(request->connection)),
+      G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE, G_PRIORITY_DEFAULT,
+      g_task_get_cancellable(task), on_reply_read, task);
+}
+
+static void on_connected(GObject *source, GAsyncResult *res,
+                         gpointer user_data) {
+  GTask *task = G_TASK(user_data);
+  Request *request = g_task_get_task_data(task);
+  GError *error = NULL;
+
+  request->connection =
+      g_socket_client_connect_finish(G_SOCKET_CLIENT(source), res, &error);
+  if (request->connection == NULL) {
+    g_task_return_error(task, error);
+    g_object_unref(task);
+    return;
+  }
+
+  g_output_stream_write_all_async(
+      g_io_stream_get_output_stream(G_IO_STREAM(request->connection)),
+      request->request, strlen(request->request), G_PRIORITY_DEFAULT,
+      g_task_get_cancellable(task), on_request_written, task);
+}
+
+void hyprland_request_async(const gchar *command, GCancellable *cancellable,
+                            GAsyncReadyCallback callback, gpointer user_data) {
+  GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+  Request *request = g_new0(Request, 1);
+  g_autofree gchar *path = socket_path(".socket.sock");
+  g_autoptr(GSocketClient) client = NULL;
+  g_autoptr(GSocketAddress) address = NULL;
+  gsize verb = strcspn(command, " ");
+
+  request->request = g_strdup(command);
+  request->stats_key = g_strdup_printf("hyprland %.*s", (gint)verb, command);
+  request->reply = g_memory_output_stream_new_resizable();
+  request->start = g_get_monotonic_time();
+  g_task_set_source_tag(task, hyprland_request_async);
+  g_task_set_task_data(task, request, (GDestroyNotify)request_free);
+
+  if (path == NULL) {
+    g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                            "Hyprland is not running");
+    g_object_unref(task);
+    return;
+  }
+
+  client = g_socket_client_new();
+  address = g_unix_socket_address_new(path);
+  g_socket_client_connect_async(client, G_SOCKET_CONNECTABLE(address),
+                                cancellable, on_connected, task);
+}
+
+gchar *hyprland_request_finish(GAsyncResult *result, GError **error) {
+  g_return_val_if_fail(g_task_is_valid(result, NULL), NULL);
+  return g_task_propagate_pointer(G_TASK(result), error);
+}
+
+// Replies come back in order, "ok" for every command that took
+static void on_batch_reply(GObject *source, GAsyncResult *res,
+                           gpointer user_data) {
+  GTask *task = G_TASK(user_data);
+  GError *error = NULL;
+  g_autofree gchar *reply = hyprland_request_finish(res, &error);
+  LineReader reader;
+  StrView line;
+
+  if (reply == NULL) {
+    g_task_return_error(task, error);
+    g_object_unref(task);
+    return;
+  }
+
+  line_reader_init(&reader, reply, strlen(reply));
+  while (line_reader_next(&reader, &line)) {
+    line = str_view_strip(line);
+    if (line.len == 0 || str_view_equal(line, "ok"))
+      continue;
+    g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                            "Hyprland refused: %.*s", (gint)line.len,
+                            line.data);
+    g_object_unref(task);
+    return;
+  }
+
+  g_task_return_boolean(task, TRUE);
+  g_object_unref(task);
+}
+
+void hyprland_batch_async(const gchar *const *commands,
+                          GCancellable *cancellable,
+                          GAsyncReadyCallback callback, gpointer user_data) {
+  GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+  g_autofree gchar *joined = g_strjoinv(";", (gchar **)commands);
+  g_autofree gchar *request = g_strconcat("[[BATCH]]", joined, NULL);
+
+  g_task_set_source_tag(task, hyprland_batch_async);
+  hyprland_request_async(request, cancellable, on_batch_reply, task);
+}
+
+gboolean hyprland_batch_finish(GAsyncResult *result, GError **error) {
+  g_return_val_if_fail(g_task_is_valid(result, NULL), FALSE);
+  return g_task_propagate_boolean(G_TASK(result), error);
+}
+
+static void on_query_reply(GObject *source, GAsyncResult *res,
+                           gpointer user_data) {
+  GTask *task = G_TASK(user_data);
+  GError *error = NULL;
+  g_autofree gchar *reply = hyprland_request_finish(res, &error);
+  g_autoptr(JsonParser) parser = NULL;
+  JsonNode *root;
+
+  if (reply == NULL) {
+    g_task_return_error(task, error);
+    g_object_unref(task);
+    return;
+  }
+
+  parser = json_parser_new_immutable();
+  if (!json_parser_load_from_data(parser, reply, -1, &error)) {
+    g_task_return_error(task, error);
+    g_object_unref(task);
+    return;
+  }
+
+  root = json_parser_get_root(parser);
+  if (root == NULL)
+    g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                            "Hyprland sent an empty reply");
+  else
+    g_task_return_pointer(task, json_node_ref(root),
+                          (GDestroyNotify)json_node_unref);
+  g_object_unref(task);
+}
+
+void hyprland_query_async(const gchar *query, GCancellable *cancellable,
+                          GAsyncReadyCallback callback, gpointer user_data) {
+  GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+  g_autofree gchar *request = g_strconcat("j/", query, NULL);
+
+  g_task_set_source_tag(task, hyprland_query_async);
+  hyprland_request_async(request, cancellable, on_query_reply, task);
+}
+
+JsonNode *hyprland_query_finish(GAsyncResult *result, GError **error) {
+  g_return_val_if_fail(g_task_is_valid(result, NULL), NULL);
+  return g_task_propagate_pointer(G_TASK(result), error);
+}
+
+static void call_listener(GCallback func, gpointer user_data, gpointer args) {
+  Emission *emission = args;
+
+  ((HyprlandEventFunc)func)(emission->event, emission->data, user_data);
+}
+
+static void on_event_line(StrView line, void *user_data) {
+  long split = str_view_find(line, ">>");
+  g_autofree gchar *event = NULL;
+  g_autofree gchar *data = NULL;
+
+  if (split < 0)
+    return;
+  event = g_strndup(line.data, split);
+  data = g_strndup(line.data + split + 2, line.len - split - 2);
+
+  Emission emission = {event, data};
+  listener_list_emit(&listeners, call_listener, &emission);
+}
+
+static void stop_events(void) {
+  g_cancellable_cancel(event_cancellable);
+  g_clear_object(&event_cancellable);
+  g_clear_object(&event_connection);
+  line_feeder_clear(&event_feeder);
+}
+
+static void read_events(void);
+
+static void on_events_read(GObject *source, GAsyncResult *res,
+                           gpointer user_data) {
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GBytes) bytes =
+      g_input_stream_read_bytes_finish(G_INPUT_STREAM(source), res, &error);
+  gconstpointer data;
+  gsize size;
+
+  // Nobody is listening any more
+  if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    return;
+
+  if (bytes == NULL || g_bytes_get_size(bytes) == 0) {
+    g_printerr("Hyprland event stream closed%s%s\n", error ? ": " : "",
+               error ? error->message : "");
+    stop_events();
+    return;
+  }
+
+  // Stopping while the lines are handed out would free the feeder under
+  // them, so a stop asked for meanwhile happens afterwards
+  data = g_bytes_get_data(bytes, &size);
+  dispatching = TRUE;
+  line_feeder_feed(&event_feeder, data, size, on_event_line, NULL);
+  dispatching = FALSE;
+  if (stop_pending || event_connection == NULL) {
+    stop_pending = FALSE;
+    stop_events();
+    return;
+  }
+  read_events();
+}
+
+static void read_events(void) {
+  g_input_stream_read_bytes_async(
+      g_io_stream_get_input_stream(G_IO_STREAM(event_connection)),
+      HYPRLAND_READ_SIZE, G_PRIORITY_DEFAULT, event_cancellable,
+      on_events_read, NULL);
+}
+
+// Connecting to a local socket does not block, so this is done directly
+static void start_events(void) {
+  g_autofree gchar *path = socket_path(".socket2.sock");
+  g_autoptr(GSocketClient) client = NULL;
+  g_autoptr(GSocketAddress) address = NULL;
+  g_autoptr(GError) error = NULL;
+
+  if (path == NULL)
+    return;
+
+  client = g_socket_client_new();
+  address = g_unix_socket_address_new(path);
+  event_connection = g_socket_client_connect(
+      client, G_SOCKET_CONNECTABLE(address), NULL, &error);
+  if (event_connection == NULL) {
+    g_printerr("Failed to follow Hyprland events: %s\n", error->message);
+    return;
+  }
+
+  event_cancellable = g_cancellable_new();
+  line_feeder_init(&event_feeder);
+  read_events();
+}
+
+guint hyprland_events_listen(HyprlandEventFunc func, gpointer user_data) {
+  guint id = listener_list_add(&listeners, G_CALLBACK(func), user_data);
+
+  // Someone listens again before a stop from a callback took effect
+  stop_pending = FALSE;
+  if (event_connection == NULL)
+    start_events();
+  return id;
+}
+
+void hyprland_events_unlisten(guint id) {
+  if (!listener_list_remove(&listeners, id) ||
+      listener_list_length(&listeners) > 0)
+    return;
+  if (dispatching)
+    stop_pending = TRUE;
+  else
+    stop_events();
+}
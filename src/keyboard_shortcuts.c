@@ -1,7 +1,21 @@
 #include "option/keyboard_shortcuts.h"
+#include "hyprland/ipc.h"
+#include <adwaita.h>
 #include <gtk/gtk.h>
 
 GtkWidget *Keyboard_ShortcutsPage;
+static GtkListBox *ShortcutsList = NULL;
+
+// Hyprland's modmask bits, in the order people write them
+static const struct {
+  gint64 mask;
+  const gchar *name;
+} modifiers[] = {
+    {1 << 6, "Super"},
+    {1 << 2, "Ctrl"},
+    {1 << 3, "Alt"},
+    {1 << 0, "Shift"},
+};
 
 void change_panel_to_keyboard_shortcuts(gpointer user_data) {
   GtkStack *stack = GTK_STACK(user_data);
@@ -9,6 +23,85 @@ void change_panel_to_keyboard_shortcuts(gpointer user_data) {
   gtk_stack_set_visible_child_name(stack, "keyboard_shortcuts_page");
 }
 
+static gchar *bind_keys(JsonObject *bind) {
+  gint64 modmask = json_object_get_int_member_with_default(bind, "modmask", 0);
+  GString *keys = g_string_new(NULL);
+
+  for (gsize i = 0; i < G_N_ELEMENTS(modifiers); i++) {
+    if (modmask & modifiers[i].mask)
+      g_string_append_printf(keys, "%s + ", modifiers[i].name);
+  }
+  g_string_append(keys,
+                  json_object_get_string_member_with_default(bind, "key", ""));
+  return g_string_free(keys, FALSE);
+}
+
+static gchar *bind_action(JsonObject *bind) {
+  const gchar *description =
+      json_object_get_string_member_with_default(bind, "description", "");
+  const gchar *dispatcher =
+      json_object_get_string_member_with_default(bind, "dispatcher", "");
+  const gchar *arg = json_object_get_string_member_with_default(bind, "arg", "");
+
+  if (json_object_get_boolean_member_with_default(bind, "has_description",
+                                                  FALSE) &&
+      *description != '\0')
+    return g_strdup(description);
+  return *arg != '\0' ? g_strdup_printf("%s %s", dispatcher, arg)
+                      : g_strdup(dispatcher);
+}
+
+static void on_binds_ready(GObject *source, GAsyncResult *res,
+                           gpointer user_data) {
+  g_autoptr(GError) error = NULL;
+  g_autoptr(JsonNode) root = hyprland_query_finish(res, &error);
+  JsonArray *binds;
+  GtkWidget *child;
+
+  if (root == NULL) {
+    g_printerr("Failed to list Hyprland binds: %s\n", error->message);
+    return;
+  }
+  if (!JSON_NODE_HOLDS_ARRAY(root))
+    return;
+
+  while ((child = gtk_widget_get_first_child(GTK_WIDGET(ShortcutsList))))
+    gtk_list_box_remove(ShortcutsList, child);
+
+  binds = json_node_get_array(root);
+  for (guint i = 0; i < json_array_get_length(binds); i++) {
+    JsonObject *bind = json_array_get_object_element(binds, i);
+    g_autofree gchar *action = NULL;
+    g_autofree gchar *keys = NULL;
+    GtkWidget *row;
+
+    // Mouse binds drag and resize windows; they are not shortcuts
+    if (bind == NULL ||
+        json_object_get_boolean_member_with_default(bind, "mouse", FALSE))
+      continue;
+
+    action = bind_action(bind);
+    keys = bind_keys(bind);
+    row = adw_action_row_new();
+    // Arguments are shell commands, not markup
+    adw_preferences_row_set_use_markup(ADW_PREFERENCES_ROW(row), FALSE);
+    adw_preferences_row_set_title(ADW_PREFERENCES_ROW(row), action);
+    adw_action_row_set_subtitle(ADW_ACTION_ROW(row), keys);
+    gtk_list_box_append(ShortcutsList, row);
+  }
+}
+
+static void load_binds(void) {
+  hyprland_query_async("binds", NULL, on_binds_ready, NULL);
+}
+
+// Editing hyprland.conf reloads it, and with it the binds
+static void on_hyprland_event(const gchar *event, const gchar *data,
+                              gpointer user_data) {
+  if (g_strcmp0(event, "configreloaded") == 0)
+    load_binds();
+}
+
 static void keyboard_shortcuts_to_stack(GtkStack *stack) {
   if (Keyboard_ShortcutsPage) {
     return;
@@ -27,6 +120,14 @@ static void keyboard_shortcuts_to_stack(GtkStack *stack) {
     return;
   }
 
+  // Under Hyprland the custom shortcuts are its binds, kept live
+  ShortcutsList = GTK_LIST_BOX(
+      gtk_builder_get_object(keyboard_shortcuts_builder, "custom_shortcuts_list"));
+  if (ShortcutsList != NULL && hyprland_ipc_available()) {
+    load_binds();
+    hyprland_events_listen(on_hyprland_event, NULL);
+  }
+
   gtk_stack_add_named(stack, Keyboard_ShortcutsPage, "keyboard_shortcuts_page");
   g_object_unref(keyboard_shortcuts_builder);
 }
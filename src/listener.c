@@ -0,0 +1,69 @@
+#include "listener/listener.h"
+
+typedef struct {
+  guint id; // 0 once it left during an emission
+  GCallback func;
+  gpointer user_data;
+} ListenerEntry;
+
+static guint next_id = 1;
+
+guint listener_list_add(ListenerList *list, GCallback func,
+                        gpointer user_data) {
+  ListenerEntry entry = {next_id++, func, user_data};
+
+  g_return_val_if_fail(func != NULL, 0);
+
+  if (list->entries == NULL)
+    list->entries = g_array_new(FALSE, FALSE, sizeof(ListenerEntry));
+  g_array_append_val(list->entries, entry);
+  list->length++;
+  return entry.id;
+}
+
+gboolean listener_list_remove(ListenerList *list, guint id) {
+  if (id == 0)
+    return FALSE;
+
+  for (guint i = 0; list->entries != NULL && i < list->entries->len; i++) {
+    ListenerEntry *entry = &g_array_index(list->entries, ListenerEntry, i);
+
+    if (entry->id != id)
+      continue;
+    list->length--;
+    // Emissions walk the array by position; it only shrinks after them
+    if (list->emitting > 0)
+      entry->id = 0;
+    else
+      g_array_remove_index(list->entries, i);
+    return TRUE;
+  }
+  return FALSE;
+}
+
+guint listener_list_length(const ListenerList *list) { return list->length; }
+
+void listener_list_emit(ListenerList *list, ListenerCall call, gpointer args) {
+  guint end;
+
+  if (list->entries == NULL)
+    return;
+
+  // Listeners that join meanwhile are appended past the end. Each entry is
+  // copied out, since a join may move the array.
+  end = list->entries->len;
+  list->emitting++;
+  for (guint i = 0; i < end; i++) {
+    ListenerEntry entry = g_array_index(list->entries, ListenerEntry, i);
+
+    if (entry.id != 0)
+      call(entry.func, entry.user_data, args);
+  }
+  if (--list->emitting > 0)
+    return;
+
+  for (guint i = list->entries->len; i > 0; i--) {
+    if (g_array_index(list->entries, ListenerEntry, i - 1).id == 0)
+      g_array_remove_index(list->entries, i - 1);
+  }
+}
@@ -1,4 +1,7 @@
 #include "window/window.h"
+#include "capability/capability.h"
+#include "command/setter.h"
+#include "command/stats.h"
 #include <gtk/gtk.h>
 #include <stdio.h>
 #include <sys/stat.h>
@@ -28,7 +31,17 @@ static void load_css(void) {
   g_object_unref(provider);
 }
 
+static gboolean print_stats = FALSE;
+
+static gint handle_local_options(GApplication *app, GVariantDict *options,
+                                 gpointer user_data) {
+  print_stats = g_variant_dict_contains(options, "stats");
+  return -1; // keep going
+}
+
 static void activate(GtkApplication *app, gpointer user_data) {
+  // Pages consult this instead of probing for tools themselves
+  capabilities_init();
   load_css();
 
   GtkWidget *window = create_main_window(app);
@@ -39,10 +52,24 @@ int main(int argc, char *argv[]) {
   GtkApplication *app =
       gtk_application_new("org.gtk.example", G_APPLICATION_DEFAULT_FLAGS);
 
+  g_application_add_main_option(G_APPLICATION(app), "stats", 0,
+                                G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE,
+                                "Print backend command statistics on exit",
+                                NULL);
+  g_signal_connect(app, "handle-local-options",
+                   G_CALLBACK(handle_local_options), NULL);
   g_signal_connect(app, "activate", G_CALLBACK(activate), NULL);
 
   int status = g_application_run(G_APPLICATION(app), argc, argv);
+  // Don't drop the last slider position if the window closed mid-drag
+  command_set_flush();
   g_object_unref(app);
 
+  if (print_stats) {
+    gchar *report = command_stats_report();
+    g_print("%s", report);
+    g_free(report);
+  }
+
   return status;
 }
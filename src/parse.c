@@ -0,0 +1,463 @@
+#include "parse/parse.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define LINE_FEEDER_MIN_SIZE 256
+
+static bool is_blank(char c) { return c == ' ' || c == '\t'; }
+
+static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+StrView str_view(const char *string) {
+  StrView view = {string, string ? strlen(string) : 0};
+  return view;
+}
+
+StrView str_view_strip(StrView view) {
+  while (view.len > 0 && (is_blank(*view.data) || *view.data == '\r' ||
+                          *view.data == '\n')) {
+    view.data++;
+    view.len--;
+  }
+  while (view.len > 0 &&
+         (is_blank(view.data[view.len - 1]) || view.data[view.len - 1] == '\r' ||
+          view.data[view.len - 1] == '\n'))
+    view.len--;
+  return view;
+}
+
+bool str_view_equal(StrView view, const char *string) {
+  size_t len = strlen(string);
+  return view.len == len && memcmp(view.data, string, len) == 0;
+}
+
+bool str_view_has_prefix(StrView view, const char *prefix) {
+  size_t len = strlen(prefix);
+  return view.len >= len && memcmp(view.data, prefix, len) == 0;
+}
+
+bool str_view_has_suffix(StrView view, const char *suffix) {
+  size_t len = strlen(suffix);
+  return view.len >= len &&
+         memcmp(view.data + view.len - len, suffix, len) == 0;
+}
+
+long str_view_find_char(StrView view, char c) {
+  const char *found = view.len ? memchr(view.data, c, view.len) : NULL;
+  return found ? found - view.data : -1;
+}
+
+long str_view_find(StrView view, const char *needle) {
+  size_t len = strlen(needle);
+
+  if (len == 0)
+    return 0;
+  // Jump between candidate first bytes instead of comparing at every offset
+  for (size_t offset = 0; offset + len <= view.len;) {
+    const char *candidate =
+        memchr(view.data + offset, needle[0], view.len - len - offset + 1);
+    if (candidate == NULL)
+      return -1;
+    offset = candidate - view.data;
+    if (memcmp(candidate, needle, len) == 0)
+      return offset;
+    offset++;
+  }
+  return -1;
+}
+
+StrView str_view_skip(StrView view, size_t n) {
+  if (n > view.len)
+    n = view.len;
+  view.data += n;
+  view.len -= n;
+  return view;
+}
+
+bool str_view_split(StrView *view, char c, StrView *head) {
+  long at = str_view_find_char(*view, c);
+
+  if (at < 0)
+    return false;
+  head->data = view->data;
+  head->len = at;
+  *view = str_view_skip(*view, at + 1);
+  return true;
+}
+
+static StrView skip_blanks(StrView view) {
+  while (view.len > 0 && is_blank(*view.data))
+    view = str_view_skip(view, 1);
+  return view;
+}
+
+bool str_view_take_word(StrView *view, StrView *word) {
+  StrView cursor = skip_blanks(*view);
+  size_t len = 0;
+
+  while (len < cursor.len && !is_blank(cursor.data[len]))
+    len++;
+  if (len == 0)
+    return false;
+  word->data = cursor.data;
+  word->len = len;
+  *view = str_view_skip(cursor, len);
+  return true;
+}
+
+bool str_view_take_int(StrView *view, long *value) {
+  StrView cursor = skip_blanks(*view);
+  bool negative = false;
+  long result = 0;
+
+  if (cursor.len > 0 && (*cursor.data == '-' || *cursor.data == '+')) {
+    negative = *cursor.data == '-';
+    cursor = str_view_skip(cursor, 1);
+  }
+  if (cursor.len == 0 || !is_digit(*cursor.data))
+    return false;
+
+  while (cursor.len > 0 && is_digit(*cursor.data)) {
+    // Saturate rather than overflow on absurd input
+    if (result < 100000000000L)
+      result = result * 10 + (*cursor.data - '0');
+    cursor = str_view_skip(cursor, 1);
+  }
+
+  *value = negative ? -result : result;
+  *view = cursor;
+  return true;
+}
+
+bool str_view_take_milli(StrView *view, long *value) {
+  StrView cursor = *view;
+  long whole, fraction = 0;
+  int digits = 0;
+
+  if (!str_view_take_int(&cursor, &whole))
+    return false;
+
+  if (cursor.len > 0 && *cursor.data == '.') {
+    cursor = str_view_skip(cursor, 1);
+    while (cursor.len > 0 && is_digit(*cursor.data)) {
+      if (digits < 3) {
+        fraction = fraction * 10 + (*cursor.data - '0');
+      } else if (digits == 3 && *cursor.data >= '5') {
+        fraction++;
+      }
+      digits++;
+      cursor = str_view_skip(cursor, 1);
+    }
+  }
+  for (; digits < 3; digits++)
+    fraction *= 10;
+
+  *value = whole < 0 ? whole * 1000 - fraction : whole * 1000 + fraction;
+  *view = cursor;
+  return true;
+}
+
+size_t str_view_copy(StrView view, char *buffer, size_t size) {
+  if (size == 0)
+    return 0;
+  size_t len = view.len < size - 1 ? view.len : size - 1;
+  memcpy(buffer, view.data, len);
+  buffer[len] = '\0';
+  return len;
+}
+
+void line_reader_init(LineReader *reader, const char *data, size_t len) {
+  reader->pos = data;
+  reader->end = data ? data + len : NULL;
+}
+
+static StrView chomp(const char *start, size_t len) {
+  if (len > 0 && start[len - 1] == '\r')
+    len--;
+  StrView line = {start, len};
+  return line;
+}
+
+bool line_reader_next(LineReader *reader, StrView *line) {
+  if (reader->pos == NULL || reader->pos >= reader->end)
+    return false;
+
+  const char *start = reader->pos;
+  const char *newline = memchr(start, '\n', reader->end - start);
+
+  if (newline) {
+    *line = chomp(start, newline - start);
+    reader->pos = newline + 1;
+  } else {
+    *line = chomp(start, reader->end - start);
+    reader->pos = reader->end;
+  }
+  return true;
+}
+
+void line_feeder_init(LineFeeder *feeder) {
+  feeder->partial = NULL;
+  feeder->partial_len = 0;
+  feeder->partial_size = 0;
+}
+
+static void line_feeder_keep(LineFeeder *feeder, const char *data,
+                             size_t len) {
+  size_t needed = feeder->partial_len + len;
+
+  if (needed > feeder->partial_size) {
+    size_t size = feeder->partial_size ? feeder->partial_size
+                                       : LINE_FEEDER_MIN_SIZE;
+    while (size < needed)
+      size *= 2;
+    char *partial = realloc(feeder->partial, size);
+    if (partial == NULL)
+      abort();
+    feeder->partial = partial;
+    feeder->partial_size = size;
+  }
+  memcpy(feeder->partial + feeder->partial_len, data, len);
+  feeder->partial_len = needed;
+}
+
+void line_feeder_feed(LineFeeder *feeder, const char *data, size_t len,
+                      LineFunc callback, void *user_data) {
+  const char *end = data + len;
+  const char *newline;
+
+  // Finish the line the previous chunk left open
+  if (feeder->partial_len > 0) {
+    newline = memchr(data, '\n', len);
+    if (newline == NULL) {
+      line_feeder_keep(feeder, data, len);
+      return;
+    }
+    line_feeder_keep(feeder, data, newline - data);
+    callback(chomp(feeder->partial, feeder->partial_len), user_data);
+    feeder->partial_len = 0;
+    data = newline + 1;
+  }
+
+  while (data < end && (newline = memchr(data, '\n', end - data)) != NULL) {
+    callback(chomp(data, newline - data), user_data);
+    data = newline + 1;
+  }
+
+  if (data < end)
+    line_feeder_keep(feeder, data, end - data);
+}
+
+void line_feeder_flush(LineFeeder *feeder, LineFunc callback,
+                       void *user_data) {
+  if (feeder->partial_len == 0)
+    return;
+  callback(chomp(feeder->partial, feeder->partial_len), user_data);
+  feeder->partial_len = 0;
+}
+
+void line_feeder_clear(LineFeeder *feeder) {
+  free(feeder->partial);
+  line_feeder_init(feeder);
+}
+
+size_t nmcli_split(StrView line, StrView *fields, size_t max) {
+  size_t count = 0;
+  size_t start = 0;
+
+  for (size_t i = 0; i <= line.len; i++) {
+    if (i < line.len && line.data[i] == '\\') {
+      if (i + 1 < line.len)
+        i++; // the escaped byte can't be a separator
+      continue;
+    }
+    if (i < line.len && line.data[i] != ':')
+      continue;
+    if (count < max) {
+      fields[count].data = line.data + start;
+      fields[count].len = (i < line.len ? i : line.len) - start;
+    }
+    count++;
+    start = i + 1;
+  }
+  return count;
+}
+
+size_t nmcli_unescape(StrView field, char *buffer, size_t size) {
+  size_t len = 0;
+
+  if (size == 0)
+    return 0;
+  for (size_t i = 0; i < field.len && len < size - 1; i++) {
+    if (field.data[i] == '\\' && i + 1 < field.len)
+      i++;
+    buffer[len++] = field.data[i];
+  }
+  buffer[len] = '\0';
+  return len;
+}
+
+bool parse_key_value(StrView line, StrView *key, StrView *value) {
+  StrView rest = line;
+
+  if (!str_view_split(&rest, ':', key))
+    return false;
+  *key = str_view_strip(*key);
+  *value = str_view_strip(rest);
+  return true;
+}
+
+// "1920x1080" with nothing but digits on either side of the 'x'
+static bool take_size(StrView *view, ModeLine *mode) {
+  StrView cursor = *view;
+  long width, height;
+
+  if (!str_view_take_int(&cursor, &width) || width <= 0 ||
+      cursor.len == 0 || *cursor.data != 'x')
+    return false;
+  cursor = str_view_skip(cursor, 1);
+  if (cursor.len == 0 || !is_digit(*cursor.data) ||
+      !str_view_take_int(&cursor, &height) || height <= 0)
+    return false;
+
+  mode->width = (int)width;
+  mode->height = (int)height;
+  *view = cursor;
+  return true;
+}
+
+bool parse_xrandr_mode(StrView line, ModeLine *mode) {
+  StrView cursor = line;
+  ModeLine parsed = {0};
+  bool have_rate = false;
+
+  // Mode lines are indented; output headers are not
+  if (cursor.len == 0 || !is_blank(*cursor.data))
+    return false;
+  if (!take_size(&cursor, &parsed))
+    return false;
+  // Interlaced and doublescan modes carry a suffix such as "1920x1080i"
+  while (cursor.len > 0 && !is_blank(*cursor.data))
+    cursor = str_view_skip(cursor, 1);
+
+  long rate;
+  while (str_view_take_milli(&cursor, &rate)) {
+    bool current = false, preferred = false;
+
+    while (cursor.len > 0 && (*cursor.data == '*' || *cursor.data == '+')) {
+      if (*cursor.data == '*')
+        current = true;
+      else
+        preferred = true;
+      cursor = str_view_skip(cursor, 1);
+    }
+
+    if (!have_rate || current) {
+      parsed.refresh_mhz = rate;
+      have_rate = true;
+    }
+    parsed.current |= current;
+    parsed.preferred |= preferred;
+  }
+
+  if (!have_rate)
+    return false;
+  *mode = parsed;
+  return true;
+}
+
+bool parse_wlr_randr_mode(StrView line, ModeLine *mode) {
+  StrView cursor = line;
+  ModeLine parsed = {0};
+
+  if (!take_size(&cursor, &parsed))
+    return false;
+  cursor = skip_blanks(cursor);
+  if (!str_view_has_prefix(cursor, "px,"))
+    return false;
+  cursor = str_view_skip(cursor, 3);
+  if (!str_view_take_milli(&cursor, &parsed.refresh_mhz))
+    return false;
+
+  long flags = str_view_find_char(cursor, '(');
+  if (flags >= 0) {
+    StrView rest = str_view_skip(cursor, flags);
+    parsed.current = str_view_find(rest, "current") >= 0;
+    parsed.preferred = str_view_find(rest, "preferred") >= 0;
+  }
+
+  *mode = parsed;
+  return true;
+}
+
+bool parse_pw_metadata(StrView line, StrView *key, StrView *value) {
+  long at = str_view_find(line, "key:'");
+  StrView rest;
+
+  if (!str_view_has_prefix(line, "update:") || at < 0)
+    return false;
+  rest = str_view_skip(line, at + 5);
+
+  at = str_view_find(rest, "' value:'");
+  if (at < 0)
+    return false;
+  key->data = rest.data;
+  key->len = at;
+  rest = str_view_skip(rest, at + 9);
+
+  // Values can hold quotes of their own ("[ 44100 48000 ]", JSON objects)
+  at = str_view_find(rest, "' type:");
+  if (at < 0)
+    return false;
+  value->data = rest.data;
+  value->len = at;
+  return true;
+}
+
+// An integer column that is a whole word, not the start of "35.2us"
+static bool take_column(StrView *view, long *value) {
+  StrView cursor = *view;
+
+  if (!str_view_take_int(&cursor, value) ||
+      (cursor.len > 0 && !is_blank(*cursor.data)))
+    return false;
+  *view = cursor;
+  return true;
+}
+
+bool parse_pw_top_node(StrView line, PwTopNode *node) {
+  StrView cursor = line, word, last = {0};
+  PwTopNode parsed = {0};
+  long plus;
+
+  // The state column is a single letter; this also skips the header line
+  if (!str_view_take_word(&cursor, &word) || word.len != 1 ||
+      !take_column(&cursor, &parsed.id) ||
+      !take_column(&cursor, &parsed.quantum) ||
+      !take_column(&cursor, &parsed.rate))
+    return false;
+
+  // WAIT, BUSY, W/Q and B/Q: timings or "---"
+  for (int i = 0; i < 4; i++) {
+    if (!str_view_take_word(&cursor, &word))
+      return false;
+  }
+  if (!take_column(&cursor, &parsed.errors))
+    return false;
+
+  // Then an optional format of several words and the name
+  cursor = str_view_strip(cursor);
+  plus = str_view_find(cursor, "+ ");
+  if (plus >= 0 && (plus == 0 || is_blank(cursor.data[plus - 1]))) {
+    parsed.name = str_view_strip(str_view_skip(cursor, plus + 2));
+  } else {
+    parsed.driver = true;
+    while (str_view_take_word(&cursor, &word))
+      last = word;
+    parsed.name = last;
+  }
+  if (parsed.name.len == 0)
+    return false;
+
+  *node = parsed;
+  return true;
+}
@@ -1,4 +1,5 @@
 #include "option/security.h"
+#include "capability/capability.h"
 #include "command/command.h"
 #include <adwaita.h>
 #include <gtk/gtk.h>
@@ -11,17 +12,23 @@ void change_panel_to_security(gpointer user_data) {
   gtk_stack_set_visible_child_name(stack, "security_page");
 }
 
-void enable_firewall() { execute_command("pkexec ufw enable"); }
+// Run `pkexec ufw <action> [rule]` without blocking the UI on the polkit prompt
+static void run_ufw(const char *action, const char *rule) {
+  const gchar *argv[] = {"pkexec", "ufw", action, rule, NULL};
+  command_spawn(argv);
+}
+
+void enable_firewall() { run_ufw("enable", NULL); }
 
-void disable_firewall() { execute_command("pkexec ufw disable"); }
+void disable_firewall() { run_ufw("disable", NULL); }
 
 static void on_ssh_switch_activated(GObject *object, GParamSpec *pspec,
                                     gpointer user_data) {
   GtkSwitch *ssh_switch = GTK_SWITCH(object);
   if (gtk_switch_get_active(ssh_switch)) {
-    execute_command("pkexec ufw allow ssh");
+    run_ufw("allow", "ssh");
   } else {
-    execute_command("pkexec ufw deny ssh");
+    run_ufw("deny", "ssh");
   }
 }
 
@@ -29,9 +36,9 @@ static void on_smtp_switch_activated(GObject *object, GParamSpec *pspec,
                                      gpointer user_data) {
   GtkSwitch *smtp_switch = GTK_SWITCH(object);
   if (gtk_switch_get_active(smtp_switch)) {
-    execute_command("pkexec ufw allow smtp");
+    run_ufw("allow", "smtp");
   } else {
-    execute_command("pkexec ufw deny smtp");
+    run_ufw("deny", "smtp");
   }
 }
 
@@ -39,9 +46,9 @@ static void on_vnc_switch_activated(GObject *object, GParamSpec *pspec,
                                     gpointer user_data) {
   GtkSwitch *vnc_switch = GTK_SWITCH(object);
   if (gtk_switch_get_active(vnc_switch)) {
-    execute_command("pkexec ufw allow vnc");
+    run_ufw("allow", "vnc");
   } else {
-    execute_command("pkexec ufw deny vnc");
+    run_ufw("deny", "vnc");
   }
 }
 
@@ -62,14 +69,9 @@ static void on_port_switch_activated(GObject *object, GParamSpec *pspec,
   GtkSwitch *port_switch = GTK_SWITCH(object);
 
   if (port_number && *port_number) {
-    gchar *command;
-    if (gtk_switch_get_active(port_switch)) {
-      command = g_strdup_printf("pkexec ufw allow %s", port_number);
-    } else {
-      command = g_strdup_printf("pkexec ufw deny %s", port_number);
-    }
-    execute_command(command);
-    g_free(command);
+    // The port goes to ufw as a single argument, never through a shell
+    run_ufw(gtk_switch_get_active(port_switch) ? "allow" : "deny",
+            port_number);
   }
 }
 
@@ -135,6 +137,12 @@ static void security_to_stack(GtkStack *stack) {
   g_signal_connect(port_switch, "notify::active",
                    G_CALLBACK(on_port_switch_activated), port_entry);
 
+  // Every switch runs `pkexec ufw`
+  if (!capabilities()->ufw || !capabilities()->pkexec) {
+    g_print("Firewall settings need ufw and pkexec\n");
+    gtk_widget_set_sensitive(SecurityPage, FALSE);
+  }
+
   gtk_stack_add_named(stack, SecurityPage, "security_page");
   g_object_unref(security_builder);
 }
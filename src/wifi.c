@@ -1,4 +1,16 @@
 #include "option/wifi.h"
+#include "capability/capability.h"
+#include "command/cache.h"
+#include "command/coprocess.h"
+#include "command/setter.h"
+#include "command/stats.h"
+#include "parse/parse.h"
+#include "wifi/attempt.h"
+#include "wifi/history.h"
+#include "wifi/networks.h"
+#include "wifi/nm.h"
+#include "wifi/sparkline.h"
+#include "window/refresh.h"
 #include <adwaita.h>
 #include <gio/gio.h>
 #include <glib.h>
@@ -8,10 +20,13 @@
 
 GtkWidget *WifiPage;
 
-typedef struct {
-  GtkListBox *list_box;
-  GCancellable *cancellable;
-} ScanData;
+// NetworkManager rate-limits rescans anyway; the list and radio state are
+// shared between back-to-back refreshes
+#define WIFI_RESCAN_TTL 10000
+#define WIFI_QUERY_TTL 2000
+// Rescans while the page is seen, less often while nothing changes
+#define WIFI_SCAN_INTERVAL 30
+#define WIFI_SCAN_MAX_INTERVAL 480
 
 typedef struct {
   GtkStack *stack;
@@ -21,57 +36,40 @@ typedef struct {
 } InitData;
 
 // Forward declarations for all functions
-static void update_wifi_networks_list(GtkListBox *list_box);
-static void clear_list_box(GtkListBox *list_box);
-static GtkWidget *create_network_row(const char *ssid, int signal_strength,
-                                     gboolean is_secured);
+static GtkWidget *create_network_row(gpointer item, gpointer user_data);
 static const char *get_signal_icon_name(int signal_strength);
+static WifiSecurity nmcli_security(StrView security);
 static void on_wifi_switch_active(GObject *wifi_switch, GParamSpec *pspec,
                                   gpointer user_data);
-static gboolean get_wifi_status(void);
 static void set_wifi_switch_state(GtkWidget *wifi_switch, gboolean is_active);
-static void toggle_wifi(gboolean enable);
 static void wifi_to_stack(GtkStack *stack);
-static gboolean on_refresh_timeout(gpointer user_data);
-static void refresh_wifi_networks(GtkListBox *list_box);
+static void refresh_wifi_networks(GCancellable *cancellable,
+                                  gpointer user_data);
 static void on_row_clicked(GtkGestureClick *gesture, gint n_press, gdouble x,
                            gdouble y, gpointer user_data);
-static void connect_to_network(const char *ssid, gboolean is_secured);
-static void show_password_dialog(const char *ssid);
-static void connect_with_password(const char *ssid, const char *password);
+static void connect_to_network(const char *ssid, const char *ap_path,
+                               WifiSecurity security);
+static void show_password_dialog(const char *ssid, const char *ap_path,
+                                 WifiSecurity security);
+static void connect_with_password(const char *ssid, const char *ap_path,
+                                  WifiSecurity security, const char *password);
 static void on_password_dialog_response(GtkDialog *dialog, gint response_id,
                                         gpointer user_data);
 static void update_current_network(GtkBuilder *builder);
 
 // Global variables
-static guint refresh_timeout_id = 0;
-
-// Function to complete initialization after all async operations
-// static void complete_initialization(InitData *init_data) {
-//     if (!gtk_widget_get_parent(WifiPage)) {
-//         gtk_stack_add_named(init_data->stack, WifiPage, "wifi_page");
-//     }
-//     gtk_widget_set_visible(WifiPage, TRUE);
-//     g_object_unref(init_data->builder);
-
-//     // Set up periodic updates
-//     if (refresh_timeout_id == 0) {
-//         refresh_timeout_id = g_timeout_add_seconds(30, on_refresh_timeout,
-//         init_data->wifi_list);
-//     }
-
-//     // Start initial WiFi network scan
-//     refresh_wifi_networks(init_data->wifi_list);
-
-//     g_free(init_data);
-// }
-static void complete_initialization(InitData *init_data) {
-  // Only set up periodic updates
-  if (refresh_timeout_id == 0) {
-    refresh_timeout_id =
-        g_timeout_add_seconds(30, on_refresh_timeout, init_data->wifi_list);
-  }
+static guint scan_job = 0;
+static GtkWidget *WifiSwitch;
+static GtkListBox *WifiList;
+static GtkWidget *CurrentRow;
+static GtkWidget *CurrentIcon;
+static GtkWidget *CurrentSparkline;
+// NetworkManager over D-Bus unless it could not be reached at all
+static gboolean use_nmcli = FALSE;
+static gboolean nm_was_ready = FALSE;
+static guint nm_listener = 0;
 
+static void complete_initialization(InitData *init_data) {
   g_object_unref(init_data->builder);
   g_free(init_data);
 }
@@ -79,167 +77,302 @@ static void complete_initialization(InitData *init_data) {
 // Async WiFi scan operation
 static void wifi_scan_thread(GTask *task, gpointer source_object,
                              gpointer task_data, GCancellable *cancellable) {
+  g_auto(CommandStatsSpan) span = command_stats_begin("task wifi scan");
   GError *error = NULL;
-  gchar *output = NULL;
-
-  if (!g_spawn_command_line_sync("nmcli device wifi rescan", NULL, NULL, NULL,
-                                 &error)) {
+  const gchar *rescan_argv[] = {"nmcli", "device", "wifi", "rescan", NULL};
+  const gchar *list_argv[] = {"nmcli",  "-t",   "-f",
+                              "BSSID,SSID,SIGNAL,SECURITY",
+                              "device", "wifi", "list", NULL};
+
+  // A refused rescan (rate limited by NetworkManager) still leaves a usable
+  // list, so only spawn failures abort
+  CommandResult *result =
+      command_query_sync(rescan_argv, WIFI_RESCAN_TTL, cancellable, &error);
+  if (error) {
     g_task_return_error(task, error);
     return;
   }
+  command_result_free(result);
 
-  if (!g_spawn_command_line_sync(
-          "nmcli -t -f SSID,SIGNAL,SECURITY device wifi list", &output, NULL,
-          NULL, &error)) {
+  result = command_query_sync(list_argv, WIFI_QUERY_TTL, cancellable, &error);
+  if (error) {
     g_task_return_error(task, error);
     return;
   }
 
-  g_task_return_pointer(task, output, g_free);
+  g_task_return_pointer(task, g_steal_pointer(&result->out), g_free);
+  command_result_free(result);
 }
 
 static void wifi_scan_complete(GObject *source_object, GAsyncResult *result,
                                gpointer user_data) {
+  GCancellable *cancellable = g_task_get_cancellable(G_TASK(result));
   GError *error = NULL;
   gchar *output;
-  ScanData *scan_data = user_data;
 
   output = g_task_propagate_pointer(G_TASK(result), &error);
   if (error) {
-    g_warning("WiFi scan failed: %s", error->message);
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      g_warning("WiFi scan failed: %s", error->message);
     g_error_free(error);
-    goto cleanup;
+    refresh_done(cancellable, FALSE);
+    return;
   }
 
-  clear_list_box(scan_data->list_box);
+  // BSSID:SSID:SIGNAL:SECURITY, where colons inside the BSSID and SSID
+  // arrive as "\:". Each line is one access point; the network list folds
+  // them into networks and applies only what changed since the last scan.
+  LineReader reader;
+  StrView line, fields[4];
+  char bssid[32], ssid[128];
+  long signal_strength;
+
+  wifi_networks_begin();
+  line_reader_init(&reader, output, strlen(output));
+  while (line_reader_next(&reader, &line)) {
+    if (nmcli_split(line, fields, 4) < 4 ||
+        !str_view_take_int(&fields[2], &signal_strength))
+      continue;
+
+    nmcli_unescape(fields[0], bssid, sizeof(bssid));
+    nmcli_unescape(fields[1], ssid, sizeof(ssid));
+    WifiAccessPoint ap = {
+        .ssid = ssid,
+        .bssid = bssid,
+        .security = nmcli_security(fields[3]),
+        .strength = (guint8)CLAMP(signal_strength, 0, 100),
+    };
+    wifi_networks_update(&ap);
+    wifi_history_record(ap.bssid, ap.strength, 0, 0);
+  }
+  refresh_done(cancellable, wifi_networks_end());
+  g_free(output);
+}
 
-  gchar **lines = g_strsplit(output, "\n", -1);
-  for (int i = 0; lines[i] != NULL && *lines[i] != '\0'; i++) {
-    gchar **fields = g_strsplit(lines[i], ":", -1);
-    if (g_strv_length(fields) >= 3) {
-      const char *ssid = fields[0];
-      int signal_strength = atoi(fields[1]);
-      gboolean is_secured = (fields[2] != NULL && *fields[2] != '\0');
+static const char *get_signal_icon_name(int signal_strength) {
+  static const char *const names[] = {
+      "network-wireless-signal-weak-symbolic",
+      "network-wireless-signal-ok-symbolic",
+      "network-wireless-signal-good-symbolic",
+      "network-wireless-signal-excellent-symbolic",
+  };
+
+  return names[wifi_signal_bars(MAX(signal_strength, 0))];
+}
 
-      if (strlen(ssid) > 0) {
-        GtkWidget *row = create_network_row(ssid, signal_strength, is_secured);
-        gtk_list_box_append(scan_data->list_box, row);
-      }
-    }
-    g_strfreev(fields);
+static const char *security_label(WifiSecurity security) {
+  switch (security) {
+  case WIFI_SECURITY_NONE:
+    return "Open Network";
+  case WIFI_SECURITY_WEP:
+    return "Secured with WEP";
+  case WIFI_SECURITY_SAE:
+    return "Secured with WPA3";
+  case WIFI_SECURITY_ENTERPRISE:
+    return "Secured with 802.1X";
+  default:
+    return "Secured with WPA";
   }
-  g_strfreev(lines);
-  g_free(output);
+}
 
-cleanup:
-  g_free(scan_data);
+// nmcli's SECURITY column, e.g. "WPA1 WPA2", "WPA3" or "WPA2 802.1X"
+static WifiSecurity nmcli_security(StrView security) {
+  if (str_view_find(security, "802.1X") >= 0)
+    return WIFI_SECURITY_ENTERPRISE;
+  if (str_view_find(security, "WPA3") >= 0 &&
+      str_view_find(security, "WPA2") < 0)
+    return WIFI_SECURITY_SAE;
+  if (str_view_find(security, "WPA") >= 0)
+    return WIFI_SECURITY_PSK;
+  if (str_view_find(security, "WEP") >= 0)
+    return WIFI_SECURITY_WEP;
+  return WIFI_SECURITY_NONE;
 }
 
-// Async WiFi toggle operation
-static void wifi_toggle_thread(GTask *task, gpointer source_object,
-                               gpointer task_data, GCancellable *cancellable) {
-  gboolean enable = GPOINTER_TO_INT(task_data);
-  GError *error = NULL;
-  gchar *command =
-      g_strdup_printf("nmcli radio wifi %s", enable ? "on" : "off");
+// Saved networks say so; clicking them connects without asking anything.
+// A connection attempt shows its progress instead, and how it failed. Its
+// success shows on the current network row.
+static void set_network_subtitle(AdwActionRow *row, WifiNetworkItem *network) {
+  WifiSecurity security = wifi_network_item_get_security(network);
+  gboolean attempt = wifi_attempt_is_for(wifi_network_item_get_ssid(network),
+                                         security) &&
+                     wifi_attempt_get_state() != WIFI_ATTEMPT_CONNECTED &&
+                     wifi_attempt_get_state() != WIFI_ATTEMPT_CANCELLED;
+  gboolean busy = attempt && wifi_attempt_in_progress();
+  g_autofree gchar *subtitle = NULL;
+
+  if (attempt)
+    subtitle = g_strdup(wifi_attempt_get_label());
+  else if (wifi_network_item_get_last_used(network) > 0)
+    subtitle = g_strdup_printf("Saved · %s", security_label(security));
+  adw_action_row_set_subtitle(
+      row, subtitle != NULL ? subtitle : security_label(security));
+
+  gtk_widget_set_visible(g_object_get_data(G_OBJECT(row), "spinner"), busy);
+  gtk_spinner_set_spinning(g_object_get_data(G_OBJECT(row), "spinner"), busy);
+  gtk_widget_set_visible(g_object_get_data(G_OBJECT(row), "cancel"), busy);
+}
 
-  if (!g_spawn_command_line_sync(command, NULL, NULL, NULL, &error)) {
-    g_free(command);
-    g_task_return_error(task, error);
+static void on_network_last_used(WifiNetworkItem *network, GParamSpec *pspec,
+                                 gpointer user_data) {
+  set_network_subtitle(ADW_ACTION_ROW(user_data), network);
+}
+
+// Attempts change state a handful of times each, so every row is checked
+static void on_attempt_changed(gpointer user_data) {
+  GtkWidget *child;
+
+  if (WifiList == NULL)
     return;
-  }
+  for (child = gtk_widget_get_first_child(GTK_WIDGET(WifiList)); child != NULL;
+       child = gtk_widget_get_next_sibling(child)) {
+    WifiNetworkItem *network = g_object_get_data(G_OBJECT(child), "network");
 
-  g_free(command);
-  g_task_return_boolean(task, TRUE);
+    if (network != NULL)
+      set_network_subtitle(ADW_ACTION_ROW(child), network);
+  }
 }
 
-static void wifi_toggle_complete(GObject *source_object, GAsyncResult *result,
-                                 gpointer user_data) {
-  GError *error = NULL;
-  GtkWidget *wifi_switch = user_data;
+static void on_cancel_clicked(GtkButton *button, gpointer user_data) {
+  wifi_attempt_cancel();
+}
 
-  if (!g_task_propagate_boolean(G_TASK(result), &error)) {
-    g_warning("Failed to toggle WiFi: %s", error->message);
-    g_error_free(error);
+// Most strength changes stay within the same bars
+static void on_network_strength(WifiNetworkItem *network, GParamSpec *pspec,
+                                gpointer user_data) {
+  GtkImage *icon = GTK_IMAGE(user_data);
+  const char *icon_name =
+      get_signal_icon_name(wifi_network_item_get_strength(network));
 
-    gboolean current_state;
-    g_object_get(wifi_switch, "active", &current_state, NULL);
-    g_object_set(wifi_switch, "active", !current_state, NULL);
-  }
+  if (g_strcmp0(gtk_image_get_icon_name(icon), icon_name) != 0)
+    gtk_image_set_from_icon_name(icon, icon_name);
 }
 
-static const char *get_signal_icon_name(int signal_strength) {
-  if (signal_strength > 80) {
-    return "network-wireless-signal-excellent-symbolic";
-  } else if (signal_strength > 55) {
-    return "network-wireless-signal-good-symbolic";
-  } else if (signal_strength > 30) {
-    return "network-wireless-signal-ok-symbolic";
-  } else {
-    return "network-wireless-signal-weak-symbolic";
-  }
+static void on_network_bssid(WifiNetworkItem *network, GParamSpec *pspec,
+                             gpointer user_data) {
+  wifi_sparkline_set_bssid(WIFI_SPARKLINE(user_data),
+                           wifi_network_item_get_bssid(network));
 }
-// Modify create_network_row to add click gesture
-static GtkWidget *create_network_row(const char *ssid, int signal_strength,
-                                     gboolean is_secured) {
+
+// Rows are made once per network and follow its item from then on
+static GtkWidget *create_network_row(gpointer item, gpointer user_data) {
+  WifiNetworkItem *network = WIFI_NETWORK_ITEM(item);
   AdwActionRow *row = ADW_ACTION_ROW(adw_action_row_new());
-  adw_preferences_row_set_title(ADW_PREFERENCES_ROW(row), ssid);
-  adw_action_row_set_subtitle(row,
-                              is_secured ? "Secured with WPA" : "Open Network");
 
+  // SSIDs are arbitrary text, not markup
+  adw_preferences_row_set_use_markup(ADW_PREFERENCES_ROW(row), FALSE);
+  adw_preferences_row_set_title(ADW_PREFERENCES_ROW(row),
+                                wifi_network_item_get_ssid(network));
   gtk_list_box_row_set_activatable(GTK_LIST_BOX_ROW(row), TRUE);
+  g_object_set_data_full(G_OBJECT(row), "network", g_object_ref(network),
+                         g_object_unref);
+
+  GtkWidget *spinner = gtk_spinner_new();
+  gtk_widget_set_valign(spinner, GTK_ALIGN_CENTER);
+  adw_action_row_add_suffix(row, spinner);
+  g_object_set_data(G_OBJECT(row), "spinner", spinner);
+
+  GtkWidget *cancel = gtk_button_new_from_icon_name("process-stop-symbolic");
+  gtk_widget_set_valign(cancel, GTK_ALIGN_CENTER);
+  gtk_widget_set_tooltip_text(cancel, "Cancel");
+  gtk_widget_add_css_class(cancel, "flat");
+  g_signal_connect(cancel, "clicked", G_CALLBACK(on_cancel_clicked), NULL);
+  adw_action_row_add_suffix(row, cancel);
+  g_object_set_data(G_OBJECT(row), "cancel", cancel);
+
+  set_network_subtitle(row, network);
+  g_signal_connect_object(network, "notify::last-used",
+                          G_CALLBACK(on_network_last_used), row, 0);
 
-  // Add click gesture to the row
   GtkGesture *click = gtk_gesture_click_new();
   g_signal_connect(click, "pressed", G_CALLBACK(on_row_clicked), row);
   gtk_widget_add_controller(GTK_WIDGET(row), GTK_EVENT_CONTROLLER(click));
 
-  // Print debug info
-  g_print("DEBUG: Created row for network: %s\n", ssid);
-
-  GtkImage *signal_icon = GTK_IMAGE(
-      gtk_image_new_from_icon_name(get_signal_icon_name(signal_strength)));
-  gtk_widget_set_valign(GTK_WIDGET(signal_icon), GTK_ALIGN_CENTER);
-  adw_action_row_add_suffix(row, GTK_WIDGET(signal_icon));
+  // The history of the access point the row stands for at the moment
+  GtkWidget *sparkline = wifi_sparkline_new();
+  gtk_widget_set_valign(sparkline, GTK_ALIGN_CENTER);
+  wifi_sparkline_set_bssid(WIFI_SPARKLINE(sparkline),
+                           wifi_network_item_get_bssid(network));
+  adw_action_row_add_suffix(row, sparkline);
+  g_signal_connect_object(network, "notify::bssid",
+                          G_CALLBACK(on_network_bssid), sparkline, 0);
+
+  GtkWidget *signal_icon = gtk_image_new_from_icon_name(
+      get_signal_icon_name(wifi_network_item_get_strength(network)));
+  gtk_widget_set_valign(signal_icon, GTK_ALIGN_CENTER);
+  adw_action_row_add_suffix(row, signal_icon);
+  g_signal_connect_object(network, "notify::strength",
+                          G_CALLBACK(on_network_strength), signal_icon, 0);
 
   return GTK_WIDGET(row);
 }
-static void clear_list_box(GtkListBox *list_box) {
-  GtkWidget *child;
-  while ((child = gtk_widget_get_first_child(GTK_WIDGET(list_box))) != NULL) {
-    gtk_list_box_remove(list_box, child);
-  }
+
+// Profiles never used still rank above unsaved networks
+static guint64 profile_last_used(const gchar *ssid, WifiSecurity security) {
+  const WifiProfile *profile = wifi_nm_lookup_profile(ssid, security);
+
+  return profile != NULL ? MAX(profile->timestamp, 1) : 0;
 }
 
-static void update_wifi_networks_list(GtkListBox *list_box) {
-  refresh_wifi_networks(list_box);
+// Every reported value is a sample; the history thins them out. Only the
+// access point in use has a bit rate.
+static void record_history(const WifiAccessPoint *ap) {
+  gboolean in_use = ap == wifi_nm_active() &&
+                    wifi_nm_get_link() == WIFI_LINK_CONNECTED;
+
+  wifi_history_record(ap->bssid, ap->strength,
+                      in_use ? wifi_nm_get_bitrate() : 0, ap->frequency);
 }
 
-static void refresh_wifi_networks(GtkListBox *list_box) {
-  ScanData *scan_data = g_new0(ScanData, 1);
-  scan_data->list_box = list_box;
-  scan_data->cancellable = g_cancellable_new();
+// NetworkManager's list, for after (re)connecting
+static void sync_networks_from_nm(void) {
+  g_autoptr(GPtrArray) access_points = wifi_nm_access_points();
 
-  GTask *task =
-      g_task_new(NULL, scan_data->cancellable, wifi_scan_complete, scan_data);
+  wifi_networks_begin();
+  for (guint i = 0; i < access_points->len; i++) {
+    wifi_networks_update(access_points->pdata[i]);
+    record_history(access_points->pdata[i]);
+  }
+  wifi_networks_end();
+}
+
+// The task keeps the scheduler's cancellable until the scan completes
+static void refresh_wifi_networks(GCancellable *cancellable,
+                                  gpointer user_data) {
+  GTask *task = g_task_new(NULL, cancellable, wifi_scan_complete, NULL);
   g_task_run_in_thread(task, wifi_scan_thread);
   g_object_unref(task);
 }
 
-static gboolean on_refresh_timeout(gpointer user_data) {
-  GtkListBox *list_box = GTK_LIST_BOX(user_data);
-  refresh_wifi_networks(list_box);
-  return G_SOURCE_CONTINUE;
+static const RefreshJob wifi_scan_job = {
+    .name = "wifi scan",
+    .interval = WIFI_SCAN_INTERVAL,
+    .max_interval = WIFI_SCAN_MAX_INTERVAL,
+    .run = refresh_wifi_networks,
+};
+
+// Results come in as access point changes, so the run is over once asked.
+// Signal strengths move all the time; only access points coming or going
+// since the last run count as a change.
+static void request_nm_scan(GCancellable *cancellable, gpointer user_data) {
+  static guint last_seen = 0;
+  g_autoptr(GPtrArray) access_points = wifi_nm_access_points();
+  guint seen = access_points->len;
+
+  for (guint i = 0; i < access_points->len; i++)
+    seen ^= g_str_hash(((WifiAccessPoint *)access_points->pdata[i])->path);
+
+  wifi_nm_request_scan();
+  refresh_done(cancellable, seen != last_seen);
+  last_seen = seen;
 }
-// static gboolean on_refresh_timeout(gpointer user_data) {
-//     InitData *init_data = (InitData *)user_data;
-
-//     // Refresh both list and current status
-//     refresh_wifi_networks(init_data->wifi_list);
-//     update_current_network(init_data->builder);
 
-//     return G_SOURCE_CONTINUE;
-// }
+static const RefreshJob wifi_nm_scan_job = {
+    .name = "wifi nm scan",
+    .interval = WIFI_SCAN_INTERVAL,
+    .max_interval = WIFI_SCAN_MAX_INTERVAL,
+    .run = request_nm_scan,
+};
 
 void change_panel_to_wifi(gpointer user_data) {
   GtkStack *stack = GTK_STACK(user_data);
@@ -254,25 +387,32 @@ static void on_wifi_switch_active(GObject *wifi_switch, GParamSpec *pspec,
   gboolean is_active;
   g_object_get(wifi_switch, "active", &is_active, NULL);
 
-  GTask *task = g_task_new(NULL, NULL, wifi_toggle_complete, wifi_switch);
-  g_task_set_task_data(task, GINT_TO_POINTER(is_active), NULL);
-  g_task_run_in_thread(task, wifi_toggle_thread);
-  g_object_unref(task);
+  if (!use_nmcli) {
+    wifi_nm_set_radio(is_active);
+    return;
+  }
+
+  // Rapid flicks only write the final position
+  const gchar *argv[] = {"nmcli", "radio", "wifi", is_active ? "on" : "off",
+                         NULL};
+  command_set("wifi-radio", argv);
 }
 
 static void wifi_status_thread(GTask *task, gpointer source_object,
                                gpointer task_data, GCancellable *cancellable) {
+  g_auto(CommandStatsSpan) span = command_stats_begin("task wifi status");
   GError *error = NULL;
-  gchar *output = NULL;
+  const gchar *argv[] = {"nmcli", "radio", "wifi", NULL};
 
-  if (!g_spawn_command_line_sync("nmcli radio wifi", &output, NULL, NULL,
-                                 &error)) {
+  CommandResult *result =
+      command_query_sync(argv, WIFI_QUERY_TTL, cancellable, &error);
+  if (error) {
     g_task_return_error(task, error);
     return;
   }
 
-  gboolean wifi_enabled = (g_strstr_len(output, -1, "enabled") != NULL);
-  g_free(output);
+  gboolean wifi_enabled = (g_strstr_len(result->out, -1, "enabled") != NULL);
+  command_result_free(result);
   g_task_return_boolean(task, wifi_enabled);
 }
 
@@ -290,33 +430,14 @@ static void wifi_status_complete(GObject *source_object, GAsyncResult *result,
   complete_initialization(init_data);
 }
 
-static gboolean get_wifi_status(void) {
-  gchar *command = "nmcli radio wifi";
-  gchar *output = NULL;
-  GError *error = NULL;
-  gint exit_status;
-
-  g_spawn_command_line_sync(command, &output, NULL, &exit_status, &error);
-
-  if (error) {
-    g_printerr("Failed to get Wi-Fi status: %s\n", error->message);
-    g_error_free(error);
-    return FALSE;
-  }
-
-  gboolean wifi_enabled = (g_strstr_len(output, -1, "enabled") != NULL);
-  g_free(output);
-  return wifi_enabled;
-}
-
 static void get_thread_wifi_status(GTask *task, gpointer source_obj,
                           gpointer task_data, GCancellable *cancellable) {
-  gchar *command = "nmcli radio wifi";
-  gchar *output = NULL;
+  g_auto(CommandStatsSpan) span = command_stats_begin("task wifi status");
+  const gchar *argv[] = {"nmcli", "radio", "wifi", NULL};
   GError *error = NULL;
-  gint exit_status;
 
-  g_spawn_command_line_sync(command, &output, NULL, &exit_status, &error);
+  CommandResult *result =
+      command_query_sync(argv, WIFI_QUERY_TTL, cancellable, &error);
 
   if (error) {
     g_printerr("Failed to get Wi-Fi status: %s\n", error->message);
@@ -325,8 +446,8 @@ static void get_thread_wifi_status(GTask *task, gpointer source_obj,
     return;
   }
 
-  gboolean wifi_enabled = (g_strstr_len(output, -1, "enabled") != NULL);
-  g_free(output);
+  gboolean wifi_enabled = (g_strstr_len(result->out, -1, "enabled") != NULL);
+  command_result_free(result);
   g_task_return_boolean(task, wifi_enabled);
 }
 
@@ -338,11 +459,22 @@ static void change_wifi_status(GObject *source, GAsyncResult *res, gpointer user
 
   if (error) {
     g_printerr("Error getting Wi-Fi status: %s\n", error->message);
-    g_error_free(error);
     return;
   }
 
-  g_object_set(wifi_switch, "active", status, NULL);
+  set_wifi_switch_state(wifi_switch, status);
+}
+
+// The last toggle failed: put the switch back to the radio's real state
+static void on_wifi_radio_settled(const gchar *target, gboolean success,
+                                  gpointer user_data) {
+  if (success)
+    return;
+
+  g_warning("Failed to toggle WiFi");
+  GTask *task = g_task_new(NULL, NULL, change_wifi_status, user_data);
+  g_task_run_in_thread(task, get_thread_wifi_status);
+  g_object_unref(task);
 }
 
 static void set_wifi_initial_state(GtkWidget *window, gpointer data) {
@@ -351,52 +483,59 @@ static void set_wifi_initial_state(GtkWidget *window, gpointer data) {
   g_task_run_in_thread(task, get_thread_wifi_status);
 }
 
+// Show the radio state without writing it back
 static void set_wifi_switch_state(GtkWidget *wifi_switch, gboolean is_active) {
+  if (wifi_switch == NULL)
+    return;
+  g_signal_handlers_block_by_func(wifi_switch, on_wifi_switch_active, NULL);
   g_object_set(wifi_switch, "active", is_active, NULL);
-}
-
-static void toggle_wifi(gboolean enable) {
-  gchar *command =
-      g_strdup_printf("nmcli radio wifi %s", enable ? "on" : "off");
-  g_print("Executing command: %s\n", command);
-
-  GError *error = NULL;
-  gint exit_status;
-  g_spawn_command_line_sync(command, NULL, NULL, &exit_status, &error);
-  g_free(command);
-
-  if (error) {
-    g_printerr("Failed to toggle Wi-Fi: %s\n", error->message);
-    g_error_free(error);
-  }
+  g_signal_handlers_unblock_by_func(wifi_switch, on_wifi_switch_active, NULL);
 }
 
 // Modify the row click handler to initiate connection
 static void on_row_clicked(GtkGestureClick *gesture, gint n_press, gdouble x,
                            gdouble y, gpointer user_data) {
-  AdwActionRow *row = ADW_ACTION_ROW(user_data);
-  if (row) {
-    const char *ssid = adw_preferences_row_get_title(ADW_PREFERENCES_ROW(row));
-    const char *subtitle = adw_action_row_get_subtitle(row);
-    gboolean is_secured = g_str_has_prefix(subtitle, "Secured");
+  WifiNetworkItem *network =
+      user_data ? g_object_get_data(G_OBJECT(user_data), "network") : NULL;
+  if (network) {
+    const char *ssid = wifi_network_item_get_ssid(network);
+    WifiSecurity security = wifi_network_item_get_security(network);
+    // The strongest access point of the network at the time of the click
+    const char *ap_path = wifi_network_item_get_access_point(network);
+    const WifiProfile *profile =
+        use_nmcli ? NULL : wifi_nm_lookup_profile(ssid, security);
+
+    // Its row has a cancel button meanwhile
+    if (wifi_attempt_in_progress() && wifi_attempt_is_for(ssid, security))
+      return;
+
+    // NetworkManager has the secrets of saved networks already
+    if (profile != NULL) {
+      wifi_attempt_start_profile(ssid, security, profile->uuid, ap_path,
+                                 NULL);
+      return;
+    }
 
     g_print("Attempting to connect to: %s\n", ssid);
-    connect_to_network(ssid, is_secured);
+    connect_to_network(ssid, ap_path, security);
   }
 }
 
-// Function to handle network connection
-static void connect_to_network(const char *ssid, gboolean is_secured) {
-  if (is_secured) {
-    show_password_dialog(ssid);
+// Function to handle network connection. ap_path is the access point's
+// D-Bus path, NULL for rows listed by nmcli.
+static void connect_to_network(const char *ssid, const char *ap_path,
+                               WifiSecurity security) {
+  if (security != WIFI_SECURITY_NONE) {
+    show_password_dialog(ssid, ap_path, security);
   } else {
     // Connect directly to open network
-    connect_with_password(ssid, NULL);
+    connect_with_password(ssid, ap_path, security, NULL);
   }
 }
 
 // Function to show password dialog for secured networks
-static void show_password_dialog(const char *ssid) {
+static void show_password_dialog(const char *ssid, const char *ap_path,
+                                 WifiSecurity security) {
   GtkWidget *dialog;
   GtkWidget *content_area;
   GtkWidget *password_entry;
@@ -435,6 +574,9 @@ static void show_password_dialog(const char *ssid) {
   gtk_box_append(GTK_BOX(content_area), box);
 
   // Connect response signal
+  g_object_set_data_full(G_OBJECT(dialog), "access-point", g_strdup(ap_path),
+                         g_free);
+  g_object_set_data(G_OBJECT(dialog), "security", GINT_TO_POINTER(security));
   g_signal_connect(dialog, "response", G_CALLBACK(on_password_dialog_response),
                    (gpointer)g_strdup(ssid));
 
@@ -453,90 +595,234 @@ static void on_password_dialog_response(GtkDialog *dialog, gint response_id,
     GtkWidget *password_entry = gtk_widget_get_last_child(box);
 
     const char *password = gtk_editable_get_text(GTK_EDITABLE(password_entry));
-    connect_with_password(ssid, password);
+    connect_with_password(
+        ssid, g_object_get_data(G_OBJECT(dialog), "access-point"),
+        GPOINTER_TO_INT(g_object_get_data(G_OBJECT(dialog), "security")),
+        password);
   }
 
   g_free(ssid);
   gtk_window_destroy(GTK_WINDOW(dialog));
 }
 
-// Function to actually connect to the network
-static void connect_with_password(const char *ssid, const char *password) {
-  GError *error = NULL;
-  char *command;
+// The password was wrong, or a saved profile's no longer works: ask again.
+// The answer goes into the profile if the network has one.
+static void on_attempt_needs_secrets(const gchar *ssid, WifiSecurity security,
+                                     const gchar *ap_path, gpointer user_data) {
+  show_password_dialog(ssid, ap_path, security);
+}
 
-  if (password) {
-    command = g_strdup_printf("nmcli dev wifi connect '%s' password '%s' ",
-                              ssid, password);
-  } else {
-    command = g_strdup_printf("nmcli device wifi connect '%s'", ssid);
+// Progress and the outcome show on the network's row; the request runs on
+// the main loop and never waits there
+static void connect_with_password(const char *ssid, const char *ap_path,
+                                  WifiSecurity security, const char *password) {
+  const WifiProfile *profile =
+      use_nmcli ? NULL : wifi_nm_lookup_profile(ssid, security);
+
+  // A saved profile whose password was refused gets the new one
+  if (profile != NULL)
+    wifi_attempt_start_profile(ssid, security, profile->uuid, ap_path,
+                               password);
+  else if (!use_nmcli && ap_path != NULL)
+    wifi_attempt_start(ssid, security, ap_path, password);
+  else
+    wifi_attempt_start_nmcli(ssid, security, password);
+}
+
+static void show_current_network(const char *title, const char *subtitle,
+                                 const char *icon_name) {
+  adw_preferences_row_set_title(ADW_PREFERENCES_ROW(CurrentRow), title);
+  adw_action_row_set_subtitle(ADW_ACTION_ROW(CurrentRow), subtitle);
+  gtk_image_set_from_icon_name(GTK_IMAGE(CurrentIcon), icon_name);
+}
+
+static void on_current_network_ready(GObject *source, GAsyncResult *res,
+                                     gpointer user_data) {
+  GtkBuilder *builder = GTK_BUILDER(user_data);
+  g_autoptr(GError) error = NULL;
+  g_autoptr(CommandResult) result = command_query_finish(res, &error);
+
+  if (error) {
+    g_warning("Failed to get current network: %s", error->message);
+    g_object_unref(builder);
+    return;
   }
 
-  g_print("Executing: %s\n", command);
+  LineReader reader;
+  StrView line, fields[2];
+  char ssid[128];
+  gboolean connected = FALSE;
 
-  gchar *output = NULL;
-  if (!g_spawn_command_line_sync(command, &output, NULL, NULL, &error)) {
-    g_print("Failed to connect: %s\n", error->message);
-    g_error_free(error);
-  } else {
-    g_print("Connection output: %s\n", output);
+  line_reader_init(&reader, result->out, result->out_len);
+  while (line_reader_next(&reader, &line)) {
+    if (nmcli_split(line, fields, 2) >= 2 && str_view_equal(fields[0], "yes")) {
+      nmcli_unescape(fields[1], ssid, sizeof(ssid));
+      show_current_network(ssid, "Connected",
+                           "network-wireless-signal-excellent-symbolic");
+      connected = TRUE;
+      break;
+    }
   }
 
-  // if (!error) {
-  //     g_print("Connected successfully!\n");
-  //     // Update network list and current connection
-  //     refresh_wifi_networks(init_data->wifi_list);
-  //     update_current_network(init_data->builder);
-  // }
+  if (!connected)
+    show_current_network("Not Connected", "No active network connection",
+                         "network-wireless-offline-symbolic");
 
-  g_free(command);
-  g_free(output);
+  g_object_unref(builder);
 }
 
 static void update_current_network(GtkBuilder *builder) {
-  GError *error = NULL;
-  gchar *output = NULL;
-  GtkWidget *current_row =
-      GTK_WIDGET(gtk_builder_get_object(builder, "current_network_row"));
-  GtkWidget *current_icon =
-      GTK_WIDGET(gtk_builder_get_object(builder, "current_network_icon"));
-
-  if (!g_spawn_command_line_sync("nmcli -t -f active,ssid dev wifi", &output,
-                                 NULL, NULL, &error)) {
-    g_warning("Failed to get current network: %s", error->message);
-    g_error_free(error);
+  const gchar *argv[] = {"nmcli", "-t", "-f", "active,ssid", "dev", "wifi",
+                         NULL};
+  command_query_async(argv, WIFI_QUERY_TTL, NULL, on_current_network_ready,
+                      g_object_ref(builder));
+}
+
+// One line of `nmcli monitor`, e.g. "wlan0: connected" or
+// "'Home' is now the primary connection"
+static void on_network_event(const gchar *line, gpointer user_data) {
+  GtkBuilder *builder = GTK_BUILDER(user_data);
+
+  if (!strstr(line, "connected") && !strstr(line, "connecting") &&
+      !strstr(line, "primary connection"))
     return;
+
+  command_cache_invalidate("nmcli");
+  update_current_network(builder);
+}
+
+static const char *link_label(WifiLink link) {
+  switch (link) {
+  case WIFI_LINK_ASSOCIATING:
+    return "Connecting…";
+  case WIFI_LINK_AUTHENTICATING:
+    return "Authenticating…";
+  case WIFI_LINK_CONFIGURING:
+    return "Getting an address…";
+  case WIFI_LINK_CONNECTED:
+    return "Connected";
+  default:
+    return NULL;
   }
+}
 
-  gchar **lines = g_strsplit(output, "\n", -1);
-  gboolean connected = FALSE;
+// The history of the access point in use, while there is one
+static void show_current_history(const char *bssid) {
+  if (CurrentSparkline == NULL)
+    return;
+  wifi_sparkline_set_bssid(WIFI_SPARKLINE(CurrentSparkline), bssid);
+  gtk_widget_set_visible(CurrentSparkline, bssid != NULL);
+}
 
-  for (int i = 0; lines[i] != NULL; i++) {
-    gchar **fields = g_strsplit(lines[i], ":", 2);
-    if (g_strv_length(fields) >= 2 && g_strcmp0(fields[0], "yes") == 0) {
-      adw_preferences_row_set_title(ADW_PREFERENCES_ROW(current_row),
-                                    fields[1]);
-      adw_action_row_set_subtitle(ADW_ACTION_ROW(current_row), "Connected");
-      gtk_image_set_from_icon_name(
-          GTK_IMAGE(current_icon),
-          "network-wireless-signal-excellent-symbolic");
-      connected = TRUE;
-      break;
-    }
-    g_strfreev(fields);
+static void show_nm_current_network(void) {
+  const WifiAccessPoint *ap = wifi_nm_active();
+  WifiLink link = wifi_nm_get_link();
+  const char *label = link_label(link);
+
+  show_current_history(ap != NULL && link == WIFI_LINK_CONNECTED ? ap->bssid
+                                                                 : NULL);
+  if (ap == NULL || label == NULL) {
+    show_current_network("Not Connected",
+                         link == WIFI_LINK_FAILED
+                             ? "The last connection attempt failed"
+                             : "No active network connection",
+                         "network-wireless-offline-symbolic");
+    return;
   }
+  show_current_network(ap->ssid, label,
+                       link == WIFI_LINK_CONNECTED
+                           ? get_signal_icon_name(ap->strength)
+                           : "network-wireless-acquiring-symbolic");
+}
+
+// Poll nmcli and follow `nmcli monitor` instead of NetworkManager's D-Bus API
+static void start_nmcli_fallback(GtkBuilder *builder) {
+  static const gchar *monitor_argv[] = {"nmcli", "monitor", NULL};
+
+  use_nmcli = TRUE;
+  wifi_nm_unlisten(nm_listener);
+  nm_listener = 0;
 
-  if (!connected) {
-    adw_preferences_row_set_title(ADW_PREFERENCES_ROW(current_row),
-                                  "Not Connected");
-    adw_action_row_set_subtitle(ADW_ACTION_ROW(current_row),
-                                "No active network connection");
-    gtk_image_set_from_icon_name(GTK_IMAGE(current_icon),
-                                 "network-wireless-offline-symbolic");
+  // Nothing on this page works without nmcli then; leave it greyed out
+  // rather than spawning commands that cannot run
+  if (!capabilities()->nmcli) {
+    g_print("Wi-Fi settings need NetworkManager or nmcli\n");
+    gtk_widget_set_sensitive(WifiPage, FALSE);
+    return;
   }
 
-  g_strfreev(lines);
-  g_free(output);
+  if (WifiSwitch != NULL)
+    command_set_connect_settled("wifi-radio", on_wifi_radio_settled,
+                                WifiSwitch);
+
+  // Scans start right away while the page is on screen and stop when it is
+  // not
+  if (WifiList != NULL) {
+    scan_job = refresh_add(WifiPage, &wifi_scan_job, NULL);
+    update_current_network(builder);
+  }
+
+  // Follow connection changes pushed by NetworkManager; the page lives for the
+  // rest of the session, so the subscription keeps its own builder reference
+  coprocess_subscribe(coprocess_get(monitor_argv), NULL, on_network_event,
+                      g_object_ref(builder));
+
+  InitData *init_data = g_new0(InitData, 1);
+  init_data->builder = g_object_ref(builder);
+  init_data->wifi_switch = WifiSwitch;
+  init_data->wifi_list = WifiList;
+
+  // Start async initialization chain for additional setup
+  GTask *wifi_task = g_task_new(NULL, NULL, wifi_status_complete, init_data);
+  g_task_run_in_thread(wifi_task, wifi_status_thread);
+  g_object_unref(wifi_task);
+}
+
+// Every change touches only what it concerns
+static void on_wifi_change(WifiChange change, const WifiAccessPoint *ap,
+                           gpointer user_data) {
+  switch (change) {
+  case WIFI_CHANGE_STATE:
+    if (wifi_nm_get_state() == WIFI_NM_READY) {
+      nm_was_ready = TRUE;
+      set_wifi_switch_state(WifiSwitch, wifi_nm_get_radio());
+      sync_networks_from_nm();
+      show_nm_current_network();
+      // Scans while the page is on screen, like the nmcli path
+      if (scan_job == 0)
+        scan_job = refresh_add(WifiPage, &wifi_nm_scan_job, NULL);
+      else
+        wifi_nm_request_scan();
+    } else if (!nm_was_ready) {
+      start_nmcli_fallback(GTK_BUILDER(user_data));
+    } else {
+      wifi_networks_clear();
+      show_nm_current_network();
+    }
+    break;
+  case WIFI_CHANGE_RADIO:
+    set_wifi_switch_state(WifiSwitch, wifi_nm_get_radio());
+    break;
+  case WIFI_CHANGE_AP:
+  case WIFI_CHANGE_AP_REMOVED:
+    if (change == WIFI_CHANGE_AP) {
+      wifi_networks_update(ap);
+      record_history(ap);
+    } else {
+      wifi_networks_remove(ap->path);
+    }
+    if (ap == wifi_nm_active())
+      show_nm_current_network();
+    break;
+  case WIFI_CHANGE_LINK:
+    if (wifi_nm_active() != NULL)
+      record_history(wifi_nm_active());
+    show_nm_current_network();
+    break;
+  case WIFI_CHANGE_PROFILES:
+    wifi_networks_rerank();
+    break;
+  }
 }
 
 static void wifi_to_stack(GtkStack *stack) {
@@ -552,6 +838,9 @@ static void wifi_to_stack(GtkStack *stack) {
   GtkBuilder *wifi_builder = NULL;
   size_t num_paths = sizeof(ui_paths) / sizeof(ui_paths[0]);
 
+  // wifi.ui refers to the sparkline by its type name
+  g_type_ensure(WIFI_TYPE_SPARKLINE);
+
   for (size_t i = 0; i < num_paths; i++) {
     if (g_file_test(ui_paths[i], G_FILE_TEST_EXISTS)) {
       wifi_builder = gtk_builder_new_from_file(ui_paths[i]);
@@ -582,46 +871,49 @@ static void wifi_to_stack(GtkStack *stack) {
   gtk_widget_set_visible(WifiPage, TRUE);
   gtk_stack_set_visible_child_name(stack, "wifi_page");
 
-  InitData *init_data = g_new0(InitData, 1);
-  init_data->stack = stack;
-  init_data->builder = wifi_builder;
-
-  init_data->wifi_switch =
-      GTK_WIDGET(gtk_builder_get_object(wifi_builder, "wifi_switch"));
-  if (init_data->wifi_switch != NULL) {
-    g_signal_connect(init_data->wifi_switch, "notify::active",
+  WifiSwitch = GTK_WIDGET(gtk_builder_get_object(wifi_builder, "wifi_switch"));
+  if (WifiSwitch != NULL)
+    g_signal_connect(WifiSwitch, "notify::active",
                      G_CALLBACK(on_wifi_switch_active), NULL);
-  }
 
-  init_data->wifi_list =
+  WifiList =
       GTK_LIST_BOX(gtk_builder_get_object(wifi_builder, "wifi_networks_list"));
-  if (init_data->wifi_list != NULL) {
-    g_print("DEBUG: Found wifi_list\n");
+  if (WifiList != NULL) {
+    wifi_attempt_set_changed_func(on_attempt_changed, NULL);
+    wifi_attempt_set_secrets_func(on_attempt_needs_secrets, NULL);
+    gtk_list_box_bind_model(WifiList, wifi_network_list(), create_network_row,
+                            NULL, NULL);
 
     // Add a direct click handler to the list box as well
     GtkGesture *list_click = gtk_gesture_click_new();
     g_signal_connect(list_click, "pressed", G_CALLBACK(on_row_clicked), NULL);
-    gtk_widget_add_controller(GTK_WIDGET(init_data->wifi_list),
+    gtk_widget_add_controller(GTK_WIDGET(WifiList),
                               GTK_EVENT_CONTROLLER(list_click));
-
-    refresh_wifi_networks(init_data->wifi_list);
   }
 
-  // Start immediate network scan
-  if (init_data->wifi_list != NULL) {
-    refresh_wifi_networks(init_data->wifi_list);
-    update_current_network(init_data->builder);
+  CurrentRow =
+      GTK_WIDGET(gtk_builder_get_object(wifi_builder, "current_network_row"));
+  CurrentIcon =
+      GTK_WIDGET(gtk_builder_get_object(wifi_builder, "current_network_icon"));
+  CurrentSparkline = GTK_WIDGET(
+      gtk_builder_get_object(wifi_builder, "current_network_sparkline"));
+
+  // Talk to NetworkManager directly and follow its signals: the list fills in
+  // as access points arrive and stays current without polling. Without
+  // NetworkManager on the bus this falls back to nmcli. The listener keeps
+  // its own builder reference for the rest of the session.
+  if (capabilities()->network_manager) {
+    wifi_networks_set_last_used_func(profile_last_used);
+    nm_listener = wifi_nm_listen(on_wifi_change, g_object_ref(wifi_builder));
+    wifi_nm_connect();
+  } else {
+    start_nmcli_fallback(wifi_builder);
   }
-
-  // Start async initialization chain for additional setup
-  GTask *wifi_task = g_task_new(NULL, NULL, wifi_status_complete, init_data);
-  g_task_run_in_thread(
-      wifi_task, wifi_status_thread); // Fixed: changed 'task' to 'wifi_task'
-  g_object_unref(wifi_task);
+  g_object_unref(wifi_builder);
 }
 void cleanup_wifi(void) {
-  if (refresh_timeout_id > 0) {
-    g_source_remove(refresh_timeout_id);
-    refresh_timeout_id = 0;
-  }
+  refresh_remove(scan_job);
+  scan_job = 0;
+  wifi_nm_unlisten(nm_listener);
+  nm_listener = 0;
 }
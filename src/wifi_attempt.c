@@ -0,0 +1,280 @@
+#include "wifi/attempt.h"
+#include "command/cache.h"
+#include "command/command.h"
+#include "command/stats.h"
+
+// Association, authentication and DHCP together; DHCP alone may take 30 s
+#define WIFI_ATTEMPT_TIMEOUT 60
+
+typedef struct {
+  guint serial; // tells the answers to replaced attempts apart
+  gchar *ssid;
+  WifiSecurity security;
+  gchar *ap_path;
+  WifiAttemptState state;
+  gchar *reason;             // why it failed
+  gboolean nmcli;
+  GCancellable *cancellable; // the nmcli run, while in flight
+  gchar *active_connection;  // NetworkManager's, once it took the request
+  gboolean left_previous;    // the device left the link it had before
+  guint timeout_id;
+  gint64 start;
+} Attempt;
+
+static Attempt attempt;
+static guint nm_listener = 0;
+static WifiAttemptFunc changed_func = NULL;
+static gpointer changed_data = NULL;
+static WifiAttemptSecretsFunc secrets_func = NULL;
+static gpointer secrets_data = NULL;
+
+void wifi_attempt_set_changed_func(WifiAttemptFunc func, gpointer user_data) {
+  changed_func = func;
+  changed_data = user_data;
+}
+
+void wifi_attempt_set_secrets_func(WifiAttemptSecretsFunc func,
+                                   gpointer user_data) {
+  secrets_func = func;
+  secrets_data = user_data;
+}
+
+static void set_state(WifiAttemptState state) {
+  if (attempt.state == state)
+    return;
+  attempt.state = state;
+  if (changed_func != NULL)
+    changed_func(changed_data);
+}
+
+static void finish(WifiAttemptState state, const gchar *reason) {
+  g_clear_handle_id(&attempt.timeout_id, g_source_remove);
+  g_clear_object(&attempt.cancellable);
+  g_free(attempt.reason);
+  attempt.reason = g_strdup(reason);
+
+  if (state == WIFI_ATTEMPT_CONNECTED)
+    command_stats_add("wifi connect", g_get_monotonic_time() - attempt.start,
+                      0, FALSE);
+  else if (state == WIFI_ATTEMPT_FAILED)
+    g_printerr("Failed to connect to %s: %s\n", attempt.ssid,
+               reason != NULL ? reason : "unknown error");
+  set_state(state);
+}
+
+// Also what the timeout does, with another outcome
+static void give_up(WifiAttemptState state) {
+  if (attempt.cancellable != NULL)
+    g_cancellable_cancel(attempt.cancellable);
+  if (attempt.active_connection != NULL)
+    wifi_nm_deactivate(attempt.active_connection);
+  finish(state, NULL);
+}
+
+static gboolean on_timeout(gpointer user_data) {
+  attempt.timeout_id = 0;
+  give_up(WIFI_ATTEMPT_TIMED_OUT);
+  return G_SOURCE_REMOVE;
+}
+
+// The device goes through its states for the connection it is leaving
+// first, and those say nothing about this attempt
+static void on_nm_change(WifiChange change, const WifiAccessPoint *ap,
+                         gpointer user_data) {
+  const WifiAccessPoint *active;
+
+  if (!wifi_attempt_in_progress() || attempt.nmcli)
+    return;
+  if (change == WIFI_CHANGE_STATE && wifi_nm_get_state() != WIFI_NM_READY) {
+    finish(WIFI_ATTEMPT_FAILED, "NetworkManager went away");
+    return;
+  }
+  if (change != WIFI_CHANGE_LINK)
+    return;
+
+  switch (wifi_nm_get_link()) {
+  case WIFI_LINK_ASSOCIATING:
+    attempt.left_previous = TRUE;
+    set_state(WIFI_ATTEMPT_ASSOCIATING);
+    break;
+  case WIFI_LINK_AUTHENTICATING:
+    attempt.left_previous = TRUE;
+    set_state(WIFI_ATTEMPT_AUTHENTICATING);
+    break;
+  case WIFI_LINK_CONFIGURING:
+    attempt.left_previous = TRUE;
+    set_state(WIFI_ATTEMPT_OBTAINING_IP);
+    break;
+  case WIFI_LINK_CONNECTED:
+    if (!attempt.left_previous)
+      break;
+    active = wifi_nm_active();
+    if (active == NULL || g_strcmp0(active->ssid, attempt.ssid) == 0)
+      finish(WIFI_ATTEMPT_CONNECTED, NULL);
+    else
+      finish(WIFI_ATTEMPT_FAILED, "Another network was joined instead");
+    break;
+  case WIFI_LINK_FAILED:
+    if (!attempt.left_previous)
+      break;
+    finish(WIFI_ATTEMPT_FAILED, wifi_nm_get_failure());
+    // Asked after the row shows the failure; the answer starts a new attempt
+    if (wifi_nm_failure_needs_secrets() && secrets_func != NULL &&
+        attempt.security != WIFI_SECURITY_NONE)
+      secrets_func(attempt.ssid, attempt.security, attempt.ap_path,
+                   secrets_data);
+    break;
+  case WIFI_LINK_DISCONNECTED:
+    if (attempt.left_previous)
+      finish(WIFI_ATTEMPT_FAILED, "The connection was dropped");
+    break;
+  case WIFI_LINK_UNAVAILABLE:
+    finish(WIFI_ATTEMPT_FAILED, "Wi-Fi is off");
+    break;
+  }
+}
+
+// A replaced attempt is not taken back: the device drops it for the new one
+static guint begin(const gchar *ssid, WifiSecurity security,
+                   const gchar *ap_path, gboolean nmcli) {
+  if (attempt.cancellable != NULL)
+    g_cancellable_cancel(attempt.cancellable);
+  g_clear_object(&attempt.cancellable);
+  g_clear_handle_id(&attempt.timeout_id, g_source_remove);
+  g_clear_pointer(&attempt.active_connection, g_free);
+  g_clear_pointer(&attempt.reason, g_free);
+  g_free(attempt.ssid);
+  g_free(attempt.ap_path);
+
+  attempt.serial++;
+  attempt.ssid = g_strdup(ssid);
+  attempt.security = security;
+  attempt.ap_path = g_strdup(ap_path);
+  attempt.nmcli = nmcli;
+  attempt.left_previous = FALSE;
+  attempt.start = g_get_monotonic_time();
+  attempt.timeout_id =
+      g_timeout_add_seconds(WIFI_ATTEMPT_TIMEOUT, on_timeout, NULL);
+  if (!nmcli && nm_listener == 0)
+    nm_listener = wifi_nm_listen(on_nm_change, NULL);
+
+  // Listeners hear of every new attempt, also after one for the same network
+  attempt.state = WIFI_ATTEMPT_NONE;
+  set_state(WIFI_ATTEMPT_STARTING);
+  return attempt.serial;
+}
+
+// The request is not cancelled with the attempt, so that an activation
+// NetworkManager started meanwhile can still be taken down here
+static void on_activated(GObject *source, GAsyncResult *res,
+                         gpointer user_data) {
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *active_connection = wifi_nm_activate_finish(res, &error);
+
+  if (GPOINTER_TO_UINT(user_data) != attempt.serial)
+    return;
+
+  if (active_connection == NULL) {
+    if (wifi_attempt_in_progress())
+      finish(WIFI_ATTEMPT_FAILED, error->message);
+  } else if (!wifi_attempt_in_progress()) {
+    if (attempt.state != WIFI_ATTEMPT_CONNECTED)
+      wifi_nm_deactivate(active_connection);
+  } else {
+    attempt.active_connection = g_steal_pointer(&active_connection);
+  }
+}
+
+void wifi_attempt_start(const gchar *ssid, WifiSecurity security,
+                        const gchar *ap_path, const gchar *password) {
+  guint serial = begin(ssid, security, ap_path, FALSE);
+
+  wifi_nm_activate_async(ap_path, password, NULL, on_activated,
+                         GUINT_TO_POINTER(serial));
+}
+
+void wifi_attempt_start_profile(const gchar *ssid, WifiSecurity security,
+                                const gchar *uuid, const gchar *ap_path,
+                                const gchar *password) {
+  guint serial = begin(ssid, security, ap_path, FALSE);
+
+  wifi_nm_activate_profile_async(uuid, ap_path, password, NULL, on_activated,
+                                 GUINT_TO_POINTER(serial));
+}
+
+static void on_nmcli_done(GObject *source, GAsyncResult *res,
+                          gpointer user_data) {
+  g_autoptr(GError) error = NULL;
+  g_autoptr(CommandResult) result = command_run_finish(res, &error);
+  g_autofree gchar *reason = NULL;
+
+  command_cache_invalidate("nmcli");
+  if (GPOINTER_TO_UINT(user_data) != attempt.serial ||
+      !wifi_attempt_in_progress())
+    return;
+
+  if (error != NULL) {
+    finish(WIFI_ATTEMPT_FAILED, error->message);
+  } else if (!command_result_success(result)) {
+    reason = g_strstrip(g_strdup(result->err != NULL ? result->err : ""));
+    finish(WIFI_ATTEMPT_FAILED, *reason != '\0' ? reason : NULL);
+  } else {
+    finish(WIFI_ATTEMPT_CONNECTED, NULL);
+  }
+}
+
+// nmcli waits for the whole activation and only then says how it went.
+// Cancelling stops the wait; NetworkManager may still finish joining.
+void wifi_attempt_start_nmcli(const gchar *ssid, WifiSecurity security,
+                              const gchar *password) {
+  // SSID and password are passed as discrete arguments, so quotes in either
+  // cannot break the command
+  const gchar *argv[] = {"nmcli",  "device",   "wifi", "connect",
+                         ssid,     password ? "password" : NULL,
+                         password, NULL};
+  guint serial = begin(ssid, security, NULL, TRUE);
+
+  attempt.cancellable = g_cancellable_new();
+  command_run_async(argv, 0, NULL, NULL, attempt.cancellable, on_nmcli_done,
+                    GUINT_TO_POINTER(serial));
+}
+
+void wifi_attempt_cancel(void) {
+  if (wifi_attempt_in_progress())
+    give_up(WIFI_ATTEMPT_CANCELLED);
+}
+
+WifiAttemptState wifi_attempt_get_state(void) { return attempt.state; }
+
+gboolean wifi_attempt_in_progress(void) {
+  return attempt.state >= WIFI_ATTEMPT_STARTING &&
+         attempt.state <= WIFI_ATTEMPT_OBTAINING_IP;
+}
+
+gboolean wifi_attempt_is_for(const gchar *ssid, WifiSecurity security) {
+  return attempt.state != WIFI_ATTEMPT_NONE && attempt.security == security &&
+         g_strcmp0(attempt.ssid, ssid) == 0;
+}
+
+const gchar *wifi_attempt_get_label(void) {
+  switch (attempt.state) {
+  case WIFI_ATTEMPT_STARTING:
+    return "Connecting…";
+  case WIFI_ATTEMPT_ASSOCIATING:
+    return "Associating…";
+  case WIFI_ATTEMPT_AUTHENTICATING:
+    return "Authenticating…";
+  case WIFI_ATTEMPT_OBTAINING_IP:
+    return "Obtaining an IP address…";
+  case WIFI_ATTEMPT_CONNECTED:
+    return "Connected";
+  case WIFI_ATTEMPT_FAILED:
+    return attempt.reason != NULL ? attempt.reason : "The connection failed";
+  case WIFI_ATTEMPT_CANCELLED:
+    return "Cancelled";
+  case WIFI_ATTEMPT_TIMED_OUT:
+    return "Gave up after a minute";
+  default:
+    return NULL;
+  }
+}
@@ -0,0 +1,135 @@
+#include "wifi/history.h"
+#include "listener/listener.h"
+
+// Access points seen once in passing should not pile up over a long
+// session; past this many, the one heard from longest ago goes
+#define WIFI_HISTORY_MAX_APS 256
+
+struct _WifiHistory {
+  gchar *bssid;
+  guint16 head;   // index of the oldest sample once the ring is full
+  guint16 length;
+  guint16 capacity;
+  WifiSample *samples; // grows up to WIFI_HISTORY_SAMPLES
+};
+
+static GHashTable *histories = NULL; // bssid -> WifiHistory
+static ListenerList listeners;
+
+static void history_free(WifiHistory *history) {
+  g_free(history->bssid);
+  g_free(history->samples);
+  g_free(history);
+}
+
+static WifiSample *newest(WifiHistory *history) {
+  return &history->samples[(history->head + history->length - 1) %
+                           history->capacity];
+}
+
+static void evict_oldest(void) {
+  GHashTableIter iter;
+  gpointer value;
+  WifiHistory *oldest = NULL;
+
+  g_hash_table_iter_init(&iter, histories);
+  while (g_hash_table_iter_next(&iter, NULL, &value)) {
+    WifiHistory *history = value;
+
+    if (oldest == NULL || newest(history)->time < newest(oldest)->time)
+      oldest = history;
+  }
+  if (oldest != NULL)
+    g_hash_table_remove(histories, oldest->bssid);
+}
+
+// bssid is already upper case
+static WifiHistory *history_for(const gchar *bssid) {
+  WifiHistory *history;
+
+  if (histories == NULL)
+    histories = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                      (GDestroyNotify)history_free);
+
+  history = g_hash_table_lookup(histories, bssid);
+  if (history != NULL)
+    return history;
+
+  if (g_hash_table_size(histories) >= WIFI_HISTORY_MAX_APS)
+    evict_oldest();
+  history = g_new0(WifiHistory, 1);
+  history->bssid = g_strdup(bssid);
+  g_hash_table_insert(histories, history->bssid, history);
+  return history;
+}
+
+// Until the ring is full it is a plain array, with head at 0
+static WifiSample *append(WifiHistory *history) {
+  if (history->length < history->capacity)
+    return &history->samples[history->length++];
+  if (history->capacity < WIFI_HISTORY_SAMPLES) {
+    history->capacity = MIN(MAX(history->capacity * 2, 8),
+                            WIFI_HISTORY_SAMPLES);
+    history->samples =
+        g_renew(WifiSample, history->samples, history->capacity);
+    return &history->samples[history->length++];
+  }
+  history->head = (history->head + 1) % history->capacity;
+  return newest(history);
+}
+
+static void call_listener(GCallback func, gpointer user_data, gpointer args) {
+  ((WifiHistoryFunc)func)(args, user_data);
+}
+
+void wifi_history_record(const gchar *bssid, guint strength, guint32 bitrate,
+                         guint32 frequency) {
+  g_autofree gchar *key = NULL;
+  guint32 now = g_get_monotonic_time() / G_USEC_PER_SEC;
+  WifiHistory *history;
+  WifiSample *sample;
+
+  if (bssid == NULL || *bssid == '\0')
+    return;
+
+  key = g_ascii_strup(bssid, -1);
+  history = history_for(key);
+
+  // Values within one interval fold into its sample, which keeps the last
+  if (history->length > 0 &&
+      now - newest(history)->time < WIFI_HISTORY_INTERVAL) {
+    sample = newest(history);
+  } else {
+    sample = append(history);
+    sample->time = now;
+  }
+  sample->strength = MIN(strength, 100);
+  sample->bitrate = MIN(bitrate / 1000, G_MAXUINT16);
+  sample->frequency = MIN(frequency, G_MAXUINT16);
+
+  listener_list_emit(&listeners, call_listener, history->bssid);
+}
+
+const WifiHistory *wifi_history_lookup(const gchar *bssid) {
+  g_autofree gchar *key = NULL;
+
+  if (histories == NULL || bssid == NULL)
+    return NULL;
+  key = g_ascii_strup(bssid, -1);
+  return g_hash_table_lookup(histories, key);
+}
+
+guint wifi_history_length(const WifiHistory *history) {
+  return history != NULL ? history->length : 0;
+}
+
+const WifiSample *wifi_history_nth(const WifiHistory *history, guint index) {
+  g_return_val_if_fail(history != NULL && index < history->length, NULL);
+  return &history->samples[(history->head + index) % history->capacity];
+}
+
+guint wifi_history_listen(WifiHistoryFunc func, gpointer user_data) {
+  return listener_list_add(&listeners, G_CALLBACK(func), user_data);
+}
+
+void wifi_history_unlisten(guint id) { listener_list_remove(&listeners, id); }
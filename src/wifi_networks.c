@@ -0,0 +1,413 @@
+#include "wifi/networks.h"
+
+struct _WifiNetworkItem {
+  GObject parent_instance;
+  gchar *key; // security and SSID
+  gchar *ssid;
+  WifiSecurity security;
+  guint strength;
+  gchar *access_point;
+  gchar *bssid;
+  guint64 last_used;
+  GPtrArray *members; // AccessPoint, owned by the access point table
+};
+
+// One BSSID as the backend reported it
+typedef struct {
+  gchar *key;  // D-Bus path, or the BSSID for nmcli
+  gchar *path; // NULL for nmcli
+  gchar *bssid;
+  guint8 strength;
+  WifiNetworkItem *network;
+  guint generation; // last begin() pass that saw it
+} AccessPoint;
+
+enum {
+  PROP_0,
+  PROP_SSID,
+  PROP_SECURITY,
+  PROP_STRENGTH,
+  PROP_ACCESS_POINT,
+  PROP_BSSID,
+  PROP_LAST_USED,
+  N_PROPS
+};
+
+static GParamSpec *properties[N_PROPS];
+
+G_DEFINE_TYPE(WifiNetworkItem, wifi_network_item, G_TYPE_OBJECT)
+
+static void wifi_network_item_finalize(GObject *object) {
+  WifiNetworkItem *item = WIFI_NETWORK_ITEM(object);
+
+  g_free(item->key);
+  g_free(item->ssid);
+  g_free(item->access_point);
+  g_free(item->bssid);
+  g_ptr_array_unref(item->members);
+  G_OBJECT_CLASS(wifi_network_item_parent_class)->finalize(object);
+}
+
+static void wifi_network_item_get_property(GObject *object, guint prop_id,
+                                           GValue *value, GParamSpec *pspec) {
+  WifiNetworkItem *item = WIFI_NETWORK_ITEM(object);
+
+  switch (prop_id) {
+  case PROP_SSID:
+    g_value_set_string(value, item->ssid);
+    break;
+  case PROP_SECURITY:
+    g_value_set_uint(value, item->security);
+    break;
+  case PROP_STRENGTH:
+    g_value_set_uint(value, item->strength);
+    break;
+  case PROP_ACCESS_POINT:
+    g_value_set_string(value, item->access_point);
+    break;
+  case PROP_BSSID:
+    g_value_set_string(value, item->bssid);
+    break;
+  case PROP_LAST_USED:
+    g_value_set_uint64(value, item->last_used);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+  }
+}
+
+static void wifi_network_item_class_init(WifiNetworkItemClass *klass) {
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+  GParamFlags flags =
+      G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS;
+
+  object_class->finalize = wifi_network_item_finalize;
+  object_class->get_property = wifi_network_item_get_property;
+
+  properties[PROP_SSID] = g_param_spec_string("ssid", NULL, NULL, NULL, flags);
+  properties[PROP_SECURITY] =
+      g_param_spec_uint("security", NULL, NULL, WIFI_SECURITY_NONE,
+                        WIFI_SECURITY_ENTERPRISE, WIFI_SECURITY_NONE, flags);
+  properties[PROP_STRENGTH] =
+      g_param_spec_uint("strength", NULL, NULL, 0, 100, 0, flags);
+  properties[PROP_ACCESS_POINT] =
+      g_param_spec_string("access-point", NULL, NULL, NULL, flags);
+  properties[PROP_BSSID] =
+      g_param_spec_string("bssid", NULL, NULL, NULL, flags);
+  properties[PROP_LAST_USED] =
+      g_param_spec_uint64("last-used", NULL, NULL, 0, G_MAXUINT64, 0, flags);
+  g_object_class_install_properties(object_class, N_PROPS, properties);
+}
+
+static void wifi_network_item_init(WifiNetworkItem *item) {
+  item->members = g_ptr_array_new();
+}
+
+const gchar *wifi_network_item_get_ssid(WifiNetworkItem *item) {
+  return item->ssid;
+}
+
+WifiSecurity wifi_network_item_get_security(WifiNetworkItem *item) {
+  return item->security;
+}
+
+guint wifi_network_item_get_strength(WifiNetworkItem *item) {
+  return item->strength;
+}
+
+const gchar *wifi_network_item_get_access_point(WifiNetworkItem *item) {
+  return item->access_point;
+}
+
+const gchar *wifi_network_item_get_bssid(WifiNetworkItem *item) {
+  return item->bssid;
+}
+
+guint64 wifi_network_item_get_last_used(WifiNetworkItem *item) {
+  return item->last_used;
+}
+
+guint wifi_signal_bars(guint strength) {
+  if (strength > 80)
+    return 3;
+  if (strength > 55)
+    return 2;
+  if (strength > 30)
+    return 1;
+  return 0;
+}
+
+static GListStore *store = NULL;
+static GHashTable *networks = NULL;      // key -> WifiNetworkItem, owned by
+                                         // the store
+static GHashTable *access_points = NULL; // key -> AccessPoint
+static guint generation = 0;
+// Rows were added, removed or moved since begin()
+static gboolean reordered = FALSE;
+static WifiLastUsedFunc last_used_func = NULL;
+
+static void access_point_free(AccessPoint *ap) {
+  g_free(ap->key);
+  g_free(ap->path);
+  g_free(ap->bssid);
+  g_free(ap);
+}
+
+GListModel *wifi_network_list(void) {
+  if (store == NULL) {
+    store = g_list_store_new(WIFI_TYPE_NETWORK_ITEM);
+    networks = g_hash_table_new(g_str_hash, g_str_equal);
+    access_points = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                          (GDestroyNotify)access_point_free);
+  }
+  return G_LIST_MODEL(store);
+}
+
+static gint compare_network(gconstpointer a, gconstpointer b,
+                            gpointer user_data) {
+  const WifiNetworkItem *first = a;
+  const WifiNetworkItem *second = b;
+  guint first_bars = wifi_signal_bars(first->strength);
+  guint second_bars = wifi_signal_bars(second->strength);
+  gint order;
+
+  if (first->last_used != second->last_used)
+    return first->last_used > second->last_used ? -1 : 1;
+  if (first_bars != second_bars)
+    return first_bars > second_bars ? -1 : 1;
+  order = g_utf8_collate(first->ssid, second->ssid);
+  if (order != 0)
+    return order;
+  return (gint)first->security - (gint)second->security;
+}
+
+static gboolean replace_string(gchar **field, const gchar *value) {
+  if (g_strcmp0(*field, value) == 0)
+    return FALSE;
+  g_free(*field);
+  *field = g_strdup(value);
+  return TRUE;
+}
+
+static void move_network(WifiNetworkItem *item) {
+  guint position;
+
+  if (!g_list_store_find(store, item, &position))
+    return;
+  reordered = TRUE;
+  g_object_ref(item);
+  g_list_store_remove(store, position);
+  g_list_store_insert_sorted(store, item, compare_network, NULL);
+  g_object_unref(item);
+}
+
+static void remove_network(WifiNetworkItem *item) {
+  guint position;
+
+  reordered = TRUE;
+  g_hash_table_remove(networks, item->key);
+  if (g_list_store_find(store, item, &position))
+    g_list_store_remove(store, position);
+}
+
+// Show the strongest member. Only a change of bars moves the item, and only
+// that move touches the model; the rest are property notifies.
+static void refresh_network(WifiNetworkItem *item) {
+  AccessPoint *best = NULL;
+  guint bars = wifi_signal_bars(item->strength);
+
+  for (guint i = 0; i < item->members->len; i++) {
+    AccessPoint *ap = item->members->pdata[i];
+
+    if (best == NULL || ap->strength > best->strength)
+      best = ap;
+  }
+  if (best == NULL) {
+    remove_network(item);
+    return;
+  }
+
+  g_object_freeze_notify(G_OBJECT(item));
+  if (item->strength != best->strength) {
+    item->strength = best->strength;
+    g_object_notify_by_pspec(G_OBJECT(item), properties[PROP_STRENGTH]);
+  }
+  if (replace_string(&item->access_point, best->path))
+    g_object_notify_by_pspec(G_OBJECT(item), properties[PROP_ACCESS_POINT]);
+  if (replace_string(&item->bssid, best->bssid))
+    g_object_notify_by_pspec(G_OBJECT(item), properties[PROP_BSSID]);
+  g_object_thaw_notify(G_OBJECT(item));
+
+  if (wifi_signal_bars(item->strength) != bars)
+    move_network(item);
+}
+
+static void detach(AccessPoint *ap) {
+  WifiNetworkItem *network = ap->network;
+
+  ap->network = NULL;
+  g_ptr_array_remove_fast(network->members, ap);
+  refresh_network(network);
+}
+
+static void attach(AccessPoint *ap, const gchar *ssid, WifiSecurity security) {
+  g_autofree gchar *key = g_strdup_printf("%d:%s", security, ssid);
+  WifiNetworkItem *item = g_hash_table_lookup(networks, key);
+
+  if (item != NULL) {
+    ap->network = item;
+    g_ptr_array_add(item->members, ap);
+    refresh_network(item);
+    return;
+  }
+
+  item = g_object_new(WIFI_TYPE_NETWORK_ITEM, NULL);
+  item->key = g_steal_pointer(&key);
+  item->ssid = g_strdup(ssid);
+  item->security = security;
+  item->strength = ap->strength;
+  item->access_point = g_strdup(ap->path);
+  item->bssid = g_strdup(ap->bssid);
+  item->last_used = last_used_func != NULL ? last_used_func(ssid, security) : 0;
+  g_ptr_array_add(item->members, ap);
+  ap->network = item;
+
+  reordered = TRUE;
+  g_hash_table_insert(networks, item->key, item);
+  g_list_store_insert_sorted(store, item, compare_network, NULL);
+  g_object_unref(item);
+}
+
+void wifi_networks_update(const WifiAccessPoint *ap) {
+  const gchar *key = ap->path != NULL ? ap->path : ap->bssid;
+  AccessPoint *entry;
+
+  if (key == NULL)
+    return;
+  if (ap->ssid == NULL || *ap->ssid == '\0') {
+    wifi_networks_remove(key);
+    return;
+  }
+
+  wifi_network_list();
+  entry = g_hash_table_lookup(access_points, key);
+  if (entry == NULL) {
+    entry = g_new0(AccessPoint, 1);
+    entry->key = g_strdup(key);
+    entry->path = g_strdup(ap->path);
+    g_hash_table_insert(access_points, entry->key, entry);
+  }
+  entry->generation = generation;
+  entry->strength = ap->strength;
+  replace_string(&entry->bssid, ap->bssid);
+
+  // An access point that changed its name or security is another network
+  // now
+  if (entry->network != NULL &&
+      (entry->network->security != ap->security ||
+       g_strcmp0(entry->network->ssid, ap->ssid) != 0))
+    detach(entry);
+
+  if (entry->network == NULL)
+    attach(entry, ap->ssid, ap->security);
+  else
+    refresh_network(entry->network);
+}
+
+void wifi_networks_remove(const gchar *key) {
+  AccessPoint *entry;
+
+  if (access_points == NULL)
+    return;
+  entry = g_hash_table_lookup(access_points, key);
+  if (entry == NULL)
+    return;
+
+  if (entry->network != NULL)
+    detach(entry);
+  g_hash_table_remove(access_points, key);
+}
+
+void wifi_networks_set_last_used_func(WifiLastUsedFunc func) {
+  last_used_func = func;
+  wifi_networks_rerank();
+}
+
+void wifi_networks_rerank(void) {
+  g_autoptr(GPtrArray) changed = g_ptr_array_new();
+  GHashTableIter iter;
+  gpointer value;
+
+  if (store == NULL)
+    return;
+
+  g_hash_table_iter_init(&iter, networks);
+  while (g_hash_table_iter_next(&iter, NULL, &value)) {
+    WifiNetworkItem *item = value;
+    guint64 last_used = last_used_func != NULL
+                            ? last_used_func(item->ssid, item->security)
+                            : 0;
+
+    if (item->last_used != last_used) {
+      item->last_used = last_used;
+      g_ptr_array_add(changed, item);
+    }
+  }
+
+  // All out of the list before any goes back in, so each insert sees a
+  // sorted list
+  for (guint i = 0; i < changed->len; i++) {
+    guint position;
+
+    g_object_ref(changed->pdata[i]);
+    if (g_list_store_find(store, changed->pdata[i], &position))
+      g_list_store_remove(store, position);
+  }
+  for (guint i = 0; i < changed->len; i++) {
+    reordered = TRUE;
+    g_list_store_insert_sorted(store, changed->pdata[i], compare_network, NULL);
+    g_object_notify_by_pspec(changed->pdata[i], properties[PROP_LAST_USED]);
+    g_object_unref(changed->pdata[i]);
+  }
+}
+
+void wifi_networks_begin(void) {
+  generation++;
+  reordered = FALSE;
+}
+
+gboolean wifi_networks_end(void) {
+  GHashTableIter iter;
+  gpointer entry;
+  g_autoptr(GPtrArray) gone = g_ptr_array_new_with_free_func(g_free);
+
+  if (access_points == NULL)
+    return FALSE;
+
+  g_hash_table_iter_init(&iter, access_points);
+  while (g_hash_table_iter_next(&iter, NULL, &entry)) {
+    if (((AccessPoint *)entry)->generation != generation)
+      g_ptr_array_add(gone, g_strdup(((AccessPoint *)entry)->key));
+  }
+
+  for (guint i = 0; i < gone->len; i++)
+    wifi_networks_remove(gone->pdata[i]);
+  return reordered;
+}
+
+void wifi_networks_clear(void) {
+  GHashTableIter iter;
+  gpointer item;
+
+  if (store == NULL)
+    return;
+
+  // Rows may hold on to items for a moment; their members go away now
+  g_hash_table_iter_init(&iter, networks);
+  while (g_hash_table_iter_next(&iter, NULL, &item))
+    g_ptr_array_set_size(WIFI_NETWORK_ITEM(item)->members, 0);
+
+  g_hash_table_remove_all(networks);
+  g_list_store_remove_all(store);
+  g_hash_table_remove_all(access_points);
+}
@@ -0,0 +1,1207 @@
+#include "wifi/nm.h"
+#include "command/stats.h"
+#include "listener/listener.h"
+#include <string.h>
+
+#define NM_SERVICE "org.freedesktop.NetworkManager"
+#define NM_PATH "/org/freedesktop/NetworkManager"
+#define NM_DEVICE NM_SERVICE ".Device"
+#define NM_WIRELESS NM_SERVICE ".Device.Wireless"
+#define NM_ACCESS_POINT NM_SERVICE ".AccessPoint"
+#define NM_SETTINGS_PATH NM_PATH "/Settings"
+#define NM_SETTINGS NM_SERVICE ".Settings"
+#define NM_CONNECTION NM_SETTINGS ".Connection"
+#define DBUS_PROPERTIES "org.freedesktop.DBus.Properties"
+
+// From NetworkManager's nm-dbus-interface.h
+#define NM_DEVICE_TYPE_WIFI 2
+#define NM_DEVICE_STATE_DISCONNECTED 30
+#define NM_DEVICE_STATE_PREPARE 40
+#define NM_DEVICE_STATE_CONFIG 50
+#define NM_DEVICE_STATE_NEED_AUTH 60
+#define NM_DEVICE_STATE_IP_CONFIG 70
+#define NM_DEVICE_STATE_SECONDARIES 90
+#define NM_DEVICE_STATE_ACTIVATED 100
+#define NM_DEVICE_STATE_DEACTIVATING 110
+#define NM_DEVICE_STATE_FAILED 120
+#define NM_DEVICE_STATE_REASON_NO_SECRETS 7
+#define NM_DEVICE_STATE_REASON_SUPPLICANT_DISCONNECT 8
+#define NM_DEVICE_STATE_REASON_SUPPLICANT_CONFIG_FAILED 9
+#define NM_DEVICE_STATE_REASON_SUPPLICANT_FAILED 10
+#define NM_DEVICE_STATE_REASON_SUPPLICANT_TIMEOUT 11
+#define NM_DEVICE_STATE_REASON_DHCP_START_FAILED 15
+#define NM_DEVICE_STATE_REASON_DHCP_ERROR 16
+#define NM_DEVICE_STATE_REASON_DHCP_FAILED 17
+#define NM_DEVICE_STATE_REASON_SSID_NOT_FOUND 53
+#define NM_802_11_AP_FLAGS_PRIVACY 0x1
+#define NM_802_11_AP_SEC_KEY_MGMT_PSK 0x100
+#define NM_802_11_AP_SEC_KEY_MGMT_802_1X 0x200
+#define NM_802_11_AP_SEC_KEY_MGMT_SAE 0x400
+
+typedef struct {
+  WifiAccessPoint ap; // first, so public pointers cast back
+  guint32 flags;
+  guint32 wpa_flags;
+  guint32 rsn_flags;
+  gboolean loaded; // its properties have arrived
+} NmAccessPoint;
+
+typedef struct {
+  WifiChange change;
+  const WifiAccessPoint *ap;
+} Emission;
+
+static WifiNmState state = WIFI_NM_FAILED;
+static GDBusConnection *bus;
+static guint watch_id;
+static GCancellable *nm_cancellable; // calls made while NetworkManager is up
+static gchar *device;             // object path of the Wi-Fi device
+static GHashTable *access_points; // path -> NmAccessPoint
+static gchar *active_path;
+static guint32 device_state;
+static guint32 state_reason; // why the device entered device_state
+static guint32 bitrate;      // kbit/s of the link in use
+static gboolean radio;
+static ListenerList listeners;
+static guint pending_loads; // device types or access points still to come
+static gint64 load_start;
+static gint64 scan_start;
+static gint64 radio_start;
+static GHashTable *profiles;      // path -> WifiProfile, Wi-Fi ones only
+static guint pending_profiles;    // initial GetSettings still to come
+static gint64 profiles_start;
+static gchar *activating_profile; // settings path being activated
+static gchar *activating_connection; // its active connection, once known
+static gboolean activating_new;   // whether it was added for this activation
+static gboolean activation_begun; // the device has started on it
+
+static void nm_access_point_free(NmAccessPoint *nm_ap) {
+  g_free(nm_ap->ap.path);
+  g_free(nm_ap->ap.ssid);
+  g_free(nm_ap->ap.bssid);
+  g_free(nm_ap);
+}
+
+static void wifi_profile_free(WifiProfile *profile) {
+  g_free(profile->path);
+  g_free(profile->uuid);
+  g_free(profile->id);
+  g_free(profile->ssid);
+  g_free(profile);
+}
+
+static void call_listener(GCallback func, gpointer user_data, gpointer args) {
+  Emission *emission = args;
+
+  ((WifiNmFunc)func)(emission->change, emission->ap, user_data);
+}
+
+static void emit(WifiChange change, const WifiAccessPoint *ap) {
+  Emission emission = {change, ap};
+
+  listener_list_emit(&listeners, call_listener, &emission);
+}
+
+static void call(const gchar *path, const gchar *interface,
+                 const gchar *method, GVariant *parameters,
+                 const GVariantType *reply_type, GAsyncReadyCallback callback,
+                 gpointer user_data) {
+  g_dbus_connection_call(bus, NM_SERVICE, path, interface, method, parameters,
+                         reply_type, G_DBUS_CALL_FLAGS_NONE, -1,
+                         nm_cancellable, callback, user_data);
+}
+
+static void get_all(const gchar *path, const gchar *interface,
+                    GAsyncReadyCallback callback, gpointer user_data) {
+  call(path, DBUS_PROPERTIES, "GetAll", g_variant_new("(s)", interface),
+       G_VARIANT_TYPE("(a{sv})"), callback, user_data);
+}
+
+// Calls cancelled because NetworkManager went away set *cancelled and are
+// not errors. what is NULL where a failure is expected and not worth
+// reporting.
+static GVariant *call_finish(GAsyncResult *res, const gchar *what,
+                             gboolean *cancelled) {
+  g_autoptr(GError) error = NULL;
+  GVariant *reply = g_dbus_connection_call_finish(bus, res, &error);
+  gboolean was_cancelled =
+      g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+
+  if (reply == NULL && what != NULL && !was_cancelled)
+    g_printerr("Failed to %s: %s\n", what, error->message);
+  if (cancelled != NULL)
+    *cancelled = was_cancelled;
+  return reply;
+}
+
+static WifiSecurity security_of(const NmAccessPoint *nm_ap) {
+  guint32 key_mgmt = nm_ap->wpa_flags | nm_ap->rsn_flags;
+
+  if (key_mgmt & NM_802_11_AP_SEC_KEY_MGMT_802_1X)
+    return WIFI_SECURITY_ENTERPRISE;
+  if (key_mgmt & NM_802_11_AP_SEC_KEY_MGMT_PSK)
+    return WIFI_SECURITY_PSK;
+  if (key_mgmt & NM_802_11_AP_SEC_KEY_MGMT_SAE)
+    return WIFI_SECURITY_SAE;
+  if (nm_ap->flags & NM_802_11_AP_FLAGS_PRIVACY)
+    return WIFI_SECURITY_WEP;
+  return WIFI_SECURITY_NONE;
+}
+
+// SSIDs are bytes; the ones that are not UTF-8 are shown with replacements
+static gchar *ssid_from_bytes(GVariant *value) {
+  gsize length;
+  const gchar *bytes = g_variant_get_fixed_array(value, &length, 1);
+
+  return length > 0 ? g_utf8_make_valid(bytes, length) : g_strdup("");
+}
+
+// properties is an a{sv} of the AccessPoint interface, whole or changed
+static void apply_properties(NmAccessPoint *nm_ap, GVariant *properties) {
+  GVariantIter iter;
+  const gchar *name;
+  GVariant *value;
+
+  g_variant_iter_init(&iter, properties);
+  while (g_variant_iter_next(&iter, "{&sv}", &name, &value)) {
+    if (g_strcmp0(name, "Ssid") == 0 &&
+        g_variant_is_of_type(value, G_VARIANT_TYPE_BYTESTRING)) {
+      g_free(nm_ap->ap.ssid);
+      nm_ap->ap.ssid = ssid_from_bytes(value);
+    } else if (g_strcmp0(name, "HwAddress") == 0 &&
+               g_variant_is_of_type(value, G_VARIANT_TYPE_STRING)) {
+      g_free(nm_ap->ap.bssid);
+      nm_ap->ap.bssid = g_variant_dup_string(value, NULL);
+    } else if (g_strcmp0(name, "Strength") == 0 &&
+               g_variant_is_of_type(value, G_VARIANT_TYPE_BYTE)) {
+      nm_ap->ap.strength = g_variant_get_byte(value);
+    } else if (g_strcmp0(name, "Frequency") == 0 &&
+               g_variant_is_of_type(value, G_VARIANT_TYPE_UINT32)) {
+      nm_ap->ap.frequency = g_variant_get_uint32(value);
+    } else if (g_strcmp0(name, "MaxBitrate") == 0 &&
+               g_variant_is_of_type(value, G_VARIANT_TYPE_UINT32)) {
+      nm_ap->ap.max_bitrate = g_variant_get_uint32(value);
+    } else if (g_strcmp0(name, "Flags") == 0 &&
+               g_variant_is_of_type(value, G_VARIANT_TYPE_UINT32)) {
+      nm_ap->flags = g_variant_get_uint32(value);
+    } else if (g_strcmp0(name, "WpaFlags") == 0 &&
+               g_variant_is_of_type(value, G_VARIANT_TYPE_UINT32)) {
+      nm_ap->wpa_flags = g_variant_get_uint32(value);
+    } else if (g_strcmp0(name, "RsnFlags") == 0 &&
+               g_variant_is_of_type(value, G_VARIANT_TYPE_UINT32)) {
+      nm_ap->rsn_flags = g_variant_get_uint32(value);
+    }
+    g_variant_unref(value);
+  }
+
+  if (nm_ap->ap.ssid == NULL)
+    nm_ap->ap.ssid = g_strdup("");
+  nm_ap->ap.security = security_of(nm_ap);
+}
+
+static void load_done(void) {
+  if (state != WIFI_NM_CONNECTING || --pending_loads > 0)
+    return;
+
+  state = WIFI_NM_READY;
+  command_stats_add("nm initial sync", g_get_monotonic_time() - load_start, 0,
+                    FALSE);
+  emit(WIFI_CHANGE_STATE, NULL);
+}
+
+static void on_access_point_ready(GObject *source, GAsyncResult *res,
+                                  gpointer user_data) {
+  g_autofree gchar *path = user_data;
+  gboolean cancelled;
+  g_autoptr(GVariant) reply = call_finish(res, NULL, &cancelled);
+  g_autoptr(GVariant) properties = NULL;
+  NmAccessPoint *nm_ap;
+
+  if (cancelled)
+    return;
+
+  // Without a reply it went again before its properties were read, which
+  // scans do all the time
+  nm_ap = access_points ? g_hash_table_lookup(access_points, path) : NULL;
+  if (nm_ap != NULL && reply != NULL) {
+    properties = g_variant_get_child_value(reply, 0);
+    apply_properties(nm_ap, properties);
+    nm_ap->loaded = TRUE;
+    // The initial load announces everything at once when it completes
+    if (state == WIFI_NM_READY)
+      emit(WIFI_CHANGE_AP, &nm_ap->ap);
+  }
+  load_done();
+}
+
+// Known from the start, so a removal that overtakes the properties finds it
+static void add_access_point(const gchar *path) {
+  NmAccessPoint *nm_ap;
+
+  if (g_hash_table_contains(access_points, path))
+    return;
+
+  nm_ap = g_new0(NmAccessPoint, 1);
+  nm_ap->ap.path = g_strdup(path);
+  g_hash_table_insert(access_points, nm_ap->ap.path, nm_ap);
+  pending_loads++;
+  get_all(path, NM_ACCESS_POINT, on_access_point_ready, g_strdup(path));
+}
+
+static void remove_access_point(const gchar *path) {
+  NmAccessPoint *nm_ap = g_hash_table_lookup(access_points, path);
+
+  if (nm_ap == NULL)
+    return;
+  if (nm_ap->loaded && state == WIFI_NM_READY)
+    emit(WIFI_CHANGE_AP_REMOVED, &nm_ap->ap);
+  g_hash_table_remove(access_points, path);
+}
+
+static void set_active_path(const gchar *path) {
+  g_free(active_path);
+  // "/" is D-Bus for none
+  active_path = g_strcmp0(path, "/") != 0 ? g_strdup(path) : NULL;
+}
+
+static void on_access_points_ready(GObject *source, GAsyncResult *res,
+                                   gpointer user_data) {
+  gboolean cancelled;
+  g_autoptr(GVariant) reply =
+      call_finish(res, "list access points", &cancelled);
+  g_autoptr(GVariantIter) iter = NULL;
+  const gchar *path;
+
+  if (reply == NULL) {
+    if (!cancelled)
+      load_done();
+    return;
+  }
+
+  g_variant_get(reply, "(ao)", &iter);
+  while (g_variant_iter_next(iter, "&o", &path))
+    add_access_point(path);
+  load_done();
+}
+
+static void on_wireless_ready(GObject *source, GAsyncResult *res,
+                              gpointer user_data) {
+  g_autoptr(GVariant) reply = call_finish(res, "read the Wi-Fi device", NULL);
+  g_autoptr(GVariant) properties = NULL;
+  const gchar *path;
+
+  if (reply == NULL)
+    return;
+  properties = g_variant_get_child_value(reply, 0);
+  g_variant_lookup(properties, "Bitrate", "u", &bitrate);
+  if (g_variant_lookup(properties, "ActiveAccessPoint", "&o", &path)) {
+    set_active_path(path);
+    emit(WIFI_CHANGE_LINK, NULL);
+  }
+}
+
+static void on_device_state_ready(GObject *source, GAsyncResult *res,
+                                  gpointer user_data) {
+  g_autoptr(GVariant) reply = call_finish(res, "read the device state", NULL);
+  g_autoptr(GVariant) value = NULL;
+
+  if (reply == NULL)
+    return;
+  g_variant_get(reply, "(v)", &value);
+  if (g_variant_is_of_type(value, G_VARIANT_TYPE_UINT32)) {
+    device_state = g_variant_get_uint32(value);
+    emit(WIFI_CHANGE_LINK, NULL);
+  }
+}
+
+static void use_device(const gchar *path) {
+  device = g_strdup(path);
+
+  call(device, DBUS_PROPERTIES, "Get",
+       g_variant_new("(ss)", NM_DEVICE, "State"), G_VARIANT_TYPE("(v)"),
+       on_device_state_ready, NULL);
+  get_all(device, NM_WIRELESS, on_wireless_ready, NULL);
+  pending_loads++;
+  call(device, NM_WIRELESS, "GetAllAccessPoints", NULL,
+       G_VARIANT_TYPE("(ao)"), on_access_points_ready, NULL);
+}
+
+static void on_device_type_ready(GObject *source, GAsyncResult *res,
+                                 gpointer user_data) {
+  g_autofree gchar *path = user_data;
+  gboolean cancelled;
+  g_autoptr(GVariant) reply =
+      call_finish(res, "read a device type", &cancelled);
+  g_autoptr(GVariant) value = NULL;
+
+  if (cancelled)
+    return;
+
+  if (reply != NULL) {
+    g_variant_get(reply, "(v)", &value);
+    if (device == NULL && g_variant_is_of_type(value, G_VARIANT_TYPE_UINT32) &&
+        g_variant_get_uint32(value) == NM_DEVICE_TYPE_WIFI)
+      use_device(path);
+  }
+
+  if (pending_loads == 1 && device == NULL) {
+    g_printerr("NetworkManager has no Wi-Fi device\n");
+    state = WIFI_NM_FAILED;
+    emit(WIFI_CHANGE_STATE, NULL);
+    return;
+  }
+  load_done();
+}
+
+static void on_devices_ready(GObject *source, GAsyncResult *res,
+                             gpointer user_data) {
+  gboolean cancelled;
+  g_autoptr(GVariant) reply =
+      call_finish(res, "list network devices", &cancelled);
+  g_autoptr(GVariantIter) iter = NULL;
+  const gchar *path;
+
+  if (reply == NULL) {
+    if (!cancelled) {
+      state = WIFI_NM_FAILED;
+      emit(WIFI_CHANGE_STATE, NULL);
+    }
+    return;
+  }
+
+  // Every device's type is read; the last reply decides if there is none
+  pending_loads = 0;
+  g_variant_get(reply, "(ao)", &iter);
+  while (g_variant_iter_next(iter, "&o", &path)) {
+    pending_loads++;
+    call(path, DBUS_PROPERTIES, "Get",
+         g_variant_new("(ss)", NM_DEVICE, "DeviceType"), G_VARIANT_TYPE("(v)"),
+         on_device_type_ready, g_strdup(path));
+  }
+  if (pending_loads == 0) {
+    g_printerr("NetworkManager has no Wi-Fi device\n");
+    state = WIFI_NM_FAILED;
+    emit(WIFI_CHANGE_STATE, NULL);
+  }
+}
+
+static void on_radio_ready(GObject *source, GAsyncResult *res,
+                           gpointer user_data) {
+  g_autoptr(GVariant) reply = call_finish(res, "read the Wi-Fi radio", NULL);
+  g_autoptr(GVariant) value = NULL;
+
+  if (reply == NULL)
+    return;
+  g_variant_get(reply, "(v)", &value);
+  if (g_variant_is_of_type(value, G_VARIANT_TYPE_BOOLEAN)) {
+    radio = g_variant_get_boolean(value);
+    emit(WIFI_CHANGE_RADIO, NULL);
+  }
+}
+
+// 802-11-wireless-security.key-mgmt; no security section means open
+static WifiSecurity security_of_key_mgmt(const gchar *key_mgmt) {
+  if (key_mgmt == NULL || g_strcmp0(key_mgmt, "owe") == 0)
+    return WIFI_SECURITY_NONE;
+  if (g_strcmp0(key_mgmt, "none") == 0)
+    return WIFI_SECURITY_WEP;
+  if (g_strcmp0(key_mgmt, "wpa-psk") == 0)
+    return WIFI_SECURITY_PSK;
+  if (g_strcmp0(key_mgmt, "sae") == 0)
+    return WIFI_SECURITY_SAE;
+  return WIFI_SECURITY_ENTERPRISE;
+}
+
+// settings is the a{sa{sv}} of GetSettings. Only profiles for joining a
+// Wi-Fi network are kept; hotspots and wired ones are not.
+static WifiProfile *profile_from_settings(const gchar *path,
+                                          GVariant *settings) {
+  g_autoptr(GVariant) connection =
+      g_variant_lookup_value(settings, "connection", G_VARIANT_TYPE_VARDICT);
+  g_autoptr(GVariant) wireless = g_variant_lookup_value(
+      settings, "802-11-wireless", G_VARIANT_TYPE_VARDICT);
+  g_autoptr(GVariant) security = g_variant_lookup_value(
+      settings, "802-11-wireless-security", G_VARIANT_TYPE_VARDICT);
+  g_autoptr(GVariant) ssid = NULL;
+  const gchar *type = NULL, *uuid = NULL, *id = NULL, *mode = NULL;
+  const gchar *key_mgmt = NULL;
+  WifiProfile *profile;
+
+  if (connection == NULL || wireless == NULL)
+    return NULL;
+  g_variant_lookup(connection, "type", "&s", &type);
+  g_variant_lookup(connection, "uuid", "&s", &uuid);
+  g_variant_lookup(wireless, "mode", "&s", &mode);
+  ssid = g_variant_lookup_value(wireless, "ssid", G_VARIANT_TYPE_BYTESTRING);
+  if (g_strcmp0(type, "802-11-wireless") != 0 || uuid == NULL ||
+      ssid == NULL || (mode != NULL && g_strcmp0(mode, "infrastructure") != 0))
+    return NULL;
+
+  g_variant_lookup(connection, "id", "&s", &id);
+  if (security != NULL)
+    g_variant_lookup(security, "key-mgmt", "&s", &key_mgmt);
+
+  profile = g_new0(WifiProfile, 1);
+  profile->path = g_strdup(path);
+  profile->uuid = g_strdup(uuid);
+  profile->id = g_strdup(id);
+  profile->ssid = ssid_from_bytes(ssid);
+  profile->security = security_of_key_mgmt(key_mgmt);
+  g_variant_lookup(connection, "timestamp", "t", &profile->timestamp);
+  return profile;
+}
+
+static void profiles_loaded(void) {
+  command_stats_add("nm saved connections",
+                    g_get_monotonic_time() - profiles_start, 0, FALSE);
+  emit(WIFI_CHANGE_PROFILES, NULL);
+}
+
+static void on_profile_ready(GObject *source, GAsyncResult *res,
+                             gpointer user_data) {
+  g_autofree gchar *path = user_data;
+  gboolean cancelled;
+  g_autoptr(GVariant) reply = call_finish(res, NULL, &cancelled);
+  g_autoptr(GVariant) settings = NULL;
+  WifiProfile *profile = NULL;
+  gboolean known;
+
+  if (cancelled)
+    return;
+
+  // Without a reply it was deleted meanwhile or is not ours to read
+  if (reply != NULL) {
+    settings = g_variant_get_child_value(reply, 0);
+    profile = profile_from_settings(path, settings);
+  }
+  known = g_hash_table_contains(profiles, path);
+  if (profile != NULL)
+    g_hash_table_replace(profiles, profile->path, profile);
+  else
+    g_hash_table_remove(profiles, path);
+
+  // The initial load announces every profile at once when it completes
+  if (pending_profiles > 0) {
+    if (--pending_profiles == 0)
+      profiles_loaded();
+  } else if (profile != NULL || known) {
+    emit(WIFI_CHANGE_PROFILES, NULL);
+  }
+}
+
+// Also reloads a profile after its Updated signal
+static void load_profile(const gchar *path) {
+  call(path, NM_CONNECTION, "GetSettings", NULL,
+       G_VARIANT_TYPE("(a{sa{sv}})"), on_profile_ready, g_strdup(path));
+}
+
+static void on_connections_ready(GObject *source, GAsyncResult *res,
+                                 gpointer user_data) {
+  g_autoptr(GVariant) reply =
+      call_finish(res, "list saved connections", NULL);
+  g_autoptr(GVariantIter) iter = NULL;
+  const gchar *path;
+
+  if (reply == NULL)
+    return;
+
+  g_variant_get(reply, "(ao)", &iter);
+  while (g_variant_iter_next(iter, "&o", &path)) {
+    pending_profiles++;
+    load_profile(path);
+  }
+  if (pending_profiles == 0)
+    profiles_loaded();
+}
+
+static void clear_activation(void) {
+  g_clear_pointer(&activating_profile, g_free);
+  g_clear_pointer(&activating_connection, g_free);
+  activating_new = FALSE;
+  activation_begun = FALSE;
+}
+
+// A profile that was just activated successfully is the most recently used
+// one. NetworkManager records that too, but does not signal it.
+static void note_profile_used(void) {
+  WifiProfile *profile = NULL;
+
+  if (activating_profile != NULL)
+    profile = g_hash_table_lookup(profiles, activating_profile);
+  clear_activation();
+  if (profile == NULL)
+    return;
+
+  profile->timestamp = g_get_real_time() / G_USEC_PER_SEC;
+  emit(WIFI_CHANGE_PROFILES, NULL);
+}
+
+static void on_profile_deleted(GObject *source, GAsyncResult *res,
+                               gpointer user_data) {
+  g_autoptr(GVariant) reply = call_finish(res, "delete the connection", NULL);
+}
+
+// A connection added with a password that turned out wrong, or was never
+// tried because the attempt was given up, would be saved with it, and
+// joining the network again would fail on it without asking. It only stays
+// once it worked.
+static void drop_unused_profile(void) {
+  if (activating_new && activating_profile != NULL)
+    call(activating_profile, NM_CONNECTION, "Delete", NULL, NULL,
+         on_profile_deleted, NULL);
+  clear_activation();
+}
+
+static void on_settings_signal(GDBusConnection *connection,
+                               const gchar *sender, const gchar *path,
+                               const gchar *interface, const gchar *signal,
+                               GVariant *parameters, gpointer user_data) {
+  const gchar *profile_path;
+
+  if (profiles == NULL || nm_cancellable == NULL)
+    return;
+
+  if (g_strcmp0(signal, "Updated") == 0) {
+    load_profile(path);
+    return;
+  }
+  if (g_strcmp0(path, NM_SETTINGS_PATH) != 0 ||
+      !g_variant_is_of_type(parameters, G_VARIANT_TYPE("(o)")))
+    return;
+
+  g_variant_get(parameters, "(&o)", &profile_path);
+  if (g_strcmp0(signal, "NewConnection") == 0)
+    load_profile(profile_path);
+  else if (g_strcmp0(signal, "ConnectionRemoved") == 0 &&
+           g_hash_table_remove(profiles, profile_path))
+    emit(WIFI_CHANGE_PROFILES, NULL);
+}
+
+// One subscription covers every object: NetworkManager sends the standard
+// PropertiesChanged, with the interface as the first argument
+static void on_properties_changed(GDBusConnection *connection,
+                                  const gchar *sender, const gchar *path,
+                                  const gchar *interface, const gchar *signal,
+                                  GVariant *parameters, gpointer user_data) {
+  const gchar *changed_interface;
+  g_autoptr(GVariant) changed = NULL;
+  NmAccessPoint *nm_ap;
+  const gchar *active;
+
+  if (!g_variant_is_of_type(parameters, G_VARIANT_TYPE("(sa{sv}as)")))
+    return;
+  g_variant_get(parameters, "(&s@a{sv}as)", &changed_interface, &changed,
+                NULL);
+
+  if (g_strcmp0(changed_interface, NM_ACCESS_POINT) == 0) {
+    nm_ap = access_points ? g_hash_table_lookup(access_points, path) : NULL;
+    if (nm_ap == NULL || !nm_ap->loaded)
+      return;
+    apply_properties(nm_ap, changed);
+    if (state == WIFI_NM_READY)
+      emit(WIFI_CHANGE_AP, &nm_ap->ap);
+  } else if (g_strcmp0(changed_interface, NM_SERVICE) == 0 &&
+             g_strcmp0(path, NM_PATH) == 0) {
+    if (g_variant_lookup(changed, "WirelessEnabled", "b", &radio))
+      emit(WIFI_CHANGE_RADIO, NULL);
+  } else if (g_strcmp0(path, device) != 0) {
+    return;
+  } else if (g_strcmp0(changed_interface, NM_WIRELESS) == 0) {
+    gboolean link_changed =
+        g_variant_lookup(changed, "Bitrate", "u", &bitrate);
+
+    if (g_variant_lookup(changed, "ActiveAccessPoint", "&o", &active)) {
+      set_active_path(active);
+      link_changed = TRUE;
+    }
+    if (link_changed)
+      emit(WIFI_CHANGE_LINK, NULL);
+  } else if (g_strcmp0(changed_interface, NM_DEVICE) == 0) {
+    // NetworkManager sends StateReason along with every State
+    g_variant_lookup(changed, "StateReason", "(uu)", NULL, &state_reason);
+    if (g_variant_lookup(changed, "State", "u", &device_state)) {
+      // Leaving the previous network passes DISCONNECTED too; only once the
+      // device began on ours does it mean the activation ended
+      if (device_state == NM_DEVICE_STATE_ACTIVATED)
+        note_profile_used();
+      else if (device_state == NM_DEVICE_STATE_FAILED ||
+               (device_state == NM_DEVICE_STATE_DISCONNECTED &&
+                activation_begun))
+        drop_unused_profile();
+      else if (activating_profile != NULL &&
+               device_state >= NM_DEVICE_STATE_PREPARE &&
+               device_state <= NM_DEVICE_STATE_SECONDARIES)
+        activation_begun = TRUE;
+      emit(WIFI_CHANGE_LINK, NULL);
+    }
+  }
+}
+
+static void on_wireless_signal(GDBusConnection *connection,
+                               const gchar *sender, const gchar *path,
+                               const gchar *interface, const gchar *signal,
+                               GVariant *parameters, gpointer user_data) {
+  const gchar *ap_path;
+
+  if (g_strcmp0(path, device) != 0 || access_points == NULL ||
+      !g_variant_is_of_type(parameters, G_VARIANT_TYPE("(o)")))
+    return;
+
+  g_variant_get(parameters, "(&o)", &ap_path);
+  if (g_strcmp0(signal, "AccessPointAdded") == 0)
+    add_access_point(ap_path);
+  else if (g_strcmp0(signal, "AccessPointRemoved") == 0)
+    remove_access_point(ap_path);
+}
+
+static void on_nm_appeared(GDBusConnection *connection, const gchar *name,
+                           const gchar *owner, gpointer user_data) {
+  nm_cancellable = g_cancellable_new();
+  state = WIFI_NM_CONNECTING;
+  load_start = g_get_monotonic_time();
+
+  call(NM_PATH, DBUS_PROPERTIES, "Get",
+       g_variant_new("(ss)", NM_SERVICE, "WirelessEnabled"),
+       G_VARIANT_TYPE("(v)"), on_radio_ready, NULL);
+  call(NM_PATH, NM_SERVICE, "GetDevices", NULL, G_VARIANT_TYPE("(ao)"),
+       on_devices_ready, NULL);
+  profiles_start = g_get_monotonic_time();
+  call(NM_SETTINGS_PATH, NM_SETTINGS, "ListConnections", NULL,
+       G_VARIANT_TYPE("(ao)"), on_connections_ready, NULL);
+}
+
+// Also called right away when NetworkManager is not running
+static void on_nm_vanished(GDBusConnection *connection, const gchar *name,
+                           gpointer user_data) {
+  g_cancellable_cancel(nm_cancellable);
+  g_clear_object(&nm_cancellable);
+  g_clear_pointer(&device, g_free);
+  g_clear_pointer(&active_path, g_free);
+  clear_activation();
+  g_hash_table_remove_all(access_points);
+  g_hash_table_remove_all(profiles);
+  device_state = 0;
+  state_reason = 0;
+  bitrate = 0;
+  pending_loads = 0;
+  pending_profiles = 0;
+
+  g_printerr("NetworkManager is not running\n");
+  state = WIFI_NM_FAILED;
+  emit(WIFI_CHANGE_STATE, NULL);
+}
+
+static void on_bus_ready(GObject *source, GAsyncResult *res,
+                         gpointer user_data) {
+  g_autoptr(GError) error = NULL;
+
+  bus = g_bus_get_finish(res, &error);
+  if (bus == NULL) {
+    g_printerr("No system bus: %s\n", error->message);
+    state = WIFI_NM_FAILED;
+    emit(WIFI_CHANGE_STATE, NULL);
+    return;
+  }
+
+  g_dbus_connection_signal_subscribe(
+      bus, NM_SERVICE, DBUS_PROPERTIES, "PropertiesChanged", NULL, NULL,
+      G_DBUS_SIGNAL_FLAGS_NONE, on_properties_changed, NULL, NULL);
+  g_dbus_connection_signal_subscribe(bus, NM_SERVICE, NM_WIRELESS, NULL, NULL,
+                                     NULL, G_DBUS_SIGNAL_FLAGS_NONE,
+                                     on_wireless_signal, NULL, NULL);
+  g_dbus_connection_signal_subscribe(bus, NM_SERVICE, NM_SETTINGS, NULL,
+                                     NM_SETTINGS_PATH, NULL,
+                                     G_DBUS_SIGNAL_FLAGS_NONE,
+                                     on_settings_signal, NULL, NULL);
+  g_dbus_connection_signal_subscribe(bus, NM_SERVICE, NM_CONNECTION, "Updated",
+                                     NULL, NULL, G_DBUS_SIGNAL_FLAGS_NONE,
+                                     on_settings_signal, NULL, NULL);
+  watch_id = g_bus_watch_name_on_connection(bus, NM_SERVICE,
+                                            G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                            on_nm_appeared, on_nm_vanished,
+                                            NULL, NULL);
+}
+
+void wifi_nm_connect(void) {
+  if (access_points != NULL)
+    return;
+
+  access_points = g_hash_table_new_full(
+      g_str_hash, g_str_equal, NULL, (GDestroyNotify)nm_access_point_free);
+  profiles = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                   (GDestroyNotify)wifi_profile_free);
+  state = WIFI_NM_CONNECTING;
+  g_bus_get(G_BUS_TYPE_SYSTEM, NULL, on_bus_ready, NULL);
+}
+
+WifiNmState wifi_nm_get_state(void) { return state; }
+
+guint wifi_nm_listen(WifiNmFunc func, gpointer user_data) {
+  return listener_list_add(&listeners, G_CALLBACK(func), user_data);
+}
+
+void wifi_nm_unlisten(guint id) { listener_list_remove(&listeners, id); }
+
+GPtrArray *wifi_nm_access_points(void) {
+  GPtrArray *result = g_ptr_array_new();
+  GHashTableIter iter;
+  gpointer value;
+
+  if (access_points == NULL)
+    return result;
+
+  g_hash_table_iter_init(&iter, access_points);
+  while (g_hash_table_iter_next(&iter, NULL, &value)) {
+    NmAccessPoint *nm_ap = value;
+    if (nm_ap->loaded)
+      g_ptr_array_add(result, &nm_ap->ap);
+  }
+  return result;
+}
+
+const WifiAccessPoint *wifi_nm_lookup(const gchar *path) {
+  NmAccessPoint *nm_ap;
+
+  if (access_points == NULL || path == NULL)
+    return NULL;
+  nm_ap = g_hash_table_lookup(access_points, path);
+  return nm_ap != NULL && nm_ap->loaded ? &nm_ap->ap : NULL;
+}
+
+const WifiAccessPoint *wifi_nm_active(void) {
+  return wifi_nm_lookup(active_path);
+}
+
+WifiLink wifi_nm_get_link(void) {
+  if (device_state == NM_DEVICE_STATE_FAILED)
+    return WIFI_LINK_FAILED;
+  if (device_state == NM_DEVICE_STATE_ACTIVATED)
+    return WIFI_LINK_CONNECTED;
+  if (device_state >= NM_DEVICE_STATE_IP_CONFIG &&
+      device_state <= NM_DEVICE_STATE_SECONDARIES)
+    return WIFI_LINK_CONFIGURING;
+  if (device_state == NM_DEVICE_STATE_NEED_AUTH)
+    return WIFI_LINK_AUTHENTICATING;
+  if (device_state == NM_DEVICE_STATE_PREPARE ||
+      device_state == NM_DEVICE_STATE_CONFIG)
+    return WIFI_LINK_ASSOCIATING;
+  if (device_state == NM_DEVICE_STATE_DISCONNECTED ||
+      device_state == NM_DEVICE_STATE_DEACTIVATING)
+    return WIFI_LINK_DISCONNECTED;
+  return WIFI_LINK_UNAVAILABLE;
+}
+
+guint32 wifi_nm_get_bitrate(void) {
+  return device_state == NM_DEVICE_STATE_ACTIVATED ? bitrate : 0;
+}
+
+const gchar *wifi_nm_get_failure(void) {
+  if (device_state != NM_DEVICE_STATE_FAILED)
+    return NULL;
+
+  switch (state_reason) {
+  case NM_DEVICE_STATE_REASON_NO_SECRETS:
+    return "The password is wrong or missing";
+  case NM_DEVICE_STATE_REASON_SUPPLICANT_DISCONNECT:
+  case NM_DEVICE_STATE_REASON_SUPPLICANT_CONFIG_FAILED:
+  case NM_DEVICE_STATE_REASON_SUPPLICANT_FAILED:
+    return "Authentication failed";
+  case NM_DEVICE_STATE_REASON_SUPPLICANT_TIMEOUT:
+    return "The network did not answer";
+  case NM_DEVICE_STATE_REASON_DHCP_START_FAILED:
+  case NM_DEVICE_STATE_REASON_DHCP_ERROR:
+  case NM_DEVICE_STATE_REASON_DHCP_FAILED:
+    return "No IP address was assigned";
+  case NM_DEVICE_STATE_REASON_SSID_NOT_FOUND:
+    return "The network is out of range";
+  default:
+    return "The connection failed";
+  }
+}
+
+gboolean wifi_nm_failure_needs_secrets(void) {
+  return device_state == NM_DEVICE_STATE_FAILED &&
+         state_reason == NM_DEVICE_STATE_REASON_NO_SECRETS;
+}
+
+static gboolean personal(WifiSecurity security) {
+  return security == WIFI_SECURITY_PSK || security == WIFI_SECURITY_SAE;
+}
+
+const WifiProfile *wifi_nm_lookup_profile(const gchar *ssid,
+                                          WifiSecurity security) {
+  GHashTableIter iter;
+  gpointer value;
+  WifiProfile *best = NULL;
+
+  if (profiles == NULL || ssid == NULL)
+    return NULL;
+
+  g_hash_table_iter_init(&iter, profiles);
+  while (g_hash_table_iter_next(&iter, NULL, &value)) {
+    WifiProfile *profile = value;
+
+    if (g_strcmp0(profile->ssid, ssid) != 0 ||
+        (profile->security != security &&
+         !(personal(profile->security) && personal(security))))
+      continue;
+    if (best == NULL || profile->timestamp > best->timestamp)
+      best = profile;
+  }
+  return best;
+}
+
+gboolean wifi_nm_get_radio(void) { return radio; }
+
+static void on_radio_set(GObject *source, GAsyncResult *res,
+                         gpointer user_data) {
+  g_autoptr(GVariant) reply = call_finish(res, "switch the Wi-Fi radio", NULL);
+
+  command_stats_add("nm WirelessEnabled", g_get_monotonic_time() - radio_start,
+                    0, FALSE);
+  // The change itself arrives as PropertiesChanged
+  if (reply == NULL)
+    emit(WIFI_CHANGE_RADIO, NULL);
+}
+
+void wifi_nm_set_radio(gboolean enabled) {
+  if (state != WIFI_NM_READY) {
+    emit(WIFI_CHANGE_RADIO, NULL);
+    return;
+  }
+
+  radio_start = g_get_monotonic_time();
+  g_dbus_connection_call(
+      bus, NM_SERVICE, NM_PATH, DBUS_PROPERTIES, "Set",
+      g_variant_new("(ssv)", NM_SERVICE, "WirelessEnabled",
+                    g_variant_new_boolean(enabled)),
+      NULL, G_DBUS_CALL_FLAGS_ALLOW_INTERACTIVE_AUTHORIZATION, -1,
+      nm_cancellable, on_radio_set, NULL);
+}
+
+static void on_scan_requested(GObject *source, GAsyncResult *res,
+                              gpointer user_data) {
+  g_autoptr(GVariant) reply = g_dbus_connection_call_finish(
+      G_DBUS_CONNECTION(source), res, NULL);
+
+  command_stats_add("nm RequestScan", g_get_monotonic_time() - scan_start, 0,
+                    FALSE);
+}
+
+void wifi_nm_request_scan(void) {
+  if (device == NULL)
+    return;
+
+  scan_start = g_get_monotonic_time();
+  call(device, NM_WIRELESS, "RequestScan", g_variant_new("(a{sv})", NULL),
+       NULL, on_scan_requested, NULL);
+}
+
+// Only what the access point does not say itself: NetworkManager fills in
+// the SSID, mode and the rest from it
+static GVariant *connection_settings(const WifiAccessPoint *ap,
+                                     const gchar *password) {
+  GVariantBuilder settings;
+  GVariantBuilder security;
+
+  g_variant_builder_init(&settings, G_VARIANT_TYPE("a{sa{sv}}"));
+  g_variant_builder_init(&security, G_VARIANT_TYPE_VARDICT);
+
+  switch (ap->security) {
+  case WIFI_SECURITY_PSK:
+  case WIFI_SECURITY_SAE:
+    g_variant_builder_add(
+        &security, "{sv}", "key-mgmt",
+        g_variant_new_string(ap->security == WIFI_SECURITY_SAE ? "sae"
+                                                               : "wpa-psk"));
+    if (password != NULL)
+      g_variant_builder_add(&security, "{sv}", "psk",
+                            g_variant_new_string(password));
+    break;
+  case WIFI_SECURITY_WEP:
+    g_variant_builder_add(&security, "{sv}", "key-mgmt",
+                          g_variant_new_string("none"));
+    if (password != NULL)
+      g_variant_builder_add(&security, "{sv}", "wep-key0",
+                            g_variant_new_string(password));
+    break;
+  default:
+    break;
+  }
+
+  if (ap->security != WIFI_SECURITY_NONE)
+    g_variant_builder_add(&settings, "{s@a{sv}}", "802-11-wireless-security",
+                          g_variant_builder_end(&security));
+  else
+    g_variant_builder_clear(&security);
+  return g_variant_builder_end(&settings);
+}
+
+static void on_activated(GObject *source, GAsyncResult *res,
+                         gpointer user_data) {
+  GTask *task = G_TASK(user_data);
+  gint64 *start = g_task_get_task_data(task);
+  GError *error = NULL;
+  g_autoptr(GVariant) reply =
+      g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res, &error);
+  gchar *active_connection;
+
+  command_stats_add("nm AddAndActivateConnection",
+                    g_get_monotonic_time() - *start, 0, FALSE);
+  if (reply == NULL) {
+    g_dbus_error_strip_remote_error(error);
+    g_task_return_error(task, error);
+    g_object_unref(task);
+    return;
+  }
+
+  clear_activation();
+  g_variant_get(reply, "(oo)", &activating_profile, &active_connection);
+  activating_connection = g_strdup(active_connection);
+  activating_new = TRUE;
+  g_task_return_pointer(task, active_connection, g_free);
+  g_object_unref(task);
+}
+
+void wifi_nm_activate_async(const gchar *ap_path, const gchar *password,
+                            GCancellable *cancellable,
+                            GAsyncReadyCallback callback, gpointer user_data) {
+  GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+  const WifiAccessPoint *ap = wifi_nm_lookup(ap_path);
+  gint64 *start = g_new(gint64, 1);
+
+  *start = g_get_monotonic_time();
+  g_task_set_source_tag(task, wifi_nm_activate_async);
+  g_task_set_task_data(task, start, g_free);
+
+  if (ap == NULL || device == NULL) {
+    g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                            "The network is out of range");
+    g_object_unref(task);
+    return;
+  }
+  if (ap->security == WIFI_SECURITY_ENTERPRISE) {
+    g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                            "%s needs enterprise (802.1X) settings",
+                            ap->ssid);
+    g_object_unref(task);
+    return;
+  }
+
+  // The password travels inside the settings, never on a command line
+  g_dbus_connection_call(
+      bus, NM_SERVICE, NM_PATH, NM_SERVICE, "AddAndActivateConnection",
+      g_variant_new("(@a{sa{sv}}oo)", connection_settings(ap, password),
+                    device, ap->path),
+      G_VARIANT_TYPE("(oo)"), G_DBUS_CALL_FLAGS_ALLOW_INTERACTIVE_AUTHORIZATION,
+      -1, cancellable, on_activated, task);
+}
+
+gchar *wifi_nm_activate_finish(GAsyncResult *result, GError **error) {
+  g_return_val_if_fail(g_task_is_valid(result, NULL), NULL);
+  return g_task_propagate_pointer(G_TASK(result), error);
+}
+
+static void on_deactivated(GObject *source, GAsyncResult *res,
+                           gpointer user_data) {
+  g_autoptr(GVariant) reply = call_finish(res, "deactivate the connection",
+                                          NULL);
+}
+
+void wifi_nm_deactivate(const gchar *active_connection) {
+  if (nm_cancellable == NULL)
+    return;
+  call(NM_PATH, NM_SERVICE, "DeactivateConnection",
+       g_variant_new("(o)", active_connection), NULL, on_deactivated, NULL);
+  // A given up attempt may never reach the device states that end it
+  if (g_strcmp0(active_connection, activating_connection) == 0)
+    drop_unused_profile();
+}
+
+// What a profile activation carries between its calls
+typedef struct {
+  gint64 start;
+  gchar *path;
+  gchar *ap_path;
+  gchar *password; // new secret to save first, or NULL
+  WifiSecurity security;
+} ProfileActivation;
+
+static void profile_activation_free(ProfileActivation *activation) {
+  g_free(activation->path);
+  g_free(activation->ap_path);
+  g_free(activation->password);
+  g_free(activation);
+}
+
+static void on_profile_activated(GObject *source, GAsyncResult *res,
+                                 gpointer user_data) {
+  GTask *task = G_TASK(user_data);
+  ProfileActivation *activation = g_task_get_task_data(task);
+  GError *error = NULL;
+  g_autoptr(GVariant) reply =
+      g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res, &error);
+  gchar *active_connection;
+
+  command_stats_add("nm ActivateConnection",
+                    g_get_monotonic_time() - activation->start, 0, FALSE);
+  if (reply == NULL) {
+    clear_activation();
+    g_dbus_error_strip_remote_error(error);
+    g_task_return_error(task, error);
+    g_object_unref(task);
+    return;
+  }
+
+  g_variant_get(reply, "(o)", &active_connection);
+  g_free(activating_connection);
+  activating_connection = g_strdup(active_connection);
+  g_task_return_pointer(task, active_connection, g_free);
+  g_object_unref(task);
+}
+
+// No settings and no secrets travel: NetworkManager has them already
+static void activate_profile(GTask *task) {
+  ProfileActivation *activation = g_task_get_task_data(task);
+
+  clear_activation();
+  activating_profile = g_strdup(activation->path);
+  g_dbus_connection_call(
+      bus, NM_SERVICE, NM_PATH, NM_SERVICE, "ActivateConnection",
+      g_variant_new("(ooo)", activation->path, device,
+                    activation->ap_path != NULL ? activation->ap_path : "/"),
+      G_VARIANT_TYPE("(o)"), G_DBUS_CALL_FLAGS_ALLOW_INTERACTIVE_AUTHORIZATION,
+      -1, g_task_get_cancellable(task), on_profile_activated, task);
+}
+
+static void on_secrets_saved(GObject *source, GAsyncResult *res,
+                             gpointer user_data) {
+  GTask *task = G_TASK(user_data);
+  GError *error = NULL;
+  g_autoptr(GVariant) reply =
+      g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res, &error);
+
+  if (reply == NULL) {
+    g_dbus_error_strip_remote_error(error);
+    g_task_return_error(task, error);
+    g_object_unref(task);
+    return;
+  }
+  activate_profile(task);
+}
+
+// settings is the profile's a{sa{sv}} without secrets, as GetSettings has
+// it. The new secret is stored with the profile rather than left to an
+// agent, since nothing here answers NetworkManager's secret requests.
+static GVariant *settings_with_secret(GVariant *settings,
+                                      WifiSecurity security,
+                                      const gchar *password) {
+  const gchar *key = security == WIFI_SECURITY_WEP ? "wep-key0" : "psk";
+  const gchar *flags = security == WIFI_SECURITY_WEP ? "wep-key-flags"
+                                                     : "psk-flags";
+  GVariantBuilder builder;
+  GVariantIter iter;
+  const gchar *name;
+  GVariant *section;
+
+  g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sa{sv}}"));
+  g_variant_iter_init(&iter, settings);
+  while (g_variant_iter_next(&iter, "{&s@a{sv}}", &name, &section)) {
+    if (g_strcmp0(name, "802-11-wireless-security") == 0) {
+      GVariantBuilder security_builder;
+      GVariantIter entries;
+      const gchar *entry;
+      GVariant *value;
+
+      g_variant_builder_init(&security_builder, G_VARIANT_TYPE_VARDICT);
+      g_variant_iter_init(&entries, section);
+      while (g_variant_iter_next(&entries, "{&sv}", &entry, &value)) {
+        if (g_strcmp0(entry, key) != 0 && g_strcmp0(entry, flags) != 0)
+          g_variant_builder_add(&security_builder, "{sv}", entry, value);
+        g_variant_unref(value);
+      }
+      g_variant_builder_add(&security_builder, "{sv}", key,
+                            g_variant_new_string(password));
+      g_variant_builder_add(&security_builder, "{sv}", flags,
+                            g_variant_new_uint32(0));
+      g_variant_builder_add(&builder, "{s@a{sv}}", name,
+                            g_variant_builder_end(&security_builder));
+    } else {
+      g_variant_builder_add(&builder, "{s@a{sv}}", name, section);
+    }
+    g_variant_unref(section);
+  }
+  return g_variant_builder_end(&builder);
+}
+
+static void on_settings_for_secrets(GObject *source, GAsyncResult *res,
+                                    gpointer user_data) {
+  GTask *task = G_TASK(user_data);
+  ProfileActivation *activation = g_task_get_task_data(task);
+  GError *error = NULL;
+  g_autoptr(GVariant) reply =
+      g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res, &error);
+  g_autoptr(GVariant) settings = NULL;
+
+  if (reply == NULL) {
+    g_dbus_error_strip_remote_error(error);
+    g_task_return_error(task, error);
+    g_object_unref(task);
+    return;
+  }
+
+  settings = g_variant_get_child_value(reply, 0);
+  g_dbus_connection_call(
+      bus, NM_SERVICE, activation->path, NM_CONNECTION, "Update",
+      g_variant_new("(@a{sa{sv}})",
+                    settings_with_secret(settings, activation->security,
+                                         activation->password)),
+      NULL, G_DBUS_CALL_FLAGS_ALLOW_INTERACTIVE_AUTHORIZATION, -1,
+      g_task_get_cancellable(task), on_secrets_saved, task);
+}
+
+void wifi_nm_activate_profile_async(const gchar *uuid, const gchar *ap_path,
+                                    const gchar *password,
+                                    GCancellable *cancellable,
+                                    GAsyncReadyCallback callback,
+                                    gpointer user_data) {
+  GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+  ProfileActivation *activation = g_new0(ProfileActivation, 1);
+  WifiProfile *profile = NULL;
+  GHashTableIter iter;
+  gpointer value;
+
+  activation->start = g_get_monotonic_time();
+  g_task_set_source_tag(task, wifi_nm_activate_profile_async);
+  g_task_set_task_data(task, activation,
+                       (GDestroyNotify)profile_activation_free);
+
+  if (profiles != NULL) {
+    g_hash_table_iter_init(&iter, profiles);
+    while (profile == NULL && g_hash_table_iter_next(&iter, NULL, &value)) {
+      if (g_strcmp0(((WifiProfile *)value)->uuid, uuid) == 0)
+        profile = value;
+    }
+  }
+  if (profile == NULL || device == NULL) {
+    g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                            "The saved connection is gone");
+    g_object_unref(task);
+    return;
+  }
+
+  activation->path = g_strdup(profile->path);
+  activation->ap_path = g_strdup(ap_path);
+  activation->security = profile->security;
+  if (password == NULL) {
+    activate_profile(task);
+    return;
+  }
+
+  // The profile is read back whole, as Update replaces every setting
+  activation->password = g_strdup(password);
+  g_dbus_connection_call(bus, NM_SERVICE, profile->path, NM_CONNECTION,
+                         "GetSettings", NULL, G_VARIANT_TYPE("(a{sa{sv}})"),
+                         G_DBUS_CALL_FLAGS_NONE, -1, cancellable,
+                         on_settings_for_secrets, task);
+}
@@ -0,0 +1,161 @@
+#include "wifi/sparkline.h"
+#include "wifi/history.h"
+
+#define SPARKLINE_WIDTH 48
+#define SPARKLINE_HEIGHT 16
+#define BAR_WIDTH 2
+#define BAR_GAP 1
+
+struct _WifiSparkline {
+  GtkWidget parent_instance;
+  gchar *bssid; // upper case, as the history keys it
+  guint listener;
+};
+
+G_DEFINE_TYPE(WifiSparkline, wifi_sparkline, GTK_TYPE_WIDGET)
+
+static void on_sample(const gchar *bssid, gpointer user_data) {
+  WifiSparkline *self = WIFI_SPARKLINE(user_data);
+
+  if (g_strcmp0(self->bssid, bssid) == 0)
+    gtk_widget_queue_draw(GTK_WIDGET(self));
+}
+
+// Only sparklines on screen follow the samples; mapping draws anew anyway
+static void wifi_sparkline_map(GtkWidget *widget) {
+  WifiSparkline *self = WIFI_SPARKLINE(widget);
+
+  GTK_WIDGET_CLASS(wifi_sparkline_parent_class)->map(widget);
+  self->listener = wifi_history_listen(on_sample, self);
+}
+
+static void wifi_sparkline_unmap(GtkWidget *widget) {
+  WifiSparkline *self = WIFI_SPARKLINE(widget);
+
+  wifi_history_unlisten(self->listener);
+  self->listener = 0;
+  GTK_WIDGET_CLASS(wifi_sparkline_parent_class)->unmap(widget);
+}
+
+static void wifi_sparkline_measure(GtkWidget *widget,
+                                   GtkOrientation orientation, int for_size,
+                                   int *minimum, int *natural,
+                                   int *minimum_baseline,
+                                   int *natural_baseline) {
+  *minimum = *natural = orientation == GTK_ORIENTATION_HORIZONTAL
+                            ? SPARKLINE_WIDTH
+                            : SPARKLINE_HEIGHT;
+}
+
+static void wifi_sparkline_snapshot(GtkWidget *widget,
+                                    GtkSnapshot *snapshot) {
+  WifiSparkline *self = WIFI_SPARKLINE(widget);
+  const WifiHistory *history = wifi_history_lookup(self->bssid);
+  guint length = wifi_history_length(history);
+  gint width = gtk_widget_get_width(widget);
+  gint height = gtk_widget_get_height(widget);
+  guint shown =
+      MIN(length, (guint)MAX(width + BAR_GAP, 0) / (BAR_WIDTH + BAR_GAP));
+  GdkRGBA bar_color, tick_color;
+
+  if (shown == 0)
+    return;
+
+  gtk_widget_get_color(widget, &bar_color);
+  tick_color = bar_color;
+  bar_color.alpha *= 0.6f;
+  tick_color.alpha *= 0.25f;
+
+  for (guint i = 0; i < shown; i++) {
+    guint index = length - shown + i;
+    const WifiSample *sample = wifi_history_nth(history, index);
+    const WifiSample *before =
+        index > 0 ? wifi_history_nth(history, index - 1) : NULL;
+    float x = width - (float)(shown - i) * (BAR_WIDTH + BAR_GAP) + BAR_GAP;
+    float bar = MAX(1.0f, height * sample->strength / 100.0f);
+
+    // Another channel or band, as when roaming between radios
+    if (before != NULL && before->frequency != 0 && sample->frequency != 0 &&
+        before->frequency != sample->frequency)
+      gtk_snapshot_append_color(
+          snapshot, &tick_color,
+          &GRAPHENE_RECT_INIT(x - BAR_GAP, 0, BAR_GAP, height));
+    gtk_snapshot_append_color(
+        snapshot, &bar_color,
+        &GRAPHENE_RECT_INIT(x, height - bar, BAR_WIDTH, bar));
+  }
+}
+
+// Worked out on hover only
+static gboolean on_query_tooltip(GtkWidget *widget, gint x, gint y,
+                                 gboolean keyboard_mode, GtkTooltip *tooltip,
+                                 gpointer user_data) {
+  WifiSparkline *self = WIFI_SPARKLINE(widget);
+  const WifiHistory *history = wifi_history_lookup(self->bssid);
+  guint length = wifi_history_length(history);
+  const WifiSample *last;
+  guint low = 100, high = 0, minutes;
+  g_autoptr(GString) text = NULL;
+
+  if (length == 0)
+    return FALSE;
+
+  for (guint i = 0; i < length; i++) {
+    const WifiSample *sample = wifi_history_nth(history, i);
+
+    low = MIN(low, sample->strength);
+    high = MAX(high, sample->strength);
+  }
+  last = wifi_history_nth(history, length - 1);
+  minutes = (g_get_monotonic_time() / G_USEC_PER_SEC -
+             wifi_history_nth(history, 0)->time) /
+            60;
+
+  text = g_string_new(NULL);
+  g_string_append_printf(text, "Signal %u%%, %u–%u%% in the last %u min",
+                         last->strength, low, high, MAX(minutes, 1));
+  if (last->bitrate > 0)
+    g_string_append_printf(text, "\n%u Mbit/s", last->bitrate);
+  if (last->frequency > 0)
+    g_string_append_printf(text, "%s%u MHz",
+                           last->bitrate > 0 ? " at " : "\n",
+                           last->frequency);
+  gtk_tooltip_set_text(tooltip, text->str);
+  return TRUE;
+}
+
+static void wifi_sparkline_finalize(GObject *object) {
+  g_free(WIFI_SPARKLINE(object)->bssid);
+  G_OBJECT_CLASS(wifi_sparkline_parent_class)->finalize(object);
+}
+
+static void wifi_sparkline_class_init(WifiSparklineClass *klass) {
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+  GtkWidgetClass *widget_class = GTK_WIDGET_CLASS(klass);
+
+  object_class->finalize = wifi_sparkline_finalize;
+  widget_class->map = wifi_sparkline_map;
+  widget_class->unmap = wifi_sparkline_unmap;
+  widget_class->measure = wifi_sparkline_measure;
+  widget_class->snapshot = wifi_sparkline_snapshot;
+  gtk_widget_class_set_accessible_role(widget_class, GTK_ACCESSIBLE_ROLE_IMG);
+}
+
+static void wifi_sparkline_init(WifiSparkline *self) {
+  gtk_widget_set_has_tooltip(GTK_WIDGET(self), TRUE);
+  g_signal_connect(self, "query-tooltip", G_CALLBACK(on_query_tooltip), NULL);
+}
+
+GtkWidget *wifi_sparkline_new(void) {
+  return g_object_new(WIFI_TYPE_SPARKLINE, NULL);
+}
+
+void wifi_sparkline_set_bssid(WifiSparkline *self, const gchar *bssid) {
+  g_autofree gchar *key = bssid != NULL ? g_ascii_strup(bssid, -1) : NULL;
+
+  if (g_strcmp0(self->bssid, key) == 0)
+    return;
+  g_free(self->bssid);
+  self->bssid = g_steal_pointer(&key);
+  gtk_widget_queue_draw(GTK_WIDGET(self));
+}
@@ -10,6 +10,8 @@
 #include "option/user_permissions.h"
 #include "option/keyboard_shortcuts.h"
 #include "option/config.h"
+#include "option/debug.h"
+#include "command/stats.h"
 
 static void quit_cb(GtkWindow *window) { gtk_window_close(window); }
 
@@ -27,6 +29,10 @@ static void on_setting_selected(GtkListBox *listbox, GtkListBoxRow *row,
   // Get the name of the child widget
   const char *name = gtk_widget_get_name(child);
 
+  // Time the synchronous part of opening the page
+  g_autofree gchar *stats_key = g_strdup_printf("open %s", name);
+  g_auto(CommandStatsSpan) span = command_stats_begin(stats_key);
+
   if (g_strcmp0(name, "audio_controls") == 0) {
     change_panel_to_audio(user_data);
   } else if (g_strcmp0(name, "display_settings") == 0) {
@@ -50,6 +56,12 @@ static void on_setting_selected(GtkListBox *listbox, GtkListBoxRow *row,
   }
 }
 
+static gboolean on_debug_shortcut(GtkWidget *widget, GVariant *args,
+                                  gpointer user_data) {
+  change_panel_to_debug(user_data);
+  return TRUE;
+}
+
 GtkWidget *create_main_window(GtkApplication *app) {
   /* Load UI from file */
   GtkBuilder *builder = gtk_builder_new();
@@ -74,6 +86,17 @@ GtkWidget *create_main_window(GtkApplication *app) {
   }
 
   gtk_window_set_application(GTK_WINDOW(window), app);
+
+  // The debug page has no sidebar entry
+  GtkEventController *shortcuts = gtk_shortcut_controller_new();
+  gtk_shortcut_controller_set_scope(GTK_SHORTCUT_CONTROLLER(shortcuts),
+                                    GTK_SHORTCUT_SCOPE_GLOBAL);
+  gtk_shortcut_controller_add_shortcut(
+      GTK_SHORTCUT_CONTROLLER(shortcuts),
+      gtk_shortcut_new(
+          gtk_keyval_trigger_new(GDK_KEY_d, GDK_CONTROL_MASK | GDK_SHIFT_MASK),
+          gtk_callback_action_new(on_debug_shortcut, right_panel, NULL)));
+  gtk_widget_add_controller(GTK_WIDGET(window), shortcuts);
   change_panel_to_display(right_panel);
 
   g_object_unref(builder);
@@ -0,0 +1,177 @@
+#include "window/refresh.h"
+#include "command/stats.h"
+
+typedef struct {
+  guint id;
+  GtkWidget *page;
+  const RefreshJob *job;
+  gpointer user_data;
+  guint interval;            // current wait, between interval and the limit
+  gint64 last_done;          // monotonic, 0 before the first run finished
+  gint64 run_start;
+  GCancellable *cancellable; // run in flight
+  guint timer_id;
+  gboolean in_sight;
+  gulong map_id;
+  gulong unmap_id;
+} Registration;
+
+static GPtrArray *registrations = NULL;
+static guint next_id = 1;
+
+static gboolean in_sight(Registration *registration) {
+  GtkRoot *root = gtk_widget_get_root(registration->page);
+
+  return gtk_widget_get_mapped(registration->page) && GTK_IS_WINDOW(root) &&
+         gtk_window_is_active(GTK_WINDOW(root));
+}
+
+static void run(Registration *registration) {
+  registration->cancellable = g_cancellable_new();
+  registration->run_start = g_get_monotonic_time();
+  registration->job->run(registration->cancellable, registration->user_data);
+}
+
+static gboolean on_due(gpointer user_data) {
+  Registration *registration = user_data;
+
+  registration->timer_id = 0;
+  run(registration);
+  return G_SOURCE_REMOVE;
+}
+
+// Whole seconds let GLib fold these wake-ups into its once-a-second ones
+static void schedule(Registration *registration) {
+  gint64 now = g_get_monotonic_time();
+  gint64 due = registration->last_done +
+               (gint64)registration->interval * G_USEC_PER_SEC;
+
+  if (registration->last_done == 0 || due <= now) {
+    run(registration);
+    return;
+  }
+  registration->timer_id = g_timeout_add_seconds(
+      (guint)((due - now + G_USEC_PER_SEC - 1) / G_USEC_PER_SEC), on_due,
+      registration);
+}
+
+static void stop(Registration *registration) {
+  g_clear_handle_id(&registration->timer_id, g_source_remove);
+  if (registration->cancellable != NULL) {
+    g_cancellable_cancel(registration->cancellable);
+    g_clear_object(&registration->cancellable);
+  }
+}
+
+static void update(Registration *registration) {
+  gboolean visible = in_sight(registration);
+
+  if (visible != registration->in_sight) {
+    registration->in_sight = visible;
+    if (registration->job->visible != NULL)
+      registration->job->visible(visible, registration->user_data);
+  }
+
+  if (!visible)
+    stop(registration);
+  else if (registration->cancellable == NULL && registration->timer_id == 0)
+    schedule(registration);
+}
+
+static void on_window_active(GtkWindow *window, GParamSpec *pspec,
+                             gpointer user_data) {
+  for (guint i = 0; registrations != NULL && i < registrations->len; i++) {
+    Registration *registration = registrations->pdata[i];
+
+    if (gtk_widget_get_root(registration->page) == GTK_ROOT(window))
+      update(registration);
+  }
+}
+
+// Pages only know their window once they are in it
+static void watch_window(GtkWidget *page) {
+  GtkRoot *root = gtk_widget_get_root(page);
+
+  if (!GTK_IS_WINDOW(root) ||
+      g_object_get_data(G_OBJECT(root), "refresh-watched"))
+    return;
+  g_object_set_data(G_OBJECT(root), "refresh-watched", GINT_TO_POINTER(TRUE));
+  g_signal_connect(root, "notify::is-active", G_CALLBACK(on_window_active),
+                   NULL);
+}
+
+static void on_page_map(GtkWidget *page, gpointer user_data) {
+  watch_window(page);
+  update(user_data);
+}
+
+static void on_page_unmap(GtkWidget *page, gpointer user_data) {
+  update(user_data);
+}
+
+guint refresh_add(GtkWidget *page, const RefreshJob *job, gpointer user_data) {
+  Registration *registration = g_new0(Registration, 1);
+
+  if (registrations == NULL)
+    registrations = g_ptr_array_new();
+
+  registration->id = next_id++;
+  registration->page = g_object_ref(page);
+  registration->job = job;
+  registration->user_data = user_data;
+  registration->interval = job->interval;
+  registration->map_id = g_signal_connect(page, "map", G_CALLBACK(on_page_map),
+                                          registration);
+  registration->unmap_id = g_signal_connect(
+      page, "unmap", G_CALLBACK(on_page_unmap), registration);
+  g_ptr_array_add(registrations, registration);
+
+  watch_window(page);
+  update(registration);
+  return registration->id;
+}
+
+void refresh_remove(guint id) {
+  for (guint i = 0; registrations != NULL && i < registrations->len; i++) {
+    Registration *registration = registrations->pdata[i];
+
+    if (registration->id != id)
+      continue;
+
+    g_ptr_array_remove_index(registrations, i);
+    stop(registration);
+    if (registration->in_sight && registration->job->visible != NULL)
+      registration->job->visible(FALSE, registration->user_data);
+    g_signal_handler_disconnect(registration->page, registration->map_id);
+    g_signal_handler_disconnect(registration->page, registration->unmap_id);
+    g_object_unref(registration->page);
+    g_free(registration);
+    return;
+  }
+}
+
+void refresh_done(GCancellable *cancellable, gboolean changed) {
+  Registration *registration = NULL;
+
+  for (guint i = 0; registrations != NULL && i < registrations->len; i++) {
+    if (((Registration *)registrations->pdata[i])->cancellable == cancellable)
+      registration = registrations->pdata[i];
+  }
+  if (cancellable == NULL || registration == NULL)
+    return;
+
+  g_clear_object(&registration->cancellable);
+  registration->last_done = g_get_monotonic_time();
+  if (registration->job->name != NULL) {
+    g_autofree gchar *key =
+        g_strdup_printf("refresh %s", registration->job->name);
+    command_stats_add(key, registration->last_done - registration->run_start,
+                      0, FALSE);
+  }
+
+  registration->interval =
+      changed ? registration->job->interval
+              : MIN(registration->interval * 2, registration->job->max_interval);
+  if (registration->in_sight)
+    schedule(registration);
+}